@@ -0,0 +1,26 @@
+#ifndef GLKIT_BENCH_BENCH_TIMER_HPP_
+#define GLKIT_BENCH_BENCH_TIMER_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+namespace bench {
+
+// Fastest of `repeats` runs of `fn` in milliseconds, for the standalone
+// comparison benchmarks; glkit_bench has its own per-case timing.
+inline double BestMs(int repeats, const std::function<void()>& fn) {
+  double best = 1e30;
+  for (int r = 0; r < repeats; ++r) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    best = std::min(best, std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count());
+  }
+  return best;
+}
+
+}  // namespace bench
+
+#endif  // GLKIT_BENCH_BENCH_TIMER_HPP_
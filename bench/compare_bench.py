@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""Compares two glkit_bench --json results benchmark by benchmark.
+
+usage: compare_bench.py <base.json> <new.json> [--threshold PERCENT]
+
+Prints the median and p99 per item of both runs and the change of the
+median. Exits with 1 when a median got slower by more than the threshold,
+5% by default, so the script can gate a build.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return data.get("context", {}), {b["name"]: b for b in data["benchmarks"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("base")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="slowdown of the median in percent that fails")
+    args = parser.parse_args()
+
+    base_context, base = load(args.base)
+    new_context, new = load(args.new)
+    if base_context.get("renderer") != new_context.get("renderer"):
+        print("warning: renderers differ: %s vs %s" %
+              (base_context.get("renderer"), new_context.get("renderer")))
+
+    print("%-28s %12s %12s %9s %12s %12s" %
+          ("benchmark", "base median", "new median", "change", "base p99",
+           "new p99"))
+    regressions = []
+    for name in sorted(set(base) | set(new)):
+        if name not in base or name not in new:
+            print("%-28s only in %s" % (name, "base" if name in base else "new"))
+            continue
+        b, n = base[name], new[name]
+        change = (n["median_ns"] / b["median_ns"] - 1.0) * 100.0
+        mark = ""
+        if change > args.threshold:
+            mark = "  REGRESSION"
+            regressions.append(name)
+        print("%-28s %9.1f ns %9.1f ns %+8.1f%% %9.1f ns %9.1f ns%s" %
+              (name, b["median_ns"], n["median_ns"], change, b["p99_ns"],
+               n["p99_ns"], mark))
+
+    if regressions:
+        print("%d of %d benchmarks slower by more than %.1f%%" %
+              (len(regressions), len(set(base) & set(new)), args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,61 @@
+// Compares CullSpheres of gl_frustum.hpp against testing one BoundingSphere
+// at a time with Frustum::Intersects.
+//
+// usage: glkit_frustum_cull_bench [objects]
+// Culls 100k random spheres by default, about a quarter of them visible.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bench/bench_timer.hpp"
+#include "glkit/gl_frustum.hpp"
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+  std::uniform_real_distribution<float> radius(0.1f, 2.0f);
+  std::vector<glkit::BoundingSphere> spheres(count);
+  glkit::SphereArray soa;
+  for (auto& sphere : spheres) {
+    sphere.center = glkit::Vec3(position(rng), position(rng), position(rng));
+    sphere.radius = radius(rng);
+    soa.push_back(sphere);
+  }
+  const glkit::Mat4 projection =
+      glm::perspective(glkit::PI / 2.0f, 16.0f / 9.0f, 0.1f, 150.0f);
+  const glkit::Mat4 view =
+      glm::lookAt(glkit::Vec3(0.0f), glkit::Vec3(1.0f, 0.2f, 0.0f),
+                  glkit::Vec3(0.0f, 0.0f, 1.0f));
+  const glkit::Frustum frustum =
+      glkit::Frustum::FromMatrix(projection * view);
+  printf("%zu spheres, %s kernels\n", count, glkit::SimdName());
+
+  const int kRepeats = 20;
+  std::vector<uint32_t> scalar, simd;
+  scalar.reserve(count);
+  simd.reserve(count);
+  double scalar_ms = bench::BestMs(kRepeats, [&]() {
+    scalar.clear();
+    for (size_t i = 0; i < count; ++i) {
+      if (frustum.Intersects(spheres[i])) {
+        scalar.push_back(static_cast<uint32_t>(i));
+      }
+    }
+  });
+  double simd_ms = bench::BestMs(kRepeats, [&]() {
+    simd.clear();
+    glkit::CullSpheres(frustum, soa, &simd);
+  });
+  printf("%-12s %8.3f ms %8zu visible\n", "scalar aos", scalar_ms,
+         scalar.size());
+  printf("%-12s %8.3f ms %8zu visible %6.2fx  %s\n", "simd soa", simd_ms,
+         simd.size(), scalar_ms / simd_ms,
+         simd == scalar ? "same result" : "DIFFERENT result");
+  return simd == scalar ? 0 : 1;
+}
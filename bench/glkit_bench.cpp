@@ -0,0 +1,426 @@
+// Regression benchmarks of the loaders, geometry kernels, transforms and
+// draw submission. Every benchmark runs --warmup untimed calls, then
+// --iterations timed ones; the median and 99th percentile per item are
+// printed and, with --json, written for bench/compare_bench.py to diff
+// against another build.
+//
+// usage: glkit_bench [--warmup N] [--iterations N] [--filter TEXT]
+//                    [--models N] [--json FILE]
+// Run from the repository root so objects/ and shaders/ can be found. The
+// GL benchmarks need a headless build (GLKIT_HEADLESS) and run on whatever
+// EGL offers, the llvmpipe software rasterizer included.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glkit/gl_camera.hpp"
+#include "glkit/gl_mesh.hpp"
+#include "glkit/gl_model.hpp"
+#include "glkit/gl_scene_graph.hpp"
+
+#ifdef GLKIT_HEADLESS
+#include "glkit/gl_frame_uniforms.hpp"
+#include "glkit/gl_framebuffer.hpp"
+#include "glkit/gl_headless.hpp"
+#include "glkit/gl_render_queue.hpp"
+#endif
+
+namespace {
+
+using namespace glkit;
+
+struct Benchmark {
+  std::string name;
+  // Items one call of `run` processes; times are reported per item.
+  size_t items = 1;
+  // Bytes one call reads, for a throughput column; 0 for none.
+  size_t bytes = 0;
+  std::function<void()> run;
+};
+
+struct Result {
+  std::string name;
+  size_t items = 1;
+  size_t bytes = 0;
+  // Per item, in nanoseconds.
+  double median_ns = 0.0;
+  double p99_ns = 0.0;
+  double min_ns = 0.0;
+  double mean_ns = 0.0;
+};
+
+// Keeps the compiler from dropping computations whose result is unused.
+volatile float g_sink = 0.0f;
+
+Result Run(const Benchmark& benchmark, int warmup, int iterations) {
+  for (int i = 0; i < warmup; ++i) benchmark.run();
+  std::vector<double> samples(iterations);
+  for (int i = 0; i < iterations; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    benchmark.run();
+    samples[i] = std::chrono::duration<double, std::nano>(
+                     std::chrono::steady_clock::now() - start)
+                     .count() /
+                 benchmark.items;
+  }
+  std::sort(samples.begin(), samples.end());
+  Result result;
+  result.name = benchmark.name;
+  result.items = benchmark.items;
+  result.bytes = benchmark.bytes;
+  const size_t n = samples.size();
+  result.median_ns = n % 2 ? samples[n / 2]
+                           : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+  // Nearest rank.
+  result.p99_ns = samples[static_cast<size_t>(ceil(0.99 * n)) - 1];
+  result.min_ns = samples.front();
+  double sum = 0.0;
+  for (double s : samples) sum += s;
+  result.mean_ns = sum / n;
+  return result;
+}
+
+size_t FileSize(const std::string& path) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (f == nullptr) return 0;
+  fseek(f, 0, SEEK_END);
+  const long size = ftell(f);
+  fclose(f);
+  return size > 0 ? static_cast<size_t>(size) : 0;
+}
+
+// A wavy n x n vertex grid, so normals differ from vertex to vertex.
+void MakeGrid(size_t n, std::vector<Vertex>* vertices,
+              std::vector<GLuint>* indices) {
+  vertices->resize(n * n);
+  for (size_t y = 0; y < n; ++y) {
+    for (size_t x = 0; x < n; ++x) {
+      Vertex& v = (*vertices)[y * n + x];
+      const float fx = static_cast<float>(x), fy = static_cast<float>(y);
+      v.position = Vec3(fx, fy, sinf(fx * 0.1f) * cosf(fy * 0.07f));
+      v.normal = Vec3(0.0f);
+      v.texcoord = Vec2(0.0f);
+    }
+  }
+  indices->clear();
+  for (size_t y = 0; y + 1 < n; ++y) {
+    for (size_t x = 0; x + 1 < n; ++x) {
+      const GLuint a = static_cast<GLuint>(y * n + x), b = a + 1;
+      const GLuint c = static_cast<GLuint>(a + n), d = c + 1;
+      indices->insert(indices->end(), {a, b, c, b, d, c});
+    }
+  }
+}
+
+// Transforms spread over a volume, as in a scene of many objects. Without a
+// shader the models are only good for their matrices.
+void PlaceModels(size_t count, Mesh* mesh, Shader* shader,
+                 std::vector<std::unique_ptr<Model>>* models) {
+  for (size_t i = 0; i < count; ++i) {
+    const float t = static_cast<float>(i);
+    models->emplace_back(new Model());
+    Model* model = models->back().get();
+    if (shader) model->Init(mesh, shader);
+    model->set_position(Vec3(fmodf(t * 1.7f, 40.0f) - 20.0f,
+                             fmodf(t * 0.9f, 20.0f) - 10.0f,
+                             -fmodf(t * 0.37f, 60.0f) - 5.0f));
+    model->set_rotation(Vec3(t * 0.1f, t * 0.2f, t * 0.3f));
+    model->set_scale(Vec3(0.5f + fmodf(t, 3.0f) * 0.25f));
+  }
+}
+
+void AddCpuBenchmarks(std::vector<Benchmark>* benchmarks) {
+  const char* objects[] = {"cube", "sphere", "monkey"};
+  for (const char* object : objects) {
+    const std::string file = std::string("objects/") + object + ".obj";
+    Benchmark benchmark;
+    benchmark.name = std::string("obj_parse/") + object;
+    benchmark.bytes = FileSize(file);
+    if (benchmark.bytes == 0) continue;
+    benchmark.run = [file] {
+      MeshData data;
+      Mesh::LoadObjFile(file, MeshLoadOptions(), &data);
+      g_sink = g_sink + static_cast<float>(data.vertices.size());
+    };
+    benchmarks->push_back(benchmark);
+  }
+
+  {
+    const size_t n = 512;
+    std::shared_ptr<std::vector<Vertex>> vertices(new std::vector<Vertex>());
+    std::shared_ptr<std::vector<GLuint>> indices(new std::vector<GLuint>());
+    MakeGrid(n, vertices.get(), indices.get());
+    Benchmark benchmark;
+    benchmark.name = "normals/grid_512";
+    benchmark.items = indices->size() / 3;
+    benchmark.run = [vertices, indices] {
+      Mesh::ComputeNormals(*indices, 1, vertices.get());
+      g_sink = g_sink + (*vertices)[0].normal.z;
+    };
+    benchmarks->push_back(benchmark);
+  }
+
+  // Composing the matrix after a transform change, and reading the cached
+  // one of an unchanged model.
+  for (bool changed : {true, false}) {
+    const size_t count = 1024;
+    std::shared_ptr<std::vector<std::unique_ptr<Model>>> models(
+        new std::vector<std::unique_ptr<Model>>());
+    PlaceModels(count, nullptr, nullptr, models.get());
+    Benchmark benchmark;
+    benchmark.name = changed ? "model_matrix" : "model_matrix/cached";
+    benchmark.items = count;
+    benchmark.run = [models, changed] {
+      float sum = 0.0f;
+      for (const auto& model : *models) {
+        if (changed) {
+          model->set_rotation(model->rotation() + Vec3(0.0f, 0.0f, 0.01f));
+        }
+        sum += model->GetModelMatrix()[3][0];
+      }
+      g_sink = g_sink + sum;
+    };
+    benchmarks->push_back(benchmark);
+  }
+
+  // A rig of 64 arms of 63 nodes. Moving the root recomputes every world
+  // matrix and is timed per node; a static graph recomputes none and is
+  // timed per Update, whose early return is too cheap to split by node.
+  for (bool moving : {true, false}) {
+    std::shared_ptr<SceneGraph> graph(new SceneGraph());
+    const SceneNode root = graph->Create();
+    for (int arm = 0; arm < 64; ++arm) {
+      SceneNode node = graph->Create(root);
+      for (int i = 0; i < 62; ++i) {
+        graph->set_position(node, Vec3(0.1f * arm, 0.5f, 0.0f));
+        node = graph->Create(node);
+      }
+    }
+    graph->Update();
+    Benchmark benchmark;
+    benchmark.name =
+        moving ? "scene_graph/moving_root" : "scene_graph/static";
+    benchmark.items = moving ? graph->size() : 1;
+    benchmark.run = [graph, root, moving] {
+      if (moving) {
+        const Vec3 rotation = graph->rotation(root);
+        graph->set_rotation(root, rotation + Vec3(0.0f, 0.0f, 0.01f));
+      }
+      graph->Update();
+      g_sink = g_sink + graph->world_matrix(root)[0][0];
+    };
+    benchmarks->push_back(benchmark);
+  }
+
+  {
+    const size_t count = 1024;
+    std::shared_ptr<Camera> camera(new Camera());
+    Benchmark benchmark;
+    benchmark.name = "camera_rotate_around";
+    benchmark.items = count;
+    benchmark.run = [camera, count] {
+      for (size_t i = 0; i < count; ++i) {
+        const float step = (i & 1) ? 0.01f : -0.01f;
+        camera->RotateAround(Vec3(step, 0.02f, 0.0f));
+      }
+      g_sink = g_sink + camera->position().x;
+    };
+    benchmarks->push_back(benchmark);
+  }
+}
+
+#ifdef GLKIT_HEADLESS
+// GL objects the GL benchmarks share, created once the context is current.
+struct GlState {
+  Shader shader;
+  Mesh cube;
+  FrameUniforms frame_uniforms;
+  Framebuffer framebuffer;
+  RenderQueue render_queue;
+  Camera camera;
+  std::vector<std::unique_ptr<Model>> models;
+};
+
+int AddGlBenchmarks(size_t num_models, std::vector<Benchmark>* benchmarks) {
+  std::shared_ptr<GlState> gl(new GlState());
+  MeshLoadOptions options;
+  options.optimize = true;
+  if (gl->shader.InitFromFile("shaders/object.vs", "shaders/object.fs") != 0 ||
+      gl->cube.InitFromObjFile("objects/cube.obj", options) != 0 ||
+      gl->frame_uniforms.Init() != 0 || gl->framebuffer.Init(256, 256) != 0) {
+    return -1;
+  }
+  PlaceModels(num_models, &gl->cube, &gl->shader, &gl->models);
+  gl->camera.set_aspect(1.0f);
+  glEnable(GL_DEPTH_TEST);
+
+  {
+    Benchmark benchmark;
+    benchmark.name = "mesh_init/monkey";
+    benchmark.bytes = FileSize("objects/monkey.obj");
+    benchmark.run = [] {
+      Mesh mesh;
+      mesh.InitFromObjFile("objects/monkey.obj");
+      glFinish();
+    };
+    benchmarks->push_back(benchmark);
+  }
+
+  {
+    const size_t count = 1024;
+    Benchmark benchmark;
+    benchmark.name = "uniform_set";
+    benchmark.items = count;
+    benchmark.run = [gl, count] {
+      Shader& shader = gl->shader;
+      const Uniform<Mat4> model = shader.GetUniform<Mat4>("model");
+      const Uniform<Vec3> color = shader.GetUniform<Vec3>("color");
+      shader.Use();
+      Mat4 matrix(1.0f);
+      for (size_t i = 0; i < count; ++i) {
+        matrix[3][0] = static_cast<float>(i);
+        shader.Set(model, matrix);
+        shader.Set(color, Vec3(static_cast<float>(i & 255) / 255.0f));
+      }
+      glFinish();
+    };
+    benchmarks->push_back(benchmark);
+  }
+
+  {
+    Benchmark benchmark;
+    benchmark.name = "draw_submit/" + std::to_string(num_models);
+    benchmark.items = num_models;
+    benchmark.run = [gl] {
+      FrameData data = FrameData();
+      data.view = gl->camera.view_mat();
+      data.projection = gl->camera.projection_mat();
+      data.view_projection = data.projection * data.view;
+      data.camera_position = Vec4(gl->camera.position(), 1.0f);
+      data.near = gl->camera.near();
+      data.far = gl->camera.far();
+      data.num_lights = 1;
+      data.lights[0].position = Vec4(0.0f, 10.0f, 10.0f, 1.0f);
+      data.lights[0].color = Vec4(1.0f);
+      gl->frame_uniforms.Update(data);
+      gl->framebuffer.Bind();
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      for (const auto& model : gl->models) {
+        model->Submit(&gl->render_queue, data.view, data.projection);
+      }
+      gl->render_queue.Flush();
+      glFinish();
+    };
+    benchmarks->push_back(benchmark);
+  }
+  return 0;
+}
+#endif  // GLKIT_HEADLESS
+
+int WriteJson(const std::string& path, const std::vector<Result>& results,
+              int warmup, int iterations, const std::string& renderer) {
+  FILE* f = fopen(path.c_str(), "w");
+  if (f == nullptr) {
+    fprintf(stderr, "Failed to create %s\n", path.c_str());
+    return -1;
+  }
+  fprintf(f,
+          "{\n  \"context\": {\"warmup\": %d, \"iterations\": %d, "
+          "\"renderer\": \"%s\"},\n  \"benchmarks\": [",
+          warmup, iterations, renderer.c_str());
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    fprintf(f,
+            "%s\n    {\"name\": \"%s\", \"items\": %zu, \"bytes\": %zu, "
+            "\"median_ns\": %.3f, \"p99_ns\": %.3f, \"min_ns\": %.3f, "
+            "\"mean_ns\": %.3f}",
+            i ? "," : "", r.name.c_str(), r.items, r.bytes, r.median_ns,
+            r.p99_ns, r.min_ns, r.mean_ns);
+  }
+  fprintf(f, "\n  ]\n}\n");
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int warmup = 3;
+  int iterations = 30;
+  size_t num_models = 1000;
+  std::string filter;
+  std::string json_path;
+  for (int i = 1; i < argc; ++i) {
+    const bool has_value = i + 1 < argc;
+    if (!strcmp(argv[i], "--warmup") && has_value) {
+      warmup = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--iterations") && has_value) {
+      iterations = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--filter") && has_value) {
+      filter = argv[++i];
+    } else if (!strcmp(argv[i], "--models") && has_value) {
+      num_models = static_cast<size_t>(atol(argv[++i]));
+    } else if (!strcmp(argv[i], "--json") && has_value) {
+      json_path = argv[++i];
+    } else {
+      fprintf(stderr,
+              "usage: %s [--warmup N] [--iterations N] [--filter TEXT] "
+              "[--models N] [--json FILE]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (warmup < 0 || iterations <= 0 || num_models == 0) {
+    fprintf(stderr, "Bad --warmup, --iterations or --models\n");
+    return 1;
+  }
+
+#ifdef GLKIT_HEADLESS
+  // Outlives the benchmarks, whose GL objects it deletes.
+  HeadlessContext context;
+#endif
+  std::vector<Benchmark> benchmarks;
+  AddCpuBenchmarks(&benchmarks);
+  std::string renderer = "none";
+#ifdef GLKIT_HEADLESS
+  if (context.Init() == 0 && AddGlBenchmarks(num_models, &benchmarks) == 0) {
+    renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+  } else {
+    fprintf(stderr, "No GL context, skipping the GL benchmarks\n");
+  }
+#endif
+
+  printf("%-28s %12s %12s %12s\n", "benchmark", "median/item", "p99/item",
+         "throughput");
+  std::vector<Result> results;
+  for (const Benchmark& benchmark : benchmarks) {
+    if (!filter.empty() && benchmark.name.find(filter) == std::string::npos) {
+      continue;
+    }
+    results.push_back(Run(benchmark, warmup, iterations));
+    const Result& r = results.back();
+    char throughput[32];
+    if (r.bytes) {
+      snprintf(throughput, sizeof(throughput), "%.1f MB/s",
+               r.bytes / r.median_ns * 1e3);
+    } else {
+      snprintf(throughput, sizeof(throughput), "%.2f M/s",
+               1e3 / r.median_ns);
+    }
+    printf("%-28s %9.1f ns %9.1f ns %12s\n", r.name.c_str(), r.median_ns,
+           r.p99_ns, throughput);
+    fflush(stdout);
+  }
+  if (!json_path.empty() &&
+      WriteJson(json_path, results, warmup, iterations, renderer) != 0) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,121 @@
+// Compares the SoA normal kernels of gl_geometry.hpp against the AoS loop
+// Mesh::ComputeNormals used before: scatter glm::cross results through
+// vertices[indices[i]] and normalize vertex by vertex.
+//
+// usage: glkit_normals_bench [triangles] [threads]
+// Runs on a generated grid of about 4M triangles by default.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "bench/bench_timer.hpp"
+#include "glkit/gl_geometry.hpp"
+#include "glkit/gl_mesh.hpp"
+
+namespace {
+
+void LegacyNormals(const std::vector<GLuint>& indices,
+                   std::vector<glkit::Vertex>* vertices) {
+  glkit::Vertex* v = vertices->data();
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const GLuint i1 = indices[i], i2 = indices[i + 1], i3 = indices[i + 2];
+    const glkit::Vec3& v1 = v[i1].position;
+    glkit::Vec3 normal = glm::cross(v[i2].position - v1, v[i3].position - v1);
+    v[i1].normal += normal;
+    v[i2].normal += normal;
+    v[i3].normal += normal;
+  }
+  for (auto& vertex : *vertices) vertex.normal = glm::normalize(vertex.normal);
+}
+
+// A wavy n x n vertex grid, so normals differ from vertex to vertex.
+void MakeGrid(size_t n, std::vector<glkit::Vertex>* vertices,
+              std::vector<GLuint>* indices) {
+  vertices->resize(n * n);
+  for (size_t y = 0; y < n; ++y) {
+    for (size_t x = 0; x < n; ++x) {
+      glkit::Vertex& v = (*vertices)[y * n + x];
+      float fx = static_cast<float>(x), fy = static_cast<float>(y);
+      v.position = glkit::Vec3(fx, fy, sinf(fx * 0.1f) * cosf(fy * 0.07f));
+      v.normal = glkit::Vec3(0.0f);
+      v.texcoord = glkit::Vec2(0.0f);
+    }
+  }
+  indices->clear();
+  indices->reserve((n - 1) * (n - 1) * 6);
+  for (size_t y = 0; y + 1 < n; ++y) {
+    for (size_t x = 0; x + 1 < n; ++x) {
+      GLuint a = static_cast<GLuint>(y * n + x), b = a + 1;
+      GLuint c = static_cast<GLuint>(a + n), d = c + 1;
+      indices->insert(indices->end(), {a, b, c, b, d, c});
+    }
+  }
+}
+
+float MaxDegrees(const std::vector<glkit::Vertex>& reference,
+                 const glkit::Vec3Array& normals) {
+  float max_deg = 0.0f;
+  for (size_t i = 0; i < reference.size(); ++i) {
+    glkit::Vec3 n(normals.x[i], normals.y[i], normals.z[i]);
+    float c = glm::dot(reference[i].normal, n);
+    c = std::min(std::max(c, -1.0f), 1.0f);
+    max_deg = std::max(max_deg, acosf(c) / glkit::PI * 180.0f);
+  }
+  return max_deg;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t triangles = argc > 1 ? strtoull(argv[1], nullptr, 10) : 4000000;
+  int threads = glkit::ResolveThreadCount(argc > 2 ? atoi(argv[2]) : 0);
+  size_t n = static_cast<size_t>(sqrt(triangles / 2.0)) + 1;
+
+  std::vector<glkit::Vertex> vertices;
+  std::vector<GLuint> indices;
+  MakeGrid(n, &vertices, &indices);
+  glkit::Vec3Array positions;
+  positions.assign(vertices.size(), 0.0f);
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    positions.x[i] = vertices[i].position.x;
+    positions.y[i] = vertices[i].position.y;
+    positions.z[i] = vertices[i].position.z;
+  }
+  const double mtris = indices.size() / 3 / 1e6;
+  printf("%zu triangles, %zu vertices, %s kernels\n", indices.size() / 3,
+         vertices.size(), glkit::SimdName());
+
+  const int kRepeats = 5;
+  std::vector<glkit::Vertex> legacy = vertices;
+  double legacy_ms = bench::BestMs(kRepeats, [&]() {
+    for (auto& v : legacy) v.normal = glkit::Vec3(0.0f);
+    LegacyNormals(indices, &legacy);
+  });
+  printf("%-24s %9.2f ms %8.1f Mtri/s\n", "legacy aos", legacy_ms,
+         mtris / legacy_ms * 1e3);
+
+  struct Case {
+    const char* name;
+    glkit::NormalWeighting weighting;
+    int threads;
+  };
+  const Case cases[] = {
+      {"soa area", glkit::kNormalWeightArea, 1},
+      {"soa angle", glkit::kNormalWeightAngle, 1},
+      {"soa area threaded", glkit::kNormalWeightArea, threads},
+      {"soa angle threaded", glkit::kNormalWeightAngle, threads},
+  };
+  for (const auto& c : cases) {
+    glkit::Vec3Array normals;
+    double ms = bench::BestMs(kRepeats, [&]() {
+      glkit::ComputeVertexNormals(positions, indices, c.weighting, c.threads,
+                                  &normals);
+    });
+    printf("%-24s %9.2f ms %8.1f Mtri/s %6.2fx  max %.3f deg vs legacy\n",
+           c.name, ms, mtris / ms * 1e3, legacy_ms / ms,
+           MaxDegrees(legacy, normals));
+  }
+  return 0;
+}
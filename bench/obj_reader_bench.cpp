@@ -0,0 +1,174 @@
+// Compares the memory mapped ObjReader against the original
+// getline/stringstream loop of Mesh::InitFromObjFile, and reports how chunked
+// parsing scales with the thread count on the synthetic file.
+//
+// usage: glkit_obj_reader_bench [synthetic_size_mb] [iterations]
+// Run from the repository root so objects/*.obj can be found.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "glkit/gl_obj_reader.hpp"
+
+namespace {
+
+// The parsing part of Mesh::InitFromObjFile before ObjReader existed.
+int LegacyParseObj(const std::string& file_path,
+                   std::vector<glkit::Vec3>* positions,
+                   std::vector<unsigned int>* indices) {
+  std::ifstream fin(file_path);
+  if (!fin.is_open()) return -1;
+  while (!fin.eof()) {
+    std::string line;
+    std::getline(fin, line);
+    std::stringstream ss(line);
+    std::string type;
+    ss >> type;
+    if (type == "v") {
+      glkit::Vec3 v;
+      ss >> v.x >> v.y >> v.z;
+      positions->push_back(v);
+    } else if (type == "f") {
+      std::vector<unsigned int> face;
+      std::string index;
+      while (ss >> index) {
+        size_t pos = index.find('/');
+        int idx = std::stoi(index.substr(0, pos));
+        face.push_back(idx - 1);
+      }
+      for (size_t i = 1; i + 1 < face.size(); ++i) {
+        indices->push_back(face[0]);
+        indices->push_back(face[i]);
+        indices->push_back(face[i + 1]);
+      }
+    }
+  }
+  return 0;
+}
+
+size_t FileSize(const std::string& file_path) {
+  std::ifstream fin(file_path, std::ios::binary | std::ios::ate);
+  return fin.is_open() ? static_cast<size_t>(fin.tellg()) : 0;
+}
+
+// Writes a grid mesh of roughly `target_mb` megabytes, using every face
+// index form so all ObjReader paths are exercised.
+int WriteSyntheticObj(const std::string& file_path, size_t target_mb) {
+  FILE* f = fopen(file_path.c_str(), "wb");
+  if (f == nullptr) return -1;
+  // ~150 bytes of text per grid vertex (v + vt + vn + faces).
+  size_t n = 2;
+  while (n * n * 150 < target_mb * 1024 * 1024) n += 16;
+  for (size_t y = 0; y < n; ++y) {
+    for (size_t x = 0; x < n; ++x) {
+      float fx = static_cast<float>(x) / n, fy = static_cast<float>(y) / n;
+      fprintf(f, "v %.6f %.6f %.6f\n", fx, fy, 0.1f * (fx * fx - fy));
+      fprintf(f, "vt %.6f %.6f\n", fx, fy);
+      fprintf(f, "vn 0.000000 0.000000 1.000000\n");
+    }
+  }
+  for (size_t y = 0; y + 1 < n; ++y) {
+    for (size_t x = 0; x + 1 < n; ++x) {
+      size_t a = y * n + x + 1, b = a + 1, c = a + n, d = c + 1;
+      switch ((x + y) % 4) {
+        case 0:
+          fprintf(f, "f %zu %zu %zu %zu\n", a, b, d, c);
+          break;
+        case 1:
+          fprintf(f, "f %zu/%zu %zu/%zu %zu/%zu\nf %zu/%zu %zu/%zu %zu/%zu\n",
+                  a, a, b, b, d, d, a, a, d, d, c, c);
+          break;
+        case 2:
+          fprintf(f, "f %zu//%zu %zu//%zu %zu//%zu %zu//%zu\n", a, a, b, b, d,
+                  d, c, c);
+          break;
+        default:
+          fprintf(f, "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n", a,
+                  a, a, b, b, b, d, d, d, c, c, c);
+          break;
+      }
+    }
+  }
+  fclose(f);
+  return 0;
+}
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void Run(const std::string& file_path, int iterations) {
+  const double mb = FileSize(file_path) / (1024.0 * 1024.0);
+  double legacy_best = 1e30, reader_best = 1e30;
+  size_t legacy_tris = 0, reader_tris = 0;
+  for (int i = 0; i < iterations; ++i) {
+    std::vector<glkit::Vec3> positions;
+    std::vector<unsigned int> indices;
+    auto start = std::chrono::steady_clock::now();
+    LegacyParseObj(file_path, &positions, &indices);
+    legacy_best = std::min(legacy_best, Seconds(start));
+    legacy_tris = indices.size() / 3;
+
+    glkit::ObjData obj;
+    glkit::ObjReader reader;
+    start = std::chrono::steady_clock::now();
+    reader.ReadFile(file_path, &obj);
+    reader_best = std::min(reader_best, Seconds(start));
+    reader_tris = obj.corners.size() / 3;
+  }
+  printf("%-28s %9.2f MB  legacy %8.1f MB/s  reader %8.1f MB/s  x%.1f%s\n",
+         file_path.c_str(), mb, mb / legacy_best, mb / reader_best,
+         legacy_best / reader_best,
+         legacy_tris == reader_tris ? "" : "  (triangle count mismatch)");
+}
+
+// Reader throughput for 1, 2, 4, ... threads up to the hardware count.
+void RunThreaded(const std::string& file_path, int iterations) {
+  const double mb = FileSize(file_path) / (1024.0 * 1024.0);
+  const int max_threads = glkit::ResolveThreadCount(0);
+  double single = 0.0;
+  for (int threads = 1;; threads = std::min(threads * 2, max_threads)) {
+    double best = 1e30;
+    for (int i = 0; i < iterations; ++i) {
+      glkit::ObjData obj;
+      glkit::ObjReader reader;
+      auto start = std::chrono::steady_clock::now();
+      reader.ReadFile(file_path, &obj, threads);
+      best = std::min(best, Seconds(start));
+    }
+    if (threads == 1) single = best;
+    printf("%-28s %2d threads %8.1f MB/s  speedup x%.2f\n", file_path.c_str(),
+           threads, mb / best, single / best);
+    if (threads == max_threads) break;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t synthetic_mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 256;
+  int iterations = argc > 2 ? atoi(argv[2]) : 3;
+
+  Run("objects/cube.obj", iterations * 100);
+  Run("objects/sphere.obj", iterations * 10);
+  Run("objects/monkey.obj", iterations * 10);
+
+  if (synthetic_mb > 0) {
+    const std::string synthetic = "synthetic_bench.obj";
+    if (WriteSyntheticObj(synthetic, synthetic_mb) != 0) {
+      fprintf(stderr, "Failed to write %s\n", synthetic.c_str());
+      return -1;
+    }
+    Run(synthetic, iterations);
+    RunThreaded(synthetic, iterations);
+    remove(synthetic.c_str());
+  }
+  return 0;
+}
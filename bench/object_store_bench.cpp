@@ -0,0 +1,122 @@
+// Compares one frame of CPU work for many moving objects, kept either as
+// individual Models or in an ObjectStore: advance every rotation, compose
+// the model matrices, cull the bounding spheres and pack the visible
+// objects as instances.
+//
+// usage: glkit_object_store_bench [objects]
+// Runs 100k objects on a grid in the XY plane by default.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bench/bench_timer.hpp"
+#include "glkit/gl_frustum.hpp"
+#include "glkit/gl_model.hpp"
+#include "glkit/gl_object_store.hpp"
+
+int main(int argc, char** argv) {
+  using glkit::Vec3;
+  size_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> angle(-glkit::PI, glkit::PI);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::vector<glkit::Model> models(count);
+  glkit::ObjectStore store;
+  const size_t columns = 316;
+  for (size_t i = 0; i < count; ++i) {
+    const Vec3 position(2.0f * (i % columns), 2.0f * (i / columns), 0.5f);
+    const Vec3 rotation(angle(rng), angle(rng), angle(rng));
+    const Vec3 scale(0.5f + unit(rng), 0.5f + unit(rng), 0.5f);
+    const Vec3 color(unit(rng), unit(rng), unit(rng));
+    models[i].set_position(position);
+    models[i].set_rotation(rotation);
+    models[i].set_scale(scale);
+    models[i].set_color(color);
+    const glkit::ObjectHandle object = store.Create();
+    store.set_position(object, position);
+    store.set_rotation(object, rotation);
+    store.set_scale(object, scale);
+    store.set_color(object, color);
+  }
+  glkit::BoundingSphere local;
+  local.center = Vec3(0.0f);
+  local.radius = 1.0f;
+  const glkit::Mat4 projection =
+      glm::perspective(glkit::PI / 3.0f, 16.0f / 9.0f, 0.1f, 500.0f);
+  const glkit::Mat4 view =
+      glm::lookAt(Vec3(316.0f, -40.0f, 60.0f), Vec3(316.0f, 200.0f, 0.0f),
+                  Vec3(0.0f, 0.0f, 1.0f));
+  const glkit::Frustum frustum =
+      glkit::Frustum::FromMatrix(projection * view);
+  printf("%zu objects, %s kernels\n", count, glkit::SimdName());
+
+  const float step = 0.01f;
+  const int kRepeats = 20;
+  glkit::SphereArray model_spheres, store_spheres;
+  std::vector<uint32_t> model_visible, store_visible;
+  std::vector<glkit::InstanceData> model_instances, store_instances;
+  double model_ms = bench::BestMs(kRepeats, [&]() {
+    model_spheres.clear();
+    for (glkit::Model& model : models) {
+      model.set_rotation(model.rotation() + Vec3(0.0f, 0.0f, step));
+      const glkit::Mat4& m = model.GetModelMatrix();
+      glkit::BoundingSphere sphere;
+      sphere.center = Vec3(m * glkit::Vec4(local.center, 1.0f));
+      sphere.radius =
+          local.radius * sqrtf(std::max(
+                             std::max(glm::dot(Vec3(m[0]), Vec3(m[0])),
+                                      glm::dot(Vec3(m[1]), Vec3(m[1]))),
+                             glm::dot(Vec3(m[2]), Vec3(m[2]))));
+      model_spheres.push_back(sphere);
+    }
+    model_visible.clear();
+    glkit::CullSpheres(frustum, model_spheres, &model_visible);
+    model_instances.resize(model_visible.size());
+    for (size_t i = 0; i < model_visible.size(); ++i) {
+      const glkit::Model& model = models[model_visible[i]];
+      model_instances[i].model = model.GetModelMatrix();
+      model_instances[i].color = glkit::Vec4(model.color(), 1.0f);
+    }
+  });
+  double store_ms = bench::BestMs(kRepeats, [&]() {
+    float* rotation_z = store.channel(glkit::ObjectStore::kRotationZ);
+    for (size_t i = 0; i < store.size(); ++i) rotation_z[i] += step;
+    store.MarkTransformsChanged();
+    store.UpdateMatrices();
+    store.ComputeSpheres(local, &store_spheres);
+    store_visible.clear();
+    glkit::CullSpheres(frustum, store_spheres, &store_visible);
+    store_instances.resize(store_visible.size());
+    store.Gather(store_visible.data(), store_visible.size(),
+                 store_instances.data());
+  });
+
+  // Both ran the same number of steps. The polynomial sine and cosine may
+  // move spheres right at a plane to the other side.
+  float max_error = 0.0f;
+  for (size_t i = 0; i < count; ++i) {
+    const glkit::Mat4& a = models[i].GetModelMatrix();
+    const glkit::Mat4 b = store.matrix(store.handle(i));
+    for (int c = 0; c < 4; ++c) {
+      for (int r = 0; r < 4; ++r) {
+        max_error = std::max(max_error, fabsf(a[c][r] - b[c][r]));
+      }
+    }
+  }
+  const size_t differ =
+      std::max(model_visible.size(), store_visible.size()) -
+      std::min(model_visible.size(), store_visible.size());
+  printf("%-12s %8.3f ms %8zu visible\n", "models", model_ms,
+         model_visible.size());
+  printf("%-12s %8.3f ms %8zu visible %6.2fx  max matrix error %.2g\n",
+         "store", store_ms, store_visible.size(), model_ms / store_ms,
+         max_error);
+  return max_error < 1e-4f && differ <= count / 1000 ? 0 : 1;
+}
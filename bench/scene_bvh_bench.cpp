@@ -0,0 +1,151 @@
+// Per frame cost of SceneBvh for a scene where a fraction of the objects
+// moves every frame: update the moved bounds, refit, then one frustum query
+// and a few sphere queries. Compared against scanning all objects.
+//
+// usage: glkit_scene_bvh_bench [objects] [frames] [moving_percent]
+// Defaults to 100k objects over 200 frames with 10% moving.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "glkit/gl_scene_bvh.hpp"
+
+namespace {
+
+const int kSphereQueries = 16;
+
+double Ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+glkit::Aabb Box(const glkit::Vec3& center, float half) {
+  glkit::Aabb box;
+  box.min = center - glkit::Vec3(half);
+  box.max = center + glkit::Vec3(half);
+  return box;
+}
+
+bool SphereOverlaps(const glkit::BoundingSphere& s, const glkit::Aabb& b) {
+  const glkit::Vec3 d = glm::clamp(s.center, b.min, b.max) - s.center;
+  return glm::dot(d, d) <= s.radius * s.radius;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+  int frames = argc > 2 ? atoi(argv[2]) : 200;
+  int moving_percent = argc > 3 ? atoi(argv[3]) : 10;
+  const size_t moving = count * moving_percent / 100;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+  std::uniform_real_distribution<float> velocity(-1.0f, 1.0f);
+  std::uniform_real_distribution<float> size(0.5f, 2.0f);
+  std::vector<glkit::Vec3> centers(count), velocities(count);
+  std::vector<float> halves(count);
+  std::vector<glkit::Aabb> boxes(count);
+  glkit::SceneBvh bvh;
+  for (size_t i = 0; i < count; ++i) {
+    centers[i] = glkit::Vec3(position(rng), position(rng), position(rng));
+    velocities[i] = glkit::Vec3(velocity(rng), velocity(rng), velocity(rng));
+    halves[i] = size(rng);
+    boxes[i] = Box(centers[i], halves[i]);
+    bvh.Insert(boxes[i]);
+  }
+  auto start = std::chrono::steady_clock::now();
+  bvh.Rebuild();
+  printf("%zu objects, %zu moving per frame, %d frames\n", count, moving,
+         frames);
+  printf("full rebuild %.2f ms, %zu nodes, sah %.1f\n", Ms(start),
+         bvh.nodes().size(), bvh.sah_cost());
+
+  const glkit::Mat4 projection =
+      glm::perspective(glkit::PI / 3.0f, 16.0f / 9.0f, 0.1f, 400.0f);
+  double update_ms = 0, refit_ms = 0, frustum_ms = 0, sphere_ms = 0;
+  double scan_frustum_ms = 0, scan_sphere_ms = 0;
+  size_t visible = 0, mismatches = 0;
+  std::vector<uint32_t> result, expected;
+  for (int frame = 0; frame < frames; ++frame) {
+    // A different slice moves every frame.
+    start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < moving; ++k) {
+      const size_t i = (static_cast<size_t>(frame) * moving + k) % count;
+      centers[i] += velocities[i];
+      boxes[i] = Box(centers[i], halves[i]);
+      bvh.Update(static_cast<uint32_t>(i), boxes[i]);
+    }
+    update_ms += Ms(start);
+    start = std::chrono::steady_clock::now();
+    bvh.Refit();
+    refit_ms += Ms(start);
+
+    const float angle = frame * 0.01f;
+    const glkit::Mat4 view = glm::lookAt(
+        glkit::Vec3(0.0f), glkit::Vec3(cosf(angle), sinf(angle), 0.1f),
+        glkit::Vec3(0.0f, 0.0f, 1.0f));
+    const glkit::Frustum frustum =
+        glkit::Frustum::FromMatrix(projection * view);
+    result.clear();
+    start = std::chrono::steady_clock::now();
+    bvh.QueryFrustum(frustum, &result);
+    frustum_ms += Ms(start);
+    visible += result.size();
+    expected.clear();
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+      if (frustum.Intersects(boxes[i])) {
+        expected.push_back(static_cast<uint32_t>(i));
+      }
+    }
+    scan_frustum_ms += Ms(start);
+    std::sort(result.begin(), result.end());
+    if (result != expected) ++mismatches;
+
+    glkit::BoundingSphere spheres[kSphereQueries];
+    for (auto& sphere : spheres) {
+      sphere.center = glkit::Vec3(position(rng), position(rng), position(rng));
+      sphere.radius = 20.0f;
+    }
+    result.clear();
+    start = std::chrono::steady_clock::now();
+    for (const auto& sphere : spheres) bvh.QuerySphere(sphere, &result);
+    sphere_ms += Ms(start);
+    expected.clear();
+    start = std::chrono::steady_clock::now();
+    for (const auto& sphere : spheres) {
+      for (size_t i = 0; i < count; ++i) {
+        if (SphereOverlaps(sphere, boxes[i])) {
+          expected.push_back(static_cast<uint32_t>(i));
+        }
+      }
+    }
+    scan_sphere_ms += Ms(start);
+    if (result.size() != expected.size()) ++mismatches;
+  }
+
+  printf("%-22s %8.3f ms/frame\n", "update", update_ms / frames);
+  printf("%-22s %8.3f ms/frame\n", "refit", refit_ms / frames);
+  printf("%-22s %8.3f ms/frame  %zu visible\n", "bvh frustum query",
+         frustum_ms / frames, visible / frames);
+  printf("%-22s %8.3f ms/frame\n", "scan frustum", scan_frustum_ms / frames);
+  printf("%-22s %8.3f ms/frame  %d queries\n", "bvh sphere queries",
+         sphere_ms / frames, kSphereQueries);
+  printf("%-22s %8.3f ms/frame\n", "scan sphere queries",
+         scan_sphere_ms / frames);
+  printf("bvh frame %.3f ms vs scan %.3f ms, %zu background rebuilds, "
+         "sah %.1f (%.1f at build), %zu mismatching frames\n",
+         (update_ms + refit_ms + frustum_ms + sphere_ms) / frames,
+         (update_ms + scan_frustum_ms + scan_sphere_ms) / frames,
+         bvh.rebuilds() - 1, bvh.sah_cost(), bvh.build_sah_cost(),
+         mismatches);
+  return mismatches == 0 ? 0 : 1;
+}
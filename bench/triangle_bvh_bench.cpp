@@ -0,0 +1,133 @@
+// Build time of TriangleBvh on one and on all threads, and closest hit
+// throughput of its SIMD and scalar leaf tests for rays from around the
+// mesh towards its center.
+//
+// usage: glkit_triangle_bvh_bench [file.obj ...]
+// Defaults to objects/monkey.obj and a generated 2M triangle height field
+// standing in for a large scan.
+
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "glkit/gl_mesh.hpp"
+#include "glkit/gl_triangle_bvh.hpp"
+
+namespace {
+
+double Ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// A noisy n x n height field, like a terrain scan.
+void MakeScan(size_t n, glkit::MeshData* data) {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> noise(-0.05f, 0.05f);
+  data->vertices.resize(n * n);
+  for (size_t y = 0; y < n; ++y) {
+    for (size_t x = 0; x < n; ++x) {
+      const float fx = static_cast<float>(x), fy = static_cast<float>(y);
+      glkit::Vertex& v = data->vertices[y * n + x];
+      v.position = glkit::Vec3(
+          fx, fy, 8.0f * sinf(fx * 0.02f) * cosf(fy * 0.013f) + noise(rng));
+      data->bounds.Extend(v.position);
+    }
+  }
+  data->indices.clear();
+  data->indices.reserve((n - 1) * (n - 1) * 6);
+  for (size_t y = 0; y + 1 < n; ++y) {
+    for (size_t x = 0; x + 1 < n; ++x) {
+      GLuint a = static_cast<GLuint>(y * n + x), b = a + 1;
+      GLuint c = static_cast<GLuint>(a + n), d = c + 1;
+      data->indices.insert(data->indices.end(), {a, b, c, b, d, c});
+    }
+  }
+}
+
+template <typename F>
+double TraceMs(const glkit::TriangleBvh& bvh,
+               const std::vector<glkit::Ray>& rays,
+               std::vector<glkit::TriangleHit>* hits) {
+  hits->resize(rays.size());
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < rays.size(); ++i) {
+    bvh.Intersect<F>(rays[i], FLT_MAX, &(*hits)[i]);
+  }
+  return Ms(start);
+}
+
+void Run(const std::string& name, const glkit::MeshData& data) {
+  const size_t num_triangles = data.indices.size() / 3;
+  const float* positions = &data.vertices[0].position.x;
+  const size_t stride = sizeof(glkit::Vertex) / sizeof(float);
+  const int threads = glkit::ResolveThreadCount(0);
+  glkit::TriangleBvh bvh;
+  auto start = std::chrono::steady_clock::now();
+  bvh.Build(positions, stride, data.indices.data(), num_triangles, 1);
+  const double single_ms = Ms(start);
+  start = std::chrono::steady_clock::now();
+  bvh.Build(positions, stride, data.indices.data(), num_triangles, threads);
+  const double threaded_ms = Ms(start);
+  printf("%s: %zu triangles, %zu nodes, %.1f MB\n", name.c_str(),
+         num_triangles, bvh.nodes().size(), bvh.memory_bytes() / 1e6);
+  printf("  build %9.2f ms 1 thread, %9.2f ms %d threads\n", single_ms,
+         threaded_ms, threads);
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  const glkit::Vec3 center = data.bounds.center();
+  const glkit::Vec3 size = data.bounds.size();
+  const float radius = glm::length(size);
+  std::vector<glkit::Ray> rays(1000000);
+  for (auto& ray : rays) {
+    glkit::Vec3 d(unit(rng), unit(rng), unit(rng));
+    ray.origin = center + glm::normalize(d) * radius;
+    const glkit::Vec3 target =
+        center + glkit::Vec3(unit(rng), unit(rng), unit(rng)) * size * 0.5f;
+    ray.direction = glm::normalize(target - ray.origin);
+  }
+  std::vector<glkit::TriangleHit> simd_hits, scalar_hits;
+  const double simd_ms = TraceMs<glkit::SimdFloat>(bvh, rays, &simd_hits);
+  const double scalar_ms = TraceMs<glkit::FloatX1>(bvh, rays, &scalar_hits);
+  size_t hits = 0, mismatches = 0;
+  for (size_t i = 0; i < rays.size(); ++i) {
+    hits += simd_hits[i].hit();
+    if (simd_hits[i].triangle != scalar_hits[i].triangle) ++mismatches;
+  }
+  printf("  %-6s %9.2f Mrays/s\n", glkit::SimdName(),
+         rays.size() / simd_ms / 1e3);
+  printf("  %-6s %9.2f Mrays/s\n", "scalar", rays.size() / scalar_ms / 1e3);
+  printf("  %.1f%% hit, %zu mismatching hits\n", 100.0 * hits / rays.size(),
+         mismatches);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    for (int i = 1; i < argc; ++i) {
+      glkit::MeshData data;
+      if (glkit::Mesh::LoadObjFile(argv[i], glkit::MeshLoadOptions(),
+                                   &data) != 0) {
+        fprintf(stderr, "Failed to load %s\n", argv[i]);
+        continue;
+      }
+      Run(argv[i], data);
+    }
+    return 0;
+  }
+  glkit::MeshData monkey;
+  if (glkit::Mesh::LoadObjFile("objects/monkey.obj", glkit::MeshLoadOptions(),
+                               &monkey) == 0) {
+    Run("objects/monkey.obj", monkey);
+  }
+  glkit::MeshData scan;
+  MakeScan(1001, &scan);
+  Run("height field", scan);
+  return 0;
+}
@@ -0,0 +1,81 @@
+// Compares the 32-byte float Vertex against the 16-byte PackedVertex:
+// buffer sizes, CPU packing throughput and the quantization error.
+//
+// usage: glkit_vertex_format_bench [file.obj ...]
+
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "glkit/gl_mesh.hpp"
+
+namespace {
+
+glkit::Vec3 UnpackSnorm10x3(uint32_t packed) {
+  glkit::Vec3 n;
+  for (int i = 0; i < 3; ++i) {
+    int32_t q = static_cast<int32_t>((packed >> (10 * i)) & 0x3FFu);
+    if (q & 0x200) q -= 0x400;
+    n[i] = std::max(q / 511.0f, -1.0f);
+  }
+  return n;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; ++i) files.push_back(argv[i]);
+  if (files.empty()) {
+    files.push_back("objects/cube.obj");
+    files.push_back("objects/sphere.obj");
+    files.push_back("objects/monkey.obj");
+  }
+
+  printf("%-24s %10s %10s %8s %12s %12s %10s\n", "file", "float KB",
+         "packed KB", "ratio", "pack Mvert/s", "max pos err", "max n deg");
+  for (const auto& file : files) {
+    glkit::MeshData data;
+    if (glkit::Mesh::LoadObjFile(file, glkit::MeshLoadOptions(), &data) != 0) {
+      fprintf(stderr, "Failed to load %s\n", file.c_str());
+      continue;
+    }
+    const size_t n = data.vertices.size();
+    glkit::Vec3 offset, scale;
+    glkit::Mesh::PositionTransform(data.bounds, &offset, &scale);
+    std::vector<glkit::PackedVertex> packed(n);
+
+    const int kRepeats = 200;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < kRepeats; ++r) {
+      glkit::Mesh::PackVertices(data.vertices.data(), n, offset, scale,
+                                packed.data());
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    float max_pos_err = 0.0f;
+    float max_normal_deg = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+      for (int k = 0; k < 3; ++k) {
+        float p = offset[k] + packed[i].position[k] / 65535.0f * scale[k];
+        max_pos_err =
+            std::max(max_pos_err, fabsf(p - data.vertices[i].position[k]));
+      }
+      glkit::Vec3 normal = glm::normalize(UnpackSnorm10x3(packed[i].normal));
+      float c = glm::dot(normal, data.vertices[i].normal);
+      c = std::min(std::max(c, -1.0f), 1.0f);
+      max_normal_deg = std::max(max_normal_deg, acosf(c) / glkit::PI * 180.f);
+    }
+
+    const double float_kb = n * sizeof(glkit::Vertex) / 1024.0;
+    const double packed_kb = n * sizeof(glkit::PackedVertex) / 1024.0;
+    printf("%-24s %10.1f %10.1f %8.2f %12.1f %12.6f %10.3f\n", file.c_str(),
+           float_kb, packed_kb, float_kb / packed_kb,
+           n * kRepeats / seconds / 1e6, max_pos_err, max_normal_deg);
+  }
+  return 0;
+}
@@ -18,6 +18,15 @@
 #endif  // CGL_VERSION_1_3
 #endif
 
+// Headless builds link libOpenGL, which exports the core entry points, and
+// get no window toolkit to load them.
+#if defined(GLKIT_HEADLESS) && !defined(_WIN32) && !defined(__APPLE__)
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES 1
+#endif
+#include <GL/glcorearb.h>
+#endif
+
 #include "cb/logging.hpp"
 
 #ifndef LOG
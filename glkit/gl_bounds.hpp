@@ -0,0 +1,86 @@
+#ifndef GLKIT_GL_BOUNDS_HPP_
+#define GLKIT_GL_BOUNDS_HPP_
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+
+#include "gl_base.hpp"
+
+namespace glkit {
+
+// Axis aligned bounding box. A default constructed box is empty (min > max)
+// and grows with Extend().
+struct Aabb {
+  Vec3 min = Vec3(FLT_MAX);
+  Vec3 max = Vec3(-FLT_MAX);
+
+  bool empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+  Vec3 center() const { return (min + max) * 0.5f; }
+  Vec3 size() const { return max - min; }
+
+  void Extend(const Vec3& p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+
+  void Extend(const Aabb& other) {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+  }
+};
+
+// Bounding sphere; a negative radius means empty.
+struct BoundingSphere {
+  Vec3 center = Vec3(0.0f);
+  float radius = -1.0f;
+
+  bool empty() const { return radius < 0.0f; }
+};
+
+// Points origin + t * direction. The direction need not be unit length;
+// distances along the ray are in multiples of it.
+struct Ray {
+  Vec3 origin = Vec3(0.0f);
+  Vec3 direction = Vec3(0.0f, 0.0f, -1.0f);
+};
+
+// Component wise 1 / direction for the slab test, with zero components
+// mapped to a huge value of the same sign instead of infinity, which would
+// turn 0 * inf into NaN for rays in a slab plane.
+inline Vec3 SafeInverse(const Vec3& direction) {
+  Vec3 inv;
+  for (int i = 0; i < 3; ++i) {
+    const float d = direction[i];
+    inv[i] = fabsf(d) > 1e-30f ? 1.0f / d : copysignf(1e30f, d);
+  }
+  return inv;
+}
+
+// Slab test of the ray against the box [min, max] over [0, max_t]. Returns
+// the entry distance (0 when the origin is inside) or FLT_MAX on a miss.
+inline float IntersectRayBox(const Vec3& origin, const Vec3& inv_direction,
+                             float max_t, const Vec3& min, const Vec3& max) {
+  const Vec3 t0 = (min - origin) * inv_direction;
+  const Vec3 t1 = (max - origin) * inv_direction;
+  const Vec3 lo = glm::min(t0, t1), hi = glm::max(t0, t1);
+  const float enter = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+  const float exit = std::min(std::min(hi.x, hi.y), std::min(hi.z, max_t));
+  return enter <= exit ? enter : FLT_MAX;
+}
+
+// Node of the flat bounding volume hierarchies, 32 bytes, two to a cache
+// line. A leaf (count > 0) owns the item slots [first, first + count); an
+// inner node has children first and first + 1.
+struct BvhNode {
+  Vec3 min;
+  int32_t first;
+  Vec3 max;
+  int32_t count;
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode must stay 32 bytes");
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_BOUNDS_HPP_
@@ -31,26 +31,26 @@ class Camera {
 
   float fovy() const { return fovy_; }
   void set_fovy(float fovy) {
-    UpdateProjectionMat();
     fovy_ = fovy;
+    UpdateProjectionMat();
   }
 
   float aspect() const { return aspect_; }
   void set_aspect(float aspect) {
-    UpdateProjectionMat();
     aspect_ = aspect;
+    UpdateProjectionMat();
   }
 
   float near() const { return near_; }
   void set_near(float near) {
-    UpdateProjectionMat();
     near_ = near;
+    UpdateProjectionMat();
   }
 
   float far() const { return far_; }
   void set_far(float far) {
-    UpdateProjectionMat();
     far_ = far;
+    UpdateProjectionMat();
   }
 
   Vec3 right() const {
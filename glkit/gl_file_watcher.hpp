@@ -0,0 +1,130 @@
+#ifndef GLKIT_GL_FILE_WATCHER_HPP_
+#define GLKIT_GL_FILE_WATCHER_HPP_
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "gl_base.hpp"
+
+namespace glkit {
+
+// Reports changes to a set of files. On Linux the parent directories are
+// watched with inotify, so a save that replaces the file through a rename,
+// as many editors do, is seen as well; elsewhere Poll compares modification
+// times.
+class FileWatcher {
+ public:
+  FileWatcher() = default;
+  ~FileWatcher() { Clear(); }
+
+  int Add(const std::string& path) {
+    if (files_.count(path)) return 0;
+    const size_t slash = path.find_last_of('/');
+    const std::string dir =
+        slash == std::string::npos ? "." : path.substr(0, slash);
+    const std::string name =
+        slash == std::string::npos ? path : path.substr(slash + 1);
+#ifdef __linux__
+    if (fd_ < 0) {
+      fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (fd_ < 0) {
+        LOG(ERROR) << "inotify_init1 failed: " << errno;
+        return -1;
+      }
+    }
+    const int wd = inotify_add_watch(
+        fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd < 0) {
+      LOG(ERROR) << "Failed to watch " << dir << ": " << errno;
+      return -1;
+    }
+    // Watching a directory twice yields the same descriptor.
+    watches_[wd][name] = path;
+#endif
+    files_[path] = ModificationTime(path);
+    return 0;
+  }
+
+  // Appends the added files changed since the last Poll to `changed`, each
+  // once. Never blocks.
+  void Poll(std::vector<std::string>* changed) {
+    const size_t first = changed->size();
+#ifdef __linux__
+    if (fd_ >= 0) {
+      alignas(inotify_event) char buffer[4096];
+      for (;;) {
+        const ssize_t length = read(fd_, buffer, sizeof(buffer));
+        if (length <= 0) break;
+        for (ssize_t i = 0; i < length;) {
+          const inotify_event* event =
+              reinterpret_cast<const inotify_event*>(buffer + i);
+          i += sizeof(inotify_event) + event->len;
+          auto dir = watches_.find(event->wd);
+          if (dir == watches_.end() || event->len == 0) continue;
+          auto file = dir->second.find(event->name);
+          if (file != dir->second.end()) changed->push_back(file->second);
+        }
+      }
+    }
+#else
+    for (auto& file : files_) {
+      const long mtime = ModificationTime(file.first);
+      if (mtime != file.second) {
+        file.second = mtime;
+        changed->push_back(file.first);
+      }
+    }
+#endif
+    std::sort(changed->begin() + first, changed->end());
+    changed->erase(std::unique(changed->begin() + first, changed->end()),
+                   changed->end());
+  }
+
+  void Clear() {
+#ifdef __linux__
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    watches_.clear();
+#endif
+    files_.clear();
+  }
+
+  size_t size() const { return files_.size(); }
+
+ private:
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  static long ModificationTime(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return 0;
+    return static_cast<long>(st.st_mtime);
+  }
+
+  // Path as added, with its last modification time for the polling
+  // fallback.
+  std::map<std::string, long> files_;
+#ifdef __linux__
+  int fd_ = -1;
+  // File names by watch descriptor of their directory.
+  std::map<int, std::map<std::string, std::string>> watches_;
+#endif
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_FILE_WATCHER_HPP_
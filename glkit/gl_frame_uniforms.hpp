@@ -0,0 +1,85 @@
+#ifndef GLKIT_GL_FRAME_UNIFORMS_HPP_
+#define GLKIT_GL_FRAME_UNIFORMS_HPP_
+
+#include "gl_base.hpp"
+
+namespace glkit {
+
+const int kMaxFrameLights = 4;
+
+struct FrameLight {
+  // xyz used.
+  Vec4 position;
+  Vec4 color;
+};
+
+// Mirrors the std140 FrameData uniform block of the shaders, member for
+// member; keep both in sync.
+struct FrameData {
+  Mat4 view;
+  Mat4 projection;
+  Mat4 view_projection;
+  // xyz used.
+  Vec4 camera_position;
+  float near;
+  float far;
+  int num_lights;
+  int padding;
+  FrameLight lights[kMaxFrameLights];
+};
+static_assert(sizeof(FrameData) == 224 + 32 * kMaxFrameLights,
+              "FrameData must match the std140 block layout");
+
+// Per-frame camera and light data in one uniform buffer, updated once per
+// frame and shared by every program that declares the FrameData block.
+class FrameUniforms {
+ public:
+  // Uniform buffer binding point of the FrameData block.
+  static const GLuint kBinding = 0;
+  static const char* BlockName() { return "FrameData"; }
+
+  FrameUniforms() = default;
+
+  int Init() {
+    Free();
+    glGenBuffers(1, &ubo_);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo_);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    RETURN_IF_GL_ERROR(-1, "Failed to create frame uniform buffer");
+    return 0;
+  }
+
+  // Uploads `data` and binds the buffer to kBinding. The store is
+  // respecified each frame so the driver can rename it instead of waiting
+  // for draws still reading the previous frame.
+  int Update(const FrameData& data) {
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo_);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), &data,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kBinding, ubo_);
+    RETURN_IF_GL_ERROR(-1, "Failed to update frame uniform buffer");
+    return 0;
+  }
+
+  void Free() {
+    if (ubo_) {
+      glDeleteBuffers(1, &ubo_);
+      ubo_ = 0;
+    }
+  }
+
+  ~FrameUniforms() { Free(); }
+
+ private:
+  FrameUniforms(const FrameUniforms&) = delete;
+  FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+  GLuint ubo_ = 0;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_FRAME_UNIFORMS_HPP_
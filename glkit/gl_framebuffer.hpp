@@ -0,0 +1,170 @@
+#ifndef GLKIT_GL_FRAMEBUFFER_HPP_
+#define GLKIT_GL_FRAMEBUFFER_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "gl_base.hpp"
+
+namespace glkit {
+
+// Offscreen render target: RGBA8 color and 32-bit float depth
+// renderbuffers. Reads go through pixel buffers, so the copy of one frame
+// overlaps the rendering of the next; see StartRead.
+class Framebuffer {
+ public:
+  // Frames that can be read back at once.
+  static const int kReadSlots = 2;
+
+  Framebuffer() = default;
+  ~Framebuffer() { Free(); }
+
+  int Init(int width, int height) {
+    Free();
+    width_ = width;
+    height_ = height;
+    glGenFramebuffers(1, &fbo_);
+    glGenRenderbuffers(1, &color_);
+    glGenRenderbuffers(1, &depth_);
+    glBindRenderbuffer(GL_RENDERBUFFER, color_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width,
+                          height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, color_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, depth_);
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+      LOG(ERROR) << "Framebuffer incomplete: 0x" << std::hex << status;
+      Free();
+      return -1;
+    }
+    glGenBuffers(2 * kReadSlots, &read_buffers_[0][0]);
+    for (auto& slot : read_buffers_) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, slot[0]);
+      glBufferData(GL_PIXEL_PACK_BUFFER, color_bytes(), nullptr,
+                   GL_STREAM_READ);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, slot[1]);
+      glBufferData(GL_PIXEL_PACK_BUFFER, depth_bytes(), nullptr,
+                   GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    RETURN_IF_GL_ERROR(-1, "Failed to create framebuffer");
+    return 0;
+  }
+
+  // Binds the framebuffer for drawing and sets the viewport to all of it.
+  void Bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    glViewport(0, 0, width_, height_);
+  }
+
+  static void Unbind() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+
+  // Queues the copy of color and depth into the next free read slot and
+  // returns without waiting for the frame to finish. Fails when all
+  // kReadSlots frames are still to be taken with FinishRead.
+  int StartRead() {
+    if (num_reads_ == kReadSlots) {
+      LOG(ERROR) << "No free framebuffer read slot";
+      return -1;
+    }
+    const GLuint* slot =
+        read_buffers_[(first_read_ + num_reads_) % kReadSlots];
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot[0]);
+    glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot[1]);
+    glReadPixels(0, 0, width_, height_, GL_DEPTH_COMPONENT, GL_FLOAT,
+                 nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    RETURN_IF_GL_ERROR(-1, "Failed to read framebuffer");
+    ++num_reads_;
+    return 0;
+  }
+
+  // Copies out the oldest read StartRead queued, waiting for it if needed.
+  // Rows run bottom to top, as in GL; `color` holds RGBA bytes and `depth`
+  // the window space depth in [0, 1].
+  int FinishRead(std::vector<uint8_t>* color, std::vector<float>* depth) {
+    if (num_reads_ == 0) {
+      LOG(ERROR) << "No framebuffer read started";
+      return -1;
+    }
+    const GLuint* slot = read_buffers_[first_read_];
+    first_read_ = (first_read_ + 1) % kReadSlots;
+    --num_reads_;
+    color->resize(static_cast<size_t>(width_) * height_ * 4);
+    depth->resize(static_cast<size_t>(width_) * height_);
+    if (CopyBuffer(slot[0], color->data(), color_bytes()) != 0 ||
+        CopyBuffer(slot[1], depth->data(), depth_bytes()) != 0) {
+      return -1;
+    }
+    return 0;
+  }
+
+  void Free() {
+    if (fbo_) {
+      glDeleteFramebuffers(1, &fbo_);
+      glDeleteRenderbuffers(1, &color_);
+      glDeleteRenderbuffers(1, &depth_);
+      fbo_ = color_ = depth_ = 0;
+    }
+    if (read_buffers_[0][0]) {
+      glDeleteBuffers(2 * kReadSlots, &read_buffers_[0][0]);
+      memset(read_buffers_, 0, sizeof(read_buffers_));
+    }
+    first_read_ = num_reads_ = 0;
+  }
+
+  GLuint fbo() const { return fbo_; }
+  int width() const { return width_; }
+  int height() const { return height_; }
+  size_t color_bytes() const {
+    return static_cast<size_t>(width_) * height_ * 4;
+  }
+  size_t depth_bytes() const {
+    return static_cast<size_t>(width_) * height_ * sizeof(float);
+  }
+
+ private:
+  Framebuffer(const Framebuffer&) = delete;
+  Framebuffer& operator=(const Framebuffer&) = delete;
+
+  static int CopyBuffer(GLuint buffer, void* data, size_t size) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size,
+                                          GL_MAP_READ_BIT);
+    if (mapped == nullptr) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      RETURN_IF_GL_ERROR(-1, "Failed to map pixel buffer");
+      return -1;
+    }
+    memcpy(data, mapped, size);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return 0;
+  }
+
+  GLuint fbo_ = 0;
+  GLuint color_ = 0;
+  GLuint depth_ = 0;
+  // Color and depth pixel buffer per read slot.
+  GLuint read_buffers_[kReadSlots][2] = {};
+  int first_read_ = 0;
+  int num_reads_ = 0;
+  int width_ = 0;
+  int height_ = 0;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_FRAMEBUFFER_HPP_
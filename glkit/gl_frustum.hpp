@@ -0,0 +1,147 @@
+#ifndef GLKIT_GL_FRUSTUM_HPP_
+#define GLKIT_GL_FRUSTUM_HPP_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "gl_base.hpp"
+#include "gl_bounds.hpp"
+#include "gl_simd.hpp"
+
+namespace glkit {
+
+// The six clip planes of a view projection matrix. A plane (n, d) keeps the
+// points p with dot(n, p) + d >= 0; n is unit length, so the value is the
+// signed distance.
+struct Frustum {
+  enum Plane {
+    kLeft = 0,
+    kRight = 1,
+    kBottom = 2,
+    kTop = 3,
+    kNear = 4,
+    kFar = 5,
+  };
+
+  Vec4 planes[6];
+
+  // Gribb & Hartmann: each plane is the last row of the matrix plus or
+  // minus one of the others. Planes are in the space the matrix maps from,
+  // world space for projection * view.
+  static Frustum FromMatrix(const Mat4& m) {
+    // glm is column major, m[c][r].
+    Vec4 row[4];
+    for (int r = 0; r < 4; ++r) {
+      row[r] = Vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+    }
+    Frustum f;
+    f.planes[kLeft] = row[3] + row[0];
+    f.planes[kRight] = row[3] - row[0];
+    f.planes[kBottom] = row[3] + row[1];
+    f.planes[kTop] = row[3] - row[1];
+    f.planes[kNear] = row[3] + row[2];
+    f.planes[kFar] = row[3] - row[2];
+    for (auto& p : f.planes) {
+      const float length = glm::length(Vec3(p));
+      if (length > 0.0f) p /= length;
+    }
+    return f;
+  }
+
+  // False only when the sphere is entirely outside one plane; spheres near
+  // the frustum corners may pass without intersecting it.
+  bool Intersects(const BoundingSphere& sphere) const {
+    for (const auto& p : planes) {
+      if (glm::dot(Vec3(p), sphere.center) + p.w <= -sphere.radius) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Tests the box corner farthest along each plane normal; like the sphere
+  // test it is conservative near the corners.
+  bool Intersects(const Aabb& box) const {
+    for (const auto& p : planes) {
+      const Vec3 far(p.x > 0.0f ? box.max.x : box.min.x,
+                     p.y > 0.0f ? box.max.y : box.min.y,
+                     p.z > 0.0f ? box.max.z : box.min.z);
+      if (glm::dot(Vec3(p), far) + p.w < 0.0f) return false;
+    }
+    return true;
+  }
+};
+
+// Bounding spheres as structure of arrays, the input of CullSpheres.
+struct SphereArray {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> r;
+
+  size_t size() const { return x.size(); }
+  void clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+    r.clear();
+  }
+  void push_back(const BoundingSphere& sphere) {
+    x.push_back(sphere.center.x);
+    y.push_back(sphere.center.y);
+    z.push_back(sphere.center.z);
+    r.push_back(sphere.radius);
+  }
+};
+
+template <typename F>
+inline size_t CullSpheresLoop(const Frustum& frustum, const float* x,
+                              const float* y, const float* z, const float* r,
+                              size_t i, size_t count,
+                              std::vector<uint32_t>* visible) {
+  F px[6], py[6], pz[6], pw[6];
+  for (int k = 0; k < 6; ++k) {
+    px[k] = F::Set1(frustum.planes[k].x);
+    py[k] = F::Set1(frustum.planes[k].y);
+    pz[k] = F::Set1(frustum.planes[k].z);
+    pw[k] = F::Set1(frustum.planes[k].w);
+  }
+  for (; i + F::kWidth <= count; i += F::kWidth) {
+    const F cx = F::Load(x + i), cy = F::Load(y + i), cz = F::Load(z + i);
+    const F neg_r = F::Set1(0.0f) - F::Load(r + i);
+    F inside = CmpGreater(px[0] * cx + py[0] * cy + pz[0] * cz + pw[0], neg_r);
+    for (int k = 1; k < 6; ++k) {
+      inside = And(inside, CmpGreater(px[k] * cx + py[k] * cy +
+                                          pz[k] * cz + pw[k],
+                                      neg_r));
+    }
+    int mask = MoveMask(inside);
+    for (size_t lane = i; mask; ++lane, mask >>= 1) {
+      if (mask & 1) visible->push_back(static_cast<uint32_t>(lane));
+    }
+  }
+  return i;
+}
+
+// Appends the index of every sphere that is not entirely outside the
+// frustum to `visible`, in increasing order. Spheres are tested
+// SimdFloat::kWidth at a time against all six planes.
+inline void CullSpheres(const Frustum& frustum, const float* x,
+                        const float* y, const float* z, const float* r,
+                        size_t count, std::vector<uint32_t>* visible) {
+  size_t i =
+      CullSpheresLoop<SimdFloat>(frustum, x, y, z, r, 0, count, visible);
+  CullSpheresLoop<FloatX1>(frustum, x, y, z, r, i, count, visible);
+}
+
+inline void CullSpheres(const Frustum& frustum, const SphereArray& spheres,
+                        std::vector<uint32_t>* visible) {
+  CullSpheres(frustum, spheres.x.data(), spheres.y.data(), spheres.z.data(),
+              spheres.r.data(), spheres.size(), visible);
+}
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_FRUSTUM_HPP_
@@ -0,0 +1,231 @@
+#ifndef GLKIT_GL_GEOMETRY_HPP_
+#define GLKIT_GL_GEOMETRY_HPP_
+
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+
+#include "gl_base.hpp"
+#include "gl_parallel.hpp"
+#include "gl_simd.hpp"
+
+// Geometry processing kernels over structure-of-arrays data, independent of
+// the mesh source. Per triangle work runs SimdFloat::kWidth triangles at a
+// time with a scalar tail; the vertex scatter is scalar.
+
+namespace glkit {
+
+enum NormalWeighting {
+  // Face normals weighted by triangle area.
+  kNormalWeightArea = 0,
+  // Unit face normals weighted by the corner angle, which does not depend
+  // on how a surface is triangulated.
+  kNormalWeightAngle = 1,
+};
+
+struct Vec3Array {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+
+  size_t size() const { return x.size(); }
+  void assign(size_t n, float value) {
+    x.assign(n, value);
+    y.assign(n, value);
+    z.assign(n, value);
+  }
+};
+
+template <typename F>
+inline size_t FaceNormalsLoop(const float* px, const float* py,
+                              const float* pz, const GLuint* indices,
+                              size_t t, size_t end, float* nx, float* ny,
+                              float* nz) {
+  for (; t + F::kWidth <= end; t += F::kWidth) {
+    const GLuint* tri = indices + t * 3;
+    const F x0 = F::Gather(px, tri, 3), y0 = F::Gather(py, tri, 3),
+            z0 = F::Gather(pz, tri, 3);
+    const F ax = F::Gather(px, tri + 1, 3) - x0,
+            ay = F::Gather(py, tri + 1, 3) - y0,
+            az = F::Gather(pz, tri + 1, 3) - z0;
+    const F bx = F::Gather(px, tri + 2, 3) - x0,
+            by = F::Gather(py, tri + 2, 3) - y0,
+            bz = F::Gather(pz, tri + 2, 3) - z0;
+    (ay * bz - az * by).Store(nx + t);
+    (az * bx - ax * bz).Store(ny + t);
+    (ax * by - ay * bx).Store(nz + t);
+  }
+  return t;
+}
+
+// Abramowitz & Stegun 4.4.45, absolute error below 7e-5 rad.
+template <typename F>
+inline F AcosApprox(F x) {
+  const F ax = Min(Abs(x), F::Set1(1.0f));
+  F p = F::Set1(-0.0187293f) * ax + F::Set1(0.0742610f);
+  p = p * ax - F::Set1(0.2121144f);
+  p = p * ax + F::Set1(1.5707288f);
+  const F r = Sqrt(F::Set1(1.0f) - ax) * p;
+  return SelectNegative(x, F::Set1(PI) - r, r);
+}
+
+template <typename F>
+inline size_t CornerAnglesLoop(const float* px, const float* py,
+                               const float* pz, const GLuint* indices,
+                               size_t t, size_t end, float* a0, float* a1,
+                               float* a2) {
+  for (; t + F::kWidth <= end; t += F::kWidth) {
+    const GLuint* tri = indices + t * 3;
+    F x[3], y[3], z[3];
+    for (int k = 0; k < 3; ++k) {
+      x[k] = F::Gather(px, tri + k, 3);
+      y[k] = F::Gather(py, tri + k, 3);
+      z[k] = F::Gather(pz, tri + k, 3);
+    }
+    // Unit edge vectors e[k] = p[k + 1] - p[k].
+    F ex[3], ey[3], ez[3];
+    for (int k = 0; k < 3; ++k) {
+      const int n = (k + 1) % 3;
+      ex[k] = x[n] - x[k];
+      ey[k] = y[n] - y[k];
+      ez[k] = z[n] - z[k];
+      const F inv = InvOrZero(Sqrt(ex[k] * ex[k] + ey[k] * ey[k] +
+                                   ez[k] * ez[k]));
+      ex[k] = ex[k] * inv;
+      ey[k] = ey[k] * inv;
+      ez[k] = ez[k] * inv;
+    }
+    // The angle at corner k is between e[k] and -e[k - 1].
+    float* out[3] = {a0, a1, a2};
+    for (int k = 0; k < 3; ++k) {
+      const int p = (k + 2) % 3;
+      const F cos_angle = F::Set1(0.0f) - (ex[k] * ex[p] + ey[k] * ey[p] +
+                                           ez[k] * ez[p]);
+      AcosApprox(cos_angle).Store(out[k] + t);
+    }
+  }
+  return t;
+}
+
+template <typename F>
+inline size_t NormalizeLoop(float* x, float* y, float* z, size_t i,
+                            size_t end) {
+  for (; i + F::kWidth <= end; i += F::kWidth) {
+    const F vx = F::Load(x + i), vy = F::Load(y + i), vz = F::Load(z + i);
+    const F inv = InvOrZero(Sqrt(vx * vx + vy * vy + vz * vz));
+    (vx * inv).Store(x + i);
+    (vy * inv).Store(y + i);
+    (vz * inv).Store(z + i);
+  }
+  return i;
+}
+
+// Writes the normal of the `count` triangles at `indices` to n[0, count),
+// not normalized: its length is twice the triangle area.
+inline void ComputeFaceNormals(const float* px, const float* py,
+                               const float* pz, const GLuint* indices,
+                               size_t count, float* nx, float* ny,
+                               float* nz) {
+  size_t t =
+      FaceNormalsLoop<SimdFloat>(px, py, pz, indices, 0, count, nx, ny, nz);
+  FaceNormalsLoop<FloatX1>(px, py, pz, indices, t, count, nx, ny, nz);
+}
+
+// Writes the interior angles in radians at the three corners of the `count`
+// triangles at `indices` to a0, a1 and a2.
+inline void ComputeCornerAngles(const float* px, const float* py,
+                                const float* pz, const GLuint* indices,
+                                size_t count, float* a0, float* a1,
+                                float* a2) {
+  size_t t =
+      CornerAnglesLoop<SimdFloat>(px, py, pz, indices, 0, count, a0, a1, a2);
+  CornerAnglesLoop<FloatX1>(px, py, pz, indices, t, count, a0, a1, a2);
+}
+
+// Normalizes `count` vectors in place; zero vectors stay zero.
+inline void NormalizeVectors(float* x, float* y, float* z, size_t count) {
+  size_t i = NormalizeLoop<SimdFloat>(x, y, z, 0, count);
+  NormalizeLoop<FloatX1>(x, y, z, i, count);
+}
+
+// Adds the face normals f[0, count) of the triangles at `indices` to their
+// vertices. With corner angles (a0 not null) the face normals must be unit
+// length and each corner adds its face normal times its angle.
+inline void AccumulateVertexNormals(const GLuint* indices, size_t count,
+                                    const float* fx, const float* fy,
+                                    const float* fz, const float* a0,
+                                    const float* a1, const float* a2,
+                                    float* vx, float* vy, float* vz) {
+  const float* angles[3] = {a0, a1, a2};
+  for (size_t t = 0; t < count; ++t) {
+    for (int k = 0; k < 3; ++k) {
+      const GLuint v = indices[t * 3 + k];
+      const float w = a0 ? angles[k][t] : 1.0f;
+      vx[v] += fx[t] * w;
+      vy[v] += fy[t] * w;
+      vz[v] += fz[t] * w;
+    }
+  }
+}
+
+// Smooth unit vertex normals of an indexed triangle list. Triangles are
+// processed in small blocks whose face normals stay in cache between the
+// SIMD pass and the scatter. With several threads every thread accumulates
+// its triangle range into a private buffer (thread 0 uses `normals`
+// directly) and the buffers are reduced and normalized per vertex range, so
+// no atomics are needed.
+inline void ComputeVertexNormals(const Vec3Array& positions,
+                                 const std::vector<GLuint>& indices,
+                                 NormalWeighting weighting, int num_threads,
+                                 Vec3Array* normals) {
+  const size_t kBlock = 256;
+  const size_t num_triangles = indices.size() / 3;
+  const size_t num_vertices = positions.size();
+  const bool angle = weighting == kNormalWeightAngle;
+  num_threads = static_cast<int>(
+      std::min(static_cast<size_t>(std::max(num_threads, 1)),
+               std::max(num_triangles, static_cast<size_t>(1))));
+  normals->assign(num_vertices, 0.0f);
+  std::vector<Vec3Array> partial(num_threads - 1);
+
+  ParallelFor(num_triangles, num_threads, [&](int t, size_t b, size_t e) {
+    const float* px = positions.x.data();
+    const float* py = positions.y.data();
+    const float* pz = positions.z.data();
+    Vec3Array* acc = normals;
+    if (t > 0) {
+      acc = &partial[t - 1];
+      acc->assign(num_vertices, 0.0f);
+    }
+    float fx[kBlock], fy[kBlock], fz[kBlock];
+    float a0[kBlock], a1[kBlock], a2[kBlock];
+    for (size_t i = b; i < e; i += kBlock) {
+      const size_t count = std::min(kBlock, e - i);
+      const GLuint* tri = indices.data() + i * 3;
+      ComputeFaceNormals(px, py, pz, tri, count, fx, fy, fz);
+      if (angle) {
+        NormalizeVectors(fx, fy, fz, count);
+        ComputeCornerAngles(px, py, pz, tri, count, a0, a1, a2);
+      }
+      AccumulateVertexNormals(tri, count, fx, fy, fz, angle ? a0 : nullptr,
+                              a1, a2, acc->x.data(), acc->y.data(),
+                              acc->z.data());
+    }
+  });
+  ParallelFor(num_vertices, num_threads, [&](int, size_t b, size_t e) {
+    for (const auto& acc : partial) {
+      if (acc.size() == 0) continue;
+      for (size_t i = b; i < e; ++i) {
+        normals->x[i] += acc.x[i];
+        normals->y[i] += acc.y[i];
+        normals->z[i] += acc.z[i];
+      }
+    }
+    NormalizeVectors(normals->x.data() + b, normals->y.data() + b,
+                     normals->z.data() + b, e - b);
+  });
+}
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_GEOMETRY_HPP_
@@ -0,0 +1,42 @@
+#ifndef GLKIT_GL_HASH_HPP_
+#define GLKIT_GL_HASH_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+namespace glkit {
+
+// Non-cryptographic 64-bit hash for cache keys. Consumes 8 bytes per step so
+// hashing large source files stays cheap compared to parsing them.
+inline uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0) {
+  const uint64_t kMul = 0x9E3779B97F4A7C15ull;
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  uint64_t h = seed ^ (size * kMul);
+  while (size >= 8) {
+    uint64_t k;
+    memcpy(&k, p, 8);
+    k *= kMul;
+    k ^= k >> 29;
+    h = (h ^ k) * 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 32;
+    p += 8;
+    size -= 8;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, p, size);
+  h = (h ^ (tail * kMul)) * 0x94D049BB133111EBull;
+  h ^= h >> 31;
+  h *= kMul;
+  h ^= h >> 29;
+  return h;
+}
+
+inline uint64_t Hash64(const std::string& s, uint64_t seed = 0) {
+  return Hash64(s.data(), s.size(), seed);
+}
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_HASH_HPP_
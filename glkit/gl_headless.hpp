@@ -0,0 +1,133 @@
+#ifndef GLKIT_GL_HEADLESS_HPP_
+#define GLKIT_GL_HEADLESS_HPP_
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "gl_base.hpp"
+
+namespace glkit {
+
+// OpenGL 3.3 core context without a window, through EGL. Mesa's surfaceless
+// platform needs no display server, so it runs on build machines with the
+// llvmpipe software rasterizer as well as on GPUs; drivers without it get
+// the default display. The context has no default framebuffer worth
+// drawing to: render into a Framebuffer.
+class HeadlessContext {
+ public:
+  HeadlessContext() = default;
+  ~HeadlessContext() { Destroy(); }
+
+  int Init() {
+    Destroy();
+    display_ = GetDisplay();
+    if (display_ == EGL_NO_DISPLAY) {
+      LOG(ERROR) << "No EGL display";
+      return -1;
+    }
+    EGLint major = 0, minor = 0;
+    if (!eglInitialize(display_, &major, &minor)) {
+      LOG(ERROR) << "eglInitialize failed: 0x" << std::hex << eglGetError();
+      display_ = EGL_NO_DISPLAY;
+      return -1;
+    }
+    const EGLint config_attribs[] = {EGL_SURFACE_TYPE,
+                                     EGL_PBUFFER_BIT,
+                                     EGL_RENDERABLE_TYPE,
+                                     EGL_OPENGL_BIT,
+                                     EGL_RED_SIZE,
+                                     8,
+                                     EGL_GREEN_SIZE,
+                                     8,
+                                     EGL_BLUE_SIZE,
+                                     8,
+                                     EGL_NONE};
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(display_, config_attribs, &config, 1,
+                         &num_configs) ||
+        num_configs == 0) {
+      LOG(ERROR) << "No EGL config for desktop OpenGL";
+      Destroy();
+      return -1;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+      LOG(ERROR) << "eglBindAPI(EGL_OPENGL_API) failed";
+      Destroy();
+      return -1;
+    }
+    const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                      3,
+                                      EGL_CONTEXT_MINOR_VERSION,
+                                      3,
+                                      EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                      EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                      EGL_NONE};
+    context_ =
+        eglCreateContext(display_, config, EGL_NO_CONTEXT, context_attribs);
+    if (context_ == EGL_NO_CONTEXT) {
+      LOG(ERROR) << "eglCreateContext failed: 0x" << std::hex
+                 << eglGetError();
+      Destroy();
+      return -1;
+    }
+    // EGL_KHR_surfaceless_context lets the context go current without a
+    // surface; otherwise a 1x1 pbuffer stands in.
+    if (!eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_)) {
+      const EGLint pbuffer_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1,
+                                        EGL_NONE};
+      surface_ = eglCreatePbufferSurface(display_, config, pbuffer_attribs);
+      if (surface_ == EGL_NO_SURFACE ||
+          !eglMakeCurrent(display_, surface_, surface_, context_)) {
+        LOG(ERROR) << "eglMakeCurrent failed: 0x" << std::hex
+                   << eglGetError();
+        Destroy();
+        return -1;
+      }
+    }
+    LOG(INFO) << "EGL " << major << "." << minor << ", "
+              << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION);
+    return 0;
+  }
+
+  void Destroy() {
+    if (display_ == EGL_NO_DISPLAY) return;
+    eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (surface_ != EGL_NO_SURFACE) {
+      eglDestroySurface(display_, surface_);
+      surface_ = EGL_NO_SURFACE;
+    }
+    if (context_ != EGL_NO_CONTEXT) {
+      eglDestroyContext(display_, context_);
+      context_ = EGL_NO_CONTEXT;
+    }
+    eglTerminate(display_);
+    display_ = EGL_NO_DISPLAY;
+  }
+
+ private:
+  HeadlessContext(const HeadlessContext&) = delete;
+  HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+  static EGLDisplay GetDisplay() {
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    auto get_platform_display =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (get_platform_display) {
+      EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                                EGL_DEFAULT_DISPLAY, nullptr);
+      if (display != EGL_NO_DISPLAY) return display;
+    }
+#endif
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+
+  EGLDisplay display_ = EGL_NO_DISPLAY;
+  EGLContext context_ = EGL_NO_CONTEXT;
+  EGLSurface surface_ = EGL_NO_SURFACE;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_HEADLESS_HPP_
@@ -0,0 +1,90 @@
+#ifndef GLKIT_GL_IMAGE_IO_HPP_
+#define GLKIT_GL_IMAGE_IO_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gl_base.hpp"
+
+namespace glkit {
+
+// Writers for the netpbm family, which any image tool reads and which cost
+// next to nothing to encode. Pixels come in GL order, rows bottom to top.
+
+// 8-bit RGB PPM from RGBA pixels.
+inline int WritePpm(const std::string& path, int width, int height,
+                    const uint8_t* rgba) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (f == nullptr) {
+    LOG(ERROR) << "Failed to create " << path;
+    return -1;
+  }
+  bool ok = fprintf(f, "P6\n%d %d\n255\n", width, height) > 0;
+  std::vector<uint8_t> row(static_cast<size_t>(width) * 3);
+  for (int y = height - 1; ok && y >= 0; --y) {
+    const uint8_t* src = rgba + static_cast<size_t>(y) * width * 4;
+    for (int x = 0; x < width; ++x) {
+      row[x * 3 + 0] = src[x * 4 + 0];
+      row[x * 3 + 1] = src[x * 4 + 1];
+      row[x * 3 + 2] = src[x * 4 + 2];
+    }
+    ok = fwrite(row.data(), row.size(), 1, f) == 1;
+  }
+  ok = (fclose(f) == 0) && ok;
+  if (!ok) LOG(ERROR) << "Failed to write " << path;
+  return ok ? 0 : -1;
+}
+
+// 16-bit grayscale PGM from values in [0, 1], stored big endian as the
+// format requires.
+inline int WritePgm16(const std::string& path, int width, int height,
+                      const float* values) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (f == nullptr) {
+    LOG(ERROR) << "Failed to create " << path;
+    return -1;
+  }
+  bool ok = fprintf(f, "P5\n%d %d\n65535\n", width, height) > 0;
+  std::vector<uint8_t> row(static_cast<size_t>(width) * 2);
+  for (int y = height - 1; ok && y >= 0; --y) {
+    const float* src = values + static_cast<size_t>(y) * width;
+    for (int x = 0; x < width; ++x) {
+      const float v = std::min(std::max(src[x], 0.0f), 1.0f);
+      const uint16_t gray = static_cast<uint16_t>(v * 65535.0f + 0.5f);
+      row[x * 2 + 0] = static_cast<uint8_t>(gray >> 8);
+      row[x * 2 + 1] = static_cast<uint8_t>(gray & 0xff);
+    }
+    ok = fwrite(row.data(), row.size(), 1, f) == 1;
+  }
+  ok = (fclose(f) == 0) && ok;
+  if (!ok) LOG(ERROR) << "Failed to write " << path;
+  return ok ? 0 : -1;
+}
+
+// Single channel PFM of raw floats. PFM stores rows bottom to top like GL,
+// so the pixels go out in one write; the negative scale marks them little
+// endian.
+inline int WritePfm(const std::string& path, int width, int height,
+                    const float* values) {
+  static const uint16_t kEndian = 1;
+  const bool little_endian = *reinterpret_cast<const uint8_t*>(&kEndian) == 1;
+  FILE* f = fopen(path.c_str(), "wb");
+  if (f == nullptr) {
+    LOG(ERROR) << "Failed to create " << path;
+    return -1;
+  }
+  bool ok = fprintf(f, "Pf\n%d %d\n%s\n", width, height,
+                    little_endian ? "-1.0" : "1.0") > 0;
+  ok = ok && fwrite(values, sizeof(float) * width, height, f) ==
+                 static_cast<size_t>(height);
+  ok = (fclose(f) == 0) && ok;
+  if (!ok) LOG(ERROR) << "Failed to write " << path;
+  return ok ? 0 : -1;
+}
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_IMAGE_IO_HPP_
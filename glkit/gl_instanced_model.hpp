@@ -0,0 +1,215 @@
+#ifndef GLKIT_GL_INSTANCED_MODEL_HPP_
+#define GLKIT_GL_INSTANCED_MODEL_HPP_
+
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+
+#include "gl_base.hpp"
+#include "gl_mesh.hpp"
+#include "gl_model.hpp"
+#include "gl_shader.hpp"
+
+namespace glkit {
+
+// Per-instance vertex attributes of shaders/object_instanced.vs: the model
+// matrix columns at locations 3-6 and the color at location 7.
+struct InstanceData {
+  Mat4 model;
+  Vec4 color;
+};
+
+// Many copies of one mesh drawn with a single glDrawElementsInstanced. The
+// instances live in a CPU array mirrored by a per-instance attribute buffer;
+// edits mark a dirty range and only that range is uploaded before the next
+// draw.
+class InstancedModel {
+ public:
+  static const GLuint kFirstInstanceAttribute = 3;
+
+  InstancedModel() = default;
+
+  int Init(Mesh* mesh, Shader* shader) {
+    Free();
+    mesh_ = mesh;
+    shader_ = shader;
+    ResolveUniforms();
+
+    glGenVertexArrays(1, &vao_);
+    glGenBuffers(1, &instance_vbo_);
+    glBindVertexArray(vao_);
+    attached_ = mesh_->ready();
+    if (attached_) mesh_->AttachToVertexArray();
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo_);
+    for (GLuint i = 0; i < 5; ++i) {
+      const GLuint location = kFirstInstanceAttribute + i;
+      glEnableVertexAttribArray(location);
+      glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE,
+                            sizeof(InstanceData),
+                            (void*)(i * sizeof(Vec4)));
+      glVertexAttribDivisor(location, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    RETURN_IF_GL_ERROR(-1, "Failed to create instanced model");
+    return 0;
+  }
+
+  // New instances are identity transforms in white.
+  void Resize(size_t count) {
+    const size_t old_count = instances_.size();
+    InstanceData data;
+    data.model = Mat4(1.0f);
+    data.color = Vec4(1.0f);
+    instances_.resize(count, data);
+    if (count > old_count) MarkDirty(old_count, count);
+    dirty_end_ = std::min(dirty_end_, count);
+    if (dirty_begin_ >= dirty_end_) dirty_begin_ = dirty_end_ = 0;
+  }
+
+  void SetInstance(size_t index, const Mat4& model, const Vec3& color) {
+    instances_[index].model = model;
+    instances_[index].color = Vec4(color, 1.0f);
+    MarkDirty(index, index + 1);
+  }
+
+  void SetInstanceModel(size_t index, const Mat4& model) {
+    instances_[index].model = model;
+    MarkDirty(index, index + 1);
+  }
+
+  // Resizes to `count` instances and returns them for the caller to fill
+  // completely, e.g. by ObjectStore::Gather; all of them are uploaded.
+  InstanceData* WriteInstances(size_t count) {
+    instances_.resize(count);
+    dirty_begin_ = 0;
+    dirty_end_ = count;
+    return instances_.data();
+  }
+
+  // Uploads the dirty range, growing the buffer geometrically when the
+  // instance count outgrew it.
+  int Upload() {
+    if (instances_.size() > capacity_) {
+      capacity_ = std::max(instances_.size(), capacity_ * 2);
+      glBindBuffer(GL_ARRAY_BUFFER, instance_vbo_);
+      glBufferData(GL_ARRAY_BUFFER, capacity_ * sizeof(InstanceData), nullptr,
+                   GL_DYNAMIC_DRAW);
+      dirty_begin_ = 0;
+      dirty_end_ = instances_.size();
+    } else if (dirty_begin_ < dirty_end_) {
+      glBindBuffer(GL_ARRAY_BUFFER, instance_vbo_);
+    }
+    if (dirty_begin_ < dirty_end_) {
+      glBufferSubData(GL_ARRAY_BUFFER, dirty_begin_ * sizeof(InstanceData),
+                      (dirty_end_ - dirty_begin_) * sizeof(InstanceData),
+                      &instances_[dirty_begin_]);
+      uploaded_bytes_ += (dirty_end_ - dirty_begin_) * sizeof(InstanceData);
+      dirty_begin_ = dirty_end_ = 0;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    RETURN_IF_GL_ERROR(-1, "Failed to upload instances");
+    return 0;
+  }
+
+  // Camera and lights come from the FrameData uniform block. Nothing is
+  // drawn while the mesh is loading.
+  int Draw() {
+    if (instances_.empty() || !mesh_->ready()) return 0;
+    if (!attached_) {
+      glBindVertexArray(vao_);
+      mesh_->AttachToVertexArray();
+      glBindVertexArray(0);
+      attached_ = true;
+    }
+    if (Upload() != 0) return -1;
+    if (uniforms_.generation != shader_->generation()) ResolveUniforms();
+    shader_->Use();
+    shader_->Set(uniforms_.pos_offset, mesh_->position_offset());
+    shader_->Set(uniforms_.pos_scale, mesh_->position_scale());
+    shader_->Set(uniforms_.render_mode, static_cast<int>(render_mode_));
+    glBindVertexArray(vao_);
+    mesh_->DrawElementsInstanced(lod_,
+                                 static_cast<GLsizei>(instances_.size()));
+    glBindVertexArray(0);
+    RETURN_IF_GL_ERROR(-1, "Failed to draw instanced model");
+    return 0;
+  }
+
+  void Free() {
+    if (vao_) {
+      glDeleteVertexArrays(1, &vao_);
+      vao_ = 0;
+    }
+    if (instance_vbo_) {
+      glDeleteBuffers(1, &instance_vbo_);
+      instance_vbo_ = 0;
+    }
+    capacity_ = 0;
+    dirty_begin_ = 0;
+    dirty_end_ = instances_.size();
+  }
+
+  ~InstancedModel() { Free(); }
+
+  size_t size() const { return instances_.size(); }
+  const std::vector<InstanceData>& instances() const { return instances_; }
+
+  // Level of detail drawn for all instances.
+  int lod() const { return lod_; }
+  void set_lod(int lod) { lod_ = lod; }
+
+  RenderMode render_mode() const { return render_mode_; }
+  void set_render_mode(RenderMode render_mode) { render_mode_ = render_mode; }
+
+  // Instance bytes uploaded since creation, to check the dirty tracking.
+  size_t uploaded_bytes() const { return uploaded_bytes_; }
+
+ private:
+  InstancedModel(const InstancedModel&) = delete;
+  InstancedModel& operator=(const InstancedModel&) = delete;
+
+  struct Uniforms {
+    uint32_t generation = 0;
+    Uniform<Vec3> pos_offset;
+    Uniform<Vec3> pos_scale;
+    Uniform<int> render_mode;
+  };
+
+  // Again after the shader reloads; see Shader::Swap.
+  void ResolveUniforms() {
+    uniforms_.generation = shader_->generation();
+    uniforms_.pos_offset = shader_->GetUniform<Vec3>("pos_offset");
+    uniforms_.pos_scale = shader_->GetUniform<Vec3>("pos_scale");
+    uniforms_.render_mode = shader_->GetUniform<int>("render_mode");
+  }
+
+  void MarkDirty(size_t begin, size_t end) {
+    if (dirty_begin_ == dirty_end_) {
+      dirty_begin_ = begin;
+      dirty_end_ = end;
+    } else {
+      dirty_begin_ = std::min(dirty_begin_, begin);
+      dirty_end_ = std::max(dirty_end_, end);
+    }
+  }
+
+  Mesh* mesh_ = nullptr;
+  Shader* shader_ = nullptr;
+  Uniforms uniforms_;
+  std::vector<InstanceData> instances_;
+  size_t capacity_ = 0;
+  size_t dirty_begin_ = 0;
+  size_t dirty_end_ = 0;
+  size_t uploaded_bytes_ = 0;
+  int lod_ = 0;
+  RenderMode render_mode_ = kRenderModeLight;
+  // Whether vao_ has the mesh buffers yet.
+  bool attached_ = false;
+  GLuint vao_ = 0;
+  GLuint instance_vbo_ = 0;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_INSTANCED_MODEL_HPP_
@@ -0,0 +1,136 @@
+#ifndef GLKIT_GL_MAPPED_FILE_HPP_
+#define GLKIT_GL_MAPPED_FILE_HPP_
+
+#include <stddef.h>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "gl_base.hpp"
+
+namespace glkit {
+
+// Read-only memory mapping of a whole file. The mapping stays valid until
+// Close() or destruction; an empty file maps to data() == nullptr, size() == 0.
+class MappedFile {
+ public:
+  // How the mapping is going to be read, passed on to the OS so that it
+  // reads ahead for one pass over the file and not for lookups into it.
+  enum Access {
+    kAccessSequential = 0,
+    kAccessRandom = 1,
+  };
+
+  MappedFile() = default;
+
+  int Open(const std::string& file_path, Access access = kAccessSequential) {
+    Close();
+#ifdef _WIN32
+    file_ = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                        NULL, OPEN_EXISTING,
+                        access == kAccessRandom ? FILE_FLAG_RANDOM_ACCESS
+                                                : FILE_FLAG_SEQUENTIAL_SCAN,
+                        NULL);
+    if (file_ == INVALID_HANDLE_VALUE) {
+      LOG(ERROR) << "Failed to open file: " << file_path;
+      return -1;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_, &file_size)) {
+      LOG(ERROR) << "Failed to stat file: " << file_path;
+      Close();
+      return -1;
+    }
+    size_ = static_cast<size_t>(file_size.QuadPart);
+    if (size_ == 0) return 0;
+    mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_ == NULL) {
+      LOG(ERROR) << "Failed to map file: " << file_path;
+      Close();
+      return -1;
+    }
+    data_ = static_cast<const char*>(
+        MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr) {
+      LOG(ERROR) << "Failed to map file: " << file_path;
+      Close();
+      return -1;
+    }
+#else
+    fd_ = open(file_path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      LOG(ERROR) << "Failed to open file: " << file_path;
+      return -1;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+      LOG(ERROR) << "Failed to stat file: " << file_path;
+      Close();
+      return -1;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ == 0) return 0;
+    void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (addr == MAP_FAILED) {
+      LOG(ERROR) << "Failed to map file: " << file_path;
+      Close();
+      return -1;
+    }
+    madvise(addr, size_,
+            access == kAccessRandom ? MADV_RANDOM : MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(addr);
+#endif
+    return 0;
+  }
+
+  void Close() {
+#ifdef _WIN32
+    if (data_ != nullptr) UnmapViewOfFile(data_);
+    if (mapping_ != NULL) CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+    mapping_ = NULL;
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+#endif
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  ~MappedFile() { Close(); }
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = NULL;
+#else
+  int fd_ = -1;
+#endif
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_MAPPED_FILE_HPP_
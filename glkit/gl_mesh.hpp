@@ -1,12 +1,20 @@
 #ifndef GLKIT_GL_MESH_HPP_
 #define GLKIT_GL_MESH_HPP_
 
-#include <fstream>
-#include <sstream>
+#include <algorithm>
+#include <string>
 #include <vector>
 
 #include "gl_base.hpp"
+#include "gl_bounds.hpp"
+#include "gl_geometry.hpp"
+#include "gl_mesh_optimizer.hpp"
+#include "gl_mesh_simplify.hpp"
+#include "gl_obj_reader.hpp"
+#include "gl_parallel.hpp"
 #include "gl_shader.hpp"
+#include "gl_triangle_bvh.hpp"
+#include "gl_vertex_format.hpp"
 
 namespace glkit {
 
@@ -16,94 +24,318 @@ struct Vertex {
   Vec2 texcoord;
 };
 
+// A level of detail: a range of the mesh index buffer. All levels share
+// the vertex buffer.
+struct MeshLod {
+  GLuint index_offset = 0;
+  GLuint index_count = 0;
+  // Geometric error against level 0, in mesh units.
+  float error = 0.0f;
+};
+
+// CPU side mesh, laid out exactly as it is uploaded with glBufferData. The
+// index ranges of all levels of detail are stored back to back in
+// `indices`; an empty `lods` means a single level covering all indices.
+struct MeshData {
+  std::vector<Vertex> vertices;
+  std::vector<GLuint> indices;
+  std::vector<MeshLod> lods;
+  Aabb bounds;
+};
+
+struct MeshLoadOptions {
+  // Values <= 0 use all hardware threads.
+  int num_threads = 1;
+  // Weld identical vertices and reorder triangles and vertices for the
+  // post-transform cache, overdraw and vertex fetch before upload.
+  bool optimize = false;
+  // Layout of the uploaded vertex buffer.
+  VertexFormat vertex_format = kVertexFormatFloat;
+  // How face normals are weighted into the smooth vertex normals.
+  NormalWeighting normal_weighting = kNormalWeightArea;
+  // Append simplified levels of detail with about 50%, 25% and 10% of the
+  // triangles to the index buffer.
+  bool generate_lods = false;
+  // Build the triangle BVH of level 0 for ray queries; see Mesh::bvh().
+  bool build_bvh = false;
+};
+
+enum MeshStatus {
+  // Not initialized yet, or loading in the background; see
+  // MeshManager::LoadMeshAsync.
+  kMeshStatusLoading = 0,
+  kMeshStatusReady = 1,
+  kMeshStatusFailed = 2,
+};
+
 class Mesh {
  public:
   int Init(const std::vector<Vertex>& vertices,
            const std::vector<GLuint>& indices) {
-    vertices_ = vertices;
-    indices_ = indices;
+    return Init(vertices.data(), vertices.size(), indices.data(),
+                indices.size(), ComputeBounds(vertices));
+  }
 
-    glGenVertexArrays(1, &vao_);
-    glGenBuffers(1, &vbo_);
-    glGenBuffers(1, &ebo_);
+  int Init(const MeshData& data) {
+    return Init(data.vertices.data(), data.vertices.size(),
+                data.indices.data(), data.indices.size(), data.bounds,
+                data.lods);
+  }
 
-    glBindVertexArray(vao_);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-    glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(Vertex),
-                 vertices_.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size() * sizeof(GLuint),
-                 indices_.data(), GL_STATIC_DRAW);
+  // Uploads straight from the given arrays, which may point into a mapped
+  // file; a CPU copy is kept for later queries.
+  int Init(const Vertex* vertices, size_t num_vertices, const GLuint* indices,
+           size_t num_indices, const Aabb& bounds,
+           const std::vector<MeshLod>& lods = std::vector<MeshLod>()) {
+    Free();
+    bvh_.Clear();
+    status_ = kMeshStatusFailed;
+    vertices_.assign(vertices, vertices + num_vertices);
+    indices_.assign(indices, indices + num_indices);
+    lods_ = lods;
+    if (SetupGeometry(bounds) != 0) return -1;
+    if (vertex_format_ == kVertexFormatPacked) {
+      std::vector<PackedVertex> packed(num_vertices);
+      PackVertices(vertices, num_vertices, position_offset_, position_scale_,
+                   packed.data());
+      if (CreateBuffers(packed.data(), indices) != 0) return -1;
+    } else {
+      if (CreateBuffers(vertices, indices) != 0) return -1;
+    }
+    status_ = kMeshStatusReady;
+    return 0;
+  }
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void*)offsetof(Vertex, position));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void*)offsetof(Vertex, normal));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void*)offsetof(Vertex, texcoord));
-    glBindVertexArray(0);
+  // Init for contents that arrive later: takes over the arrays of `data`,
+  // leaving it empty, and creates buffers of the right size without
+  // contents. The mesh stays loading until the caller has filled vbo() and
+  // ebo() and set it ready; see MeshManager::Update.
+  int Allocate(MeshData* data) {
+    Free();
+    bvh_.Clear();
+    status_ = kMeshStatusFailed;
+    vertices_.swap(data->vertices);
+    indices_.swap(data->indices);
+    lods_.swap(data->lods);
+    const Aabb bounds = data->bounds;
+    *data = MeshData();
+    if (SetupGeometry(bounds) != 0) return -1;
+    if (CreateBuffers(nullptr, nullptr) != 0) return -1;
+    status_ = kMeshStatusLoading;
+    return 0;
+  }
+
+  // Maps the bounds onto the unorm16 position range.
+  static void PositionTransform(const Aabb& bounds, Vec3* offset,
+                                Vec3* scale) {
+    *offset = bounds.empty() ? Vec3(0.0f) : bounds.min;
+    *scale = bounds.empty() ? Vec3(1.0f) : bounds.size();
+    for (int i = 0; i < 3; ++i) {
+      if ((*scale)[i] <= 0.0f) (*scale)[i] = 1.0f;
+    }
+  }
+
+  static void PackVertices(const Vertex* vertices, size_t num_vertices,
+                           const Vec3& offset, const Vec3& scale,
+                           PackedVertex* packed) {
+    const Vec3 inv_scale = Vec3(1.0f) / scale;
+    for (size_t i = 0; i < num_vertices; ++i) {
+      const Vertex& v = vertices[i];
+      const Vec3 p = (v.position - offset) * inv_scale;
+      PackedVertex& out = packed[i];
+      out.position[0] = PackUnorm16(p.x);
+      out.position[1] = PackUnorm16(p.y);
+      out.position[2] = PackUnorm16(p.z);
+      out.position[3] = 0;
+      out.normal = PackSnorm10x3(v.normal);
+      out.texcoord[0] = PackHalf(v.texcoord.x);
+      out.texcoord[1] = PackHalf(v.texcoord.y);
+    }
+  }
 
+  // Loads a triangle mesh and computes smooth vertex normals. More than one
+  // thread parses large files in parallel chunks and splits the normal pass.
+  int InitFromObjFile(const std::string& file_path,
+                      const MeshLoadOptions& options = MeshLoadOptions()) {
+    MeshData data;
+    if (LoadObjFile(file_path, options, &data) != 0) return -1;
+    set_vertex_format(options.vertex_format);
+    if (Init(data) != 0) return -1;
+    if (options.build_bvh) return BuildBvh(options.num_threads);
     return 0;
   }
 
-  int InitFromObjFile(const std::string& file_path) {
-    std::ifstream fin(file_path);
-    if (!fin.is_open()) {
-      LOG(ERROR) << "Failed to open file: " << file_path;
+  // Builds the triangle BVH over the level 0 triangles from the CPU copy of
+  // the mesh. Values of num_threads <= 0 use all hardware threads.
+  int BuildBvh(int num_threads) {
+    return BuildBvh(vertices_, indices_, lods_, num_threads, &bvh_);
+  }
+
+  // BuildBvh on CPU side data, usable without a GL context; an empty `lods`
+  // means all indices are level 0.
+  static int BuildBvh(const std::vector<Vertex>& vertices,
+                      const std::vector<GLuint>& indices,
+                      const std::vector<MeshLod>& lods, int num_threads,
+                      TriangleBvh* bvh) {
+    const GLuint offset = lods.empty() ? 0 : lods[0].index_offset;
+    const size_t count = lods.empty() ? indices.size() : lods[0].index_count;
+    if (bvh->Build(vertices.empty() ? nullptr : &vertices[0].position.x,
+                   sizeof(Vertex) / sizeof(float), indices.data() + offset,
+                   count / 3, num_threads) != 0) {
+      LOG(ERROR) << "Failed to build mesh bvh";
       return -1;
     }
+    return 0;
+  }
 
-    std::vector<Vertex> vertices;
-    std::vector<GLuint> indices;
-
-    while (!fin.eof()) {
-      std::string line;
-      std::getline(fin, line);
-      std::stringstream ss(line);
-      std::string type;
-      ss >> type;
-      if (type == "v") {
-        Vertex vertex;
-        ss >> vertex.position.x >> vertex.position.y >> vertex.position.z;
-        vertex.normal = Vec3(0.0f);
-        vertices.push_back(vertex);
-      } else if (type == "f") {
-        std::vector<GLuint> face;
-        std::string index;
-        while (ss >> index) {
-          size_t pos = index.find('/');
-          int idx = std::stoi(index.substr(0, pos));
-          face.push_back(idx - 1);
-        }
-        for (size_t i = 1; i < face.size() - 1; ++i) {
-          indices.push_back(face[0]);
-          indices.push_back(face[i]);
-          indices.push_back(face[i + 1]);
-        }
+  // CPU part of InitFromObjFile, usable without a GL context.
+  static int LoadObjFile(const std::string& file_path,
+                         const MeshLoadOptions& options, MeshData* data) {
+    const int num_threads = ResolveThreadCount(options.num_threads);
+    ObjData obj;
+    ObjReader reader;
+    if (reader.ReadFile(file_path, &obj, num_threads) != 0) {
+      LOG(ERROR) << "Failed to read obj file: " << file_path;
+      return -1;
+    }
+
+    std::vector<Vertex>& vertices = data->vertices;
+    std::vector<GLuint>& indices = data->indices;
+    vertices.resize(obj.positions.size());
+    indices.resize(obj.corners.size());
+    ParallelFor(vertices.size(), num_threads, [&](int, size_t b, size_t e) {
+      for (size_t i = b; i < e; ++i) {
+        vertices[i].position = obj.positions[i];
+        vertices[i].normal = Vec3(0.0f);
+        vertices[i].texcoord = Vec2(0.0f);
+      }
+    });
+    ParallelFor(indices.size(), num_threads, [&](int, size_t b, size_t e) {
+      for (size_t i = b; i < e; ++i) {
+        indices[i] = static_cast<GLuint>(obj.corners[i].v);
       }
+    });
+
+    VertexCacheStats before;
+    size_t num_input_vertices = vertices.size();
+    if (options.optimize) {
+      before = AnalyzeVertexCache(indices, vertices.size());
+      WeldVertices(&vertices, &indices);
+    }
+    ComputeNormals(indices, num_threads, &vertices, options.normal_weighting);
+    if (options.optimize) {
+      OptimizeVertexCache(&indices, vertices.size());
+      OptimizeOverdraw(vertices, &indices);
+    }
+    if (options.generate_lods) {
+      GenerateLods(vertices, options.optimize, &indices, &data->lods);
+      LOG(INFO) << "Generated " << data->lods.size() << " lods for "
+                << file_path << ": " << data->lods.back().index_count / 3
+                << " triangles, error " << data->lods.back().error
+                << " at the coarsest";
     }
+    if (options.optimize) {
+      // Levels only reference vertices of level 0, which comes first, so
+      // the fetch order follows level 0.
+      OptimizeVertexFetch(&vertices, &indices);
+      std::vector<GLuint> lod0(
+          indices.begin(),
+          indices.begin() + (data->lods.empty() ? indices.size()
+                                                : data->lods[0].index_count));
+      VertexCacheStats after = AnalyzeVertexCache(lod0, vertices.size());
+      LOG(INFO) << "Optimized " << file_path << ": vertices "
+                << num_input_vertices << " -> " << vertices.size()
+                << ", ACMR " << before.acmr << " -> " << after.acmr
+                << ", ATVR " << before.atvr << " -> " << after.atvr;
+    }
+    data->bounds = ComputeBounds(vertices);
+    return 0;
+  }
 
-    for (size_t i = 0; i < indices.size(); i += 3) {
-      Vec3 v1 = vertices[indices[i]].position;
-      Vec3 v2 = vertices[indices[i + 1]].position;
-      Vec3 v3 = vertices[indices[i + 2]].position;
-      Vec3 normal = glm::cross(v2 - v1, v3 - v1);
-      vertices[indices[i]].normal += normal;
-      vertices[indices[i + 1]].normal += normal;
-      vertices[indices[i + 2]].normal += normal;
+  // Appends simplified copies of the level 0 triangles in `indices` and
+  // fills `lods` with level 0 first. Each level is simplified from the
+  // previous one; levels that barely shrink are dropped.
+  static void GenerateLods(const std::vector<Vertex>& vertices,
+                           bool optimize, std::vector<GLuint>* indices,
+                           std::vector<MeshLod>* lods) {
+    static const float kRatios[] = {0.5f, 0.25f, 0.1f};
+    lods->assign(1, MeshLod());
+    (*lods)[0].index_count = static_cast<GLuint>(indices->size());
+    std::vector<GLuint> level(*indices);
+    float error = 0.0f;
+    for (float ratio : kRatios) {
+      size_t target = static_cast<size_t>((*lods)[0].index_count * ratio) /
+                      3 * 3;
+      float level_error = 0.0f;
+      std::vector<GLuint> next =
+          SimplifyMesh(vertices, level, target, &level_error);
+      if (next.empty() || next.size() > level.size() * 9 / 10) break;
+      if (optimize) OptimizeVertexCache(&next, vertices.size());
+      error += level_error;
+      MeshLod lod;
+      lod.index_offset = static_cast<GLuint>(indices->size());
+      lod.index_count = static_cast<GLuint>(next.size());
+      lod.error = error;
+      lods->push_back(lod);
+      indices->insert(indices->end(), next.begin(), next.end());
+      level.swap(next);
     }
-    for (size_t i = 0; i < vertices.size(); ++i) {
-      vertices[i].normal = glm::normalize(vertices[i].normal);
+  }
+
+  static Aabb ComputeBounds(const std::vector<Vertex>& vertices) {
+    Aabb bounds;
+    for (const auto& v : vertices) bounds.Extend(v.position);
+    return bounds;
+  }
+
+  // Sphere around the box center reaching the farthest vertex, which is
+  // never larger than the sphere around the box.
+  static BoundingSphere ComputeBoundingSphere(const Vertex* vertices,
+                                              size_t num_vertices,
+                                              const Aabb& bounds) {
+    BoundingSphere sphere;
+    if (bounds.empty()) return sphere;
+    sphere.center = bounds.center();
+    float radius2 = 0.0f;
+    for (size_t i = 0; i < num_vertices; ++i) {
+      Vec3 d = vertices[i].position - sphere.center;
+      radius2 = std::max(radius2, glm::dot(d, d));
     }
+    sphere.radius = sqrtf(radius2);
+    return sphere;
+  }
 
-    int ret = Init(vertices, indices);
-    return ret;
+  // Smooth vertex normals, computed on a SoA copy of the positions by the
+  // gl_geometry kernels.
+  static void ComputeNormals(
+      const std::vector<GLuint>& indices, int num_threads,
+      std::vector<Vertex>* vertices,
+      NormalWeighting weighting = kNormalWeightArea) {
+    const size_t num_vertices = vertices->size();
+    Vec3Array positions;
+    positions.x.resize(num_vertices);
+    positions.y.resize(num_vertices);
+    positions.z.resize(num_vertices);
+    ParallelFor(num_vertices, num_threads, [&](int, size_t b, size_t e) {
+      for (size_t i = b; i < e; ++i) {
+        const Vec3& p = (*vertices)[i].position;
+        positions.x[i] = p.x;
+        positions.y[i] = p.y;
+        positions.z[i] = p.z;
+      }
+    });
+    Vec3Array normals;
+    ComputeVertexNormals(positions, indices, weighting, num_threads,
+                         &normals);
+    ParallelFor(num_vertices, num_threads, [&](int, size_t b, size_t e) {
+      for (size_t i = b; i < e; ++i) {
+        (*vertices)[i].normal = Vec3(normals.x[i], normals.y[i], normals.z[i]);
+      }
+    });
   }
 
-  int Draw(const Shader* shader) {
+  // Draws level of detail `lod`, clamped to the available levels.
+  int Draw(const Shader* shader, int lod = 0) {
     int ret = shader->Use();
     if (ret != 0) {
       LOG(ERROR) << "Failed to use shader";
@@ -111,13 +343,38 @@ class Mesh {
     }
 
     glBindVertexArray(vao_);
-    glDrawElements(GL_TRIANGLES, (int)indices_.size(), GL_UNSIGNED_INT,
-                   static_cast<void*>(0));
+    DrawElements(lod);
     glBindVertexArray(0);
     RETURN_IF_GL_ERROR(-1, "Failed to draw mesh");
     return 0;
   }
 
+  // Issues the draw call for level `lod` only; the program and vao() must
+  // be bound by the caller.
+  void DrawElements(int lod) const {
+    const MeshLod& range = lod_range(lod);
+    glDrawElements(GL_TRIANGLES, (int)range.index_count, GL_UNSIGNED_INT,
+                   (void*)(range.index_offset * sizeof(GLuint)));
+  }
+
+  // Like DrawElements, for `instances` instances.
+  void DrawElementsInstanced(int lod, GLsizei instances) const {
+    const MeshLod& range = lod_range(lod);
+    glDrawElementsInstanced(GL_TRIANGLES, (int)range.index_count,
+                            GL_UNSIGNED_INT,
+                            (void*)(range.index_offset * sizeof(GLuint)),
+                            instances);
+  }
+
+  // Binds the vertex and index buffers to the currently bound VAO and sets
+  // up attributes 0-2 there, for VAOs that add attributes of their own,
+  // such as per-instance data.
+  void AttachToVertexArray() const {
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+    SetupVertexAttributes();
+  }
+
   void Free() {
     if (vao_) {
       glDeleteVertexArrays(1, &vao_);
@@ -135,9 +392,129 @@ class Mesh {
 
   ~Mesh() { Free(); }
 
+  // Loading until Init or a staged upload finishes, failed if either did.
+  MeshStatus status() const { return status_; }
+  bool ready() const { return status_ == kMeshStatusReady; }
+  void set_status(MeshStatus status) { status_ = status; }
+
+  const std::vector<Vertex>& vertices() const { return vertices_; }
+  // Index ranges of all levels of detail; see lods().
+  const std::vector<GLuint>& indices() const { return indices_; }
+  const Aabb& bounds() const { return bounds_; }
+  const BoundingSphere& bounding_sphere() const { return bounding_sphere_; }
+  // Empty unless built; TriangleHit::triangle counts level 0 triangles.
+  const TriangleBvh& bvh() const { return bvh_; }
+  // Takes over a BVH built from the CPU side data; see BuildBvh.
+  void set_bvh(TriangleBvh* bvh) { std::swap(bvh_, *bvh); }
+  GLuint vao() const { return vao_; }
+  GLuint vbo() const { return vbo_; }
+  GLuint ebo() const { return ebo_; }
+  // Never empty after Init; level 0 is the full mesh.
+  const std::vector<MeshLod>& lods() const { return lods_; }
+
+  // Takes effect on the next Init.
+  VertexFormat vertex_format() const { return vertex_format_; }
+  void set_vertex_format(VertexFormat format) { vertex_format_ = format; }
+
+  // Dequantization for the pos_offset/pos_scale shader uniforms: the
+  // attribute position maps to offset + position * scale. Identity for
+  // float vertices.
+  const Vec3& position_offset() const { return position_offset_; }
+  const Vec3& position_scale() const { return position_scale_; }
+
+  size_t vertex_bytes() const { return vertex_bytes_; }
+  size_t index_bytes() const { return indices_.size() * sizeof(GLuint); }
+
  private:
+  const MeshLod& lod_range(int lod) const {
+    return lods_[std::min(std::max(lod, 0),
+                          static_cast<int>(lods_.size()) - 1)];
+  }
+
+  // Bounds, bounding sphere, level ranges and position dequantization of
+  // the CPU copy.
+  int SetupGeometry(const Aabb& bounds) {
+    bounds_ = bounds;
+    bounding_sphere_ =
+        ComputeBoundingSphere(vertices_.data(), vertices_.size(), bounds);
+    if (lods_.empty()) {
+      lods_.resize(1);
+      lods_[0].index_count = static_cast<GLuint>(indices_.size());
+    }
+    for (const auto& lod : lods_) {
+      if (static_cast<size_t>(lod.index_offset) + lod.index_count >
+          indices_.size()) {
+        LOG(ERROR) << "Mesh lod range out of bounds";
+        return -1;
+      }
+    }
+    if (vertex_format_ == kVertexFormatPacked) {
+      PositionTransform(bounds, &position_offset_, &position_scale_);
+    } else {
+      position_offset_ = Vec3(0.0f);
+      position_scale_ = Vec3(1.0f);
+    }
+    return 0;
+  }
+
+  // Null data leaves the buffers uninitialized.
+  int CreateBuffers(const void* vertex_data, const GLuint* index_data) {
+    glGenVertexArrays(1, &vao_);
+    glGenBuffers(1, &vbo_);
+    glGenBuffers(1, &ebo_);
+
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    vertex_bytes_ = vertices_.size() * (vertex_format_ == kVertexFormatPacked
+                                            ? sizeof(PackedVertex)
+                                            : sizeof(Vertex));
+    glBufferData(GL_ARRAY_BUFFER, vertex_bytes_, vertex_data, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes(), index_data,
+                 GL_STATIC_DRAW);
+
+    SetupVertexAttributes();
+    glBindVertexArray(0);
+
+    RETURN_IF_GL_ERROR(-1, "Failed to upload mesh");
+    return 0;
+  }
+
+  void SetupVertexAttributes() const {
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    if (vertex_format_ == kVertexFormatPacked) {
+      glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                            sizeof(PackedVertex),
+                            (void*)offsetof(PackedVertex, position));
+      glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+                            sizeof(PackedVertex),
+                            (void*)offsetof(PackedVertex, normal));
+      glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE,
+                            sizeof(PackedVertex),
+                            (void*)offsetof(PackedVertex, texcoord));
+    } else {
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                            (void*)offsetof(Vertex, position));
+      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                            (void*)offsetof(Vertex, normal));
+      glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                            (void*)offsetof(Vertex, texcoord));
+    }
+  }
+
   std::vector<Vertex> vertices_;
   std::vector<GLuint> indices_;
+  std::vector<MeshLod> lods_;
+  Aabb bounds_;
+  BoundingSphere bounding_sphere_;
+  TriangleBvh bvh_;
+  MeshStatus status_ = kMeshStatusLoading;
+  VertexFormat vertex_format_ = kVertexFormatFloat;
+  Vec3 position_offset_ = Vec3(0.0f);
+  Vec3 position_scale_ = Vec3(1.0f);
+  size_t vertex_bytes_ = 0;
   GLuint vao_ = 0;
   GLuint vbo_ = 0;
   GLuint ebo_ = 0;
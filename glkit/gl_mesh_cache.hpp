@@ -0,0 +1,241 @@
+#ifndef GLKIT_GL_MESH_CACHE_HPP_
+#define GLKIT_GL_MESH_CACHE_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "gl_base.hpp"
+#include "gl_hash.hpp"
+#include "gl_mapped_file.hpp"
+#include "gl_mesh.hpp"
+
+namespace glkit {
+
+// On-disk layout of a baked mesh: this header, then the Vertex array at
+// vertex_offset and the GLuint index array at index_offset, both exactly as
+// they are passed to glBufferData, and the MeshLod table at lod_offset.
+struct MeshCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t vertex_size;
+  // MeshLoadOptions that change the baked data.
+  uint32_t flags;
+  uint32_t reserved;
+  uint64_t source_size;
+  int64_t source_mtime;
+  uint64_t content_hash;
+  uint64_t num_vertices;
+  uint64_t num_indices;
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+  uint64_t num_lods;
+  uint64_t lod_offset;
+  float bounds_min[3];
+  float bounds_max[3];
+};
+
+// A validated cache file. The arrays point into `file` and stay valid while
+// it is open.
+struct MeshCacheView {
+  MappedFile file;
+  const Vertex* vertices = nullptr;
+  size_t num_vertices = 0;
+  const GLuint* indices = nullptr;
+  size_t num_indices = 0;
+  std::vector<MeshLod> lods;
+  Aabb bounds;
+};
+
+class MeshCache {
+ public:
+  static const uint32_t kVersion = 3;
+  static const uint32_t kFlagOptimized = 1;
+  static const uint32_t kFlagLods = 2;
+  static const uint32_t kFlagAngleWeighted = 4;
+  static const char* Extension() { return ".glkmesh"; }
+
+  // The cache file lives next to the source unless `cache_dir` is given, in
+  // which case the source path hash keeps equally named files apart.
+  static std::string CachePath(const std::string& source_path,
+                               const std::string& cache_dir) {
+    if (cache_dir.empty()) return source_path + Extension();
+    size_t slash = source_path.find_last_of("/\\");
+    std::string base = slash == std::string::npos
+                           ? source_path
+                           : source_path.substr(slash + 1);
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx",
+             static_cast<unsigned long long>(Hash64(source_path)));
+    return cache_dir + "/" + base + "." + hash + Extension();
+  }
+
+  static int StatFile(const std::string& path, uint64_t* size,
+                      int64_t* mtime) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return -1;
+    *size = static_cast<uint64_t>(st.st_size);
+    *mtime = static_cast<int64_t>(st.st_mtime);
+    return 0;
+  }
+
+  static uint32_t Flags(const MeshLoadOptions& options) {
+    return (options.optimize ? kFlagOptimized : 0) |
+           (options.generate_lods ? kFlagLods : 0) |
+           (options.normal_weighting == kNormalWeightAngle ? kFlagAngleWeighted
+                                                           : 0);
+  }
+
+  static int HashFile(const std::string& path, uint64_t* hash) {
+    MappedFile file;
+    if (file.Open(path) != 0) return -1;
+    *hash = Hash64(file.data(), file.size());
+    return 0;
+  }
+
+  // Bakes `data` for `source_path`. Writes to a temporary file first so a
+  // concurrent reader never sees a partial cache.
+  static int Write(const std::string& cache_path,
+                   const std::string& source_path,
+                   const MeshLoadOptions& options, const MeshData& data) {
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic(), sizeof(header.magic));
+    header.version = kVersion;
+    header.vertex_size = sizeof(Vertex);
+    header.flags = Flags(options);
+    if (StatFile(source_path, &header.source_size, &header.source_mtime) !=
+            0 ||
+        HashFile(source_path, &header.content_hash) != 0) {
+      LOG(ERROR) << "Failed to read mesh source: " << source_path;
+      return -1;
+    }
+    header.num_vertices = data.vertices.size();
+    header.num_indices = data.indices.size();
+    header.vertex_offset = Align(sizeof(header));
+    header.index_offset =
+        Align(header.vertex_offset + header.num_vertices * sizeof(Vertex));
+    header.num_lods = data.lods.size();
+    header.lod_offset =
+        Align(header.index_offset + header.num_indices * sizeof(GLuint));
+    for (int i = 0; i < 3; ++i) {
+      header.bounds_min[i] = data.bounds.min[i];
+      header.bounds_max[i] = data.bounds.max[i];
+    }
+
+    std::string tmp_path = cache_path + ".tmp";
+    FILE* f = fopen(tmp_path.c_str(), "wb");
+    if (f == nullptr) {
+      LOG(ERROR) << "Failed to create mesh cache: " << tmp_path;
+      return -1;
+    }
+    static const char kZeros[kAlignment] = {0};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok &&
+         fwrite(kZeros, header.vertex_offset - sizeof(header), 1, f) == 1;
+    ok = ok && fwrite(data.vertices.data(), sizeof(Vertex),
+                      data.vertices.size(), f) == data.vertices.size();
+    size_t pad = header.index_offset - header.vertex_offset -
+                 header.num_vertices * sizeof(Vertex);
+    ok = ok && (pad == 0 || fwrite(kZeros, pad, 1, f) == 1);
+    ok = ok && fwrite(data.indices.data(), sizeof(GLuint), data.indices.size(),
+                      f) == data.indices.size();
+    pad = header.lod_offset - header.index_offset -
+          header.num_indices * sizeof(GLuint);
+    ok = ok && (pad == 0 || fwrite(kZeros, pad, 1, f) == 1);
+    ok = ok && fwrite(data.lods.data(), sizeof(MeshLod), data.lods.size(),
+                      f) == data.lods.size();
+    ok = (fclose(f) == 0) && ok;
+    remove(cache_path.c_str());
+    if (!ok || rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+      LOG(ERROR) << "Failed to write mesh cache: " << cache_path;
+      remove(tmp_path.c_str());
+      return -1;
+    }
+    return 0;
+  }
+
+  // Maps `cache_path` and checks it against `source_path`. A cache is fresh
+  // when the source size and mtime match, or, if only the mtime changed
+  // (e.g. after a checkout), when the source content hash still matches, and
+  // when it was baked with the same options.
+  // Returns -1 without logging an error when the cache is missing or stale.
+  static int Open(const std::string& cache_path,
+                  const std::string& source_path,
+                  const MeshLoadOptions& options, MeshCacheView* view) {
+    uint64_t cache_size = 0, source_size = 0;
+    int64_t cache_mtime = 0, source_mtime = 0;
+    if (StatFile(cache_path, &cache_size, &cache_mtime) != 0) return -1;
+    if (StatFile(source_path, &source_size, &source_mtime) != 0) return -1;
+    if (view->file.Open(cache_path) != 0) return -1;
+    const char* base = view->file.data();
+    const size_t size = view->file.size();
+    MeshCacheHeader header;
+    if (size < sizeof(header)) return Reject(view, cache_path, "truncated");
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, Magic(), sizeof(header.magic)) != 0 ||
+        header.version != kVersion || header.vertex_size != sizeof(Vertex)) {
+      return Reject(view, cache_path, "incompatible format");
+    }
+    // Counts are checked against the space after their offset, so that a
+    // corrupt count cannot wrap the end of its array around.
+    if (header.vertex_offset % kAlignment != 0 ||
+        header.index_offset % kAlignment != 0 ||
+        header.lod_offset % kAlignment != 0 ||
+        header.vertex_offset > header.index_offset ||
+        header.index_offset > header.lod_offset || header.lod_offset > size ||
+        header.num_vertices >
+            (header.index_offset - header.vertex_offset) / sizeof(Vertex) ||
+        header.num_indices >
+            (header.lod_offset - header.index_offset) / sizeof(GLuint) ||
+        header.num_lods > (size - header.lod_offset) / sizeof(MeshLod)) {
+      return Reject(view, cache_path, "truncated");
+    }
+    if (header.flags != Flags(options) ||
+        header.source_size != source_size) {
+      return Reject(view, cache_path, "stale");
+    }
+    if (header.source_mtime != source_mtime) {
+      uint64_t hash = 0;
+      if (HashFile(source_path, &hash) != 0 || hash != header.content_hash) {
+        return Reject(view, cache_path, "stale");
+      }
+    }
+    view->vertices =
+        reinterpret_cast<const Vertex*>(base + header.vertex_offset);
+    view->num_vertices = header.num_vertices;
+    view->indices =
+        reinterpret_cast<const GLuint*>(base + header.index_offset);
+    view->num_indices = header.num_indices;
+    const MeshLod* lods =
+        reinterpret_cast<const MeshLod*>(base + header.lod_offset);
+    view->lods.assign(lods, lods + header.num_lods);
+    for (int i = 0; i < 3; ++i) {
+      view->bounds.min[i] = header.bounds_min[i];
+      view->bounds.max[i] = header.bounds_max[i];
+    }
+    return 0;
+  }
+
+ private:
+  static const size_t kAlignment = 64;
+  static const char* Magic() { return "GLKMESH"; }
+
+  static uint64_t Align(uint64_t offset) {
+    return (offset + kAlignment - 1) / kAlignment * kAlignment;
+  }
+
+  static int Reject(MeshCacheView* view, const std::string& cache_path,
+                    const char* reason) {
+    LOG(INFO) << "Ignoring " << reason << " mesh cache: " << cache_path;
+    view->file.Close();
+    return -1;
+  }
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_MESH_CACHE_HPP_
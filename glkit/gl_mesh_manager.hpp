@@ -1,18 +1,29 @@
 #ifndef GLKIT_GL_MESH_MANAGER_HPP_
 #define GLKIT_GL_MESH_MANAGER_HPP_
 
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "gl_mesh.hpp"
+#include "gl_mesh_cache.hpp"
+#include "gl_thread_pool.hpp"
 
 namespace glkit {
 
 class MeshManager {
  public:
   MeshManager() = default;
-  ~MeshManager() = default;
+  ~MeshManager() {
+    // Workers may still write to their jobs.
+    pool_.Stop();
+    if (staging_) glDeleteBuffers(1, &staging_);
+  }
 
   Mesh* GetMesh(const std::string& name) {
     auto it = meshes_.find(name);
@@ -22,7 +33,12 @@ class MeshManager {
     return it->second;
   }
 
-  Mesh* AddMeshFromObjFile(const std::string& name, const std::string& file) {
+  // Loads an OBJ file, going through the binary mesh cache when it is
+  // enabled: a fresh cache is mapped and uploaded directly, otherwise the OBJ
+  // is parsed and the cache is (re)written.
+  Mesh* AddMeshFromObjFile(
+      const std::string& name, const std::string& file,
+      const MeshLoadOptions& options = MeshLoadOptions()) {
     auto it = meshes_.find(name);
     if (it != meshes_.end()) {
       LOG(WARN) << "Mesh already exists: " << name;
@@ -30,7 +46,7 @@ class MeshManager {
     }
     mesh_pool_.emplace_back(new Mesh());
     Mesh* mesh = mesh_pool_.back().get();
-    if (mesh->InitFromObjFile(file) != 0) {
+    if (LoadObjFile(file, options, mesh) != 0) {
       mesh_pool_.pop_back();
       LOG(ERROR) << "Failed to add mesh: " << name;
       return nullptr;
@@ -39,6 +55,73 @@ class MeshManager {
     return mesh;
   }
 
+  // Returns right away with a mesh in the loading state; reading, cache
+  // lookup, processing and the BVH build run on the worker threads, and
+  // Update uploads the result on the GL thread. The mesh ends up ready or
+  // failed and stays registered under `name` either way.
+  Mesh* LoadMeshAsync(const std::string& name, const std::string& file,
+                      const MeshLoadOptions& options = MeshLoadOptions()) {
+    auto it = meshes_.find(name);
+    if (it != meshes_.end()) {
+      LOG(WARN) << "Mesh already exists: " << name;
+      return it->second;
+    }
+    mesh_pool_.emplace_back(new Mesh());
+    Mesh* mesh = mesh_pool_.back().get();
+    meshes_[name] = mesh;
+    LoadJob* job = new LoadJob();
+    jobs_.emplace_back(job);
+    job->mesh = mesh;
+    job->file = file;
+    job->options = options;
+    if (use_cache_) job->cache_path = MeshCache::CachePath(file, cache_dir_);
+    if (!pool_.started()) pool_.Start(load_threads_);
+    pool_.Post([job] { RunJob(job); });
+    return mesh;
+  }
+
+  // Call once per frame on the GL thread. Hands meshes whose worker is done
+  // their buffers, then copies up to upload_budget() bytes into them
+  // through a staging buffer, oldest request first, so streaming never
+  // stalls a frame for long. `num_finished`, if given, receives the number
+  // of meshes that became ready or failed; their bounds changed.
+  int Update(size_t* num_finished = nullptr) {
+    size_t finished = 0;
+    for (auto& job : jobs_) {
+      if (job->state != kJobParsed && job->state != kJobFailed) continue;
+      if (job->state == kJobParsed) {
+        job->mesh->set_vertex_format(job->options.vertex_format);
+        if (job->mesh->Allocate(&job->data) == 0) {
+          job->mesh->set_bvh(&job->bvh);
+          job->state = kJobUploading;
+          continue;
+        }
+      }
+      LOG(ERROR) << "Failed to load mesh: " << job->file;
+      job->mesh->set_status(kMeshStatusFailed);
+      job->state = kJobDone;
+      ++finished;
+    }
+
+    upload_bytes_ = 0;
+    if (UploadStaged() != 0) return -1;
+    for (auto& job : jobs_) {
+      if (job->state != kJobUploading || job->uploaded < job->total()) {
+        continue;
+      }
+      job->mesh->set_status(kMeshStatusReady);
+      job->state = kJobDone;
+      ++finished;
+    }
+    jobs_.erase(std::remove_if(jobs_.begin(), jobs_.end(),
+                               [](const std::unique_ptr<LoadJob>& job) {
+                                 return job->state == kJobDone;
+                               }),
+                jobs_.end());
+    if (num_finished) *num_finished = finished;
+    return 0;
+  }
+
   Mesh* AddMesh(const std::string& name, const std::vector<Vertex>& vertices,
                 const std::vector<GLuint>& indices) {
     auto it = meshes_.find(name);
@@ -57,12 +140,235 @@ class MeshManager {
     return mesh;
   }
 
+  // Vertex and index buffer bytes of all meshes.
+  size_t gpu_bytes() const {
+    size_t bytes = 0;
+    for (const auto& mesh : mesh_pool_) {
+      bytes += mesh->vertex_bytes() + mesh->index_bytes();
+    }
+    return bytes;
+  }
+
+  // Meshes requested with LoadMeshAsync that are not ready or failed yet.
+  size_t loading() const { return jobs_.size(); }
+  // Bytes copied into mesh buffers by the last Update.
+  size_t upload_bytes() const { return upload_bytes_; }
+
+  // Most bytes one Update copies into mesh buffers, which is also the size
+  // of the staging buffer.
+  size_t upload_budget() const { return upload_budget_; }
+  void set_upload_budget(size_t bytes) {
+    upload_budget_ = std::max(bytes, static_cast<size_t>(1));
+  }
+
+  // Worker threads of LoadMeshAsync, taking effect when the first load
+  // starts them. Values <= 0 use all hardware threads.
+  int load_threads() const { return load_threads_; }
+  void set_load_threads(int num_threads) { load_threads_ = num_threads; }
+
+  bool use_cache() const { return use_cache_; }
+  void set_use_cache(bool use_cache) { use_cache_ = use_cache; }
+
+  // Empty means cache files are written next to their OBJ files.
+  const std::string& cache_dir() const { return cache_dir_; }
+  void set_cache_dir(const std::string& cache_dir) { cache_dir_ = cache_dir; }
+
  private:
   MeshManager(const MeshManager&) = delete;
   MeshManager& operator=(const MeshManager&) = delete;
 
+  int LoadObjFile(const std::string& file, const MeshLoadOptions& options,
+                  Mesh* mesh) {
+    if (!use_cache_) return mesh->InitFromObjFile(file, options);
+
+    mesh->set_vertex_format(options.vertex_format);
+    const std::string cache_path = MeshCache::CachePath(file, cache_dir_);
+    MeshCacheView view;
+    if (MeshCache::Open(cache_path, file, options, &view) == 0) {
+      if (mesh->Init(view.vertices, view.num_vertices, view.indices,
+                     view.num_indices, view.bounds, view.lods) != 0) {
+        return -1;
+      }
+    } else {
+      MeshData data;
+      if (Mesh::LoadObjFile(file, options, &data) != 0) return -1;
+      if (MeshCache::Write(cache_path, file, options, data) != 0) {
+        LOG(WARN) << "Failed to cache mesh: " << file;
+      }
+      if (mesh->Init(data) != 0) return -1;
+    }
+    // The triangle BVH is not part of the cache and is built on every load.
+    if (options.build_bvh) return mesh->BuildBvh(options.num_threads);
+    return 0;
+  }
+
+  enum JobState {
+    // Owned by a worker until it moves on.
+    kJobQueued = 0,
+    kJobParsed = 1,
+    kJobFailed = 2,
+    kJobUploading = 3,
+    kJobDone = 4,
+  };
+
+  // One LoadMeshAsync request. The worker fills the CPU side and publishes
+  // it through `state`; everything else belongs to the GL thread.
+  struct LoadJob {
+    Mesh* mesh = nullptr;
+    std::string file;
+    MeshLoadOptions options;
+    // Empty when the cache is off.
+    std::string cache_path;
+    MeshData data;
+    // Vertex buffer contents for kVertexFormatPacked.
+    std::vector<PackedVertex> packed;
+    TriangleBvh bvh;
+    std::atomic<int> state{kJobQueued};
+    // Bytes of the vertex buffer, then the index buffer, copied so far.
+    size_t uploaded = 0;
+
+    size_t total() const {
+      return mesh->vertex_bytes() + mesh->index_bytes();
+    }
+  };
+
+  // A staging buffer range waiting for glCopyBufferSubData.
+  struct StagedCopy {
+    GLuint buffer;
+    size_t src_offset;
+    size_t dst_offset;
+    size_t size;
+  };
+
+  static void RunJob(LoadJob* job) {
+    MeshData& data = job->data;
+    int ret = ReadMesh(job->file, job->options, job->cache_path, &data);
+    if (ret == 0 && job->options.vertex_format == kVertexFormatPacked) {
+      // Same transform as Mesh::Allocate derives from the bounds.
+      Vec3 offset, scale;
+      Mesh::PositionTransform(data.bounds, &offset, &scale);
+      job->packed.resize(data.vertices.size());
+      Mesh::PackVertices(data.vertices.data(), data.vertices.size(), offset,
+                         scale, job->packed.data());
+    }
+    if (ret == 0 && job->options.build_bvh) {
+      ret = Mesh::BuildBvh(data.vertices, data.indices, data.lods,
+                           job->options.num_threads, &job->bvh);
+    }
+    job->state.store(ret == 0 ? kJobParsed : kJobFailed);
+  }
+
+  // The CPU side of LoadObjFile.
+  static int ReadMesh(const std::string& file, const MeshLoadOptions& options,
+                      const std::string& cache_path, MeshData* data) {
+    MeshCacheView view;
+    if (!cache_path.empty() &&
+        MeshCache::Open(cache_path, file, options, &view) == 0) {
+      data->vertices.assign(view.vertices, view.vertices + view.num_vertices);
+      data->indices.assign(view.indices, view.indices + view.num_indices);
+      data->lods = view.lods;
+      data->bounds = view.bounds;
+      return 0;
+    }
+    if (Mesh::LoadObjFile(file, options, data) != 0) return -1;
+    if (!cache_path.empty() &&
+        MeshCache::Write(cache_path, file, options, *data) != 0) {
+      LOG(WARN) << "Failed to cache mesh: " << file;
+    }
+    return 0;
+  }
+
+  // Fills the staging buffer from the uploading jobs and copies it into
+  // their buffers. The whole staging buffer is invalidated on every map, so
+  // the driver can hand out fresh memory instead of waiting for the copies
+  // of the previous frame.
+  int UploadStaged() {
+    if (staging_ && staging_size_ != upload_budget_) {
+      glDeleteBuffers(1, &staging_);
+      staging_ = 0;
+    }
+    uint8_t* mapped = nullptr;
+    copies_.clear();
+    for (auto& job : jobs_) {
+      if (job->state != kJobUploading) continue;
+      const Mesh* mesh = job->mesh;
+      const size_t vertex_bytes = mesh->vertex_bytes();
+      while (job->uploaded < job->total() && upload_bytes_ < upload_budget_) {
+        if (!mapped) {
+          mapped = MapStaging();
+          if (!mapped) return -1;
+        }
+        StagedCopy copy;
+        const uint8_t* src;
+        size_t available;
+        if (job->uploaded < vertex_bytes) {
+          copy.buffer = mesh->vbo();
+          copy.dst_offset = job->uploaded;
+          available = vertex_bytes - job->uploaded;
+          src = job->packed.empty()
+                    ? reinterpret_cast<const uint8_t*>(mesh->vertices().data())
+                    : reinterpret_cast<const uint8_t*>(job->packed.data());
+        } else {
+          copy.buffer = mesh->ebo();
+          copy.dst_offset = job->uploaded - vertex_bytes;
+          available = mesh->index_bytes() - copy.dst_offset;
+          src = reinterpret_cast<const uint8_t*>(mesh->indices().data());
+        }
+        copy.src_offset = upload_bytes_;
+        copy.size = std::min(available, upload_budget_ - upload_bytes_);
+        memcpy(mapped + copy.src_offset, src + copy.dst_offset, copy.size);
+        copies_.push_back(copy);
+        upload_bytes_ += copy.size;
+        job->uploaded += copy.size;
+      }
+      // The CPU copies of the mesh stay; only the packed array was extra.
+      if (job->uploaded == job->total()) {
+        std::vector<PackedVertex>().swap(job->packed);
+      }
+    }
+    if (!mapped) return 0;
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+    for (const auto& copy : copies_) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, copy.buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                          copy.src_offset, copy.dst_offset, copy.size);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    RETURN_IF_GL_ERROR(-1, "Failed to upload staged meshes");
+    return 0;
+  }
+
+  // Leaves the staging buffer bound to GL_COPY_READ_BUFFER.
+  uint8_t* MapStaging() {
+    if (!staging_) {
+      glGenBuffers(1, &staging_);
+      glBindBuffer(GL_COPY_READ_BUFFER, staging_);
+      glBufferData(GL_COPY_READ_BUFFER, upload_budget_, nullptr,
+                   GL_STREAM_DRAW);
+      staging_size_ = upload_budget_;
+    } else {
+      glBindBuffer(GL_COPY_READ_BUFFER, staging_);
+    }
+    void* mapped = glMapBufferRange(
+        GL_COPY_READ_BUFFER, 0, staging_size_,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!mapped) LOG(ERROR) << "Failed to map mesh staging buffer";
+    return static_cast<uint8_t*>(mapped);
+  }
+
+  bool use_cache_ = true;
+  std::string cache_dir_;
   std::map<std::string, Mesh*> meshes_;
   std::vector<std::unique_ptr<Mesh>> mesh_pool_;
+  std::vector<std::unique_ptr<LoadJob>> jobs_;
+  std::vector<StagedCopy> copies_;
+  size_t upload_budget_ = 1 << 20;
+  size_t upload_bytes_ = 0;
+  size_t staging_size_ = 0;
+  GLuint staging_ = 0;
+  int load_threads_ = 2;
+  ThreadPool pool_;
 };
 }  // namespace glkit
 
@@ -0,0 +1,302 @@
+#ifndef GLKIT_GL_MESH_OPTIMIZER_HPP_
+#define GLKIT_GL_MESH_OPTIMIZER_HPP_
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "gl_base.hpp"
+#include "gl_hash.hpp"
+
+// Index and vertex buffer reordering for indexed triangle lists. The vertex
+// type only needs a Vec3 `position` member and must be trivially copyable.
+
+namespace glkit {
+
+struct VertexCacheStats {
+  // Average cache miss ratio: transformed vertices per triangle (0.5..3).
+  float acmr = 0.0f;
+  // Average transform to vertex ratio: transformed / referenced vertices
+  // (1.0 is optimal).
+  float atvr = 0.0f;
+};
+
+// Simulates a FIFO post-transform cache of `cache_size` entries.
+inline VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices,
+                                           size_t num_vertices,
+                                           int cache_size = 16) {
+  VertexCacheStats stats;
+  if (indices.empty()) return stats;
+  // A vertex is in the cache while fewer than cache_size misses happened
+  // since it was loaded.
+  std::vector<size_t> loaded_at(num_vertices, 0);
+  std::vector<char> referenced(num_vertices, 0);
+  size_t misses = 0;
+  size_t unique = 0;
+  for (GLuint index : indices) {
+    if (!referenced[index]) {
+      referenced[index] = 1;
+      ++unique;
+    }
+    if (loaded_at[index] == 0 ||
+        misses - loaded_at[index] >= static_cast<size_t>(cache_size)) {
+      ++misses;
+      loaded_at[index] = misses;
+    }
+  }
+  stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+  stats.atvr = static_cast<float>(misses) / unique;
+  return stats;
+}
+
+// Merges bitwise identical vertices and rewrites the indices. Returns the
+// number of vertices left.
+template <typename V>
+size_t WeldVertices(std::vector<V>* vertices, std::vector<GLuint>* indices) {
+  struct Hasher {
+    size_t operator()(const V& v) const {
+      return static_cast<size_t>(Hash64(&v, sizeof(V)));
+    }
+  };
+  struct Equal {
+    bool operator()(const V& a, const V& b) const {
+      return memcmp(&a, &b, sizeof(V)) == 0;
+    }
+  };
+  std::unordered_map<V, GLuint, Hasher, Equal> unique;
+  unique.reserve(vertices->size());
+  std::vector<GLuint> remap(vertices->size());
+  size_t count = 0;
+  for (size_t i = 0; i < vertices->size(); ++i) {
+    auto it = unique.insert(
+        std::make_pair((*vertices)[i], static_cast<GLuint>(count)));
+    if (it.second) (*vertices)[count++] = (*vertices)[i];
+    remap[i] = it.first->second;
+  }
+  vertices->resize(count);
+  for (auto& index : *indices) index = remap[index];
+  return count;
+}
+
+// Reorders triangles for post-transform cache locality with Tom Forsyth's
+// "Linear-Speed Vertex Cache Optimisation", using a simulated LRU cache of
+// 32 entries.
+inline void OptimizeVertexCache(std::vector<GLuint>* indices,
+                                size_t num_vertices) {
+  const int kCacheSize = 32;
+  const int kMaxValence = 32;
+  const size_t num_triangles = indices->size() / 3;
+  if (num_triangles == 0) return;
+  const GLuint* tri = indices->data();
+
+  float cache_score[kCacheSize];
+  for (int i = 0; i < kCacheSize; ++i) {
+    cache_score[i] =
+        i < 3 ? 0.75f
+              : powf(1.0f - static_cast<float>(i - 3) / (kCacheSize - 3), 1.5f);
+  }
+  float valence_score[kMaxValence + 1];
+  valence_score[0] = 0.0f;
+  for (int i = 1; i <= kMaxValence; ++i) {
+    valence_score[i] = 2.0f / sqrtf(static_cast<float>(i));
+  }
+
+  // Vertex -> triangle adjacency in CSR form. The first `valence[v]`
+  // entries of each range are the triangles not emitted yet.
+  std::vector<GLuint> offsets(num_vertices + 1, 0);
+  std::vector<GLuint> valence(num_vertices, 0);
+  for (size_t i = 0; i < num_triangles * 3; ++i) ++valence[tri[i]];
+  for (size_t v = 0; v < num_vertices; ++v) {
+    offsets[v + 1] = offsets[v] + valence[v];
+  }
+  std::vector<GLuint> adjacency(num_triangles * 3);
+  {
+    std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < num_triangles * 3; ++i) {
+      adjacency[fill[tri[i]]++] = static_cast<GLuint>(i / 3);
+    }
+  }
+
+  std::vector<int> cache_pos(num_vertices, -1);
+  std::vector<float> vertex_score(num_vertices);
+  auto score = [&](size_t v) {
+    if (valence[v] == 0) return -1.0f;
+    float s = valence_score[std::min<GLuint>(valence[v], kMaxValence)];
+    if (cache_pos[v] >= 0) s += cache_score[cache_pos[v]];
+    return s;
+  };
+  for (size_t v = 0; v < num_vertices; ++v) vertex_score[v] = score(v);
+
+  std::vector<char> emitted(num_triangles, 0);
+
+  std::vector<GLuint> output;
+  output.reserve(num_triangles * 3);
+  GLuint cache[kCacheSize + 3];
+  int cache_count = 0;
+  size_t input_cursor = 0;
+  long best = 0;
+
+  while (output.size() < num_triangles * 3) {
+    if (best < 0) {
+      // Nothing adjacent to the cache; continue in input order.
+      while (emitted[input_cursor]) ++input_cursor;
+      best = static_cast<long>(input_cursor);
+    }
+    const size_t t = static_cast<size_t>(best);
+    emitted[t] = 1;
+
+    GLuint new_cache[kCacheSize + 3];
+    int new_count = 0;
+    for (int k = 0; k < 3; ++k) {
+      const GLuint v = tri[t * 3 + k];
+      output.push_back(v);
+      if (std::find(new_cache, new_cache + new_count, v) ==
+          new_cache + new_count) {
+        new_cache[new_count++] = v;
+      }
+      // Drop t from the live part of v's adjacency range.
+      GLuint* adj = &adjacency[offsets[v]];
+      for (GLuint j = 0; j < valence[v]; ++j) {
+        if (adj[j] == t) {
+          std::swap(adj[j], adj[valence[v] - 1]);
+          break;
+        }
+      }
+      --valence[v];
+    }
+    for (int i = 0; i < cache_count; ++i) {
+      const GLuint v = cache[i];
+      if (v != tri[t * 3] && v != tri[t * 3 + 1] && v != tri[t * 3 + 2]) {
+        new_cache[new_count++] = v;
+      }
+    }
+    for (int i = 0; i < new_count; ++i) {
+      const GLuint v = new_cache[i];
+      cache_pos[v] = i < kCacheSize ? i : -1;
+      vertex_score[v] = score(v);
+    }
+
+    // Rescore the triangles around every vertex whose score changed and
+    // pick the best one as the next triangle.
+    best = -1;
+    float best_score = 0.0f;
+    for (int i = 0; i < new_count; ++i) {
+      const GLuint v = new_cache[i];
+      const GLuint* adj = &adjacency[offsets[v]];
+      for (GLuint j = 0; j < valence[v]; ++j) {
+        const GLuint a = adj[j];
+        float s = vertex_score[tri[a * 3]] + vertex_score[tri[a * 3 + 1]] +
+                  vertex_score[tri[a * 3 + 2]];
+        if (s > best_score) {
+          best_score = s;
+          best = a;
+        }
+      }
+    }
+    cache_count = std::min(new_count, kCacheSize);
+    std::copy(new_cache, new_cache + cache_count, cache);
+  }
+  indices->swap(output);
+}
+
+// Reorders the clusters produced by OptimizeVertexCache to reduce overdraw,
+// following the Tipsify idea: the triangle order is cut wherever the
+// simulated FIFO cache of `cache_size` misses on all three vertices, so
+// clusters can move without hurting cache hit rates. Clusters are then
+// sorted so the ones facing away from the mesh center, which tend to occlude
+// the rest from most view points, are drawn first.
+template <typename V>
+void OptimizeOverdraw(const std::vector<V>& vertices,
+                      std::vector<GLuint>* indices, int cache_size = 16) {
+  const size_t num_triangles = indices->size() / 3;
+  if (num_triangles == 0) return;
+  const GLuint* tri = indices->data();
+
+  std::vector<size_t> cluster_begin;
+  std::vector<size_t> loaded_at(vertices.size(), 0);
+  size_t misses = 0;
+  for (size_t t = 0; t < num_triangles; ++t) {
+    int tri_misses = 0;
+    for (int k = 0; k < 3; ++k) {
+      const GLuint v = tri[t * 3 + k];
+      if (loaded_at[v] == 0 ||
+          misses - loaded_at[v] >= static_cast<size_t>(cache_size)) {
+        loaded_at[v] = ++misses;
+        ++tri_misses;
+      }
+    }
+    if (t == 0 || tri_misses == 3) cluster_begin.push_back(t);
+  }
+  cluster_begin.push_back(num_triangles);
+  const size_t num_clusters = cluster_begin.size() - 1;
+  if (num_clusters < 2) return;
+
+  Vec3 mesh_center(0.0f);
+  float mesh_area = 0.0f;
+  std::vector<Vec3> cluster_center(num_clusters, Vec3(0.0f));
+  std::vector<Vec3> cluster_normal(num_clusters, Vec3(0.0f));
+  for (size_t c = 0; c < num_clusters; ++c) {
+    float cluster_area = 0.0f;
+    for (size_t t = cluster_begin[c]; t < cluster_begin[c + 1]; ++t) {
+      const Vec3& p0 = vertices[tri[t * 3]].position;
+      const Vec3& p1 = vertices[tri[t * 3 + 1]].position;
+      const Vec3& p2 = vertices[tri[t * 3 + 2]].position;
+      Vec3 n = glm::cross(p1 - p0, p2 - p0);
+      float area = glm::length(n);
+      Vec3 center = (p0 + p1 + p2) * (area / 3.0f);
+      cluster_center[c] += center;
+      cluster_normal[c] += n;
+      cluster_area += area;
+      mesh_center += center;
+      mesh_area += area;
+    }
+    if (cluster_area > 0.0f) cluster_center[c] /= cluster_area;
+  }
+  if (mesh_area > 0.0f) mesh_center /= mesh_area;
+
+  std::vector<float> key(num_clusters);
+  for (size_t c = 0; c < num_clusters; ++c) {
+    float len = glm::length(cluster_normal[c]);
+    key[c] = len > 0.0f ? glm::dot(cluster_center[c] - mesh_center,
+                                   cluster_normal[c] / len)
+                        : 0.0f;
+  }
+  std::vector<size_t> order(num_clusters);
+  for (size_t c = 0; c < num_clusters; ++c) order[c] = c;
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return key[a] > key[b]; });
+
+  std::vector<GLuint> output;
+  output.reserve(indices->size());
+  for (size_t c : order) {
+    output.insert(output.end(), tri + cluster_begin[c] * 3,
+                  tri + cluster_begin[c + 1] * 3);
+  }
+  indices->swap(output);
+}
+
+// Reorders vertices into the order the index buffer first references them
+// and drops unreferenced ones. Returns the number of vertices left.
+template <typename V>
+size_t OptimizeVertexFetch(std::vector<V>* vertices,
+                           std::vector<GLuint>* indices) {
+  const GLuint kUnused = ~0u;
+  std::vector<GLuint> remap(vertices->size(), kUnused);
+  std::vector<V> output;
+  output.reserve(vertices->size());
+  for (auto& index : *indices) {
+    if (remap[index] == kUnused) {
+      remap[index] = static_cast<GLuint>(output.size());
+      output.push_back((*vertices)[index]);
+    }
+    index = remap[index];
+  }
+  vertices->swap(output);
+  return vertices->size();
+}
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_MESH_OPTIMIZER_HPP_
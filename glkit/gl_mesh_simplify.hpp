@@ -0,0 +1,209 @@
+#ifndef GLKIT_GL_MESH_SIMPLIFY_HPP_
+#define GLKIT_GL_MESH_SIMPLIFY_HPP_
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "gl_base.hpp"
+
+namespace glkit {
+
+// Symmetric 4x4 error quadric (Garland & Heckbert), upper triangle only,
+// with the total weight of the accumulated planes.
+struct Quadric {
+  double a[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  double weight = 0.0;
+
+  // Plane n.p + d = 0 with unit n.
+  static Quadric FromPlane(const Vec3& n, float d, float weight) {
+    Quadric q;
+    q.a[0] = n.x * n.x;
+    q.a[1] = n.x * n.y;
+    q.a[2] = n.x * n.z;
+    q.a[3] = n.x * d;
+    q.a[4] = n.y * n.y;
+    q.a[5] = n.y * n.z;
+    q.a[6] = n.y * d;
+    q.a[7] = n.z * n.z;
+    q.a[8] = n.z * d;
+    q.a[9] = static_cast<double>(d) * d;
+    for (int i = 0; i < 10; ++i) q.a[i] *= weight;
+    q.weight = weight;
+    return q;
+  }
+
+  void Add(const Quadric& other) {
+    for (int i = 0; i < 10; ++i) a[i] += other.a[i];
+    weight += other.weight;
+  }
+
+  // Weighted mean squared distance from p to the accumulated planes.
+  double Evaluate(const Vec3& p) const {
+    if (weight <= 0.0) return 0.0;
+    const double x = p.x, y = p.y, z = p.z;
+    double e = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z +
+               2 * a[3] * x + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y +
+               a[7] * z * z + 2 * a[8] * z + a[9];
+    return e > 0.0 ? e / weight : 0.0;
+  }
+};
+
+// Reduces an indexed triangle list to about `target_index_count` indices by
+// quadric error edge collapse. Vertices are never moved or created, edges
+// collapse onto one of their endpoints, so the result indexes the same
+// vertex buffer as the input. Open boundary vertices are kept in place and
+// collapses that would flip a triangle are rejected, so the target may not
+// be reached. `error` receives the largest collapse error, the root of the
+// area weighted mean squared distance to the original faces, in mesh units.
+template <typename V>
+std::vector<GLuint> SimplifyMesh(const std::vector<V>& vertices,
+                                 const std::vector<GLuint>& indices,
+                                 size_t target_index_count, float* error) {
+  const size_t num_vertices = vertices.size();
+  std::vector<GLuint> tris(indices);
+  double max_cost = 0.0;
+  if (error) *error = 0.0f;
+  if (tris.size() <= target_index_count) return tris;
+
+  auto pos = [&](GLuint v) -> const Vec3& { return vertices[v].position; };
+
+  std::vector<Quadric> quadrics(num_vertices);
+  for (size_t i = 0; i + 2 < tris.size(); i += 3) {
+    const Vec3& p0 = pos(tris[i]);
+    Vec3 n = glm::cross(pos(tris[i + 1]) - p0, pos(tris[i + 2]) - p0);
+    float len = glm::length(n);
+    if (len <= 0.0f) continue;
+    n /= len;
+    // Area weighted, so large faces hold their shape over slivers.
+    Quadric q = Quadric::FromPlane(n, -glm::dot(n, p0), len);
+    for (int k = 0; k < 3; ++k) quadrics[tris[i + k]].Add(q);
+  }
+
+  // Undirected edges as (min << 32 | max), shared by sorting.
+  auto collect_edges = [&](std::vector<uint64_t>* edges) {
+    edges->clear();
+    edges->reserve(tris.size());
+    for (size_t i = 0; i < tris.size(); i += 3) {
+      for (int k = 0; k < 3; ++k) {
+        uint64_t a = tris[i + k], b = tris[i + (k + 1) % 3];
+        edges->push_back(a < b ? (a << 32 | b) : (b << 32 | a));
+      }
+    }
+    std::sort(edges->begin(), edges->end());
+  };
+
+  // Vertices on an edge used by a single triangle stay where they are.
+  std::vector<uint64_t> edges;
+  std::vector<char> locked(num_vertices, 0);
+  collect_edges(&edges);
+  for (size_t i = 0; i < edges.size();) {
+    size_t j = i + 1;
+    while (j < edges.size() && edges[j] == edges[i]) ++j;
+    if (j - i == 1) {
+      locked[edges[i] >> 32] = 1;
+      locked[edges[i] & 0xFFFFFFFFu] = 1;
+    }
+    i = j;
+  }
+
+  struct Collapse {
+    double cost;
+    GLuint from;
+    GLuint to;
+    bool operator<(const Collapse& o) const { return cost < o.cost; }
+  };
+  std::vector<GLuint> remap(num_vertices);
+  std::vector<char> touched(num_vertices);
+  std::vector<GLuint> offsets(num_vertices + 1);
+  std::vector<GLuint> adjacency;
+  std::vector<Collapse> collapses;
+
+  const int kMaxPasses = 32;
+  for (int pass = 0; pass < kMaxPasses && tris.size() > target_index_count;
+       ++pass) {
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    collapses.clear();
+    for (uint64_t e : edges) {
+      GLuint a = static_cast<GLuint>(e >> 32);
+      GLuint b = static_cast<GLuint>(e & 0xFFFFFFFFu);
+      Quadric q = quadrics[a];
+      q.Add(quadrics[b]);
+      Collapse c = {-1.0, a, b};
+      if (!locked[a]) c.cost = q.Evaluate(pos(b));
+      if (!locked[b]) {
+        double cost = q.Evaluate(pos(a));
+        if (c.cost < 0.0 || cost < c.cost) c = Collapse{cost, b, a};
+      }
+      if (c.cost >= 0.0) collapses.push_back(c);
+    }
+    std::sort(collapses.begin(), collapses.end());
+
+    // Vertex -> triangle adjacency of the current triangles.
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (GLuint v : tris) ++offsets[v + 1];
+    for (size_t v = 0; v < num_vertices; ++v) offsets[v + 1] += offsets[v];
+    adjacency.resize(tris.size());
+    {
+      std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+      for (size_t i = 0; i < tris.size(); ++i) {
+        adjacency[fill[tris[i]]++] = static_cast<GLuint>(i / 3);
+      }
+    }
+
+    for (size_t v = 0; v < num_vertices; ++v) remap[v] = static_cast<GLuint>(v);
+    std::fill(touched.begin(), touched.end(), 0);
+
+    // Each collapse removes about two triangles; stop once enough are gone
+    // so the cheapest collapses of the next pass can be chosen afresh.
+    const size_t excess = (tris.size() - target_index_count) / 3;
+    size_t removed = 0;
+    for (const Collapse& c : collapses) {
+      if (removed >= excess) break;
+      if (touched[c.from] || touched[c.to]) continue;
+      bool flips = false;
+      size_t degenerate = 0;
+      for (GLuint j = offsets[c.from]; j < offsets[c.from + 1] && !flips;
+           ++j) {
+        const GLuint* t = &tris[adjacency[j] * 3];
+        GLuint v[3] = {remap[t[0]], remap[t[1]], remap[t[2]]};
+        if (v[0] == c.to || v[1] == c.to || v[2] == c.to) {
+          ++degenerate;
+          continue;
+        }
+        Vec3 before = glm::cross(pos(v[1]) - pos(v[0]), pos(v[2]) - pos(v[0]));
+        for (int k = 0; k < 3; ++k) {
+          if (v[k] == c.from) v[k] = c.to;
+        }
+        Vec3 after = glm::cross(pos(v[1]) - pos(v[0]), pos(v[2]) - pos(v[0]));
+        flips = glm::dot(before, after) <= 0.0f;
+      }
+      if (flips) continue;
+      remap[c.from] = c.to;
+      quadrics[c.to].Add(quadrics[c.from]);
+      touched[c.from] = touched[c.to] = 1;
+      max_cost = std::max(max_cost, c.cost);
+      removed += std::max<size_t>(degenerate, 1);
+    }
+    if (removed == 0) break;
+
+    size_t out = 0;
+    for (size_t i = 0; i < tris.size(); i += 3) {
+      GLuint a = remap[tris[i]], b = remap[tris[i + 1]], c = remap[tris[i + 2]];
+      if (a == b || b == c || a == c) continue;
+      tris[out++] = a;
+      tris[out++] = b;
+      tris[out++] = c;
+    }
+    tris.resize(out);
+    collect_edges(&edges);
+  }
+
+  if (error) *error = static_cast<float>(sqrt(max_cost));
+  return tris;
+}
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_MESH_SIMPLIFY_HPP_
@@ -1,7 +1,13 @@
 #ifndef GLKIT_GL_MODEL_HPP_
 #define GLKIT_GL_MODEL_HPP_
 
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+
 #include "gl_mesh.hpp"
+#include "gl_render_queue.hpp"
+#include "gl_scene_graph.hpp"
 #include "gl_shader.hpp"
 
 namespace glkit {
@@ -11,6 +17,16 @@ enum RenderMode {
   kRenderModeDepth = 1,
 };
 
+class Model;
+
+// Told when the transform of a model it observes changes; see
+// Model::set_observer.
+class ModelObserver {
+ public:
+  virtual ~ModelObserver() = default;
+  virtual void OnTransformChanged(const Model& model) = 0;
+};
+
 class Model {
  public:
   Model() = default;
@@ -20,49 +36,196 @@ class Model {
     mesh_ = mesh;
     shader_ = shader;
     is_light_ = is_light;
+    ResolveUniforms();
     return 0;
   }
 
+  // Camera and lights come from the FrameData uniform block, which the
+  // caller updates once per frame; view and projection only drive the level
+  // of detail selection here.
   int Draw(const Mat4& view, const Mat4& projection) const {
+    const Mesh* mesh = drawn_mesh();
+    if (!mesh) return 0;
+    if (uniforms_.generation != shader_->generation()) ResolveUniforms();
     shader_->Use();
-    shader_->SetMat4("view", view);
-    shader_->SetMat4("projection", projection);
-    const auto& model = GetModelMatrix();
-    shader_->SetMat4("model", model);
-    shader_->SetVec3("color", color_);
+    shader_->Set(uniforms_.model, GetModelMatrix());
+    shader_->Set(uniforms_.pos_offset, mesh->position_offset());
+    shader_->Set(uniforms_.pos_scale, mesh->position_scale());
+    shader_->Set(uniforms_.color, color_);
     if (!is_light_) {
-      shader_->SetInt("render_mode", render_mode_);
-      shader_->SetFloat("near", near_);
-      shader_->SetFloat("far", far_);
+      shader_->Set(uniforms_.render_mode, static_cast<int>(render_mode_));
     }
-    mesh_->Draw(shader_);
+    lod_ = forced_lod_ >= 0 ? forced_lod_ : SelectLod(view, projection);
+    glBindVertexArray(mesh->vao());
+    mesh->DrawElements(lod_);
+    glBindVertexArray(0);
     return 0;
   }
 
-  Mat4 GetModelMatrix() const {
-    Mat4 model(1.0f);
-    model = glm::translate(model, position_);
-    model = glm::rotate(model, rotation_.x, Vec3(1.0f, 0.0f, 0.0f));
-    model = glm::rotate(model, rotation_.y, Vec3(0.0f, 1.0f, 0.0f));
-    model = glm::rotate(model, rotation_.z, Vec3(0.0f, 0.0f, 1.0f));
-    model = glm::scale(model, scale_);
-    return model;
+  // Queues the draw instead of issuing it; see RenderQueue.
+  void Submit(RenderQueue* queue, const Mat4& view,
+              const Mat4& projection) const {
+    const Mesh* mesh = drawn_mesh();
+    if (!mesh) return;
+    DrawItem item;
+    item.shader = shader_;
+    item.mesh = mesh;
+    item.model = GetModelMatrix();
+    item.material.color = color_;
+    item.material.render_mode = is_light_ ? 0 : render_mode_;
+    item.depth =
+        -(view * item.model * Vec4(mesh->bounds().center(), 1.0f)).z;
+    lod_ = forced_lod_ >= 0 ? forced_lod_ : SelectLod(view, projection);
+    item.lod = lod_;
+    queue->Submit(item);
   }
 
-  void SetLight(const Vec3& light_pos, const Vec3& light_color) {
-    shader_->Use();
-    shader_->SetVec3("light_pos", light_pos);
-    shader_->SetVec3("light_color", light_color);
+  // Picks the coarsest level of detail whose geometric error, projected at
+  // the distance of the mesh center, stays below lod_threshold of the
+  // viewport height. Moving to a coarser level needs the error to drop a
+  // further lod_hysteresis below the threshold, so a level does not flicker
+  // when the camera rests near a switching distance.
+  int SelectLod(const Mat4& view, const Mat4& projection) const {
+    const Mesh* mesh = drawn_mesh();
+    if (!mesh) return 0;
+    const auto& lods = mesh->lods();
+    const int num_lods = static_cast<int>(lods.size());
+    if (num_lods <= 1) return 0;
+    const Vec4 center =
+        view * GetModelMatrix() * Vec4(mesh->bounds().center(), 1.0f);
+    const float distance = std::max(-center.z, 1e-3f);
+    const float max_scale = MaxScale(GetModelMatrix());
+    // projection[1][1] maps view space y at distance 1 to NDC, which spans
+    // two viewport heights.
+    const float to_screen = 0.5f * projection[1][1] * max_scale / distance;
+    auto screen_error = [&](int lod) { return lods[lod].error * to_screen; };
+
+    int lod = std::min(std::max(lod_, 0), num_lods - 1);
+    while (lod > 0 && screen_error(lod) > lod_threshold_) --lod;
+    while (lod + 1 < num_lods &&
+           screen_error(lod + 1) < lod_threshold_ * (1.0f - lod_hysteresis_)) {
+      ++lod;
+    }
+    return lod;
+  }
+
+  // The world matrix: the parent node's world matrix times the model's own
+  // transform. Both parts are cached; the own one is recomposed after a
+  // setter changed it and the product only when either part changed.
+  const Mat4& GetModelMatrix() const {
+    if (local_dirty_) {
+      local_mat_ = ComposeTransform(position_, rotation_, scale_);
+      local_dirty_ = false;
+      world_valid_ = false;
+    }
+    if (!graph_) return local_mat_;
+    const uint32_t version = graph_->world_version(node_);
+    if (!world_valid_ || version != world_version_) {
+      world_mat_ = graph_->world_matrix(node_) * local_mat_;
+      world_version_ = version;
+      world_valid_ = true;
+    }
+    return world_mat_;
+  }
+
+  // Mesh bounding sphere in world space. Rotation keeps the radius, so it
+  // only grows by the largest scale factor.
+  BoundingSphere GetWorldBoundingSphere() const {
+    const Mesh* mesh = drawn_mesh();
+    if (!mesh) return BoundingSphere();
+    BoundingSphere sphere = mesh->bounding_sphere();
+    if (sphere.empty()) return sphere;
+    const Mat4& model = GetModelMatrix();
+    sphere.center = Vec3(model * Vec4(sphere.center, 1.0f));
+    sphere.radius *= MaxScale(model);
+    return sphere;
+  }
+
+  // Mesh bounding box in world space: the box around the transformed box,
+  // from the absolute values of the matrix (Arvo).
+  Aabb GetWorldBounds() const {
+    const Mesh* mesh = drawn_mesh();
+    if (!mesh) return Aabb();
+    const Aabb& local = mesh->bounds();
+    if (local.empty()) return local;
+    const Mat4& model = GetModelMatrix();
+    const Vec3 center = Vec3(model * Vec4(local.center(), 1.0f));
+    const Vec3 half = local.size() * 0.5f;
+    Vec3 extent(0.0f);
+    for (int c = 0; c < 3; ++c) {
+      extent += glm::abs(Vec3(model[c])) * half[c];
+    }
+    Aabb bounds;
+    bounds.min = center - extent;
+    bounds.max = center + extent;
+    return bounds;
+  }
+
+  // Closest hit of a world space ray with the level 0 triangles, through
+  // the mesh BVH; false when it misses or the mesh has no BVH. The ray is
+  // moved into mesh space without normalizing, so hit->t is the same in
+  // both spaces.
+  bool Raycast(const Ray& ray, float max_t, TriangleHit* hit) const {
+    const Mesh* mesh = drawn_mesh();
+    if (!mesh || mesh->bvh().empty()) return false;
+    const Mat4 inverse = glm::inverse(GetModelMatrix());
+    Ray local;
+    local.origin = Vec3(inverse * Vec4(ray.origin, 1.0f));
+    local.direction = Vec3(inverse * Vec4(ray.direction, 0.0f));
+    return mesh->bvh().Intersect(local, max_t, hit);
   }
 
   Vec3 position() const { return position_; }
-  void set_position(const Vec3& position) { position_ = position; }
+  void set_position(const Vec3& position) {
+    position_ = position;
+    local_dirty_ = true;
+    NotifyTransformChanged();
+  }
 
   Vec3 rotation() const { return rotation_; }
-  void set_rotation(const Vec3& rotation) { rotation_ = rotation; }
+  void set_rotation(const Vec3& rotation) {
+    rotation_ = rotation;
+    local_dirty_ = true;
+    NotifyTransformChanged();
+  }
 
   Vec3 scale() const { return scale_; }
-  void set_scale(const Vec3& scale) { scale_ = scale; }
+  void set_scale(const Vec3& scale) {
+    scale_ = scale;
+    local_dirty_ = true;
+    NotifyTransformChanged();
+  }
+
+  // Attaches the model to `node` of `graph`, which then places it; the
+  // position, rotation and scale become relative to the node. kNoSceneNode
+  // detaches it. Call OnParentMoved for the nodes SceneGraph::Update reports
+  // as changed, so the observer hears of it.
+  const SceneGraph* graph() const { return graph_; }
+  SceneNode node() const { return node_; }
+  void set_node(const SceneGraph* graph, SceneNode node) {
+    graph_ = node != kNoSceneNode ? graph : nullptr;
+    node_ = graph_ ? node : kNoSceneNode;
+    world_valid_ = false;
+    NotifyTransformChanged();
+  }
+  void OnParentMoved() { NotifyTransformChanged(); }
+
+  // The transform setters call observer->OnTransformChanged(*this). `id` is
+  // free for the observer to tell its models apart.
+  ModelObserver* observer() const { return observer_; }
+  uint32_t observer_id() const { return observer_id_; }
+  void set_observer(ModelObserver* observer, uint32_t id) {
+    observer_ = observer;
+    observer_id_ = id;
+  }
+
+  Mesh* mesh() const { return mesh_; }
+  // Drawn, culled and picked in place of the mesh until that is ready, for
+  // meshes that load in the background. Without one the model is skipped
+  // until then. The observer is not told when the bounds change that way;
+  // see MeshManager::Update.
+  Mesh* placeholder() const { return placeholder_; }
+  void set_placeholder(Mesh* placeholder) { placeholder_ = placeholder; }
 
   bool is_light() const { return is_light_; }
 
@@ -72,22 +235,84 @@ class Model {
   RenderMode render_mode() const { return render_mode_; }
   void set_render_mode(RenderMode render_mode) { render_mode_ = render_mode; }
 
-  void set_near(float near) { near_ = near; }
-  void set_far(float far) { far_ = far; }
+  // Level of detail used by the last Draw.
+  int lod() const { return lod_; }
+  // A level >= 0 disables the automatic selection.
+  int forced_lod() const { return forced_lod_; }
+  void set_forced_lod(int lod) { forced_lod_ = lod; }
+  // Largest projected error, as a fraction of the viewport height.
+  float lod_threshold() const { return lod_threshold_; }
+  void set_lod_threshold(float threshold) { lod_threshold_ = threshold; }
+  // Fraction of the threshold the error must undercut to go coarser.
+  float lod_hysteresis() const { return lod_hysteresis_; }
+  void set_lod_hysteresis(float hysteresis) { lod_hysteresis_ = hysteresis; }
 
  private:
+  // Again after the shader reloads; see Shader::Swap.
+  void ResolveUniforms() const {
+    uniforms_.generation = shader_->generation();
+    uniforms_.model = shader_->GetUniform<Mat4>("model");
+    uniforms_.pos_offset = shader_->GetUniform<Vec3>("pos_offset");
+    uniforms_.pos_scale = shader_->GetUniform<Vec3>("pos_scale");
+    uniforms_.color = shader_->GetUniform<Vec3>("color");
+    if (!is_light_) {
+      uniforms_.render_mode = shader_->GetUniform<int>("render_mode");
+    }
+  }
+
+  // Largest factor the matrix scales a length by, the longest axis.
+  static float MaxScale(const Mat4& m) {
+    return sqrtf(std::max(std::max(glm::dot(Vec3(m[0]), Vec3(m[0])),
+                                   glm::dot(Vec3(m[1]), Vec3(m[1]))),
+                          glm::dot(Vec3(m[2]), Vec3(m[2]))));
+  }
+
+  const Mesh* drawn_mesh() const {
+    if (mesh_->ready()) return mesh_;
+    if (placeholder_ && placeholder_->ready()) return placeholder_;
+    return nullptr;
+  }
+
+  void NotifyTransformChanged() {
+    if (observer_) observer_->OnTransformChanged(*this);
+  }
+
+  // Handles resolved in Init, so Draw does no name lookups.
+  struct Uniforms {
+    uint32_t generation = 0;
+    Uniform<Mat4> model;
+    Uniform<Vec3> pos_offset;
+    Uniform<Vec3> pos_scale;
+    Uniform<Vec3> color;
+    Uniform<int> render_mode;
+  };
+
   Mesh* mesh_ = nullptr;
+  Mesh* placeholder_ = nullptr;
   Shader* shader_ = nullptr;
   Vec3 position_ = Vec3(0.0f, 0.0f, 0.0f);
   Vec3 rotation_ = Vec3(0.0f, 0.0f, 0.0f);
   Vec3 scale_ = Vec3(1.0f, 1.0f, 1.0f);
+  const SceneGraph* graph_ = nullptr;
+  SceneNode node_ = kNoSceneNode;
+  // Caches of GetModelMatrix.
+  mutable Mat4 local_mat_;
+  mutable Mat4 world_mat_;
+  mutable uint32_t world_version_ = 0;
+  mutable bool local_dirty_ = true;
+  mutable bool world_valid_ = false;
+  mutable Uniforms uniforms_;
+  ModelObserver* observer_ = nullptr;
+  uint32_t observer_id_ = 0;
 
   bool is_light_ = false;
   Vec3 color_ = Vec3(1.0f, 1.0f, 1.0f);
 
   RenderMode render_mode_ = kRenderModeLight;
-  float near_;
-  float far_;
+  mutable int lod_ = 0;
+  int forced_lod_ = -1;
+  float lod_threshold_ = 0.001f;
+  float lod_hysteresis_ = 0.25f;
 };
 
 }  // namespace glkit
@@ -0,0 +1,415 @@
+#ifndef GLKIT_GL_OBJ_READER_HPP_
+#define GLKIT_GL_OBJ_READER_HPP_
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gl_base.hpp"
+#include "gl_mapped_file.hpp"
+#include "gl_parallel.hpp"
+
+namespace glkit {
+
+// One face corner. Indices are zero based and -1 when the attribute is absent.
+struct ObjIndex {
+  int v;
+  int vt;
+  int vn;
+};
+
+struct ObjData {
+  std::vector<Vec3> positions;
+  std::vector<Vec2> texcoords;
+  std::vector<Vec3> normals;
+  // Faces triangulated as fans, three corners per triangle.
+  std::vector<ObjIndex> corners;
+
+  void Clear() {
+    positions.clear();
+    texcoords.clear();
+    normals.clear();
+    corners.clear();
+  }
+};
+
+// Wavefront OBJ reader that tokenizes the memory mapped file in place. Only
+// v/vt/vn/f records are interpreted, everything else is skipped. Parsing does
+// no per-line allocation; the output vectors grow amortized.
+//
+// With more than one thread the file is split into newline aligned chunks
+// that are parsed concurrently and merged afterwards.
+class ObjReader {
+ public:
+  // Files are only split when every chunk gets at least this many bytes.
+  static const size_t kMinChunkSize = 4 << 20;
+
+  // `num_threads` <= 0 uses all hardware threads.
+  int ReadFile(const std::string& file_path, ObjData* data,
+               int num_threads = 1) {
+    MappedFile file;
+    if (file.Open(file_path) != 0) return -1;
+    data->Clear();
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    size_t num_chunks =
+        std::min(static_cast<size_t>(ResolveThreadCount(num_threads)),
+                 file.size() / kMinChunkSize);
+    int ret = num_chunks > 1 ? ParseChunked(begin, end, num_chunks, data)
+                             : Parse(begin, end, data);
+    if (ret != 0) {
+      LOG(ERROR) << "Failed to parse obj file: " << file_path;
+      return -1;
+    }
+    return Validate(*data);
+  }
+
+  int Parse(const char* begin, const char* end, ObjData* data) {
+    return ParseRange(begin, begin, end, data, nullptr);
+  }
+
+  // Checks that every face corner references an existing attribute.
+  static int Validate(const ObjData& data) {
+    const int num_v = static_cast<int>(data.positions.size());
+    const int num_vt = static_cast<int>(data.texcoords.size());
+    const int num_vn = static_cast<int>(data.normals.size());
+    for (size_t i = 0; i < data.corners.size(); ++i) {
+      const ObjIndex& c = data.corners[i];
+      if (c.v < 0 || c.v >= num_v || c.vt < -1 || c.vt >= num_vt ||
+          c.vn < -1 || c.vn >= num_vn) {
+        LOG(ERROR) << "Face index out of range in triangle " << i / 3;
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  // Parses a decimal float ("-1", "0.5", ".5e-3", ...). Returns the position
+  // after the number or nullptr when there is no number at `p`.
+  static const char* ParseFloat(const char* p, const char* end, float* value) {
+    static const double kPow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negative = *p == '-';
+      ++p;
+    }
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool any_digit = false;
+    for (; p < end && IsDigit(*p); ++p) {
+      any_digit = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+        if (mantissa != 0) ++digits;
+      } else {
+        ++exponent;
+      }
+    }
+    if (p < end && *p == '.') {
+      for (++p; p < end && IsDigit(*p); ++p) {
+        any_digit = true;
+        if (digits < 19) {
+          mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+          if (mantissa != 0) ++digits;
+          --exponent;
+        }
+      }
+    }
+    if (!any_digit) return nullptr;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+      const char* q = p + 1;
+      bool exp_negative = false;
+      if (q < end && (*q == '-' || *q == '+')) {
+        exp_negative = *q == '-';
+        ++q;
+      }
+      if (q < end && IsDigit(*q)) {
+        int e = 0;
+        for (; q < end && IsDigit(*q); ++q) {
+          if (e < 10000) e = e * 10 + (*q - '0');
+        }
+        exponent += exp_negative ? -e : e;
+        p = q;
+      }
+    }
+    double result = static_cast<double>(mantissa);
+    if (exponent < 0) {
+      result = -exponent <= 22 ? result / kPow10[-exponent]
+                               : result * pow(10.0, exponent);
+    } else if (exponent > 0) {
+      result = exponent <= 22 ? result * kPow10[exponent]
+                              : result * pow(10.0, exponent);
+    }
+    *value = static_cast<float>(negative ? -result : result);
+    return p;
+  }
+
+  // Parses a signed decimal integer, saturating at the int range.
+  static const char* ParseInt(const char* p, const char* end, int* value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negative = *p == '-';
+      ++p;
+    }
+    if (p == end || !IsDigit(*p)) return nullptr;
+    int64_t result = 0;
+    for (; p < end && IsDigit(*p); ++p) {
+      if (result <= INT32_MAX) result = result * 10 + (*p - '0');
+    }
+    result = std::min<int64_t>(result, INT32_MAX);
+    *value = static_cast<int>(negative ? -result : result);
+    return p;
+  }
+
+ private:
+  // Face corner whose index components (bit 0: v, 1: vt, 2: vn) were
+  // negative and are relative to the start of their chunk.
+  struct Fixup {
+    size_t corner;
+    int mask;
+  };
+
+  int ParseRange(const char* file_begin, const char* begin, const char* end,
+                 ObjData* data, std::vector<Fixup>* fixups) {
+    const char* p = begin;
+    while (p < end) {
+      p = SkipSpaces(p, end);
+      if (p == end) break;
+      const char* record = p;
+      if (p[0] == 'v' && p + 1 < end) {
+        if (IsSpace(p[1])) {
+          Vec3 v;
+          p = ParseFloats(p + 1, end, &v[0], 3, 3);
+          if (p == nullptr) return LineError(file_begin, record);
+          data->positions.push_back(v);
+        } else if (p[1] == 't' && p + 2 < end && IsSpace(p[2])) {
+          Vec2 vt;
+          p = ParseFloats(p + 2, end, &vt[0], 1, 2);
+          if (p == nullptr) return LineError(file_begin, record);
+          data->texcoords.push_back(vt);
+        } else if (p[1] == 'n' && p + 2 < end && IsSpace(p[2])) {
+          Vec3 vn;
+          p = ParseFloats(p + 2, end, &vn[0], 3, 3);
+          if (p == nullptr) return LineError(file_begin, record);
+          data->normals.push_back(vn);
+        }
+      } else if (p[0] == 'f' && p + 1 < end && IsSpace(p[1])) {
+        p = ParseFace(p + 1, end, data, fixups);
+        if (p == nullptr) return LineError(file_begin, record);
+      }
+      p = SkipLine(p, end);
+    }
+    return 0;
+  }
+
+  // Parses `num_chunks` newline aligned chunks concurrently, each into its
+  // own ObjData, then concatenates them. Positive OBJ indices are absolute
+  // and copied as is; negative ones were resolved against the chunk-local
+  // counts and are rebased with the prefix sum of the preceding chunks.
+  int ParseChunked(const char* begin, const char* end, size_t num_chunks,
+                   ObjData* data) {
+    const size_t size = end - begin;
+    std::vector<const char*> bounds(num_chunks + 1);
+    bounds[0] = begin;
+    bounds[num_chunks] = end;
+    for (size_t i = 1; i < num_chunks; ++i) {
+      const char* p = std::max(begin + size * i / num_chunks, bounds[i - 1]);
+      bounds[i] = p > begin && p[-1] == '\n' ? p : SkipLine(p, end);
+    }
+
+    std::vector<ObjData> chunks(num_chunks);
+    std::vector<std::vector<Fixup>> fixups(num_chunks);
+    std::vector<int> results(num_chunks, 0);
+    const int num_threads = static_cast<int>(num_chunks);
+    ParallelFor(num_chunks, num_threads, [&](int, size_t first, size_t last) {
+      for (size_t i = first; i < last; ++i) {
+        results[i] = ParseRange(begin, bounds[i], bounds[i + 1], &chunks[i],
+                                &fixups[i]);
+      }
+    });
+    for (size_t i = 0; i < num_chunks; ++i) {
+      if (results[i] != 0) return results[i];
+    }
+
+    std::vector<size_t> v_base(num_chunks + 1, 0);
+    std::vector<size_t> vt_base(num_chunks + 1, 0);
+    std::vector<size_t> vn_base(num_chunks + 1, 0);
+    std::vector<size_t> corner_base(num_chunks + 1, 0);
+    for (size_t i = 0; i < num_chunks; ++i) {
+      v_base[i + 1] = v_base[i] + chunks[i].positions.size();
+      vt_base[i + 1] = vt_base[i] + chunks[i].texcoords.size();
+      vn_base[i + 1] = vn_base[i] + chunks[i].normals.size();
+      corner_base[i + 1] = corner_base[i] + chunks[i].corners.size();
+    }
+    if (v_base[num_chunks] > INT32_MAX) {
+      LOG(ERROR) << "Too many vertices in obj file: " << v_base[num_chunks];
+      return -1;
+    }
+    data->positions.resize(v_base[num_chunks]);
+    data->texcoords.resize(vt_base[num_chunks]);
+    data->normals.resize(vn_base[num_chunks]);
+    data->corners.resize(corner_base[num_chunks]);
+
+    ParallelFor(num_chunks, num_threads, [&](int, size_t first, size_t last) {
+      for (size_t i = first; i < last; ++i) {
+        ObjData& chunk = chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(),
+                  data->positions.begin() + v_base[i]);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(),
+                  data->texcoords.begin() + vt_base[i]);
+        std::copy(chunk.normals.begin(), chunk.normals.end(),
+                  data->normals.begin() + vn_base[i]);
+        ObjIndex* corners = data->corners.data() + corner_base[i];
+        std::copy(chunk.corners.begin(), chunk.corners.end(), corners);
+        for (const Fixup& fixup : fixups[i]) {
+          ObjIndex& c = corners[fixup.corner];
+          if (fixup.mask & 1) c.v += static_cast<int>(v_base[i]);
+          if (fixup.mask & 2) c.vt += static_cast<int>(vt_base[i]);
+          if (fixup.mask & 4) c.vn += static_cast<int>(vn_base[i]);
+        }
+        ObjData().positions.swap(chunk.positions);
+        ObjData().texcoords.swap(chunk.texcoords);
+        ObjData().normals.swap(chunk.normals);
+        ObjData().corners.swap(chunk.corners);
+      }
+    });
+    return 0;
+  }
+
+  static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+  static bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+  static const char* SkipSpaces(const char* p, const char* end) {
+    while (p < end && IsSpace(*p)) ++p;
+    return p;
+  }
+
+  static const char* SkipLine(const char* p, const char* end) {
+    const void* eol = memchr(p, '\n', end - p);
+    return eol ? static_cast<const char*>(eol) + 1 : end;
+  }
+
+  static bool AtLineEnd(const char* p, const char* end) {
+    return p == end || *p == '\n' || *p == '#';
+  }
+
+  // Reads between `min_count` and `max_count` whitespace separated floats.
+  // Extra values (w, vertex colors) are left for SkipLine.
+  static const char* ParseFloats(const char* p, const char* end, float* out,
+                                 int min_count, int max_count) {
+    for (int i = 0; i < max_count; ++i) {
+      p = SkipSpaces(p, end);
+      if (i >= min_count && AtLineEnd(p, end)) break;
+      p = ParseFloat(p, end, &out[i]);
+      if (p == nullptr) return nullptr;
+      if (p < end && !IsSpace(*p) && *p != '\n' && *p != '#') return nullptr;
+    }
+    return p;
+  }
+
+  // OBJ indices are 1 based, negative values count back from the most
+  // recently defined element. When parsing a chunk (`relative` non-null) a
+  // negative index may point before the chunk; it is flagged for rebasing.
+  static bool ResolveIndex(int index, size_t count, int* resolved,
+                           bool* relative) {
+    if (index > 0) {
+      *resolved = index - 1;
+      return true;
+    }
+    if (index == 0) return false;
+    *resolved = static_cast<int>(count) + index;
+    if (relative == nullptr) return *resolved >= 0;
+    *relative = true;
+    return true;
+  }
+
+  // Parses `v`, `v/vt`, `v//vn` or `v/vt/vn`. Sets the Fixup mask bits of
+  // chunk-relative components when `mask` is non-null.
+  static const char* ParseCorner(const char* p, const char* end,
+                                 const ObjData& data, ObjIndex* corner,
+                                 int* mask) {
+    int index = 0;
+    bool relative = false;
+    bool* rel = mask ? &relative : nullptr;
+    corner->vt = -1;
+    corner->vn = -1;
+    p = ParseInt(p, end, &index);
+    if (p == nullptr ||
+        !ResolveIndex(index, data.positions.size(), &corner->v, rel))
+      return nullptr;
+    if (relative) *mask |= 1;
+    if (p == end || *p != '/') return p;
+    ++p;
+    if (p < end && *p != '/') {
+      relative = false;
+      p = ParseInt(p, end, &index);
+      if (p == nullptr ||
+          !ResolveIndex(index, data.texcoords.size(), &corner->vt, rel))
+        return nullptr;
+      if (relative) *mask |= 2;
+    }
+    if (p == end || *p != '/') return p;
+    ++p;
+    relative = false;
+    p = ParseInt(p, end, &index);
+    if (p == nullptr ||
+        !ResolveIndex(index, data.normals.size(), &corner->vn, rel))
+      return nullptr;
+    if (relative) *mask |= 4;
+    return p;
+  }
+
+  static void PushCorner(const ObjIndex& corner, int mask, ObjData* data,
+                         std::vector<Fixup>* fixups) {
+    if (mask != 0) {
+      Fixup fixup = {data->corners.size(), mask};
+      fixups->push_back(fixup);
+    }
+    data->corners.push_back(corner);
+  }
+
+  static const char* ParseFace(const char* p, const char* end, ObjData* data,
+                               std::vector<Fixup>* fixups) {
+    ObjIndex first = {0, -1, -1};
+    ObjIndex prev = {0, -1, -1};
+    ObjIndex corner;
+    int first_mask = 0;
+    int prev_mask = 0;
+    int count = 0;
+    for (;;) {
+      p = SkipSpaces(p, end);
+      if (AtLineEnd(p, end)) break;
+      int mask = 0;
+      p = ParseCorner(p, end, *data, &corner, fixups ? &mask : nullptr);
+      if (p == nullptr) return nullptr;
+      if (count == 0) {
+        first = corner;
+        first_mask = mask;
+      } else if (count >= 2) {
+        PushCorner(first, first_mask, data, fixups);
+        PushCorner(prev, prev_mask, data, fixups);
+        PushCorner(corner, mask, data, fixups);
+      }
+      prev = corner;
+      prev_mask = mask;
+      ++count;
+    }
+    return count >= 3 ? p : nullptr;
+  }
+
+  static int LineError(const char* begin, const char* record) {
+    size_t line = std::count(begin, record, '\n') + 1;
+    LOG(ERROR) << "Malformed obj record at line " << line;
+    return -1;
+  }
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_OBJ_READER_HPP_
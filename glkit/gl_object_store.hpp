@@ -0,0 +1,302 @@
+#ifndef GLKIT_GL_OBJECT_STORE_HPP_
+#define GLKIT_GL_OBJECT_STORE_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "gl_base.hpp"
+#include "gl_bounds.hpp"
+#include "gl_frustum.hpp"
+#include "gl_instanced_model.hpp"
+#include "gl_simd.hpp"
+
+namespace glkit {
+
+// Sine and cosine from Taylor polynomials after folding x into
+// [-pi/2, pi/2]; absolute error below 1e-6 for |x| < 100.
+template <typename F>
+inline void SinCosApprox(F x, F* sin_x, F* cos_x) {
+  // 2 pi in two parts, so the reduction loses no bits for moderate x.
+  const F k = Round(x * F::Set1(0.15915494f));
+  x = x - k * F::Set1(6.28125f) - k * F::Set1(1.9353072e-3f);
+  // sin(pi - x) = sin(x) and sin(-pi - x) = sin(x); cos changes sign.
+  const F y = Max(Min(x, F::Set1(PI) - x), F::Set1(-PI) - x);
+  const F y2 = y * y;
+  F s = F::Set1(-2.5052108e-8f) * y2 + F::Set1(2.7557319e-6f);
+  s = s * y2 - F::Set1(1.9841270e-4f);
+  s = s * y2 + F::Set1(8.3333333e-3f);
+  s = s * y2 - F::Set1(1.6666667e-1f);
+  *sin_x = (s * y2 + F::Set1(1.0f)) * y;
+  F c = F::Set1(2.0876757e-9f) * y2 - F::Set1(2.7557319e-7f);
+  c = c * y2 + F::Set1(2.4801587e-5f);
+  c = c * y2 - F::Set1(1.3888889e-3f);
+  c = c * y2 + F::Set1(4.1666667e-2f);
+  c = c * y2 - F::Set1(0.5f);
+  c = c * y2 + F::Set1(1.0f);
+  *cos_x = SelectNegative(F::Set1(0.5f * PI) - Abs(x), F::Set1(0.0f) - c, c);
+}
+
+// Stable handle of an ObjectStore object.
+typedef uint32_t ObjectHandle;
+const ObjectHandle kNoObject = 0xffffffffu;
+
+// Many simple objects, a transform and a color each, kept as structure of
+// arrays so per-frame work runs as batch kernels over all of them instead
+// of one Model at a time: UpdateMatrices composes every model matrix
+// SimdFloat::kWidth objects at a time, ComputeSpheres feeds CullSpheres
+// and Gather packs the visible ones for an InstancedModel.
+//
+// Objects are addressed by handles that stay valid until Destroy. The
+// arrays are indexed by slot instead, and Destroy moves the last object
+// into the freed slot to keep them dense.
+class ObjectStore {
+ public:
+  enum Channel {
+    kPositionX = 0,
+    kPositionY,
+    kPositionZ,
+    // Radians, applied as in Model: X, then Y, then Z.
+    kRotationX,
+    kRotationY,
+    kRotationZ,
+    kScaleX,
+    kScaleY,
+    kScaleZ,
+    kColorR,
+    kColorG,
+    kColorB,
+    kNumChannels,
+  };
+  // The model matrices are stored as the 12 arrays of their upper three
+  // rows, column-major: element c * 3 + r is column c, row r.
+  static const int kMatrixElements = 12;
+
+  ObjectStore() = default;
+
+  // An object at the origin with unit scale, in white.
+  ObjectHandle Create() {
+    ObjectHandle handle;
+    if (!free_handles_.empty()) {
+      handle = free_handles_.back();
+      free_handles_.pop_back();
+    } else {
+      handle = static_cast<ObjectHandle>(slot_of_.size());
+      slot_of_.push_back(-1);
+    }
+    slot_of_[handle] = static_cast<int32_t>(handle_of_.size());
+    handle_of_.push_back(handle);
+    for (int c = 0; c < kNumChannels; ++c) {
+      const bool one = c >= kScaleX;
+      channels_[c].push_back(one ? 1.0f : 0.0f);
+    }
+    for (auto& element : matrix_) element.push_back(0.0f);
+    transforms_dirty_ = true;
+    return handle;
+  }
+
+  int Destroy(ObjectHandle handle) {
+    if (!valid(handle)) {
+      LOG(ERROR) << "Invalid object: " << handle;
+      return -1;
+    }
+    const int32_t slot = slot_of_[handle];
+    const size_t last = handle_of_.size() - 1;
+    for (auto& channel : channels_) {
+      channel[slot] = channel[last];
+      channel.pop_back();
+    }
+    for (auto& element : matrix_) {
+      element[slot] = element[last];
+      element.pop_back();
+    }
+    handle_of_[slot] = handle_of_[last];
+    handle_of_.pop_back();
+    if (static_cast<size_t>(slot) != last) slot_of_[handle_of_[slot]] = slot;
+    slot_of_[handle] = -1;
+    free_handles_.push_back(handle);
+    return 0;
+  }
+
+  bool valid(ObjectHandle handle) const {
+    return handle < slot_of_.size() && slot_of_[handle] >= 0;
+  }
+
+  size_t size() const { return handle_of_.size(); }
+  // Slots are 0 to size() - 1 and change when objects are destroyed.
+  uint32_t slot(ObjectHandle handle) const { return slot_of_[handle]; }
+  ObjectHandle handle(uint32_t slot) const { return handle_of_[slot]; }
+
+  Vec3 position(ObjectHandle handle) const { return Get(handle, kPositionX); }
+  void set_position(ObjectHandle handle, const Vec3& position) {
+    Set(handle, kPositionX, position);
+  }
+  Vec3 rotation(ObjectHandle handle) const { return Get(handle, kRotationX); }
+  void set_rotation(ObjectHandle handle, const Vec3& rotation) {
+    Set(handle, kRotationX, rotation);
+  }
+  Vec3 scale(ObjectHandle handle) const { return Get(handle, kScaleX); }
+  void set_scale(ObjectHandle handle, const Vec3& scale) {
+    Set(handle, kScaleX, scale);
+  }
+  Vec3 color(ObjectHandle handle) const { return Get(handle, kColorR); }
+  void set_color(ObjectHandle handle, const Vec3& color) {
+    Set(handle, kColorR, color);
+  }
+
+  // A channel by slot, for batch edits. Writing a transform channel this
+  // way needs MarkTransformsChanged before the next UpdateMatrices.
+  float* channel(Channel channel) { return channels_[channel].data(); }
+  const float* channel(Channel channel) const {
+    return channels_[channel].data();
+  }
+  void MarkTransformsChanged() { transforms_dirty_ = true; }
+
+  const float* matrix_element(int element) const {
+    return matrix_[element].data();
+  }
+  // The model matrix as of the last UpdateMatrices.
+  Mat4 matrix(ObjectHandle handle) const {
+    const int32_t slot = slot_of_[handle];
+    Mat4 m(1.0f);
+    for (int c = 0; c < 4; ++c) {
+      for (int r = 0; r < 3; ++r) m[c][r] = matrix_[c * 3 + r][slot];
+    }
+    return m;
+  }
+
+  // Composes the model matrix of every object, when any transform changed
+  // since the last call.
+  void UpdateMatrices() {
+    if (!transforms_dirty_) return;
+    transforms_dirty_ = false;
+    const float* in[9];
+    float* out[kMatrixElements];
+    for (int c = 0; c < 9; ++c) in[c] = channels_[c].data();
+    for (int e = 0; e < kMatrixElements; ++e) out[e] = matrix_[e].data();
+    size_t i = ComposeTransformsLoop<SimdFloat>(in, out, 0, size());
+    ComposeTransformsLoop<FloatX1>(in, out, i, size());
+  }
+
+  // World bounding spheres by slot of objects that all share the mesh
+  // space sphere `local`, from the matrices of the last UpdateMatrices.
+  void ComputeSpheres(const BoundingSphere& local,
+                      SphereArray* spheres) const {
+    spheres->x.resize(size());
+    spheres->y.resize(size());
+    spheres->z.resize(size());
+    spheres->r.resize(size());
+    const float* m[kMatrixElements];
+    for (int e = 0; e < kMatrixElements; ++e) m[e] = matrix_[e].data();
+    float* out[4] = {spheres->x.data(), spheres->y.data(), spheres->z.data(),
+                     spheres->r.data()};
+    size_t i = TransformSpheresLoop<SimdFloat>(local, m, out, 0, size());
+    TransformSpheresLoop<FloatX1>(local, m, out, i, size());
+  }
+
+  // Writes the matrix and color of the objects at `slots` to `instances`,
+  // in that order.
+  void Gather(const uint32_t* slots, size_t count,
+              InstanceData* instances) const {
+    const float* m[kMatrixElements];
+    for (int e = 0; e < kMatrixElements; ++e) m[e] = matrix_[e].data();
+    const float* r = channels_[kColorR].data();
+    const float* g = channels_[kColorG].data();
+    const float* b = channels_[kColorB].data();
+    for (size_t i = 0; i < count; ++i) {
+      const uint32_t s = slots[i];
+      Mat4& model = instances[i].model;
+      model[0] = Vec4(m[0][s], m[1][s], m[2][s], 0.0f);
+      model[1] = Vec4(m[3][s], m[4][s], m[5][s], 0.0f);
+      model[2] = Vec4(m[6][s], m[7][s], m[8][s], 0.0f);
+      model[3] = Vec4(m[9][s], m[10][s], m[11][s], 1.0f);
+      instances[i].color = Vec4(r[s], g[s], b[s], 1.0f);
+    }
+  }
+
+ private:
+  ObjectStore(const ObjectStore&) = delete;
+  ObjectStore& operator=(const ObjectStore&) = delete;
+
+  // The same product as ComposeTransform, lane by lane.
+  template <typename F>
+  static size_t ComposeTransformsLoop(const float* const* in,
+                                      float* const* out, size_t i,
+                                      size_t end) {
+    for (; i + F::kWidth <= end; i += F::kWidth) {
+      F sx, cx, sy, cy, sz, cz;
+      SinCosApprox(F::Load(in[kRotationX] + i), &sx, &cx);
+      SinCosApprox(F::Load(in[kRotationY] + i), &sy, &cy);
+      SinCosApprox(F::Load(in[kRotationZ] + i), &sz, &cz);
+      const F scale_x = F::Load(in[kScaleX] + i);
+      const F scale_y = F::Load(in[kScaleY] + i);
+      const F scale_z = F::Load(in[kScaleZ] + i);
+      const F sx_sy = sx * sy, cx_sy = cx * sy;
+      (cy * cz * scale_x).Store(out[0] + i);
+      ((cx * sz + sx_sy * cz) * scale_x).Store(out[1] + i);
+      ((sx * sz - cx_sy * cz) * scale_x).Store(out[2] + i);
+      (F::Set1(0.0f) - cy * sz * scale_y).Store(out[3] + i);
+      ((cx * cz - sx_sy * sz) * scale_y).Store(out[4] + i);
+      ((sx * cz + cx_sy * sz) * scale_y).Store(out[5] + i);
+      (sy * scale_z).Store(out[6] + i);
+      (F::Set1(0.0f) - sx * cy * scale_z).Store(out[7] + i);
+      (cx * cy * scale_z).Store(out[8] + i);
+      F::Load(in[kPositionX] + i).Store(out[9] + i);
+      F::Load(in[kPositionY] + i).Store(out[10] + i);
+      F::Load(in[kPositionZ] + i).Store(out[11] + i);
+    }
+    return i;
+  }
+
+  // As Model::GetWorldBoundingSphere: the center transformed, the radius
+  // grown by the longest matrix axis.
+  template <typename F>
+  static size_t TransformSpheresLoop(const BoundingSphere& local,
+                                     const float* const* m,
+                                     float* const* out, size_t i,
+                                     size_t end) {
+    const F lx = F::Set1(local.center.x);
+    const F ly = F::Set1(local.center.y);
+    const F lz = F::Set1(local.center.z);
+    const F lr = F::Set1(local.radius);
+    for (; i + F::kWidth <= end; i += F::kWidth) {
+      F e[kMatrixElements];
+      for (int k = 0; k < kMatrixElements; ++k) e[k] = F::Load(m[k] + i);
+      (e[0] * lx + e[3] * ly + e[6] * lz + e[9]).Store(out[0] + i);
+      (e[1] * lx + e[4] * ly + e[7] * lz + e[10]).Store(out[1] + i);
+      (e[2] * lx + e[5] * ly + e[8] * lz + e[11]).Store(out[2] + i);
+      const F ax = e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+      const F ay = e[3] * e[3] + e[4] * e[4] + e[5] * e[5];
+      const F az = e[6] * e[6] + e[7] * e[7] + e[8] * e[8];
+      (lr * Sqrt(Max(Max(ax, ay), az))).Store(out[3] + i);
+    }
+    return i;
+  }
+
+  Vec3 Get(ObjectHandle handle, int first) const {
+    const int32_t slot = slot_of_[handle];
+    return Vec3(channels_[first][slot], channels_[first + 1][slot],
+                channels_[first + 2][slot]);
+  }
+
+  void Set(ObjectHandle handle, int first, const Vec3& value) {
+    const int32_t slot = slot_of_[handle];
+    channels_[first][slot] = value.x;
+    channels_[first + 1][slot] = value.y;
+    channels_[first + 2][slot] = value.z;
+    if (first < kColorR) transforms_dirty_ = true;
+  }
+
+  std::vector<float> channels_[kNumChannels];
+  std::vector<float> matrix_[kMatrixElements];
+  std::vector<ObjectHandle> handle_of_;
+  // Per handle; -1 for free handles.
+  std::vector<int32_t> slot_of_;
+  std::vector<ObjectHandle> free_handles_;
+  bool transforms_dirty_ = false;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_OBJECT_STORE_HPP_
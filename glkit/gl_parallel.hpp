@@ -0,0 +1,45 @@
+#ifndef GLKIT_GL_PARALLEL_HPP_
+#define GLKIT_GL_PARALLEL_HPP_
+
+#include <stddef.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace glkit {
+
+// Resolves a requested thread count: values <= 0 mean one thread per
+// hardware thread.
+inline int ResolveThreadCount(int num_threads) {
+  if (num_threads > 0) return num_threads;
+  int hw = static_cast<int>(std::thread::hardware_concurrency());
+  return std::max(hw, 1);
+}
+
+// Splits [0, count) into `num_threads` contiguous blocks and calls
+// fn(thread_index, begin, end) for each block, one block per thread. The
+// calling thread runs block 0. Blocks are never empty, so fewer than
+// `num_threads` calls are made when count is small.
+template <typename Fn>
+void ParallelFor(size_t count, int num_threads, Fn fn) {
+  if (count == 0) return;
+  size_t blocks =
+      std::min(count, static_cast<size_t>(std::max(num_threads, 1)));
+  if (blocks == 1) {
+    fn(0, static_cast<size_t>(0), count);
+    return;
+  }
+  std::vector<std::thread> threads;
+  threads.reserve(blocks - 1);
+  for (size_t i = 1; i < blocks; ++i) {
+    size_t begin = count * i / blocks;
+    size_t end = count * (i + 1) / blocks;
+    threads.emplace_back(fn, static_cast<int>(i), begin, end);
+  }
+  fn(0, static_cast<size_t>(0), count / blocks);
+  for (auto& t : threads) t.join();
+}
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_PARALLEL_HPP_
@@ -0,0 +1,77 @@
+#ifndef GLKIT_GL_PICKING_HPP_
+#define GLKIT_GL_PICKING_HPP_
+
+#include <float.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gl_base.hpp"
+#include "gl_bounds.hpp"
+#include "gl_camera.hpp"
+#include "gl_model.hpp"
+
+namespace glkit {
+
+struct PickResult {
+  const Model* model = nullptr;
+  // Level 0 triangle of the model mesh.
+  int32_t triangle = -1;
+  // Weights of the three triangle vertices.
+  Vec3 barycentric = Vec3(0.0f);
+  Vec3 position = Vec3(0.0f);
+  // World space distance from the camera.
+  float distance = FLT_MAX;
+
+  bool hit() const { return model != nullptr; }
+};
+
+// World space ray from the camera through the center of pixel (x, y) of a
+// width x height viewport, y pointing down as in window coordinates. The
+// direction is unit length.
+inline Ray ScreenRay(const Camera& camera, float x, float y, int width,
+                     int height) {
+  const float ndc_x = 2.0f * (x + 0.5f) / width - 1.0f;
+  const float ndc_y = 1.0f - 2.0f * (y + 0.5f) / height;
+  const Mat4 inverse =
+      glm::inverse(camera.projection_mat() * camera.view_mat());
+  Vec4 near_point = inverse * Vec4(ndc_x, ndc_y, -1.0f, 1.0f);
+  Vec4 far_point = inverse * Vec4(ndc_x, ndc_y, 1.0f, 1.0f);
+  near_point /= near_point.w;
+  far_point /= far_point.w;
+  Ray ray;
+  ray.origin = Vec3(near_point);
+  ray.direction = glm::normalize(Vec3(far_point) - Vec3(near_point));
+  return ray;
+}
+
+// Closest hit of `ray` among `count` models; models without a mesh BVH are
+// skipped. Returns false on a miss.
+inline bool PickModels(const Ray& ray, const Model* const* models,
+                       size_t count, PickResult* result) {
+  *result = PickResult();
+  for (size_t i = 0; i < count; ++i) {
+    TriangleHit hit;
+    if (!models[i]->Raycast(ray, result->distance, &hit)) continue;
+    result->model = models[i];
+    result->triangle = hit.triangle;
+    result->barycentric = Vec3(1.0f - hit.u - hit.v, hit.u, hit.v);
+    result->distance = hit.t;
+  }
+  if (!result->hit()) return false;
+  const float length = glm::length(ray.direction);
+  result->position = ray.origin + ray.direction * result->distance;
+  result->distance *= length;
+  return true;
+}
+
+// Picks what is under pixel (x, y) of a width x height viewport.
+inline bool PickModels(const Camera& camera, float x, float y, int width,
+                       int height, const Model* const* models, size_t count,
+                       PickResult* result) {
+  return PickModels(ScreenRay(camera, x, y, width, height), models, count,
+                    result);
+}
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_PICKING_HPP_
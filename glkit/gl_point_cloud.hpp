@@ -0,0 +1,519 @@
+#ifndef GLKIT_GL_POINT_CLOUD_HPP_
+#define GLKIT_GL_POINT_CLOUD_HPP_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <memory>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gl_base.hpp"
+#include "gl_bounds.hpp"
+#include "gl_frustum.hpp"
+#include "gl_mapped_file.hpp"
+#include "gl_point_cloud_file.hpp"
+#include "gl_shader.hpp"
+#include "gl_thread_pool.hpp"
+
+namespace glkit {
+
+// Draws an octree point cloud written by PointCloudBuilder, streaming the
+// nodes from disk. Only the hierarchy is held in memory; points.bin is
+// mapped and worker threads copy the nodes a frame asks for out of it.
+//
+// Update picks the nodes to draw: from the root down, in order of their
+// projected point spacing, for as long as they are in the frustum, their
+// points fit the point budget and their spacing is above a pixel. A node
+// is only descended into once it is on the GPU, so a view that has not
+// finished loading draws coarser nodes instead of holes. The GPU side is
+// one vertex buffer cut into max_node_points slots; a node is uploaded
+// into a free slot or the least recently drawn one, so GPU memory stays at
+// the pool size however large the cloud is.
+//
+// Points are sized to the spacing of the finest level drawn around them,
+// per octant of their node, so coarse points fill the gaps where the view
+// did not refine and shrink where it did instead of covering the detail.
+class PointCloud {
+ public:
+  PointCloud() = default;
+  ~PointCloud() {
+    // Workers may still write to their jobs.
+    pool_.Stop();
+    Free();
+  }
+
+  // Reads the hierarchy of the cloud in `dir` and allocates the GPU pool,
+  // gpu_budget() bytes rounded down to whole slots. On failure the cloud
+  // is left closed.
+  int Open(const std::string& dir, Shader* shader) {
+    Free();
+    if (ReadNodes(dir) != 0 || CreatePool() != 0) {
+      Free();
+      return -1;
+    }
+    shader_ = shader;
+    uniforms_.generation = 0;
+    frame_ = 0;
+    LOG(INFO) << "Point cloud " << dir << ": " << header_.num_points
+              << " points in " << nodes_.size() << " nodes, "
+              << slot_node_.size() << " GPU slots";
+    return 0;
+  }
+
+  // Call once per frame on the GL thread, before Draw. Uploads finished
+  // loads, selects the nodes to draw and requests the missing ones.
+  int Update(const Mat4& view, const Mat4& projection, int viewport_height) {
+    if (nodes_.empty()) return 0;
+    ++frame_;
+    viewport_height_ = static_cast<float>(viewport_height);
+    if (Upload() != 0) return -1;
+
+    // In the space of the cloud, where the node cubes are.
+    const Frustum frustum = Frustum::FromMatrix(projection * view * model_);
+    const Vec3 camera = Vec3(glm::inverse(view * model_)[3]);
+    // Pixels per unit of length at distance 1, assuming a uniform scale.
+    const float pixels = projection[1][1] * 0.5f * viewport_height;
+
+    selected_.clear();
+    visible_points_ = 0;
+    std::priority_queue<std::pair<float, uint32_t>> queue;
+    if (NodeVisible(frustum, nodes_[0])) {
+      queue.push(std::make_pair(Spacing(nodes_[0], camera, pixels), 0u));
+      node_queued_[0] = frame_;
+    }
+    // Missing nodes count against the pool too, so that what a frame
+    // wants fits into the slots it did not draw from.
+    size_t missing = 0;
+    while (!queue.empty() && selected_.size() + missing < slot_node_.size()) {
+      const uint32_t index = queue.top().second;
+      queue.pop();
+      const PointCloudNode& node = nodes_[index];
+      if (visible_points_ + node.count > point_budget_) break;
+      if (node_state_[index] != kNodeResident) {
+        Request(index);
+        ++missing;
+        continue;
+      }
+      selected_.push_back(index);
+      slot_used_[node_slot_[index]] = frame_;
+      visible_points_ += node.count;
+      uint32_t child = node.first_child;
+      for (int c = 0; c < 8; ++c) {
+        if (!(node.child_mask & (1 << c))) continue;
+        const PointCloudNode& child_node = nodes_[child];
+        const float spacing = Spacing(child_node, camera, pixels);
+        if (spacing >= min_spacing_pixels_ &&
+            NodeVisible(frustum, child_node)) {
+          queue.push(std::make_pair(spacing, child));
+          node_queued_[child] = frame_;
+          // Until it is selected, its octant only has the parent's points.
+          node_depth_[child] = node.level;
+        }
+        ++child;
+      }
+    }
+
+    // Nodes are stored breadth first, so children come before their
+    // parents in descending order.
+    std::sort(selected_.begin(), selected_.end(),
+              [](uint32_t a, uint32_t b) { return a > b; });
+    for (uint32_t index : selected_) {
+      const PointCloudNode& node = nodes_[index];
+      uint8_t depth = 0xff;
+      uint32_t child = node.first_child;
+      for (int c = 0; c < 8; ++c) {
+        if (!(node.child_mask & (1 << c))) continue;
+        // Children out of view or too small to refine do not limit it.
+        if (node_queued_[child] == frame_) {
+          depth = std::min(depth, node_depth_[child]);
+        }
+        ++child;
+      }
+      node_depth_[index] = depth == 0xff ? node.level : depth;
+    }
+    return 0;
+  }
+
+  // Draws the nodes the last Update selected, sized for its viewport.
+  int Draw() {
+    if (selected_.empty()) return 0;
+    if (shader_->Use() != 0) {
+      LOG(ERROR) << "Failed to use shader";
+      return -1;
+    }
+    if (uniforms_.generation != shader_->generation()) ResolveUniforms();
+    shader_->Set(uniforms_.model, model_);
+    shader_->Set(uniforms_.viewport_height, viewport_height_);
+    shader_->Set(uniforms_.point_scale, point_scale_);
+    shader_->Set(uniforms_.max_point_size, max_point_size_);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glBindVertexArray(vao_);
+    for (uint32_t index : selected_) {
+      const PointCloudNode& node = nodes_[index];
+      float spacing[8];
+      uint32_t child = node.first_child;
+      for (int c = 0; c < 8; ++c) {
+        const bool has_child = (node.child_mask & (1 << c)) != 0;
+        spacing[c] = LevelSpacing(has_child ? OctantLevel(node, child++)
+                                            : node.level);
+      }
+      shader_->Set(uniforms_.node_min, Vec3(node.cube_min[0],
+                                            node.cube_min[1],
+                                            node.cube_min[2]));
+      shader_->Set(uniforms_.node_size, node.cube_size);
+      shader_->Set(uniforms_.octant_spacing_low,
+                   Vec4(spacing[0], spacing[1], spacing[2], spacing[3]));
+      shader_->Set(uniforms_.octant_spacing_high,
+                   Vec4(spacing[4], spacing[5], spacing[6], spacing[7]));
+      glDrawArrays(GL_POINTS,
+                   static_cast<GLint>(node_slot_[index] *
+                                      header_.max_node_points),
+                   node.count);
+    }
+    glBindVertexArray(0);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+    RETURN_IF_GL_ERROR(-1, "Failed to draw point cloud");
+    return 0;
+  }
+
+  void Free() {
+    pool_.Stop();
+    jobs_.clear();
+    if (vao_ != 0) {
+      glDeleteVertexArrays(1, &vao_);
+      vao_ = 0;
+    }
+    if (vbo_ != 0) {
+      glDeleteBuffers(1, &vbo_);
+      vbo_ = 0;
+    }
+    points_.Close();
+    header_ = PointCloudHeader();
+    nodes_.clear();
+    node_state_.clear();
+    node_slot_.clear();
+    node_queued_.clear();
+    node_depth_.clear();
+    slot_node_.clear();
+    slot_used_.clear();
+    selected_.clear();
+    visible_points_ = 0;
+  }
+
+  bool opened() const { return !nodes_.empty(); }
+  const PointCloudHeader& header() const { return header_; }
+  // The points, relative to header().origin.
+  Aabb bounds() const {
+    Aabb box;
+    box.min = Vec3(0.0f);
+    box.max = Vec3(header_.extent[0], header_.extent[1], header_.extent[2]);
+    return box;
+  }
+
+  const Mat4& model() const { return model_; }
+  void set_model(const Mat4& model) { model_ = model; }
+
+  // Nodes and points the last Update selected.
+  size_t visible_nodes() const { return selected_.size(); }
+  size_t visible_points() const { return visible_points_; }
+  size_t resident_nodes() const {
+    return std::count_if(slot_node_.begin(), slot_node_.end(),
+                         [](int32_t node) { return node >= 0; });
+  }
+  // Nodes requested and not uploaded yet.
+  size_t loading() const { return jobs_.size(); }
+  size_t gpu_bytes() const {
+    return slot_node_.size() * header_.max_node_points * sizeof(PointRecord);
+  }
+  // Bytes copied into the GPU pool by the last Update.
+  size_t upload_bytes() const { return upload_bytes_; }
+
+  // Most points one frame draws.
+  size_t point_budget() const { return point_budget_; }
+  void set_point_budget(size_t points) { point_budget_ = points; }
+
+  // Size of the GPU pool, taking effect with the next Open.
+  size_t gpu_budget() const { return gpu_budget_; }
+  void set_gpu_budget(size_t bytes) { gpu_budget_ = bytes; }
+
+  // Most bytes one Update uploads; at least one node is uploaded.
+  size_t upload_budget() const { return upload_budget_; }
+  void set_upload_budget(size_t bytes) { upload_budget_ = bytes; }
+
+  // Children whose points would be closer than this on screen are not
+  // drawn.
+  float min_spacing_pixels() const { return min_spacing_pixels_; }
+  void set_min_spacing_pixels(float pixels) { min_spacing_pixels_ = pixels; }
+
+  // Points are drawn point_scale times the spacing of the finest level
+  // drawn around them on screen, so neighbors overlap into a closed
+  // surface, but no larger than max_point_size pixels.
+  float point_scale() const { return point_scale_; }
+  void set_point_scale(float scale) { point_scale_ = scale; }
+  float max_point_size() const { return max_point_size_; }
+  void set_max_point_size(float size) { max_point_size_ = size; }
+
+  // Loads running at once; more wait to be requested again.
+  size_t max_loads() const { return max_loads_; }
+  void set_max_loads(size_t loads) { max_loads_ = std::max<size_t>(loads, 1); }
+
+  // Worker threads, taking effect when the first load starts them. Values
+  // <= 0 use all hardware threads.
+  int load_threads() const { return load_threads_; }
+  void set_load_threads(int num_threads) { load_threads_ = num_threads; }
+
+ private:
+  PointCloud(const PointCloud&) = delete;
+  PointCloud& operator=(const PointCloud&) = delete;
+
+  enum NodeState : uint8_t {
+    kNodeIdle = 0,
+    kNodeLoading = 1,
+    kNodeResident = 2,
+  };
+
+  // Read by a worker, then published through `done`.
+  struct LoadJob {
+    uint32_t node = 0;
+    std::vector<PointRecord> points;
+    std::atomic<bool> done{false};
+  };
+
+  struct Uniforms {
+    uint32_t generation = 0;
+    Uniform<Mat4> model;
+    Uniform<Vec3> node_min;
+    Uniform<float> node_size;
+    Uniform<Vec4> octant_spacing_low;
+    Uniform<Vec4> octant_spacing_high;
+    Uniform<float> viewport_height;
+    Uniform<float> point_scale;
+    Uniform<float> max_point_size;
+  };
+
+  // Again after the shader reloads; see Shader::Swap.
+  void ResolveUniforms() {
+    uniforms_.generation = shader_->generation();
+    uniforms_.model = shader_->GetUniform<Mat4>("model");
+    uniforms_.node_min = shader_->GetUniform<Vec3>("node_min");
+    uniforms_.node_size = shader_->GetUniform<float>("node_size");
+    uniforms_.octant_spacing_low =
+        shader_->GetUniform<Vec4>("octant_spacing_low");
+    uniforms_.octant_spacing_high =
+        shader_->GetUniform<Vec4>("octant_spacing_high");
+    uniforms_.viewport_height =
+        shader_->GetUniform<float>("viewport_height");
+    uniforms_.point_scale = shader_->GetUniform<float>("point_scale");
+    uniforms_.max_point_size = shader_->GetUniform<float>("max_point_size");
+  }
+
+  int ReadNodes(const std::string& dir) {
+    if (PointCloudFile::ReadHierarchy(dir, &header_, &nodes_) != 0) {
+      return -1;
+    }
+    if (nodes_.empty() || header_.max_node_points == 0 ||
+        points_.Open(PointCloudFile::PointsPath(dir),
+                     MappedFile::kAccessRandom) != 0) {
+      LOG(ERROR) << "Failed to open point cloud: " << dir;
+      return -1;
+    }
+    // A slot holds the largest node, and the pool at least one slot.
+    if (header_.max_node_points > gpu_budget_ / sizeof(PointRecord)) {
+      LOG(ERROR) << "Point cloud nodes of " << header_.max_node_points
+                 << " points exceed the GPU budget: " << dir;
+      return -1;
+    }
+    const uint64_t file_points = points_.size() / sizeof(PointRecord);
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+      const PointCloudNode& node = nodes_[i];
+      const size_t children = std::bitset<8>(node.child_mask).count();
+      // Written so that a corrupt offset cannot wrap around.
+      if (node.offset > file_points ||
+          node.count > file_points - node.offset ||
+          node.count > header_.max_node_points ||
+          (children > 0 && (node.first_child <= i ||
+                            node.first_child + children > nodes_.size()))) {
+        LOG(ERROR) << "Invalid point cloud node " << i << ": " << dir;
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  int CreatePool() {
+    const size_t slot_bytes = header_.max_node_points * sizeof(PointRecord);
+    const size_t num_slots = gpu_budget_ / slot_bytes;
+    glGenBuffers(1, &vbo_);
+    glGenVertexArrays(1, &vao_);
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    glBufferData(GL_ARRAY_BUFFER, num_slots * slot_bytes, nullptr,
+                 GL_DYNAMIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PointRecord),
+                          reinterpret_cast<void*>(offsetof(PointRecord, x)));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(
+        1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PointRecord),
+        reinterpret_cast<void*>(offsetof(PointRecord, color)));
+    glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+    RETURN_IF_GL_ERROR(-1, "Failed to allocate point cloud buffer");
+
+    node_state_.assign(nodes_.size(), kNodeIdle);
+    node_slot_.assign(nodes_.size(), -1);
+    node_queued_.assign(nodes_.size(), 0);
+    node_depth_.assign(nodes_.size(), 0);
+    slot_node_.assign(num_slots, -1);
+    slot_used_.assign(num_slots, 0);
+    return 0;
+  }
+
+  float LevelSpacing(int level) const {
+    return ldexpf(header_.spacing, -level);
+  }
+
+  // Finest level drawn everywhere in the octant of `node` that holds
+  // `child`, as of the selection of this frame; the node's level where the
+  // child was not queued.
+  uint8_t OctantLevel(const PointCloudNode& node, uint32_t child) const {
+    return node_queued_[child] == frame_ ? node_depth_[child] : node.level;
+  }
+
+  static bool NodeVisible(const Frustum& frustum, const PointCloudNode& node) {
+    Aabb box;
+    box.min = Vec3(node.cube_min[0], node.cube_min[1], node.cube_min[2]);
+    box.max = box.min + Vec3(node.cube_size);
+    return frustum.Intersects(box);
+  }
+
+  // Projected sample spacing of the node in pixels, at the nearest point
+  // of its bounding sphere; infinite with the camera inside it.
+  float Spacing(const PointCloudNode& node, const Vec3& camera,
+                float pixels) const {
+    const Vec3 center =
+        Vec3(node.cube_min[0], node.cube_min[1], node.cube_min[2]) +
+        Vec3(0.5f * node.cube_size);
+    const float distance =
+        glm::length(camera - center) - 0.8660254f * node.cube_size;
+    if (distance <= 0.0f) return 1e30f;
+    return LevelSpacing(node.level) * pixels / distance;
+  }
+
+  void Request(uint32_t index) {
+    if (node_state_[index] != kNodeIdle || jobs_.size() >= max_loads_) return;
+    node_state_[index] = kNodeLoading;
+    LoadJob* job = new LoadJob();
+    jobs_.emplace_back(job);
+    job->node = index;
+    const PointCloudNode& node = nodes_[index];
+    const PointRecord* src =
+        reinterpret_cast<const PointRecord*>(points_.data()) + node.offset;
+    if (!pool_.started()) pool_.Start(load_threads_);
+    pool_.Post([job, src, node] {
+      // Faults the pages of the node in off the GL thread.
+      job->points.assign(src, src + node.count);
+      job->done = true;
+    });
+  }
+
+  // Slot for a new node: a free one, else the least recently drawn one not
+  // drawn last frame, whose node goes back to idle. -1 if there is none.
+  int32_t AcquireSlot() {
+    int32_t best = -1;
+    for (size_t s = 0; s < slot_node_.size(); ++s) {
+      if (slot_node_[s] < 0) return static_cast<int32_t>(s);
+      if (slot_used_[s] + 1 >= frame_) continue;
+      if (best < 0 || slot_used_[s] < slot_used_[best]) {
+        best = static_cast<int32_t>(s);
+      }
+    }
+    if (best >= 0) {
+      node_state_[slot_node_[best]] = kNodeIdle;
+      node_slot_[slot_node_[best]] = -1;
+      slot_node_[best] = -1;
+    }
+    return best;
+  }
+
+  int Upload() {
+    upload_bytes_ = 0;
+    const size_t slot_points = header_.max_node_points;
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    for (auto& job : jobs_) {
+      if (!job->done) continue;
+      if (upload_bytes_ > 0 && upload_bytes_ >= upload_budget_) break;
+      const uint32_t index = job->node;
+      const int32_t slot = AcquireSlot();
+      if (slot < 0) {
+        // Everything is on screen; the node is requested again if it
+        // still ranks high enough once something is not.
+        node_state_[index] = kNodeIdle;
+      } else {
+        const size_t bytes = job->points.size() * sizeof(PointRecord);
+        glBufferSubData(GL_ARRAY_BUFFER,
+                        slot * slot_points * sizeof(PointRecord), bytes,
+                        job->points.data());
+        upload_bytes_ += bytes;
+        node_state_[index] = kNodeResident;
+        node_slot_[index] = slot;
+        slot_node_[slot] = static_cast<int32_t>(index);
+        // Kept for the frame that asked for it.
+        slot_used_[slot] = frame_;
+      }
+      job.reset();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    jobs_.erase(std::remove(jobs_.begin(), jobs_.end(), nullptr),
+                jobs_.end());
+    RETURN_IF_GL_ERROR(-1, "Failed to upload point cloud nodes");
+    return 0;
+  }
+
+  PointCloudHeader header_ = PointCloudHeader();
+  std::vector<PointCloudNode> nodes_;
+  MappedFile points_;
+  Shader* shader_ = nullptr;
+  Uniforms uniforms_;
+  Mat4 model_ = Mat4(1.0f);
+  float viewport_height_ = 1.0f;
+  GLuint vao_ = 0;
+  GLuint vbo_ = 0;
+
+  // Per node.
+  std::vector<NodeState> node_state_;
+  std::vector<int32_t> node_slot_;
+  // Frame the node was last queued for selection in, and the finest level
+  // drawn everywhere in its cube then.
+  std::vector<uint64_t> node_queued_;
+  std::vector<uint8_t> node_depth_;
+  // Per GPU slot: the node in it or -1, and the frame it was last drawn.
+  std::vector<int32_t> slot_node_;
+  std::vector<uint64_t> slot_used_;
+  uint64_t frame_ = 0;
+
+  std::vector<uint32_t> selected_;
+  size_t visible_points_ = 0;
+  size_t upload_bytes_ = 0;
+
+  size_t point_budget_ = 4000000;
+  size_t gpu_budget_ = 256u << 20;
+  size_t upload_budget_ = 16u << 20;
+  float min_spacing_pixels_ = 1.0f;
+  float point_scale_ = 2.0f;
+  float max_point_size_ = 16.0f;
+  size_t max_loads_ = 16;
+  int load_threads_ = 2;
+  ThreadPool pool_;
+  std::vector<std::unique_ptr<LoadJob>> jobs_;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_POINT_CLOUD_HPP_
@@ -0,0 +1,777 @@
+#ifndef GLKIT_GL_POINT_CLOUD_BUILDER_HPP_
+#define GLKIT_GL_POINT_CLOUD_BUILDER_HPP_
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "gl_base.hpp"
+#include "gl_point_cloud_file.hpp"
+
+namespace glkit {
+
+struct InputPoint {
+  double x;
+  double y;
+  double z;
+  uint8_t color[4];
+};
+
+// Streams the points of a PLY file, ASCII or binary little endian, with
+// the vertex element first, or of an XYZ text file with "x y z [r g b]"
+// per line. Colors are 8 bit; files without them read as white.
+class PointReader {
+ public:
+  PointReader() = default;
+  ~PointReader() { Close(); }
+
+  int Open(const std::string& path) {
+    Close();
+    path_ = path;
+    file_ = fopen(path.c_str(), "rb");
+    if (file_ == nullptr) {
+      LOG(ERROR) << "Failed to open point file: " << path;
+      return -1;
+    }
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+    const size_t dot = path.rfind('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   ::tolower);
+    if (extension == ".ply") return ReadPlyHeader();
+    format_ = kFormatXyz;
+    return 0;
+  }
+
+  // Replaces `points` with up to `max_points` more points; empty at the
+  // end of the file.
+  int Read(size_t max_points, std::vector<InputPoint>* points) {
+    points->clear();
+    if (format_ == kFormatPlyBinary) return ReadPlyBinary(max_points, points);
+    char line[4096];
+    while (points->size() < max_points &&
+           (format_ == kFormatXyz || remaining_ > 0) &&
+           fgets(line, sizeof(line), file_)) {
+      double values[kMaxProperties];
+      const int n = ParseNumbers(line, values);
+      InputPoint point;
+      if (format_ == kFormatXyz) {
+        if (n < 3) continue;
+        point.x = values[0];
+        point.y = values[1];
+        point.z = values[2];
+        for (int c = 0; c < 3; ++c) {
+          point.color[c] = n >= 6 ? ToByte(values[3 + c], 255.0) : 255;
+        }
+        point.color[3] = 255;
+      } else {
+        --remaining_;
+        if (n < static_cast<int>(properties_.size())) {
+          LOG(ERROR) << "Short vertex line in " << path_;
+          return -1;
+        }
+        Decode(values, &point);
+      }
+      points->push_back(point);
+    }
+    if (ferror(file_)) {
+      LOG(ERROR) << "Failed to read " << path_;
+      return -1;
+    }
+    return 0;
+  }
+
+  void Close() {
+    if (file_) fclose(file_);
+    file_ = nullptr;
+    properties_.clear();
+    remaining_ = 0;
+  }
+
+ private:
+  PointReader(const PointReader&) = delete;
+  PointReader& operator=(const PointReader&) = delete;
+
+  static const int kMaxProperties = 32;
+
+  enum Format {
+    kFormatXyz = 0,
+    kFormatPlyAscii = 1,
+    kFormatPlyBinary = 2,
+  };
+
+  enum Type {
+    kInt8 = 0,
+    kUint8,
+    kInt16,
+    kUint16,
+    kInt32,
+    kUint32,
+    kFloat32,
+    kFloat64,
+  };
+
+  enum Role {
+    kRoleNone = 0,
+    kRoleX,
+    kRoleY,
+    kRoleZ,
+    kRoleRed,
+    kRoleGreen,
+    kRoleBlue,
+  };
+
+  struct Property {
+    Type type;
+    Role role;
+    size_t offset;
+  };
+
+  static int TypeSize(Type type) {
+    static const int kSizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+    return kSizes[type];
+  }
+
+  static int ParseType(const std::string& name, Type* type) {
+    static const char* kNames[][2] = {
+        {"char", "int8"},   {"uchar", "uint8"},  {"short", "int16"},
+        {"ushort", "uint16"}, {"int", "int32"},  {"uint", "uint32"},
+        {"float", "float32"}, {"double", "float64"}};
+    for (int t = 0; t < 8; ++t) {
+      if (name == kNames[t][0] || name == kNames[t][1]) {
+        *type = static_cast<Type>(t);
+        return 0;
+      }
+    }
+    return -1;
+  }
+
+  // Full range of the type for color channels; 1 for floats.
+  static double ColorScale(Type type) {
+    switch (type) {
+      case kUint16:
+        return 65535.0;
+      case kFloat32:
+      case kFloat64:
+        return 1.0;
+      default:
+        return 255.0;
+    }
+  }
+
+  static uint8_t ToByte(double value, double scale) {
+    const double v = value / scale * 255.0 + 0.5;
+    return static_cast<uint8_t>(std::min(std::max(v, 0.0), 255.0));
+  }
+
+  static int ParseNumbers(char* line, double* values) {
+    int n = 0;
+    char* p = line;
+    while (n < kMaxProperties) {
+      while (*p == ' ' || *p == '\t' || *p == ',') ++p;
+      if (*p == '#' || *p == '\0' || *p == '\n' || *p == '\r') break;
+      char* end;
+      values[n] = strtod(p, &end);
+      if (end == p) break;
+      ++n;
+      p = end;
+    }
+    return n;
+  }
+
+  int ReadPlyHeader() {
+    char line[1024];
+    if (!fgets(line, sizeof(line), file_) || strncmp(line, "ply", 3) != 0) {
+      LOG(ERROR) << "Not a PLY file: " << path_;
+      return -1;
+    }
+    bool in_vertex = false;
+    bool seen_element = false;
+    size_t offset = 0;
+    while (fgets(line, sizeof(line), file_)) {
+      char word[64] = {}, arg1[64] = {}, arg2[64] = {};
+      const int n = sscanf(line, "%63s %63s %63s", word, arg1, arg2);
+      if (n <= 0) continue;
+      const std::string keyword = word;
+      if (keyword == "end_header") {
+        if (!HasPosition()) {
+          LOG(ERROR) << "No vertex positions in " << path_;
+          return -1;
+        }
+        stride_ = offset;
+        return 0;
+      } else if (keyword == "format") {
+        const std::string format = arg1;
+        if (format == "ascii") {
+          format_ = kFormatPlyAscii;
+        } else if (format == "binary_little_endian") {
+          format_ = kFormatPlyBinary;
+        } else {
+          LOG(ERROR) << "Unsupported PLY format " << format << ": " << path_;
+          return -1;
+        }
+      } else if (keyword == "element") {
+        if (in_vertex) {
+          // Later elements are never read.
+          in_vertex = false;
+          seen_element = true;
+          continue;
+        }
+        if (strcmp(arg1, "vertex") != 0 || seen_element) {
+          if (strcmp(arg1, "vertex") == 0 || atoll(arg2) > 0) {
+            LOG(ERROR) << "PLY vertex element must come first: " << path_;
+            return -1;
+          }
+          continue;
+        }
+        in_vertex = true;
+        remaining_ = strtoull(arg2, nullptr, 10);
+      } else if (keyword == "property" && in_vertex) {
+        Property property;
+        if (strcmp(arg1, "list") == 0 || ParseType(arg1, &property.type)) {
+          LOG(ERROR) << "Unsupported PLY vertex property: " << line;
+          return -1;
+        }
+        const std::string name = arg2;
+        property.role = name == "x"       ? kRoleX
+                        : name == "y"     ? kRoleY
+                        : name == "z"     ? kRoleZ
+                        : name == "red"   ? kRoleRed
+                        : name == "green" ? kRoleGreen
+                        : name == "blue"  ? kRoleBlue
+                                          : kRoleNone;
+        property.offset = offset;
+        offset += TypeSize(property.type);
+        if (properties_.size() == kMaxProperties) {
+          LOG(ERROR) << "Too many PLY vertex properties: " << path_;
+          return -1;
+        }
+        properties_.push_back(property);
+      }
+    }
+    LOG(ERROR) << "Truncated PLY header: " << path_;
+    return -1;
+  }
+
+  bool HasPosition() const {
+    int found = 0;
+    for (const Property& property : properties_) {
+      if (property.role >= kRoleX && property.role <= kRoleZ) ++found;
+    }
+    return found == 3;
+  }
+
+  void Decode(const double* values, InputPoint* point) const {
+    point->color[0] = point->color[1] = point->color[2] = 255;
+    point->color[3] = 255;
+    for (size_t i = 0; i < properties_.size(); ++i) {
+      const Property& property = properties_[i];
+      const double v = values[i];
+      switch (property.role) {
+        case kRoleX: point->x = v; break;
+        case kRoleY: point->y = v; break;
+        case kRoleZ: point->z = v; break;
+        case kRoleRed:
+        case kRoleGreen:
+        case kRoleBlue:
+          point->color[property.role - kRoleRed] =
+              ToByte(v, ColorScale(property.type));
+          break;
+        default: break;
+      }
+    }
+  }
+
+  static double Load(const uint8_t* p, Type type) {
+    switch (type) {
+      case kInt8: return static_cast<int8_t>(*p);
+      case kUint8: return *p;
+      case kInt16: { int16_t v; memcpy(&v, p, 2); return v; }
+      case kUint16: { uint16_t v; memcpy(&v, p, 2); return v; }
+      case kInt32: { int32_t v; memcpy(&v, p, 4); return v; }
+      case kUint32: { uint32_t v; memcpy(&v, p, 4); return v; }
+      case kFloat32: { float v; memcpy(&v, p, 4); return v; }
+      case kFloat64: { double v; memcpy(&v, p, 8); return v; }
+    }
+    return 0.0;
+  }
+
+  int ReadPlyBinary(size_t max_points, std::vector<InputPoint>* points) {
+    const size_t count = std::min<uint64_t>(max_points, remaining_);
+    rows_.resize(count * stride_);
+    if (count && fread(rows_.data(), stride_, count, file_) != count) {
+      LOG(ERROR) << "Truncated PLY vertex data: " << path_;
+      return -1;
+    }
+    remaining_ -= count;
+    points->resize(count);
+    double values[kMaxProperties];
+    for (size_t i = 0; i < count; ++i) {
+      const uint8_t* row = rows_.data() + i * stride_;
+      for (size_t k = 0; k < properties_.size(); ++k) {
+        values[k] = Load(row + properties_[k].offset, properties_[k].type);
+      }
+      Decode(values, &(*points)[i]);
+    }
+    return 0;
+  }
+
+  std::string path_;
+  FILE* file_ = nullptr;
+  Format format_ = kFormatXyz;
+  std::vector<Property> properties_;
+  size_t stride_ = 0;
+  // PLY vertices not read yet.
+  uint64_t remaining_ = 0;
+  std::vector<uint8_t> rows_;
+};
+
+struct PointCloudBuildOptions {
+  // Leaves split above this many points, and no node holds more.
+  uint32_t max_node_points = 20000;
+  // Sample cells along the root cube; the root spacing is its size over
+  // this, and a node keeps at most one point per cell.
+  int grid_resolution = 128;
+  // Cubes with more points are split through temporary files instead of
+  // in memory, which bounds the memory use to about 16 bytes each.
+  size_t memory_points = 16 << 20;
+  // Deeper nodes keep max_node_points and drop the rest, which only
+  // happens for heaps of duplicate points.
+  int max_level = 24;
+};
+
+struct PointCloudBuildStats {
+  uint64_t points_read = 0;
+  uint64_t points_written = 0;
+  uint64_t points_dropped = 0;
+  size_t nodes = 0;
+  int levels = 0;
+  // Cubes split through temporary files.
+  size_t file_splits = 0;
+};
+
+// Converts point files into the octree of gl_point_cloud_file.hpp without
+// holding them in memory: one pass finds the bounds, a second writes the
+// points in float precision to a temporary file, and cubes with more than
+// memory_points points are split into eight temporary files, recursively,
+// until they fit. Those are built in memory by partitioning in place.
+//
+// Nodes are sampled bottom up: once the children of a node are built, the
+// node takes one point per grid cell of its level from the points the
+// children hold themselves, and those points leave the children. So each
+// point is stored once, and the upper levels of the tree never need more
+// than the children's samples in memory.
+class PointCloudBuilder {
+ public:
+  explicit PointCloudBuilder(
+      const PointCloudBuildOptions& options = PointCloudBuildOptions())
+      : options_(options) {}
+
+  int Build(const std::vector<std::string>& inputs, const std::string& dir,
+            PointCloudBuildStats* stats = nullptr) {
+    stats_ = PointCloudBuildStats();
+    nodes_.clear();
+    rng_.seed(1);
+    double min[3], max[3];
+    if (ComputeBounds(inputs, min, max) != 0) return -1;
+    if (stats_.points_read == 0) {
+      LOG(ERROR) << "No points in the input";
+      return -1;
+    }
+
+    PointCloudHeader header;
+    PointCloudFile::InitHeader(&header);
+    double extent = 0.0;
+    for (int c = 0; c < 3; ++c) {
+      header.origin[c] = min[c];
+      header.extent[c] = static_cast<float>(max[c] - min[c]);
+      extent = std::max(extent, max[c] - min[c]);
+    }
+    // Slack keeps the points on the far faces inside the cube.
+    header.cube_size = static_cast<float>(std::max(extent, 1e-6) * 1.0001);
+    header.spacing = header.cube_size / options_.grid_resolution;
+    header.max_node_points = options_.max_node_points;
+    root_spacing_ = header.spacing;
+
+    const std::string all_path = dir + "/points.tmp";
+    if (WriteRelative(inputs, header.origin, all_path) != 0) return -1;
+    const std::string points_path = PointCloudFile::PointsPath(dir);
+    points_file_ = fopen(points_path.c_str(), "wb");
+    if (points_file_ == nullptr) {
+      LOG(ERROR) << "Failed to create " << points_path;
+      return -1;
+    }
+    const float origin[3] = {0.0f, 0.0f, 0.0f};
+    Subtree root;
+    int ret = BuildFile(all_path, stats_.points_read, origin,
+                        header.cube_size, 0, &root);
+    if (ret == 0) ret = WriteNode(root.node, &root.points);
+    if (fclose(points_file_) != 0) ret = -1;
+    points_file_ = nullptr;
+    if (ret != 0) {
+      LOG(ERROR) << "Failed to build point cloud in " << dir;
+      return -1;
+    }
+
+    std::vector<PointCloudNode> nodes;
+    Flatten(root.node, &nodes);
+    header.num_nodes = static_cast<uint32_t>(nodes.size());
+    header.num_points = stats_.points_written;
+    if (PointCloudFile::WriteHierarchy(dir, header, nodes) != 0) return -1;
+    stats_.nodes = nodes.size();
+    if (stats) *stats = stats_;
+    return 0;
+  }
+
+ private:
+  PointCloudBuilder(const PointCloudBuilder&) = delete;
+  PointCloudBuilder& operator=(const PointCloudBuilder&) = delete;
+
+  static const size_t kBatch = 1 << 16;
+
+  struct BuildNode {
+    float cube_min[3];
+    float cube_size;
+    int level;
+    uint64_t offset;
+    uint32_t count;
+    int32_t children[8];
+  };
+
+  // A built node whose own points are not written yet, because its parent
+  // may still take some of them.
+  struct Subtree {
+    int32_t node = -1;
+    std::vector<PointRecord> points;
+  };
+
+  int ComputeBounds(const std::vector<std::string>& inputs, double* min,
+                    double* max) {
+    for (int c = 0; c < 3; ++c) {
+      min[c] = DBL_MAX;
+      max[c] = -DBL_MAX;
+    }
+    std::vector<InputPoint> batch;
+    for (const std::string& input : inputs) {
+      PointReader reader;
+      if (reader.Open(input) != 0) return -1;
+      for (;;) {
+        if (reader.Read(kBatch, &batch) != 0) return -1;
+        if (batch.empty()) break;
+        for (const InputPoint& p : batch) {
+          const double xyz[3] = {p.x, p.y, p.z};
+          for (int c = 0; c < 3; ++c) {
+            min[c] = std::min(min[c], xyz[c]);
+            max[c] = std::max(max[c], xyz[c]);
+          }
+        }
+        stats_.points_read += batch.size();
+      }
+    }
+    return 0;
+  }
+
+  int WriteRelative(const std::vector<std::string>& inputs,
+                    const double* origin, const std::string& path) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == nullptr) {
+      LOG(ERROR) << "Failed to create " << path;
+      return -1;
+    }
+    std::vector<InputPoint> batch;
+    std::vector<PointRecord> records;
+    bool ok = true;
+    for (size_t i = 0; ok && i < inputs.size(); ++i) {
+      PointReader reader;
+      ok = reader.Open(inputs[i]) == 0;
+      while (ok) {
+        ok = reader.Read(kBatch, &batch) == 0;
+        if (!ok || batch.empty()) break;
+        records.resize(batch.size());
+        for (size_t k = 0; k < batch.size(); ++k) {
+          const InputPoint& p = batch[k];
+          records[k].x = static_cast<float>(p.x - origin[0]);
+          records[k].y = static_cast<float>(p.y - origin[1]);
+          records[k].z = static_cast<float>(p.z - origin[2]);
+          memcpy(records[k].color, p.color, 4);
+        }
+        ok = fwrite(records.data(), sizeof(PointRecord), records.size(), f) ==
+             records.size();
+      }
+    }
+    if (fclose(f) != 0 || !ok) {
+      LOG(ERROR) << "Failed to write " << path;
+      remove(path.c_str());
+      return -1;
+    }
+    return 0;
+  }
+
+  int32_t NewNode(const float* cube_min, float cube_size, int level) {
+    BuildNode node;
+    memcpy(node.cube_min, cube_min, sizeof(node.cube_min));
+    node.cube_size = cube_size;
+    node.level = level;
+    node.offset = 0;
+    node.count = 0;
+    std::fill(node.children, node.children + 8, -1);
+    nodes_.push_back(node);
+    stats_.levels = std::max(stats_.levels, level + 1);
+    return static_cast<int32_t>(nodes_.size() - 1);
+  }
+
+  static void ChildCube(const float* cube_min, float cube_size, int child,
+                        float* child_min) {
+    const float half = 0.5f * cube_size;
+    for (int c = 0; c < 3; ++c) {
+      child_min[c] = cube_min[c] + (((child >> c) & 1) ? half : 0.0f);
+    }
+  }
+
+  static int Octant(const PointRecord& p, const float* mid) {
+    return (p.x >= mid[0]) | ((p.y >= mid[1]) << 1) | ((p.z >= mid[2]) << 2);
+  }
+
+  // Builds the cube from the points in `path`, which it deletes.
+  int BuildFile(const std::string& path, uint64_t count,
+                const float* cube_min, float cube_size, int level,
+                Subtree* subtree) {
+    if (count <= options_.memory_points || level >= options_.max_level) {
+      if (level >= options_.max_level && count > options_.max_node_points) {
+        stats_.points_dropped += count - options_.max_node_points;
+        count = options_.max_node_points;
+      }
+      std::vector<PointRecord> points(count);
+      FILE* f = fopen(path.c_str(), "rb");
+      const bool ok = f != nullptr && fread(points.data(), sizeof(PointRecord),
+                                            count, f) == count;
+      if (f) fclose(f);
+      remove(path.c_str());
+      if (!ok) {
+        LOG(ERROR) << "Failed to read " << path;
+        return -1;
+      }
+      return BuildRange(points.data(), points.data() + count, cube_min,
+                        cube_size, level, subtree);
+    }
+
+    ++stats_.file_splits;
+    const int32_t node = NewNode(cube_min, cube_size, level);
+    float mid[3];
+    for (int c = 0; c < 3; ++c) mid[c] = cube_min[c] + 0.5f * cube_size;
+    FILE* in = fopen(path.c_str(), "rb");
+    FILE* out[8] = {};
+    uint64_t counts[8] = {};
+    bool ok = in != nullptr;
+    for (int i = 0; ok && i < 8; ++i) {
+      out[i] = fopen((path + std::to_string(i)).c_str(), "wb");
+      ok = out[i] != nullptr;
+    }
+    std::vector<PointRecord> batch(kBatch);
+    while (ok) {
+      const size_t n = fread(batch.data(), sizeof(PointRecord), kBatch, in);
+      for (size_t k = 0; ok && k < n; ++k) {
+        const int i = Octant(batch[k], mid);
+        ok = fwrite(&batch[k], sizeof(PointRecord), 1, out[i]) == 1;
+        ++counts[i];
+      }
+      if (n < kBatch) break;
+    }
+    if (in) fclose(in);
+    for (FILE* f : out) {
+      if (f && fclose(f) != 0) ok = false;
+    }
+    remove(path.c_str());
+    if (!ok) {
+      LOG(ERROR) << "Failed to split " << path;
+      return -1;
+    }
+
+    std::vector<Subtree> children(8);
+    for (int i = 0; i < 8; ++i) {
+      const std::string child_path = path + std::to_string(i);
+      if (counts[i] == 0) {
+        remove(child_path.c_str());
+        continue;
+      }
+      float child_min[3];
+      ChildCube(cube_min, cube_size, i, child_min);
+      if (BuildFile(child_path, counts[i], child_min, 0.5f * cube_size,
+                    level + 1, &children[i]) != 0) {
+        return -1;
+      }
+    }
+    return Promote(node, &children, subtree);
+  }
+
+  int BuildRange(PointRecord* begin, PointRecord* end, const float* cube_min,
+                 float cube_size, int level, Subtree* subtree) {
+    const size_t count = end - begin;
+    if (count <= options_.max_node_points || level >= options_.max_level) {
+      subtree->node = NewNode(cube_min, cube_size, level);
+      if (count > options_.max_node_points) {
+        stats_.points_dropped += count - options_.max_node_points;
+        end = begin + options_.max_node_points;
+      }
+      subtree->points.assign(begin, end);
+      return 0;
+    }
+
+    const int32_t node = NewNode(cube_min, cube_size, level);
+    float mid[3];
+    for (int c = 0; c < 3; ++c) mid[c] = cube_min[c] + 0.5f * cube_size;
+    // Splits on x, then y, then z, so the octants end up in child index
+    // order: bounds[i] to bounds[i + 1] is child i.
+    PointRecord* bounds[9];
+    bounds[0] = begin;
+    bounds[8] = end;
+    bounds[4] = std::partition(begin, end, [&](const PointRecord& p) {
+      return p.z < mid[2];
+    });
+    for (int z = 0; z < 8; z += 4) {
+      bounds[z + 2] = std::partition(bounds[z], bounds[z + 4],
+                                     [&](const PointRecord& p) {
+                                       return p.y < mid[1];
+                                     });
+      for (int y = z; y < z + 4; y += 2) {
+        bounds[y + 1] = std::partition(bounds[y], bounds[y + 2],
+                                       [&](const PointRecord& p) {
+                                         return p.x < mid[0];
+                                       });
+      }
+    }
+
+    std::vector<Subtree> children(8);
+    for (int i = 0; i < 8; ++i) {
+      if (bounds[i] == bounds[i + 1]) continue;
+      float child_min[3];
+      ChildCube(cube_min, cube_size, i, child_min);
+      if (BuildRange(bounds[i], bounds[i + 1], child_min, 0.5f * cube_size,
+                     level + 1, &children[i]) != 0) {
+        return -1;
+      }
+    }
+    return Promote(node, &children, subtree);
+  }
+
+  // Moves a grid sample of the children's own points up into `node` and
+  // writes what the children keep. Children left without points or
+  // children of their own are dropped.
+  int Promote(int32_t node, std::vector<Subtree>* children,
+              Subtree* subtree) {
+    subtree->node = node;
+    const BuildNode& parent = nodes_[node];
+    const float cell = root_spacing_ / static_cast<float>(1 << parent.level);
+    const float inv_cell = 1.0f / cell;
+    const uint64_t cells = static_cast<uint64_t>(options_.grid_resolution);
+
+    // Candidates in random order, so the cap and the first point per cell
+    // do not favor one child.
+    std::vector<std::pair<uint32_t, uint32_t>> candidates;
+    for (uint32_t i = 0; i < 8; ++i) {
+      for (uint32_t k = 0; k < (*children)[i].points.size(); ++k) {
+        candidates.push_back(std::make_pair(i, k));
+      }
+    }
+    std::shuffle(candidates.begin(), candidates.end(), rng_);
+    std::vector<std::vector<bool>> promoted(8);
+    for (int i = 0; i < 8; ++i) {
+      promoted[i].assign((*children)[i].points.size(), false);
+    }
+    std::unordered_set<uint64_t> occupied;
+    occupied.reserve(std::min<size_t>(candidates.size(),
+                                      options_.max_node_points));
+    for (const auto& candidate : candidates) {
+      if (subtree->points.size() == options_.max_node_points) break;
+      const PointRecord& p = (*children)[candidate.first].points[
+          candidate.second];
+      uint64_t key = 0;
+      const float xyz[3] = {p.x, p.y, p.z};
+      for (int c = 0; c < 3; ++c) {
+        const float local = (xyz[c] - parent.cube_min[c]) * inv_cell;
+        const uint64_t index = std::min(
+            static_cast<uint64_t>(std::max(local, 0.0f)), cells - 1);
+        key = key * cells + index;
+      }
+      if (!occupied.insert(key).second) continue;
+      promoted[candidate.first][candidate.second] = true;
+      subtree->points.push_back(p);
+    }
+
+    for (int i = 0; i < 8; ++i) {
+      Subtree& child = (*children)[i];
+      if (child.node < 0) continue;
+      std::vector<PointRecord> kept;
+      kept.reserve(child.points.size());
+      for (size_t k = 0; k < child.points.size(); ++k) {
+        if (!promoted[i][k]) kept.push_back(child.points[k]);
+      }
+      const bool has_children =
+          std::any_of(nodes_[child.node].children,
+                      nodes_[child.node].children + 8,
+                      [](int32_t c) { return c >= 0; });
+      if (kept.empty() && !has_children) continue;
+      nodes_[node].children[i] = child.node;
+      if (WriteNode(child.node, &kept) != 0) return -1;
+      std::vector<PointRecord>().swap(child.points);
+    }
+    return 0;
+  }
+
+  int WriteNode(int32_t node, std::vector<PointRecord>* points) {
+    nodes_[node].offset = stats_.points_written;
+    nodes_[node].count = static_cast<uint32_t>(points->size());
+    if (!points->empty() &&
+        fwrite(points->data(), sizeof(PointRecord), points->size(),
+               points_file_) != points->size()) {
+      LOG(ERROR) << "Failed to write point cloud points";
+      return -1;
+    }
+    stats_.points_written += points->size();
+    std::vector<PointRecord>().swap(*points);
+    return 0;
+  }
+
+  // The reachable nodes breadth first, children next to each other.
+  void Flatten(int32_t root, std::vector<PointCloudNode>* nodes) const {
+    std::vector<int32_t> source(1, root);
+    nodes->clear();
+    for (size_t i = 0; i < source.size(); ++i) {
+      const BuildNode& node = nodes_[source[i]];
+      PointCloudNode out;
+      memset(&out, 0, sizeof(out));
+      out.offset = node.offset;
+      out.count = node.count;
+      memcpy(out.cube_min, node.cube_min, sizeof(out.cube_min));
+      out.cube_size = node.cube_size;
+      out.level = static_cast<uint8_t>(node.level);
+      out.first_child = static_cast<uint32_t>(source.size());
+      for (int c = 0; c < 8; ++c) {
+        if (node.children[c] < 0) continue;
+        out.child_mask |= 1 << c;
+        source.push_back(node.children[c]);
+      }
+      nodes->push_back(out);
+    }
+  }
+
+  PointCloudBuildOptions options_;
+  PointCloudBuildStats stats_;
+  std::vector<BuildNode> nodes_;
+  std::mt19937 rng_;
+  float root_spacing_ = 1.0f;
+  FILE* points_file_ = nullptr;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_POINT_CLOUD_BUILDER_HPP_
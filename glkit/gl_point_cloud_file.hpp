@@ -0,0 +1,138 @@
+#ifndef GLKIT_GL_POINT_CLOUD_FILE_HPP_
+#define GLKIT_GL_POINT_CLOUD_FILE_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "gl_base.hpp"
+
+namespace glkit {
+
+// One point as stored on disk and in the vertex buffer: the position as a
+// float offset from PointCloudHeader::origin, and RGBA color.
+struct PointRecord {
+  float x;
+  float y;
+  float z;
+  uint8_t color[4];
+};
+static_assert(sizeof(PointRecord) == 16, "PointRecord must be packed");
+
+// An octree point cloud is a directory of two files:
+//   hierarchy.bin  PointCloudHeader, then num_nodes PointCloudNode
+//   points.bin     the PointRecords of every node, one chunk per node
+// Every node holds a subsample of the points in its cube, spaced about
+// spacing / 2^level apart; the points of a node and all its descendants
+// together are the points of its cube, each stored once.
+struct PointCloudHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_nodes;
+  uint64_t num_points;
+  // Double precision, so georeferenced captures keep their coordinates.
+  double origin[3];
+  // The root cube, relative to origin.
+  float cube_min[3];
+  float cube_size;
+  // The points span origin to origin + extent.
+  float extent[3];
+  // Sample spacing of the root; halves with every level.
+  float spacing;
+  // Most points of a node, which sizes the GPU buffer slots.
+  uint32_t max_node_points;
+  uint32_t padding;
+};
+static_assert(sizeof(PointCloudHeader) == 88,
+              "PointCloudHeader must be packed");
+
+// Nodes are stored breadth first with the children of a node next to each
+// other, in child index order.
+struct PointCloudNode {
+  // First point of the chunk in points.bin.
+  uint64_t offset;
+  uint32_t count;
+  // Index of the first child; see child_mask.
+  uint32_t first_child;
+  float cube_min[3];
+  float cube_size;
+  // Bit i set for child i, whose cube is the octant at
+  // (i & 1, (i >> 1) & 1, (i >> 2) & 1) halves along x, y, z.
+  uint8_t child_mask;
+  uint8_t level;
+  uint16_t padding;
+  uint32_t padding2;
+};
+static_assert(sizeof(PointCloudNode) == 40, "PointCloudNode must be packed");
+
+class PointCloudFile {
+ public:
+  static const uint32_t kVersion = 1;
+
+  static std::string HierarchyPath(const std::string& dir) {
+    return dir + "/hierarchy.bin";
+  }
+  static std::string PointsPath(const std::string& dir) {
+    return dir + "/points.bin";
+  }
+
+  static void InitHeader(PointCloudHeader* header) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, Magic(), sizeof(header->magic));
+    header->version = kVersion;
+  }
+
+  static int WriteHierarchy(const std::string& dir,
+                            const PointCloudHeader& header,
+                            const std::vector<PointCloudNode>& nodes) {
+    const std::string path = HierarchyPath(dir);
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == nullptr) {
+      LOG(ERROR) << "Failed to create point cloud hierarchy: " << path;
+      return -1;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (ok && !nodes.empty()) {
+      ok = fwrite(nodes.data(), sizeof(PointCloudNode), nodes.size(), f) ==
+           nodes.size();
+    }
+    if (fclose(f) != 0 || !ok) {
+      LOG(ERROR) << "Failed to write point cloud hierarchy: " << path;
+      return -1;
+    }
+    return 0;
+  }
+
+  static int ReadHierarchy(const std::string& dir, PointCloudHeader* header,
+                           std::vector<PointCloudNode>* nodes) {
+    const std::string path = HierarchyPath(dir);
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+      LOG(ERROR) << "Failed to open point cloud hierarchy: " << path;
+      return -1;
+    }
+    bool ok = fread(header, sizeof(*header), 1, f) == 1 &&
+              memcmp(header->magic, Magic(), sizeof(header->magic)) == 0 &&
+              header->version == kVersion;
+    if (ok) {
+      nodes->resize(header->num_nodes);
+      ok = fread(nodes->data(), sizeof(PointCloudNode), nodes->size(), f) ==
+           nodes->size();
+    }
+    fclose(f);
+    if (!ok) {
+      LOG(ERROR) << "Invalid point cloud hierarchy: " << path;
+      return -1;
+    }
+    return 0;
+  }
+
+ private:
+  static const char* Magic() { return "GLKPCO1"; }
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_POINT_CLOUD_FILE_HPP_
@@ -0,0 +1,332 @@
+#ifndef GLKIT_GL_PROFILER_HPP_
+#define GLKIT_GL_PROFILER_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "gl_base.hpp"
+
+namespace glkit {
+
+const int kMaxProfileSections = 32;
+
+// One timed section of a frame. Times are steady clock nanoseconds.
+struct ProfileSection {
+  // Not copied; the profiler keeps the pointer, so pass string literals.
+  const char* name = nullptr;
+  int depth = 0;
+  int64_t start_ns = 0;
+  int64_t end_ns = 0;
+  // GPU time of the section; negative while the query is in flight, when
+  // the section was not GPU timed or the result came too late.
+  int64_t gpu_ns = -1;
+};
+
+struct ProfileFrame {
+  uint64_t index = 0;
+  int64_t start_ns = 0;
+  int64_t end_ns = 0;
+  int num_sections = 0;
+  ProfileSection sections[kMaxProfileSections];
+};
+
+// Section times averaged over the recorded frames, by name.
+struct ProfileSummary {
+  const char* name = nullptr;
+  int depth = 0;
+  float cpu_ms = 0.0f;
+  // Negative without GPU results.
+  float gpu_ms = -1.0f;
+};
+
+// Frame profiler of the render thread. Sections are recorded into a ring of
+// the last history() frames, allocated up front, so timing a section costs
+// two clock reads and no allocation; the ring is what the graph shows and
+// what ExportChromeTrace writes.
+//
+// GPU sections also run a GL_TIME_ELAPSED query. Their results are
+// collected kQueryLatency frames later, which the GPU has finished by then,
+// so reading them never waits; a result still not available is dropped
+// instead. Elapsed time queries cannot nest, so a GPU section inside
+// another is timed on the CPU only.
+class Profiler {
+ public:
+  static const int kMaxSections = kMaxProfileSections;
+  // Frames a GPU query may take before its result is read.
+  static const int kQueryLatency = 3;
+
+  // Records the last `history` frames, ten seconds at 60 Hz by default.
+  explicit Profiler(size_t history = 600)
+      : frames_(std::max(history, static_cast<size_t>(kQueryLatency + 1))) {}
+  ~Profiler() { Free(); }
+
+  bool enabled() const { return enabled_; }
+  void set_enabled(bool enabled) { enabled_ = enabled; }
+
+  size_t history() const { return frames_.size(); }
+  // GPU results given up on because they were not ready in time.
+  size_t dropped_queries() const { return dropped_queries_; }
+
+  void BeginFrame() {
+    in_frame_ = enabled_;
+    if (!in_frame_) return;
+    if (queries_.empty()) {
+      queries_.resize(kQueryLatency * kMaxSections);
+      glGenQueries(static_cast<GLsizei>(queries_.size()), queries_.data());
+    }
+    CollectQueries();
+    ProfileFrame& frame = frames_[frame_index_ % frames_.size()];
+    frame.index = frame_index_;
+    frame.start_ns = Now();
+    frame.end_ns = 0;
+    frame.num_sections = 0;
+    depth_ = 0;
+    gpu_section_ = -1;
+  }
+
+  void EndFrame() {
+    if (!in_frame_) return;
+    current().end_ns = Now();
+    in_frame_ = false;
+    ++frame_index_;
+    if (num_frames_ < frames_.size()) ++num_frames_;
+  }
+
+  // Starts a section and returns its handle for End, or -1 outside a frame
+  // and once kMaxSections sections were started in it.
+  int Begin(const char* name, bool gpu = false) {
+    if (!in_frame_) return -1;
+    ProfileFrame& frame = current();
+    if (frame.num_sections == kMaxSections) return -1;
+    const int id = frame.num_sections++;
+    ProfileSection& section = frame.sections[id];
+    section.name = name;
+    section.depth = depth_++;
+    section.end_ns = 0;
+    section.gpu_ns = -1;
+    if (gpu && gpu_section_ < 0) {
+      gpu_section_ = id;
+      glBeginQuery(GL_TIME_ELAPSED, Query(frame_index_, id));
+    }
+    section.start_ns = Now();
+    return id;
+  }
+
+  void End(int id) {
+    if (!in_frame_ || id < 0) return;
+    ProfileSection& section = current().sections[id];
+    section.end_ns = Now();
+    --depth_;
+    if (gpu_section_ == id) {
+      glEndQuery(GL_TIME_ELAPSED);
+      gpu_section_ = -1;
+      // Marks the query for CollectQueries.
+      section.gpu_ns = kPending;
+    }
+  }
+
+  // CPU frame times of the recorded frames, oldest first, in milliseconds.
+  void FrameTimes(std::vector<float>* ms) const {
+    ms->clear();
+    for (size_t i = 0; i < num_frames_; ++i) {
+      const ProfileFrame& frame = recorded(i);
+      ms->push_back(ToMs(frame.end_ns - frame.start_ns));
+    }
+  }
+
+  // Averages of every section name over the last `num_frames` recorded
+  // frames, in the order the sections first ran.
+  void Summarize(size_t num_frames,
+                 std::vector<ProfileSummary>* summary) const {
+    summary->clear();
+    std::vector<int> cpu_count, gpu_count;
+    std::vector<int64_t> cpu_ns, gpu_ns;
+    for (size_t i = num_frames_ - std::min(num_frames, num_frames_);
+         i < num_frames_; ++i) {
+      const ProfileFrame& frame = recorded(i);
+      for (int s = 0; s < frame.num_sections; ++s) {
+        const ProfileSection& section = frame.sections[s];
+        size_t k = 0;
+        while (k < summary->size() &&
+               strcmp((*summary)[k].name, section.name) != 0) {
+          ++k;
+        }
+        if (k == summary->size()) {
+          ProfileSummary entry;
+          entry.name = section.name;
+          entry.depth = section.depth;
+          summary->push_back(entry);
+          cpu_count.push_back(0);
+          gpu_count.push_back(0);
+          cpu_ns.push_back(0);
+          gpu_ns.push_back(0);
+        }
+        ++cpu_count[k];
+        cpu_ns[k] += section.end_ns - section.start_ns;
+        if (section.gpu_ns >= 0) {
+          ++gpu_count[k];
+          gpu_ns[k] += section.gpu_ns;
+        }
+      }
+    }
+    for (size_t k = 0; k < summary->size(); ++k) {
+      (*summary)[k].cpu_ms = ToMs(cpu_ns[k]) / cpu_count[k];
+      if (gpu_count[k]) (*summary)[k].gpu_ms = ToMs(gpu_ns[k]) / gpu_count[k];
+    }
+  }
+
+  // Writes the recorded frames in the Chrome trace event format, for
+  // chrome://tracing or Perfetto. CPU sections go on one track and GPU times
+  // on a second, placed at the CPU start of their section since elapsed
+  // time queries only measure durations.
+  int ExportChromeTrace(const std::string& path) const {
+    FILE* f = fopen(path.c_str(), "w");
+    if (f == nullptr) {
+      LOG(ERROR) << "Failed to create trace: " << path;
+      return -1;
+    }
+    const int64_t origin = num_frames_ ? recorded(0).start_ns : 0;
+    auto us = [origin](int64_t ns) { return (ns - origin) / 1000.0; };
+    fprintf(f,
+            "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+            "\"args\":{\"name\":\"CPU\"}},\n"
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,"
+            "\"args\":{\"name\":\"GPU\"}}");
+    for (size_t i = 0; i < num_frames_; ++i) {
+      const ProfileFrame& frame = recorded(i);
+      fprintf(f,
+              ",\n{\"name\":\"Frame %llu\",\"cat\":\"frame\",\"ph\":\"X\","
+              "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+              static_cast<unsigned long long>(frame.index),
+              us(frame.start_ns), ToUs(frame.end_ns - frame.start_ns));
+      for (int s = 0; s < frame.num_sections; ++s) {
+        const ProfileSection& section = frame.sections[s];
+        const std::string name = JsonEscape(section.name);
+        fprintf(f,
+                ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\","
+                "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+                name.c_str(), us(section.start_ns),
+                ToUs(section.end_ns - section.start_ns));
+        if (section.gpu_ns < 0) continue;
+        fprintf(f,
+                ",\n{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\","
+                "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":2}",
+                name.c_str(), us(section.start_ns), ToUs(section.gpu_ns));
+      }
+    }
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) {
+      LOG(ERROR) << "Failed to write trace: " << path;
+      return -1;
+    }
+    return 0;
+  }
+
+  // Deletes the queries; call before the context goes away.
+  void Free() {
+    if (!queries_.empty()) {
+      glDeleteQueries(static_cast<GLsizei>(queries_.size()), queries_.data());
+      queries_.clear();
+    }
+    collected_ = frame_index_;
+  }
+
+ private:
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  // gpu_ns of a section whose query is in flight.
+  static const int64_t kPending = -2;
+
+  static int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static float ToMs(int64_t ns) { return ns * 1e-6f; }
+  static double ToUs(int64_t ns) { return ns / 1000.0; }
+
+  static std::string JsonEscape(const char* s) {
+    std::string escaped;
+    for (; *s; ++s) {
+      if (*s == '"' || *s == '\\') escaped += '\\';
+      if (static_cast<unsigned char>(*s) >= 0x20) escaped += *s;
+    }
+    return escaped;
+  }
+
+  ProfileFrame& current() { return frames_[frame_index_ % frames_.size()]; }
+
+  // Recorded frame i, oldest first.
+  const ProfileFrame& recorded(size_t i) const {
+    return frames_[(frame_index_ - num_frames_ + i) % frames_.size()];
+  }
+
+  GLuint Query(uint64_t frame, int section) const {
+    return queries_[(frame % kQueryLatency) * kMaxSections + section];
+  }
+
+  // Reads the results of the frames whose queries the next frame reuses,
+  // and any later ones already available.
+  void CollectQueries() {
+    for (; collected_ < frame_index_; ++collected_) {
+      ProfileFrame& frame = frames_[collected_ % frames_.size()];
+      const bool reused = collected_ + kQueryLatency <= frame_index_;
+      for (int s = 0; s < frame.num_sections; ++s) {
+        ProfileSection& section = frame.sections[s];
+        if (section.gpu_ns != kPending) continue;
+        const GLuint query = Query(collected_, s);
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+          if (!reused) return;
+          section.gpu_ns = -1;
+          ++dropped_queries_;
+          continue;
+        }
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        section.gpu_ns = static_cast<int64_t>(elapsed);
+      }
+    }
+  }
+
+  std::vector<ProfileFrame> frames_;
+  // kQueryLatency frames of kMaxSections queries.
+  std::vector<GLuint> queries_;
+  uint64_t frame_index_ = 0;
+  // Frames before this one have all their GPU results.
+  uint64_t collected_ = 0;
+  size_t num_frames_ = 0;
+  size_t dropped_queries_ = 0;
+  int depth_ = 0;
+  int gpu_section_ = -1;
+  bool in_frame_ = false;
+  bool enabled_ = true;
+};
+
+// Times the enclosing scope as a section of `profiler`.
+class ProfileScope {
+ public:
+  ProfileScope(Profiler* profiler, const char* name, bool gpu = false)
+      : profiler_(profiler), id_(profiler->Begin(name, gpu)) {}
+  ~ProfileScope() { profiler_->End(id_); }
+
+ private:
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+  Profiler* profiler_;
+  int id_;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_PROFILER_HPP_
@@ -0,0 +1,227 @@
+#ifndef GLKIT_GL_PROGRAM_CACHE_HPP_
+#define GLKIT_GL_PROGRAM_CACHE_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "gl_base.hpp"
+#include "gl_hash.hpp"
+#include "gl_mapped_file.hpp"
+
+// glGetProgramBinary comes with GL 4.1 and ARB_get_program_binary; GL
+// headers without it, like the bundled 3.3 glad, build without the cache.
+#if defined(GL_PROGRAM_BINARY_LENGTH) && \
+    defined(GL_NUM_PROGRAM_BINARY_FORMATS)
+#define GLKIT_HAS_PROGRAM_BINARY 1
+#else
+#define GLKIT_HAS_PROGRAM_BINARY 0
+#endif
+
+namespace glkit {
+
+// On-disk layout of a cached program: this header, then binary_size bytes
+// from glGetProgramBinary.
+struct ProgramCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t binary_format;
+  uint64_t key;
+  uint64_t binary_size;
+};
+
+// Linked program binaries in one file per program under dir(), keyed by
+// the shader sources and the driver. Binaries are only valid for the
+// driver that made them, and drivers may still reject one after an
+// update they do not announce through the version string; Load then
+// fails and the caller compiles as usual.
+class ProgramCache {
+ public:
+  static const uint32_t kVersion = 1;
+  static const char* Extension() { return ".glkprog"; }
+
+  // Whether the context can store program binaries at all.
+  static bool Supported() {
+#if GLKIT_HAS_PROGRAM_BINARY
+    static const bool supported = [] {
+      GLint formats = 0;
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+      return formats > 0;
+    }();
+    return supported;
+#else
+    return false;
+#endif
+  }
+
+  // Sources hashed together with GL_VENDOR, GL_RENDERER and GL_VERSION.
+  static uint64_t Key(const std::string& vertex_src,
+                      const std::string& fragment_src) {
+    return Hash64(fragment_src, Hash64(vertex_src, DriverHash()));
+  }
+
+  // Empty disables the cache. The directory is created on the first Store.
+  const std::string& dir() const { return dir_; }
+  void set_dir(const std::string& dir) { dir_ = dir; }
+  bool enabled() const { return !dir_.empty() && Supported(); }
+
+  // Load calls that found a usable binary, and those that did not.
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+  std::string CachePath(uint64_t key) const {
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx",
+             static_cast<unsigned long long>(key));
+    return dir_ + "/" + name + Extension();
+  }
+
+  // Creates a linked program from the binary cached for `key`. Returns -1
+  // without logging an error when there is none; a binary the driver
+  // rejects is deleted so the next Store replaces it.
+  int Load(uint64_t key, GLuint* program) {
+    if (!enabled()) return -1;
+    if (LoadBinary(key, program) != 0) {
+      ++misses_;
+      return -1;
+    }
+    ++hits_;
+    return 0;
+  }
+
+  // Writes the binary of a linked program, through a temporary file so a
+  // concurrent reader never sees a partial one.
+  int Store(uint64_t key, GLuint program) {
+#if GLKIT_HAS_PROGRAM_BINARY
+    if (!enabled()) return -1;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+      LOG(WARN) << "Program binary not available";
+      return -1;
+    }
+    std::string binary(length, '\0');
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, &binary[0]);
+    RETURN_IF_GL_ERROR(-1, "glGetProgramBinary");
+    ProgramCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic(), sizeof(header.magic));
+    header.version = kVersion;
+    header.binary_format = format;
+    header.key = key;
+    header.binary_size = static_cast<uint64_t>(length);
+
+    MakeDir(dir_);
+    const std::string path = CachePath(key);
+    const std::string tmp_path = path + ".tmp";
+    FILE* f = fopen(tmp_path.c_str(), "wb");
+    if (f == nullptr) {
+      LOG(ERROR) << "Failed to create program cache: " << tmp_path;
+      return -1;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && fwrite(binary.data(), length, 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+    remove(path.c_str());
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+      LOG(ERROR) << "Failed to write program cache: " << path;
+      remove(tmp_path.c_str());
+      return -1;
+    }
+    return 0;
+#else
+    (void)key;
+    (void)program;
+    return -1;
+#endif
+  }
+
+ private:
+  static const char* Magic() { return "GLKPROG"; }
+
+  int LoadBinary(uint64_t key, GLuint* program) const {
+#if GLKIT_HAS_PROGRAM_BINARY
+    const std::string path = CachePath(key);
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return -1;
+    MappedFile file;
+    if (file.Open(path) != 0) return -1;
+    ProgramCacheHeader header;
+    if (file.size() < sizeof(header)) return Reject(&file, path, "truncated");
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, Magic(), sizeof(header.magic)) != 0 ||
+        header.version != kVersion || header.key != key) {
+      return Reject(&file, path, "incompatible");
+    }
+    // Against the space after the header, so a corrupt size cannot wrap;
+    // glProgramBinary takes a GLsizei.
+    if (header.binary_size > file.size() - sizeof(header) ||
+        header.binary_size > INT32_MAX) {
+      return Reject(&file, path, "truncated");
+    }
+    *program = glCreateProgram();
+    glProgramBinary(*program, header.binary_format,
+                    file.data() + sizeof(header),
+                    static_cast<GLsizei>(header.binary_size));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(*program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+      glDeleteProgram(*program);
+      *program = 0;
+      // Formats the driver dropped raise GL_INVALID_ENUM as well.
+      glGetError();
+      return Reject(&file, path, "rejected by the driver");
+    }
+    return 0;
+#else
+    (void)key;
+    (void)program;
+    return -1;
+#endif
+  }
+
+  static uint64_t DriverHash() {
+    static const uint64_t hash = [] {
+      std::string driver;
+      const GLenum names[3] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+      for (GLenum name : names) {
+        const GLubyte* value = glGetString(name);
+        if (value) driver += reinterpret_cast<const char*>(value);
+        driver += '\n';
+      }
+      return Hash64(driver);
+    }();
+    return hash;
+  }
+
+  static void MakeDir(const std::string& dir) {
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+  }
+
+  static int Reject(MappedFile* file, const std::string& path,
+                    const char* reason) {
+    file->Close();
+    LOG(INFO) << "Ignoring " << reason << " program cache: " << path;
+    remove(path.c_str());
+    return -1;
+  }
+
+  std::string dir_;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_PROGRAM_CACHE_HPP_
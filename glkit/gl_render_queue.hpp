@@ -0,0 +1,199 @@
+#ifndef GLKIT_GL_RENDER_QUEUE_HPP_
+#define GLKIT_GL_RENDER_QUEUE_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "gl_base.hpp"
+#include "gl_hash.hpp"
+#include "gl_mesh.hpp"
+#include "gl_shader.hpp"
+
+namespace glkit {
+
+enum RenderPass {
+  kRenderPassOpaque = 0,
+  // Drawn after the opaque pass, back to front.
+  kRenderPassTransparent = 1,
+};
+
+// Per-object parameters of the object and light shaders.
+struct Material {
+  Vec3 color = Vec3(1.0f);
+  int render_mode = 0;
+
+  bool operator==(const Material& o) const {
+    return color == o.color && render_mode == o.render_mode;
+  }
+  bool operator!=(const Material& o) const { return !(*this == o); }
+};
+
+struct DrawItem {
+  Shader* shader = nullptr;
+  const Mesh* mesh = nullptr;
+  int lod = 0;
+  Mat4 model = Mat4(1.0f);
+  Material material;
+  // View space distance, used for the order within a state bucket.
+  float depth = 0.0f;
+  RenderPass pass = kRenderPassOpaque;
+};
+
+struct RenderQueueStats {
+  size_t draws = 0;
+  size_t program_binds = 0;
+  size_t program_binds_skipped = 0;
+  size_t vao_binds = 0;
+  size_t vao_binds_skipped = 0;
+  size_t uniform_writes = 0;
+  size_t uniform_writes_skipped = 0;
+};
+
+// Collects the draws of a frame, sorts them by a packed 64-bit key and
+// issues them, binding programs and VAOs and writing per-mesh and material
+// uniforms only when they differ from the previous draw.
+//
+// Key layout, most significant first:
+//   pass:4 | program:12 | material:12 | mesh:16 | depth:20
+class RenderQueue {
+ public:
+  RenderQueue() = default;
+  ~RenderQueue() = default;
+
+  void Submit(const DrawItem& item) {
+    items_.push_back(item);
+    keys_.push_back(std::make_pair(MakeKey(item), items_.size() - 1));
+  }
+
+  // Draws and clears the queued items. The program and VAO bindings are
+  // left unspecified afterwards.
+  int Flush() {
+    std::sort(keys_.begin(), keys_.end());
+    stats_ = RenderQueueStats();
+    Shader* shader = nullptr;
+    const Mesh* mesh = nullptr;
+    const ShaderUniforms* uniforms = nullptr;
+    Material material;
+    for (const auto& key : keys_) {
+      const DrawItem& item = items_[key.second];
+      bool program_changed = item.shader != shader;
+      if (program_changed) {
+        shader = item.shader;
+        shader->Use();
+        uniforms = &Uniforms(shader);
+        ++stats_.program_binds;
+      } else {
+        ++stats_.program_binds_skipped;
+      }
+      if (item.mesh != mesh) {
+        glBindVertexArray(item.mesh->vao());
+        ++stats_.vao_binds;
+      } else {
+        ++stats_.vao_binds_skipped;
+      }
+      // Uniform values live in the program, so a program switch forgets
+      // what was written.
+      if (program_changed || item.mesh != mesh) {
+        shader->Set(uniforms->pos_offset, item.mesh->position_offset());
+        shader->Set(uniforms->pos_scale, item.mesh->position_scale());
+        stats_.uniform_writes += 2;
+      } else {
+        stats_.uniform_writes_skipped += 2;
+      }
+      mesh = item.mesh;
+      if (program_changed || item.material != material) {
+        material = item.material;
+        shader->Set(uniforms->color, material.color);
+        shader->Set(uniforms->render_mode, material.render_mode);
+        stats_.uniform_writes += 2;
+      } else {
+        stats_.uniform_writes_skipped += 2;
+      }
+      shader->Set(uniforms->model, item.model);
+      ++stats_.uniform_writes;
+      item.mesh->DrawElements(item.lod);
+      ++stats_.draws;
+    }
+    glBindVertexArray(0);
+    items_.clear();
+    keys_.clear();
+    RETURN_IF_GL_ERROR(-1, "Failed to flush render queue");
+    return 0;
+  }
+
+  size_t size() const { return items_.size(); }
+
+  // Counters of the last Flush.
+  const RenderQueueStats& stats() const { return stats_; }
+
+ private:
+  RenderQueue(const RenderQueue&) = delete;
+  RenderQueue& operator=(const RenderQueue&) = delete;
+
+  struct ShaderUniforms {
+    // Shader::generation() the handles belong to.
+    uint32_t generation = 0;
+    Uniform<Mat4> model;
+    Uniform<Vec3> pos_offset;
+    Uniform<Vec3> pos_scale;
+    Uniform<Vec3> color;
+    Uniform<int> render_mode;
+  };
+
+  const ShaderUniforms& Uniforms(Shader* shader) {
+    auto it = shader_uniforms_.find(shader);
+    if (it != shader_uniforms_.end() &&
+        it->second.generation == shader->generation()) {
+      return it->second;
+    }
+    ShaderUniforms& u = shader_uniforms_[shader];
+    u = ShaderUniforms();
+    u.generation = shader->generation();
+    u.model = shader->GetUniform<Mat4>("model");
+    if (shader->HasUniform("pos_offset")) {
+      u.pos_offset = shader->GetUniform<Vec3>("pos_offset");
+      u.pos_scale = shader->GetUniform<Vec3>("pos_scale");
+    }
+    if (shader->HasUniform("color")) {
+      u.color = shader->GetUniform<Vec3>("color");
+    }
+    if (shader->HasUniform("render_mode")) {
+      u.render_mode = shader->GetUniform<int>("render_mode");
+    }
+    return u;
+  }
+
+  // Small ids in first seen order, stable across frames.
+  uint64_t Id(const void* ptr, uint64_t mask) {
+    auto it = ids_.insert(std::make_pair(ptr, ids_.size()));
+    return it.first->second & mask;
+  }
+
+  uint64_t MakeKey(const DrawItem& item) {
+    uint64_t material = Hash64(&item.material.color, sizeof(Vec3),
+                               item.material.render_mode) &
+                        0xFFF;
+    // The bits of a non-negative float sort like the float.
+    float depth = std::max(item.depth, 0.0f);
+    uint32_t depth_bits;
+    memcpy(&depth_bits, &depth, sizeof(depth_bits));
+    uint64_t depth_key = depth_bits >> 12;
+    if (item.pass == kRenderPassTransparent) depth_key = 0xFFFFF - depth_key;
+    return static_cast<uint64_t>(item.pass & 0xF) << 60 |
+           Id(item.shader, 0xFFF) << 48 | material << 36 |
+           Id(item.mesh, 0xFFFF) << 20 | depth_key;
+  }
+
+  std::vector<DrawItem> items_;
+  std::vector<std::pair<uint64_t, size_t>> keys_;
+  std::unordered_map<const void*, uint64_t> ids_;
+  std::unordered_map<Shader*, ShaderUniforms> shader_uniforms_;
+  RenderQueueStats stats_;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_RENDER_QUEUE_HPP_
@@ -0,0 +1,477 @@
+#ifndef GLKIT_GL_SCENE_BVH_HPP_
+#define GLKIT_GL_SCENE_BVH_HPP_
+
+#include <float.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <utility>
+#include <vector>
+
+#include "gl_base.hpp"
+#include "gl_bounds.hpp"
+#include "gl_frustum.hpp"
+#include "gl_model.hpp"
+
+namespace glkit {
+
+// Bounding volume hierarchy over the world bounds of scene objects.
+//
+// Moving objects only refit: Update marks the path from the object's leaf to
+// the root and Refit recomputes the marked nodes in one backward sweep (the
+// build places children after their parent). Refitting keeps queries exact
+// but lets the tree drift from a good split, so Refit tracks the SAH cost of
+// the tree and, once it exceeds rebuild_threshold times the cost right after
+// the last build, or too many objects were inserted since, starts a binned
+// SAH build on a snapshot of the bounds in a background thread. The finished
+// tree is swapped in by a later Refit and refitted to the current bounds.
+// Objects inserted after the snapshot wait in a pending list that queries
+// scan linearly.
+class SceneBvh : public ModelObserver {
+ public:
+  static const int kMaxLeafSize = 4;
+
+  SceneBvh() = default;
+  ~SceneBvh() { WaitForRebuild(); }
+
+  uint32_t Insert(const Aabb& bounds) {
+    uint32_t id;
+    if (!free_ids_.empty()) {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+      bounds_[id] = bounds;
+      live_[id] = 1;
+    } else {
+      id = static_cast<uint32_t>(bounds_.size());
+      bounds_.push_back(bounds);
+      live_.push_back(1);
+      object_slot_.push_back(-1);
+    }
+    ++size_;
+    if (object_slot_[id] >= 0) {
+      // The id still owns a slot in the tree from before its removal.
+      SetSlotBounds(object_slot_[id], bounds);
+      --removed_in_tree_;
+    } else {
+      pending_.push_back(id);
+    }
+    return id;
+  }
+
+  // Inserts the world bounds of `model` and observes it, so its transform
+  // setters update the tree. The returned id is also model->observer_id().
+  uint32_t Insert(Model* model) {
+    uint32_t id = Insert(model->GetWorldBounds());
+    model->set_observer(this, id);
+    return id;
+  }
+
+  // The id may be returned again by a later Insert.
+  void Remove(uint32_t id) {
+    if (!live_[id]) return;
+    live_[id] = 0;
+    bounds_[id] = Aabb();
+    --size_;
+    if (object_slot_[id] >= 0) {
+      SetSlotBounds(object_slot_[id], Aabb());
+      ++removed_in_tree_;
+    } else {
+      pending_.erase(std::find(pending_.begin(), pending_.end(), id));
+    }
+    free_ids_.push_back(id);
+  }
+
+  void Remove(Model* model) {
+    Remove(model->observer_id());
+    model->set_observer(nullptr, 0);
+  }
+
+  void Update(uint32_t id, const Aabb& bounds) {
+    bounds_[id] = bounds;
+    if (object_slot_[id] >= 0) SetSlotBounds(object_slot_[id], bounds);
+  }
+
+  void OnTransformChanged(const Model& model) override {
+    Update(model.observer_id(), model.GetWorldBounds());
+  }
+
+  // Call once per frame before the queries: swaps in a finished background
+  // build, refits the nodes marked by Update and starts a background build
+  // when the tree has degraded.
+  void Refit() {
+    if (rebuild_.valid() && rebuild_.wait_for(std::chrono::seconds(0)) ==
+                                std::future_status::ready) {
+      Apply(rebuild_.get());
+    }
+    RefitDirty();
+    if (!rebuild_.valid() && NeedsRebuild()) {
+      rebuild_ = std::async(std::launch::async, &SceneBvh::Build, bounds_,
+                            live_);
+    }
+  }
+
+  // Builds the tree from scratch on the calling thread.
+  void Rebuild() {
+    WaitForRebuild();
+    Apply(Build(bounds_, live_));
+  }
+
+  // Appends the ids of the objects whose bounds intersect the frustum; see
+  // Frustum::Intersects(const Aabb&).
+  void QueryFrustum(const Frustum& frustum,
+                    std::vector<uint32_t>* result) const {
+    Query([&](const Vec3& min, const Vec3& max) {
+      Aabb box;
+      box.min = min;
+      box.max = max;
+      return frustum.Intersects(box);
+    }, result);
+  }
+
+  void QuerySphere(const BoundingSphere& sphere,
+                   std::vector<uint32_t>* result) const {
+    const float radius2 = sphere.radius * sphere.radius;
+    Query([&](const Vec3& min, const Vec3& max) {
+      const Vec3 d = glm::clamp(sphere.center, min, max) - sphere.center;
+      return glm::dot(d, d) <= radius2;
+    }, result);
+  }
+
+  void QueryBox(const Aabb& box, std::vector<uint32_t>* result) const {
+    Query([&](const Vec3& min, const Vec3& max) {
+      return min.x <= box.max.x && max.x >= box.min.x &&
+             min.y <= box.max.y && max.y >= box.min.y &&
+             min.z <= box.max.z && max.z >= box.min.z;
+    }, result);
+  }
+
+  // Objects whose bounds the ray enters within [0, max_t], in no
+  // particular order.
+  void QueryRay(const Ray& ray, float max_t,
+                std::vector<uint32_t>* result) const {
+    const Vec3 inv_direction = SafeInverse(ray.direction);
+    Query([&](const Vec3& min, const Vec3& max) {
+      return IntersectRayBox(ray.origin, inv_direction, max_t, min, max) !=
+             FLT_MAX;
+    }, result);
+  }
+
+  // Number of live objects.
+  size_t size() const { return size_; }
+  const Aabb& bounds(uint32_t id) const { return bounds_[id]; }
+  const std::vector<BvhNode>& nodes() const { return nodes_; }
+  size_t pending() const { return pending_.size(); }
+
+  // SAH cost of the tree: the surface area of every node relative to the
+  // root, weighted by its item count for leaves.
+  float sah_cost() const {
+    const float root = nodes_.empty() ? 0.0f : HalfArea(nodes_[0]);
+    return root > 0.0f ? static_cast<float>(cost_ / root) : 0.0f;
+  }
+  float build_sah_cost() const { return build_cost_; }
+
+  bool rebuilding() const { return rebuild_.valid(); }
+  size_t rebuilds() const { return rebuilds_; }
+
+  // Factor over build_sah_cost at which Refit starts a rebuild.
+  float rebuild_threshold() const { return rebuild_threshold_; }
+  void set_rebuild_threshold(float threshold) {
+    rebuild_threshold_ = threshold;
+  }
+
+ private:
+  SceneBvh(const SceneBvh&) = delete;
+  SceneBvh& operator=(const SceneBvh&) = delete;
+
+  struct Tree {
+    std::vector<BvhNode> nodes;
+    std::vector<int32_t> parents;
+    // Object id of every item slot, grouped by leaf.
+    std::vector<uint32_t> items;
+  };
+
+  static float HalfArea(const Vec3& min, const Vec3& max) {
+    const Vec3 d = max - min;
+    if (d.x < 0.0f || d.y < 0.0f || d.z < 0.0f) return 0.0f;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+  }
+  static float HalfArea(const BvhNode& node) {
+    return HalfArea(node.min, node.max);
+  }
+  static float HalfArea(const Aabb& box) { return HalfArea(box.min, box.max); }
+
+  static double NodeCost(const BvhNode& node) {
+    return static_cast<double>(HalfArea(node)) *
+           (node.count > 0 ? node.count : 1);
+  }
+
+  // Binned SAH build over the live objects. Runs on the background thread,
+  // so it only touches its arguments.
+  static Tree Build(std::vector<Aabb> bounds, std::vector<uint8_t> live) {
+    const int kBins = 16;
+    // Past this depth splits fall back to the object median, which bounds
+    // the depth of the traversal stack.
+    const int kMaxSahDepth = 40;
+    Tree tree;
+    std::vector<Vec3> centroids(bounds.size());
+    for (size_t id = 0; id < bounds.size(); ++id) {
+      if (!live[id]) continue;
+      tree.items.push_back(static_cast<uint32_t>(id));
+      centroids[id] = bounds[id].empty() ? Vec3(0.0f) : bounds[id].center();
+    }
+    if (tree.items.empty()) return tree;
+
+    struct Task {
+      int32_t node;
+      int32_t begin;
+      int32_t end;
+      int depth;
+    };
+    std::vector<Task> stack;
+    tree.nodes.resize(1);
+    tree.parents.push_back(-1);
+    stack.push_back(Task{0, 0, static_cast<int32_t>(tree.items.size()), 0});
+    while (!stack.empty()) {
+      const Task task = stack.back();
+      stack.pop_back();
+      uint32_t* items = tree.items.data();
+      Aabb box, centroid_box;
+      for (int32_t i = task.begin; i < task.end; ++i) {
+        box.Extend(bounds[items[i]]);
+        centroid_box.Extend(centroids[items[i]]);
+      }
+      BvhNode& node = tree.nodes[task.node];
+      node.min = box.min;
+      node.max = box.max;
+      node.first = task.begin;
+      node.count = task.end - task.begin;
+      if (node.count <= kMaxLeafSize) continue;
+
+      // Best split plane over the bins of all three axes.
+      int best_axis = -1, best_bin = 0;
+      float best_cost = HalfArea(box) * node.count;
+      const Vec3 extent = centroid_box.size();
+      if (task.depth < kMaxSahDepth) {
+        for (int axis = 0; axis < 3; ++axis) {
+          if (extent[axis] <= 0.0f) continue;
+          const float scale = kBins / extent[axis];
+          Aabb bin_box[kBins];
+          int bin_count[kBins] = {0};
+          for (int32_t i = task.begin; i < task.end; ++i) {
+            const int b = std::min(
+                kBins - 1,
+                static_cast<int>((centroids[items[i]][axis] -
+                                  centroid_box.min[axis]) * scale));
+            bin_box[b].Extend(bounds[items[i]]);
+            ++bin_count[b];
+          }
+          float right_area[kBins];
+          int right_count[kBins];
+          Aabb acc;
+          int count = 0;
+          for (int b = kBins - 1; b > 0; --b) {
+            acc.Extend(bin_box[b]);
+            count += bin_count[b];
+            right_area[b] = HalfArea(acc);
+            right_count[b] = count;
+          }
+          acc = Aabb();
+          count = 0;
+          for (int b = 0; b + 1 < kBins; ++b) {
+            acc.Extend(bin_box[b]);
+            count += bin_count[b];
+            if (count == 0 || right_count[b + 1] == 0) continue;
+            const float cost = HalfArea(acc) * count +
+                               right_area[b + 1] * right_count[b + 1];
+            if (cost < best_cost) {
+              best_cost = cost;
+              best_axis = axis;
+              best_bin = b;
+            }
+          }
+        }
+      }
+
+      int32_t mid;
+      if (best_axis >= 0) {
+        const float scale = kBins / extent[best_axis];
+        const float origin = centroid_box.min[best_axis];
+        mid = static_cast<int32_t>(
+            std::partition(items + task.begin, items + task.end,
+                           [&](uint32_t id) {
+                             return std::min(kBins - 1,
+                                             static_cast<int>(
+                                                 (centroids[id][best_axis] -
+                                                  origin) * scale)) <=
+                                    best_bin;
+                           }) -
+            items);
+      } else if (node.count <= kMaxLeafSize * 4 &&
+                 task.depth < kMaxSahDepth) {
+        // Splitting does not pay off.
+        continue;
+      } else {
+        int axis = 0;
+        if (extent.y > extent[axis]) axis = 1;
+        if (extent.z > extent[axis]) axis = 2;
+        mid = (task.begin + task.end) / 2;
+        std::nth_element(items + task.begin, items + mid, items + task.end,
+                         [&](uint32_t a, uint32_t b) {
+                           return centroids[a][axis] < centroids[b][axis];
+                         });
+      }
+
+      const int32_t left = static_cast<int32_t>(tree.nodes.size());
+      tree.nodes.resize(tree.nodes.size() + 2);
+      tree.parents.push_back(task.node);
+      tree.parents.push_back(task.node);
+      tree.nodes[task.node].first = left;
+      tree.nodes[task.node].count = 0;
+      stack.push_back(Task{left, task.begin, mid, task.depth + 1});
+      stack.push_back(Task{left + 1, mid, task.end, task.depth + 1});
+    }
+    return tree;
+  }
+
+  void Apply(Tree tree) {
+    nodes_.swap(tree.nodes);
+    parents_.swap(tree.parents);
+    items_.swap(tree.items);
+    item_bounds_.resize(items_.size());
+    item_leaf_.resize(items_.size());
+    object_slot_.assign(bounds_.size(), -1);
+    for (size_t n = 0; n < nodes_.size(); ++n) {
+      const BvhNode& node = nodes_[n];
+      for (int32_t i = node.first; i < node.first + node.count; ++i) {
+        item_leaf_[i] = static_cast<int32_t>(n);
+      }
+    }
+    removed_in_tree_ = 0;
+    for (size_t i = 0; i < items_.size(); ++i) {
+      const uint32_t id = items_[i];
+      object_slot_[id] = static_cast<int32_t>(i);
+      item_bounds_[i] = bounds_[id];
+      if (!live_[id]) ++removed_in_tree_;
+    }
+    pending_.clear();
+    for (size_t id = 0; id < bounds_.size(); ++id) {
+      if (live_[id] && object_slot_[id] < 0) {
+        pending_.push_back(static_cast<uint32_t>(id));
+      }
+    }
+    // Objects moved while the build ran, so refit everything once.
+    dirty_.assign(nodes_.size(), 1);
+    num_dirty_ = nodes_.size();
+    cost_ = 0.0;
+    for (const auto& node : nodes_) cost_ += NodeCost(node);
+    RefitDirty();
+    build_cost_ = sah_cost();
+    ++rebuilds_;
+  }
+
+  void SetSlotBounds(int32_t slot, const Aabb& bounds) {
+    item_bounds_[slot] = bounds;
+    for (int32_t n = item_leaf_[slot]; n >= 0 && !dirty_[n]; n = parents_[n]) {
+      dirty_[n] = 1;
+      ++num_dirty_;
+    }
+  }
+
+  void RefitDirty() {
+    if (num_dirty_ == 0) return;
+    for (size_t n = nodes_.size(); n-- > 0;) {
+      if (!dirty_[n]) continue;
+      dirty_[n] = 0;
+      BvhNode& node = nodes_[n];
+      cost_ -= NodeCost(node);
+      Aabb box;
+      if (node.count > 0) {
+        for (int32_t i = node.first; i < node.first + node.count; ++i) {
+          box.Extend(item_bounds_[i]);
+        }
+      } else {
+        for (int32_t c = node.first; c < node.first + 2; ++c) {
+          box.min = glm::min(box.min, nodes_[c].min);
+          box.max = glm::max(box.max, nodes_[c].max);
+        }
+      }
+      node.min = box.min;
+      node.max = box.max;
+      cost_ += NodeCost(node);
+    }
+    num_dirty_ = 0;
+  }
+
+  bool NeedsRebuild() const {
+    if (size_ == 0) return false;
+    const size_t limit = std::max<size_t>(64, size_ / 8);
+    if (pending_.size() > limit || removed_in_tree_ > limit) return true;
+    return !nodes_.empty() && sah_cost() > build_cost_ * rebuild_threshold_;
+  }
+
+  void WaitForRebuild() {
+    if (rebuild_.valid()) rebuild_.get();
+  }
+
+  // Stack based traversal; overlaps(min, max) tests both node and object
+  // bounds.
+  template <typename Overlaps>
+  void Query(Overlaps overlaps, std::vector<uint32_t>* result) const {
+    if (!nodes_.empty()) {
+      int32_t stack[64];
+      int top = 0;
+      stack[top++] = 0;
+      while (top > 0) {
+        const BvhNode& node = nodes_[stack[--top]];
+        if (node.min.x > node.max.x || !overlaps(node.min, node.max)) {
+          continue;
+        }
+        if (node.count == 0) {
+          stack[top++] = node.first + 1;
+          stack[top++] = node.first;
+          continue;
+        }
+        for (int32_t i = node.first; i < node.first + node.count; ++i) {
+          const Aabb& box = item_bounds_[i];
+          if (!box.empty() && overlaps(box.min, box.max)) {
+            result->push_back(items_[i]);
+          }
+        }
+      }
+    }
+    for (uint32_t id : pending_) {
+      const Aabb& box = bounds_[id];
+      if (!box.empty() && overlaps(box.min, box.max)) result->push_back(id);
+    }
+  }
+
+  // Per object id.
+  std::vector<Aabb> bounds_;
+  std::vector<uint8_t> live_;
+  std::vector<int32_t> object_slot_;
+  std::vector<uint32_t> free_ids_;
+  std::vector<uint32_t> pending_;
+  size_t size_ = 0;
+
+  // Flat tree; item slots are indexed by BvhNode::first of the leaves.
+  std::vector<BvhNode> nodes_;
+  std::vector<int32_t> parents_;
+  std::vector<uint8_t> dirty_;
+  size_t num_dirty_ = 0;
+  std::vector<uint32_t> items_;
+  std::vector<Aabb> item_bounds_;
+  std::vector<int32_t> item_leaf_;
+  size_t removed_in_tree_ = 0;
+
+  double cost_ = 0.0;
+  float build_cost_ = 0.0f;
+  float rebuild_threshold_ = 1.3f;
+  size_t rebuilds_ = 0;
+  std::future<Tree> rebuild_;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_SCENE_BVH_HPP_
@@ -0,0 +1,282 @@
+#ifndef GLKIT_GL_SCENE_GRAPH_HPP_
+#define GLKIT_GL_SCENE_GRAPH_HPP_
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "gl_base.hpp"
+
+namespace glkit {
+
+// translate * rotate X * rotate Y * rotate Z * scale, the transform of a
+// Model, written out instead of multiplying five matrices.
+inline Mat4 ComposeTransform(const Vec3& position, const Vec3& rotation,
+                             const Vec3& scale) {
+  const float cx = cosf(rotation.x), sx = sinf(rotation.x);
+  const float cy = cosf(rotation.y), sy = sinf(rotation.y);
+  const float cz = cosf(rotation.z), sz = sinf(rotation.z);
+  Mat4 m;
+  m[0] = Vec4(cy * cz, cx * sz + sx * sy * cz, sx * sz - cx * sy * cz, 0.0f) *
+         scale.x;
+  m[1] = Vec4(-cy * sz, cx * cz - sx * sy * sz, sx * cz + cx * sy * sz, 0.0f) *
+         scale.y;
+  m[2] = Vec4(sy, -sx * cy, cx * cy, 0.0f) * scale.z;
+  m[3] = Vec4(position, 1.0f);
+  return m;
+}
+
+// Stable handle of a SceneGraph node.
+typedef uint32_t SceneNode;
+const SceneNode kNoSceneNode = 0xffffffffu;
+
+// Hierarchy of transforms. Every node has a local transform relative to its
+// parent; Update composes the world matrices of the nodes whose local
+// transform or one of whose ancestors changed, and leaves the rest cached.
+//
+// The nodes are stored breadth-first in contiguous arrays, every parent
+// before its children, so Update is one forward pass that reads the parent
+// world matrix it already wrote. Structural changes (Create, Destroy,
+// SetParent) only mark the order stale; the next Update restores it.
+// Handles stay valid across the reordering.
+class SceneGraph {
+ public:
+  SceneGraph() = default;
+
+  // A node with the identity transform under `parent`, or a root.
+  SceneNode Create(SceneNode parent = kNoSceneNode) {
+    SceneNode node;
+    if (!free_nodes_.empty()) {
+      node = free_nodes_.back();
+      free_nodes_.pop_back();
+    } else {
+      node = static_cast<SceneNode>(slot_of_.size());
+      slot_of_.push_back(-1);
+    }
+    const int32_t slot = static_cast<int32_t>(node_of_.size());
+    slot_of_[node] = slot;
+    node_of_.push_back(node);
+    parent_.push_back(valid(parent) ? slot_of_[parent] : -1);
+    position_.push_back(Vec3(0.0f));
+    rotation_.push_back(Vec3(0.0f));
+    scale_.push_back(Vec3(1.0f));
+    local_.push_back(Mat4(1.0f));
+    world_.push_back(Mat4(1.0f));
+    version_.push_back(0);
+    flags_.push_back(kLocalDirty);
+    dirty_ = true;
+    order_dirty_ = true;
+    return node;
+  }
+
+  // Removes the node and everything below it.
+  int Destroy(SceneNode node) {
+    if (!valid(node)) {
+      LOG(ERROR) << "Invalid scene node: " << node;
+      return -1;
+    }
+    Reorder(slot_of_[node]);
+    return 0;
+  }
+
+  // Moves the node under `parent`, or makes it a root; its local transform
+  // is kept. Fails when `parent` is the node or below it.
+  int SetParent(SceneNode node, SceneNode parent) {
+    if (!valid(node) || (parent != kNoSceneNode && !valid(parent))) {
+      LOG(ERROR) << "Invalid scene node: " << node << " or " << parent;
+      return -1;
+    }
+    for (int32_t s = valid(parent) ? slot_of_[parent] : -1; s >= 0;
+         s = parent_[s]) {
+      if (s == slot_of_[node]) {
+        LOG(ERROR) << "Scene node " << parent << " is below " << node;
+        return -1;
+      }
+    }
+    const int32_t slot = slot_of_[node];
+    parent_[slot] = valid(parent) ? slot_of_[parent] : -1;
+    flags_[slot] |= kWorldDirty;
+    dirty_ = true;
+    order_dirty_ = true;
+    return 0;
+  }
+
+  bool valid(SceneNode node) const {
+    return node < slot_of_.size() && slot_of_[node] >= 0;
+  }
+
+  SceneNode parent(SceneNode node) const {
+    const int32_t parent = parent_[slot_of_[node]];
+    return parent >= 0 ? node_of_[parent] : kNoSceneNode;
+  }
+
+  Vec3 position(SceneNode node) const { return position_[slot_of_[node]]; }
+  void set_position(SceneNode node, const Vec3& position) {
+    position_[slot_of_[node]] = position;
+    MarkLocal(node);
+  }
+
+  Vec3 rotation(SceneNode node) const { return rotation_[slot_of_[node]]; }
+  void set_rotation(SceneNode node, const Vec3& rotation) {
+    rotation_[slot_of_[node]] = rotation;
+    MarkLocal(node);
+  }
+
+  Vec3 scale(SceneNode node) const { return scale_[slot_of_[node]]; }
+  void set_scale(SceneNode node, const Vec3& scale) {
+    scale_[slot_of_[node]] = scale;
+    MarkLocal(node);
+  }
+
+  // Both as of the last Update.
+  const Mat4& local_matrix(SceneNode node) const {
+    return local_[slot_of_[node]];
+  }
+  const Mat4& world_matrix(SceneNode node) const {
+    return world_[slot_of_[node]];
+  }
+  // Changes whenever Update changes the world matrix, so users can cache
+  // what they derive from it.
+  uint32_t world_version(SceneNode node) const {
+    return version_[slot_of_[node]];
+  }
+
+  size_t size() const { return node_of_.size(); }
+  // World matrices the last Update recomputed.
+  size_t updated() const { return updated_; }
+
+  // Recomputes the dirty local matrices and the world matrices below them,
+  // and appends the nodes whose world matrix changed to `changed`, parents
+  // first. Without changes since the last call it returns right away.
+  void Update(std::vector<SceneNode>* changed = nullptr) {
+    updated_ = 0;
+    if (order_dirty_) Reorder(-1);
+    if (!dirty_) return;
+    dirty_ = false;
+    const size_t count = node_of_.size();
+    for (size_t s = 0; s < count; ++s) {
+      const uint8_t flags = flags_[s] & (kLocalDirty | kWorldDirty);
+      const int32_t parent = parent_[s];
+      if (flags & kLocalDirty) {
+        local_[s] = ComposeTransform(position_[s], rotation_[s], scale_[s]);
+      }
+      // Parents come first, so their kChanged is already this pass's.
+      if (!flags && (parent < 0 || !(flags_[parent] & kChanged))) {
+        flags_[s] = 0;
+        continue;
+      }
+      world_[s] = parent >= 0 ? world_[parent] * local_[s] : local_[s];
+      flags_[s] = kChanged;
+      ++version_[s];
+      ++updated_;
+      if (changed) changed->push_back(node_of_[s]);
+    }
+  }
+
+ private:
+  SceneGraph(const SceneGraph&) = delete;
+  SceneGraph& operator=(const SceneGraph&) = delete;
+
+  enum : uint8_t {
+    kLocalDirty = 1,
+    // The parent changed; the local matrix is current.
+    kWorldDirty = 2,
+    // Set by Update on the nodes it recomputed, until the next Update.
+    kChanged = 4,
+  };
+
+  void MarkLocal(SceneNode node) {
+    flags_[slot_of_[node]] |= kLocalDirty;
+    dirty_ = true;
+  }
+
+  // Sorts the slots by depth, keeping the order within a depth, and drops
+  // the subtree at slot `removed` if it is >= 0.
+  void Reorder(int32_t removed) {
+    const size_t count = node_of_.size();
+    std::vector<int32_t> depth(count, -1);
+    std::vector<int32_t> path;
+    for (size_t s = 0; s < count; ++s) {
+      int32_t d = static_cast<int32_t>(s);
+      while (d >= 0 && depth[d] < 0) {
+        path.push_back(d);
+        d = parent_[d];
+      }
+      int32_t level = d >= 0 ? depth[d] : -1;
+      while (!path.empty()) {
+        depth[path.back()] = ++level;
+        path.pop_back();
+      }
+    }
+    std::vector<int32_t> order(count);
+    for (size_t s = 0; s < count; ++s) order[s] = static_cast<int32_t>(s);
+    std::stable_sort(order.begin(), order.end(),
+                     [&depth](int32_t a, int32_t b) {
+                       return depth[a] < depth[b];
+                     });
+
+    // Parents are placed first, so removal follows them down.
+    std::vector<int32_t> new_slot(count, -1);
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i) {
+      const int32_t s = order[i];
+      const int32_t parent = parent_[s];
+      if (s == removed || (parent >= 0 && new_slot[parent] < 0)) {
+        slot_of_[node_of_[s]] = -1;
+        free_nodes_.push_back(node_of_[s]);
+        continue;
+      }
+      new_slot[s] = static_cast<int32_t>(kept);
+      order[kept++] = s;
+    }
+    order.resize(kept);
+
+    Permute(order, &node_of_);
+    Permute(order, &parent_);
+    Permute(order, &position_);
+    Permute(order, &rotation_);
+    Permute(order, &scale_);
+    Permute(order, &local_);
+    Permute(order, &world_);
+    Permute(order, &version_);
+    Permute(order, &flags_);
+    for (size_t s = 0; s < kept; ++s) {
+      slot_of_[node_of_[s]] = static_cast<int32_t>(s);
+      if (parent_[s] >= 0) parent_[s] = new_slot[parent_[s]];
+      if (flags_[s] & ~kChanged) dirty_ = true;
+    }
+    order_dirty_ = false;
+  }
+
+  template <typename T>
+  static void Permute(const std::vector<int32_t>& order,
+                      std::vector<T>* values) {
+    std::vector<T> permuted;
+    permuted.reserve(order.size());
+    for (int32_t s : order) permuted.push_back((*values)[s]);
+    values->swap(permuted);
+  }
+
+  // Per slot, breadth-first.
+  std::vector<SceneNode> node_of_;
+  std::vector<int32_t> parent_;
+  std::vector<Vec3> position_;
+  std::vector<Vec3> rotation_;
+  std::vector<Vec3> scale_;
+  std::vector<Mat4> local_;
+  std::vector<Mat4> world_;
+  std::vector<uint32_t> version_;
+  std::vector<uint8_t> flags_;
+  // Per node; -1 for free handles.
+  std::vector<int32_t> slot_of_;
+  std::vector<SceneNode> free_nodes_;
+  size_t updated_ = 0;
+  bool order_dirty_ = false;
+  // Some flag is set.
+  bool dirty_ = false;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_SCENE_GRAPH_HPP_
@@ -1,57 +1,222 @@
 #ifndef GLKIT_GL_SHADER_HPP_
 #define GLKIT_GL_SHADER_HPP_
 
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 
 #include "gl_base.hpp"
+#include "gl_frame_uniforms.hpp"
+#include "gl_program_cache.hpp"
 
 namespace glkit {
 
+// A uniform location resolved once with Shader::GetUniform and set with
+// Shader::Set, without a name lookup. Setting an invalid handle is a no-op,
+// like glUniform* with location -1.
+template <typename T>
+struct Uniform {
+  GLint location = -1;
+  bool valid() const { return location != -1; }
+};
+
+// GL types a value of type T may be assigned to.
+template <typename T>
+struct UniformTraits;
+
+template <>
+struct UniformTraits<int> {
+  static bool Accepts(GLenum type) {
+    switch (type) {
+      case GL_INT:
+      case GL_BOOL:
+      case GL_SAMPLER_2D:
+      case GL_SAMPLER_3D:
+      case GL_SAMPLER_CUBE:
+      case GL_SAMPLER_2D_SHADOW:
+      case GL_SAMPLER_2D_ARRAY:
+        return true;
+      default:
+        return false;
+    }
+  }
+};
+
+template <>
+struct UniformTraits<float> {
+  static bool Accepts(GLenum type) { return type == GL_FLOAT; }
+};
+
+template <>
+struct UniformTraits<Vec2> {
+  static bool Accepts(GLenum type) { return type == GL_FLOAT_VEC2; }
+};
+
+template <>
+struct UniformTraits<Vec3> {
+  static bool Accepts(GLenum type) { return type == GL_FLOAT_VEC3; }
+};
+
+template <>
+struct UniformTraits<Vec4> {
+  static bool Accepts(GLenum type) { return type == GL_FLOAT_VEC4; }
+};
+
+template <>
+struct UniformTraits<Mat4> {
+  static bool Accepts(GLenum type) { return type == GL_FLOAT_MAT4; }
+};
+
 class Shader {
  public:
   Shader() = default;
 
-  int Init(const std::string& vertex_src, const std::string& fragment_src) {
-    int ret = 0;
-    GLuint vertex_shader = 0;
-    ret = CompileShader(GL_VERTEX_SHADER, vertex_src, &vertex_shader);
-    if (ret != 0) return ret;
-    GLuint fragment_shader = 0;
-    ret = CompileShader(GL_FRAGMENT_SHADER, fragment_src, &fragment_shader);
-    if (ret != 0) return ret;
-    ret = CreateShaderProgram(vertex_shader, fragment_shader, &program_);
-
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
-    return ret;
+  // With an enabled `cache` the program comes from a binary of the same
+  // sources when the driver accepts it, and a program built from source is
+  // stored there for the next run.
+  int Init(const std::string& vertex_src, const std::string& fragment_src,
+           ProgramCache* cache = nullptr) {
+    const bool cached = cache && cache->enabled();
+    const uint64_t key = cached ? ProgramCache::Key(vertex_src, fragment_src)
+                                : 0;
+    GLuint program = 0;
+    if (cached && cache->Load(key, &program) == 0) return Swap(program);
+    program = StartProgram(vertex_src, fragment_src, cached);
+    if (program == 0) return -1;
+    std::string error;
+    if (FinishProgram(program, &error) != 0) {
+      LOG(ERROR) << "Unable to build shader program:\n" << error;
+      return -1;
+    }
+    if (cached && cache->Store(key, program) != 0) {
+      LOG(WARN) << "Failed to cache shader program";
+    }
+    return Swap(program);
   }
 
   int InitFromFile(const std::string& vertex_file,
-                   const std::string& fragment_file) {
-    std::ifstream fin(vertex_file);
-    if (!fin.is_open()) {
-      LOG(ERROR) << "Failed to open file: " << vertex_file;
+                   const std::string& fragment_file,
+                   ProgramCache* cache = nullptr) {
+    std::string vertex_src, fragment_src;
+    if (ReadFile(vertex_file, &vertex_src) != 0 ||
+        ReadFile(fragment_file, &fragment_src) != 0) {
       return -1;
     }
-    std::stringstream vertex_ss;
-    vertex_ss << fin.rdbuf();
-    fin.close();
-    std::string vertex_src = vertex_ss.str();
+    vertex_file_ = vertex_file;
+    fragment_file_ = fragment_file;
+    return Init(vertex_src, fragment_src, cache);
+  }
 
-    fin.open(fragment_file);
+  static int ReadFile(const std::string& path, std::string* contents) {
+    std::ifstream fin(path);
     if (!fin.is_open()) {
-      LOG(ERROR) << "Failed to open file: " << fragment_file;
+      LOG(ERROR) << "Failed to open file: " << path;
       return -1;
     }
-    std::stringstream fragment_ss;
-    fragment_ss << fin.rdbuf();
-    fin.close();
-    std::string fragment_src = fragment_ss.str();
+    std::stringstream ss;
+    ss << fin.rdbuf();
+    *contents = ss.str();
+    return 0;
+  }
+
+  // Issues compiling and linking a program without asking for the result,
+  // so a driver that compiles on threads of its own is not waited for
+  // here; see ProgramCompleted and FinishProgram. Returns 0 on failure.
+  // `retrievable` asks for a program ProgramCache can store.
+  static GLuint StartProgram(const std::string& vertex_src,
+                             const std::string& fragment_src,
+                             bool retrievable = false) {
+    const GLuint program = glCreateProgram();
+    if (program == 0) {
+      LOG(ERROR) << "Unable to create shader program";
+      return 0;
+    }
+#if GLKIT_HAS_PROGRAM_BINARY
+    if (retrievable) {
+      glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                          GL_TRUE);
+    }
+#else
+    (void)retrievable;
+#endif
+    const GLenum types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+    const char* sources[2] = {vertex_src.c_str(), fragment_src.c_str()};
+    for (int i = 0; i < 2; ++i) {
+      const GLuint shader = glCreateShader(types[i]);
+      if (shader == 0) {
+        LOG(ERROR) << "Unable to create shader of type: " << types[i];
+        glDeleteProgram(program);
+        return 0;
+      }
+      glShaderSource(shader, 1, &sources[i], NULL);
+      glCompileShader(shader);
+      glAttachShader(program, shader);
+      // Deleted along with the program.
+      glDeleteShader(shader);
+    }
+    glLinkProgram(program);
+    return program;
+  }
+
+  // Whether asking for the link status of `program` would not block. Only
+  // drivers with GL_KHR_parallel_shader_compile can tell; others always
+  // report true.
+  static bool ProgramCompleted(GLuint program) {
+    static const GLenum kCompletionStatusKhr = 0x91B1;
+    if (!HasParallelCompile()) return true;
+    GLint completed = GL_TRUE;
+    glGetProgramiv(program, kCompletionStatusKhr, &completed);
+    return completed == GL_TRUE;
+  }
+
+  // Waits for a program from StartProgram. On failure the program is
+  // deleted and `error` receives the compile and link logs.
+  static int FinishProgram(GLuint program, std::string* error) {
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked) return 0;
+    error->clear();
+    GLuint shaders[2];
+    GLsizei count = 0;
+    glGetAttachedShaders(program, 2, &count, shaders);
+    for (GLsizei i = 0; i < count; ++i) {
+      GLint compiled = GL_FALSE;
+      glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &compiled);
+      if (compiled) continue;
+      GLint type = 0;
+      glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+      *error += type == GL_VERTEX_SHADER ? "vertex shader:\n"
+                                         : "fragment shader:\n";
+      *error += InfoLog(shaders[i], glGetShaderiv, glGetShaderInfoLog);
+    }
+    if (error->empty()) {
+      *error = "link:\n" + InfoLog(program, glGetProgramiv,
+                                    glGetProgramInfoLog);
+    }
+    glDeleteProgram(program);
+    return -1;
+  }
 
-    return Init(vertex_src, fragment_src);
+  // Replaces the program with a linked one, taking ownership, and reloads
+  // the uniform table. Handles from GetUniform may change, so holders
+  // compare generation() with the one they resolved them at.
+  int Swap(GLuint program) {
+    Free();
+    program_ = program;
+    ++generation_;
+    LoadUniforms();
+    // Programs declaring the shared per-frame block read it from its fixed
+    // binding point.
+    if (HasUniformBlock(FrameUniforms::BlockName())) {
+      return BindUniformBlock(FrameUniforms::BlockName(),
+                              FrameUniforms::kBinding);
+    }
+    return 0;
   }
 
   int Use() const {
@@ -60,43 +225,90 @@ class Shader {
     return 0;
   }
 
+  bool HasUniformBlock(const char* name) const {
+    return glGetUniformBlockIndex(program_, name) != GL_INVALID_INDEX;
+  }
+
+  // Sources uniform block `name` from uniform buffer binding `binding`.
+  int BindUniformBlock(const char* name, GLuint binding) {
+    GLuint index = glGetUniformBlockIndex(program_, name);
+    if (index == GL_INVALID_INDEX) {
+      LOG(ERROR) << "Uniform block " << name << " not found";
+      return -1;
+    }
+    glUniformBlockBinding(program_, index, binding);
+    RETURN_IF_GL_ERROR(-1, "glUniformBlockBinding " << name);
+    return 0;
+  }
+
+  bool HasUniform(const char* name) const {
+    auto it = uniforms_.find(name);
+    return it != uniforms_.end() && it->second.location != -1;
+  }
+
+  // Resolves a uniform of the linked program. A missing uniform or one whose
+  // GL type does not take a T yields an invalid handle, with a warning
+  // logged once per name.
+  template <typename T>
+  Uniform<T> GetUniform(const char* name) {
+    Uniform<T> uniform;
+    const UniformInfo& info = FindUniform(name);
+    if (info.location == -1) return uniform;
+    if (!UniformTraits<T>::Accepts(info.type)) {
+      LOG_IF(WARN, WarnOnce(name))
+          << "Uniform " << name << " has mismatched type " << info.type;
+      return uniform;
+    }
+    uniform.location = info.location;
+    return uniform;
+  }
+
+  // Setters for the program in use. They neither look up names nor check
+  // glGetError, so they are cheap enough for per-object use.
+  void Set(Uniform<int> uniform, int value) {
+    glUniform1i(uniform.location, value);
+  }
+  void Set(Uniform<float> uniform, float value) {
+    glUniform1f(uniform.location, value);
+  }
+  void Set(Uniform<Vec2> uniform, const Vec2& value) {
+    glUniform2fv(uniform.location, 1, &value[0]);
+  }
+  void Set(Uniform<Vec3> uniform, const Vec3& value) {
+    glUniform3fv(uniform.location, 1, &value[0]);
+  }
+  void Set(Uniform<Vec4> uniform, const Vec4& value) {
+    glUniform4fv(uniform.location, 1, &value[0]);
+  }
+  void Set(Uniform<Mat4> uniform, const Mat4& value) {
+    glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &value[0][0]);
+  }
+
+  // Name based setters, looked up in the table built at link time. A
+  // missing uniform is reported once and then ignored.
   int SetInt(const char* name, int value) {
-    auto loc = glGetUniformLocation(program_, name);
-    LOG_IF(WARN, loc == -1) << "Uniform " << name << " not found";
-    glUniform1i(loc, value);
-    RETURN_IF_GL_ERROR(-1, "glUniform1i " << name);
+    glUniform1i(FindUniform(name).location, value);
     return 0;
   }
 
   int SetFloat(const char* name, float value) {
-    auto loc = glGetUniformLocation(program_, name);
-    LOG_IF(WARN, loc == -1) << "Uniform " << name << " not found";
-    glUniform1f(loc, value);
-    RETURN_IF_GL_ERROR(-1, "glUniform1f " << name);
+    glUniform1f(FindUniform(name).location, value);
     return 0;
   }
 
   int SetVec3(const char* name, const Vec3& value) {
-    auto loc = glGetUniformLocation(program_, name);
-    LOG_IF(WARN, loc == -1) << "Uniform " << name << " not found";
-    glUniform3fv(loc, 1, &value[0]);
-    RETURN_IF_GL_ERROR(-1, "glUniform3fv " << name);
+    glUniform3fv(FindUniform(name).location, 1, &value[0]);
     return 0;
   }
 
   int SetVec3(const char* name, float x, float y, float z) {
-    auto loc = glGetUniformLocation(program_, name);
-    LOG_IF(WARN, loc == -1) << "Uniform " << name << " not found";
-    glUniform3f(loc, x, y, z);
-    RETURN_IF_GL_ERROR(-1, "glUniform3f " << name);
+    glUniform3f(FindUniform(name).location, x, y, z);
     return 0;
   }
 
   int SetMat4(const char* name, const Mat4& value, bool row_major = false) {
-    auto loc = glGetUniformLocation(program_, name);
-    LOG_IF(WARN, loc == -1) << "Uniform " << name << " not found";
-    glUniformMatrix4fv(loc, 1, row_major, &value[0][0]);
-    RETURN_IF_GL_ERROR(-1, "glUniformMatrix4fv " << name);
+    glUniformMatrix4fv(FindUniform(name).location, 1, row_major,
+                       &value[0][0]);
     return 0;
   }
 
@@ -105,61 +317,111 @@ class Shader {
       glDeleteProgram(program_);
       program_ = 0;
     }
+    uniforms_.clear();
   }
 
   ~Shader() { Free(); }
 
+  GLuint program() const { return program_; }
+  // Bumped by every program swap, starting at 1 after Init.
+  uint32_t generation() const { return generation_; }
+  // Source files of InitFromFile; empty for shaders built from strings.
+  const std::string& vertex_file() const { return vertex_file_; }
+  const std::string& fragment_file() const { return fragment_file_; }
+
  private:
   Shader(const Shader&) = delete;
   Shader& operator=(const Shader&) = delete;
 
-  int CompileShader(GLenum shader_type, const std::string& shader_source,
-                    GLuint* shader) {
-    *shader = glCreateShader(shader_type);
-    if (*shader == 0) {
-      LOG(ERROR) << "Unable to create shader of type: " << shader_type;
-      return -1;
-    }
-    const char* shader_source_cstr = shader_source.c_str();
-    glShaderSource(*shader, 1, &shader_source_cstr, NULL);
-    glCompileShader(*shader);
-
-    GLint compiled;
-    glGetShaderiv(*shader, GL_COMPILE_STATUS, &compiled);
-    if (!compiled) {
-      LOG(ERROR) << "Unable to compile shader:\n" << shader_source;
-      GL_ERROR_LOG(Shader, *shader, "compile");
-      glDeleteShader(*shader);
-      *shader = 0;
-      return -1;
+  struct UniformInfo {
+    GLint location = -1;
+    GLenum type = 0;
+    // Whether a missing or mismatched lookup has been reported.
+    bool warned = false;
+  };
+
+  // Fills the uniform table from the active uniforms of the linked program.
+  // Arrays are entered without their "[0]" suffix as well; uniforms in
+  // blocks have no location and are skipped.
+  void LoadUniforms() {
+    uniforms_.clear();
+    GLint count = 0, max_length = 0;
+    glGetProgramiv(program_, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::string name(std::max(max_length, 1), '\0');
+    for (GLint i = 0; i < count; ++i) {
+      GLsizei length = 0;
+      GLint size = 0;
+      GLenum type = 0;
+      glGetActiveUniform(program_, static_cast<GLuint>(i), max_length,
+                         &length, &size, &type, &name[0]);
+      std::string uniform_name(name.data(), length);
+      UniformInfo info;
+      info.location = glGetUniformLocation(program_, uniform_name.c_str());
+      info.type = type;
+      if (info.location == -1) continue;
+      uniforms_[uniform_name] = info;
+      // Arrays are reported as "name[0]" and also found as "name". Only a
+      // trailing index counts: "lights[0].position" is not "lights".
+      const size_t size_of_name = uniform_name.size();
+      if (size_of_name > 3 &&
+          uniform_name.compare(size_of_name - 3, 3, "[0]") == 0) {
+        uniforms_[uniform_name.substr(0, size_of_name - 3)] = info;
+      }
     }
-    return 0;
   }
 
-  int CreateShaderProgram(GLuint vertex_shader, GLuint fragment_shader,
-                          GLuint* shader_program) {
-    *shader_program = glCreateProgram();
-    if (*shader_program == 0) {
-      LOG(ERROR) << "Unable to create shader program";
-      return -1;
-    }
-    glAttachShader(*shader_program, vertex_shader);
-    glAttachShader(*shader_program, fragment_shader);
+  // Unknown names are entered with location -1 after their warning, so
+  // they are reported once.
+  const UniformInfo& FindUniform(const char* name) {
+    auto it = uniforms_.find(name);
+    if (it != uniforms_.end()) return it->second;
+    LOG(WARN) << "Uniform " << name << " not found";
+    UniformInfo& info = uniforms_[name];
+    info.warned = true;
+    return info;
+  }
 
-    glLinkProgram(*shader_program);
+  bool WarnOnce(const char* name) {
+    UniformInfo& info = uniforms_[name];
+    if (info.warned) return false;
+    info.warned = true;
+    return true;
+  }
 
-    GLint is_linked = 0;
-    glGetProgramiv(*shader_program, GL_LINK_STATUS, &is_linked);
-    if (!is_linked) {
-      LOG(ERROR) << "Unable to link shader program";
-      glDeleteProgram(*shader_program);
-      *shader_program = 0;
-      return -1;
-    }
-    return 0;
+  template <typename GetIv, typename GetLog>
+  static std::string InfoLog(GLuint object, GetIv get_iv, GetLog get_log) {
+    GLint length = 0;
+    get_iv(object, GL_INFO_LOG_LENGTH, &length);
+    if (length <= 0) return std::string();
+    std::string log(length, '\0');
+    get_log(object, length, &length, &log[0]);
+    log.resize(length);
+    return log;
+  }
+
+  static bool HasParallelCompile() {
+    static const bool has = [] {
+      GLint count = 0;
+      glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+      for (GLint i = 0; i < count; ++i) {
+        const char* name = reinterpret_cast<const char*>(
+            glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+        if (name && (strcmp(name, "GL_KHR_parallel_shader_compile") == 0 ||
+                     strcmp(name, "GL_ARB_parallel_shader_compile") == 0)) {
+          return true;
+        }
+      }
+      return false;
+    }();
+    return has;
   }
 
   GLuint program_ = 0;
+  uint32_t generation_ = 0;
+  std::string vertex_file_;
+  std::string fragment_file_;
+  std::unordered_map<std::string, UniformInfo> uniforms_;
 };
 
 }  // namespace glkit
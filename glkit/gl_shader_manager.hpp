@@ -1,10 +1,13 @@
 #ifndef GLKIT_GL_SHADER_MANAGER_HPP_
 #define GLKIT_GL_SHADER_MANAGER_HPP_
 
+#include <chrono>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "gl_file_watcher.hpp"
 #include "gl_shader.hpp"
 
 namespace glkit {
@@ -12,7 +15,9 @@ namespace glkit {
 class ShaderManager {
  public:
   ShaderManager() = default;
-  ~ShaderManager() = default;
+  ~ShaderManager() {
+    for (const auto& reload : reloads_) glDeleteProgram(reload.program);
+  }
 
   Shader* GetShader(const std::string& name) {
     auto it = shaders_.find(name);
@@ -32,12 +37,15 @@ class ShaderManager {
     }
     shader_pool_.emplace_back(new Shader());
     Shader* shader = shader_pool_.back().get();
-    if (shader->InitFromFile(vertex_file, fragment_file) != 0) {
+    auto start = std::chrono::steady_clock::now();
+    if (shader->InitFromFile(vertex_file, fragment_file, cache()) != 0) {
       shader_pool_.pop_back();
       LOG(ERROR) << "Failed to add shader: " << name;
       return nullptr;
     }
+    AddBuildTime(name, start);
     shaders_[name] = shader;
+    if (watch_) Watch(shader);
     return shader;
   }
 
@@ -50,26 +58,196 @@ class ShaderManager {
     }
     shader_pool_.emplace_back(new Shader());
     Shader* shader = shader_pool_.back().get();
-    if (shader->Init(vertex_src, fragment_src) != 0) {
+    auto start = std::chrono::steady_clock::now();
+    if (shader->Init(vertex_src, fragment_src, cache()) != 0) {
       shader_pool_.pop_back();
       LOG(ERROR) << "Failed to add shader: " << name;
       return nullptr;
     }
+    AddBuildTime(name, start);
     shaders_[name] = shader;
     return shader;
   }
 
   void Clear() {
+    for (const auto& reload : reloads_) glDeleteProgram(reload.program);
+    reloads_.clear();
+    errors_.clear();
+    watcher_.Clear();
     shaders_.clear();
     shader_pool_.clear();
   }
 
+  // Directory of the program binary cache; empty, the default, compiles
+  // every program from source. Drivers without program binaries ignore it.
+  const std::string& program_cache_dir() const {
+    return program_cache_.dir();
+  }
+  void set_program_cache_dir(const std::string& dir) {
+    program_cache_.set_dir(dir);
+  }
+  const ProgramCache& program_cache() const { return program_cache_; }
+
+  // Time spent in AddShader and AddShaderFromFile, to compare startup with
+  // a cold and a warm program cache.
+  float build_ms() const { return build_ms_; }
+
+  // Watch mode: Update recompiles shaders whose source files change and
+  // swaps the program into the same Shader, so nothing holding a Shader*
+  // needs to know.
+  bool watch() const { return watch_; }
+  int set_watch(bool watch) {
+    if (watch == watch_) return 0;
+    watch_ = watch;
+    watcher_.Clear();
+    if (!watch_) return 0;
+    for (const auto& entry : shaders_) {
+      if (Watch(entry.second) != 0) return -1;
+    }
+    return 0;
+  }
+
+  // Call once per frame on the GL thread. Changed sources are compiled and
+  // linked without waiting; a later Update picks up the result, so the
+  // driver can compile while a frame is drawn. A program that fails keeps
+  // the old one in place and leaves its log in errors(). Returns the number
+  // of reloads that finished, swapped in or failed.
+  size_t Update() {
+    size_t finished = 0;
+    // Programs started by an earlier Update, finished even after watching
+    // was turned off.
+    for (size_t i = 0; i < reloads_.size();) {
+      Reload& reload = reloads_[i];
+      if (!Shader::ProgramCompleted(reload.program)) {
+        ++i;
+        continue;
+      }
+      std::string error;
+      if (Shader::FinishProgram(reload.program, &error) == 0) {
+        if (program_cache_.enabled() &&
+            program_cache_.Store(reload.key, reload.program) != 0) {
+          LOG(WARN) << "Failed to cache shader program " << reload.name;
+        }
+        reload.shader->Swap(reload.program);
+        errors_.erase(reload.name);
+        ++reload_count_;
+        reload_ms_ = std::chrono::duration<float, std::milli>(
+                         std::chrono::steady_clock::now() - reload.start)
+                         .count();
+        LOG(INFO) << "Reloaded shader " << reload.name << " in "
+                  << reload_ms_ << " ms";
+      } else {
+        LOG(ERROR) << "Failed to reload shader " << reload.name << ":\n"
+                   << error;
+        errors_[reload.name] = error;
+      }
+      reloads_.erase(reloads_.begin() + i);
+      ++finished;
+    }
+    if (!watch_) return finished;
+    changed_.clear();
+    watcher_.Poll(&changed_);
+    if (changed_.empty()) return finished;
+    for (const auto& entry : shaders_) {
+      Shader* shader = entry.second;
+      for (const auto& file : changed_) {
+        if (file == shader->vertex_file() || file == shader->fragment_file()) {
+          StartReload(entry.first, shader);
+          break;
+        }
+      }
+    }
+    return finished;
+  }
+
+  // Whether a reload is being compiled.
+  bool reloading() const { return !reloads_.empty(); }
+
+  // Compile or link logs of the shaders whose last reload failed, by name.
+  const std::map<std::string, std::string>& errors() const { return errors_; }
+  // Reloads swapped in so far, and the time from the file change being
+  // seen to the swap of the last one.
+  size_t reload_count() const { return reload_count_; }
+  float reload_ms() const { return reload_ms_; }
+
  private:
   ShaderManager(const ShaderManager&) = delete;
   ShaderManager& operator=(const ShaderManager&) = delete;
 
+  // A program being built for `shader`.
+  struct Reload {
+    std::string name;
+    Shader* shader;
+    GLuint program;
+    // ProgramCache key of the sources.
+    uint64_t key;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  ProgramCache* cache() {
+    return program_cache_.enabled() ? &program_cache_ : nullptr;
+  }
+
+  void AddBuildTime(const std::string& name,
+                    std::chrono::steady_clock::time_point start) {
+    const float ms = std::chrono::duration<float, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    build_ms_ += ms;
+    LOG(INFO) << "Built shader " << name << " in " << ms << " ms";
+  }
+
+  int Watch(const Shader* shader) {
+    if (shader->vertex_file().empty()) return 0;
+    if (watcher_.Add(shader->vertex_file()) != 0 ||
+        watcher_.Add(shader->fragment_file()) != 0) {
+      LOG(ERROR) << "Failed to watch shader files";
+      return -1;
+    }
+    return 0;
+  }
+
+  // A newer save replaces a build still in flight.
+  void StartReload(const std::string& name, Shader* shader) {
+    for (size_t i = 0; i < reloads_.size(); ++i) {
+      if (reloads_[i].shader != shader) continue;
+      glDeleteProgram(reloads_[i].program);
+      reloads_.erase(reloads_.begin() + i);
+      break;
+    }
+    std::string vertex_src, fragment_src;
+    if (Shader::ReadFile(shader->vertex_file(), &vertex_src) != 0 ||
+        Shader::ReadFile(shader->fragment_file(), &fragment_src) != 0) {
+      errors_[name] = "Failed to read shader files";
+      return;
+    }
+    Reload reload;
+    reload.name = name;
+    reload.shader = shader;
+    reload.start = std::chrono::steady_clock::now();
+    reload.key = program_cache_.enabled()
+                     ? ProgramCache::Key(vertex_src, fragment_src)
+                     : 0;
+    reload.program = Shader::StartProgram(vertex_src, fragment_src,
+                                          program_cache_.enabled());
+    if (reload.program == 0) {
+      errors_[name] = "Failed to create shader program";
+      return;
+    }
+    reloads_.push_back(reload);
+  }
+
   std::map<std::string, Shader*> shaders_;
   std::vector<std::unique_ptr<Shader>> shader_pool_;
+  bool watch_ = false;
+  FileWatcher watcher_;
+  std::vector<std::string> changed_;
+  std::vector<Reload> reloads_;
+  std::map<std::string, std::string> errors_;
+  size_t reload_count_ = 0;
+  float reload_ms_ = 0.0f;
+  ProgramCache program_cache_;
+  float build_ms_ = 0.0f;
 };
 
 }  // namespace glkit
@@ -0,0 +1,235 @@
+#ifndef GLKIT_GL_SIMD_HPP_
+#define GLKIT_GL_SIMD_HPP_
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Thin float vector wrappers for kernels written once as templates over the
+// lane type. SimdFloat is the widest type the compiler targets (AVX2 with
+// -mavx2 or /arch:AVX2, SSE2 on x86-64) and FloatX1 handles the tails and
+// other architectures.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GLKIT_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GLKIT_SIMD_SSE2 1
+#endif
+
+namespace glkit {
+
+struct FloatX1 {
+  static const int kWidth = 1;
+  float v;
+
+  static FloatX1 Set1(float x) { return FloatX1{x}; }
+  static FloatX1 Load(const float* p) { return FloatX1{*p}; }
+  // Lane k reads base[index[k * stride]].
+  static FloatX1 Gather(const float* base, const uint32_t* index, int) {
+    return FloatX1{base[*index]};
+  }
+  void Store(float* p) const { *p = v; }
+};
+
+inline FloatX1 operator+(FloatX1 a, FloatX1 b) { return FloatX1{a.v + b.v}; }
+inline FloatX1 operator-(FloatX1 a, FloatX1 b) { return FloatX1{a.v - b.v}; }
+inline FloatX1 operator*(FloatX1 a, FloatX1 b) { return FloatX1{a.v * b.v}; }
+inline FloatX1 operator/(FloatX1 a, FloatX1 b) { return FloatX1{a.v / b.v}; }
+inline FloatX1 Sqrt(FloatX1 a) { return FloatX1{sqrtf(a.v)}; }
+inline FloatX1 Min(FloatX1 a, FloatX1 b) {
+  return FloatX1{a.v < b.v ? a.v : b.v};
+}
+inline FloatX1 Max(FloatX1 a, FloatX1 b) {
+  return FloatX1{a.v > b.v ? a.v : b.v};
+}
+inline FloatX1 Abs(FloatX1 a) { return FloatX1{fabsf(a.v)}; }
+// To the nearest integer, ties to even.
+inline FloatX1 Round(FloatX1 a) { return FloatX1{rintf(a.v)}; }
+// 1 / a, or 0 where a is not positive.
+inline FloatX1 InvOrZero(FloatX1 a) {
+  return FloatX1{a.v > 0.0f ? 1.0f / a.v : 0.0f};
+}
+// a where x < 0, b elsewhere.
+inline FloatX1 SelectNegative(FloatX1 x, FloatX1 a, FloatX1 b) {
+  return x.v < 0.0f ? a : b;
+}
+// Lane masks have all bits set where the comparison holds. MoveMask packs
+// their sign bits, lane k into bit k.
+inline FloatX1 MaskX1(bool set) {
+  uint32_t bits = set ? ~0u : 0u;
+  FloatX1 r;
+  memcpy(&r.v, &bits, sizeof(bits));
+  return r;
+}
+inline FloatX1 CmpGreater(FloatX1 a, FloatX1 b) { return MaskX1(a.v > b.v); }
+inline FloatX1 CmpGreaterEqual(FloatX1 a, FloatX1 b) {
+  return MaskX1(a.v >= b.v);
+}
+inline FloatX1 And(FloatX1 a, FloatX1 b) {
+  uint32_t x, y;
+  memcpy(&x, &a.v, sizeof(x));
+  memcpy(&y, &b.v, sizeof(y));
+  x &= y;
+  memcpy(&a.v, &x, sizeof(x));
+  return a;
+}
+inline int MoveMask(FloatX1 a) {
+  uint32_t bits;
+  memcpy(&bits, &a.v, sizeof(bits));
+  return static_cast<int>(bits >> 31);
+}
+
+#if defined(GLKIT_SIMD_AVX2)
+
+struct FloatX8 {
+  static const int kWidth = 8;
+  __m256 v;
+
+  static FloatX8 Set1(float x) { return FloatX8{_mm256_set1_ps(x)}; }
+  static FloatX8 Load(const float* p) { return FloatX8{_mm256_loadu_ps(p)}; }
+  static FloatX8 Gather(const float* base, const uint32_t* index,
+                        int stride) {
+    // Plain loads: vgatherdps is microcoded and slower on several CPUs.
+    return FloatX8{_mm256_setr_ps(
+        base[index[0]], base[index[stride]], base[index[2 * stride]],
+        base[index[3 * stride]], base[index[4 * stride]],
+        base[index[5 * stride]], base[index[6 * stride]],
+        base[index[7 * stride]])};
+  }
+  void Store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline FloatX8 operator+(FloatX8 a, FloatX8 b) {
+  return FloatX8{_mm256_add_ps(a.v, b.v)};
+}
+inline FloatX8 operator-(FloatX8 a, FloatX8 b) {
+  return FloatX8{_mm256_sub_ps(a.v, b.v)};
+}
+inline FloatX8 operator*(FloatX8 a, FloatX8 b) {
+  return FloatX8{_mm256_mul_ps(a.v, b.v)};
+}
+inline FloatX8 operator/(FloatX8 a, FloatX8 b) {
+  return FloatX8{_mm256_div_ps(a.v, b.v)};
+}
+inline FloatX8 Sqrt(FloatX8 a) { return FloatX8{_mm256_sqrt_ps(a.v)}; }
+inline FloatX8 Min(FloatX8 a, FloatX8 b) {
+  return FloatX8{_mm256_min_ps(a.v, b.v)};
+}
+inline FloatX8 Max(FloatX8 a, FloatX8 b) {
+  return FloatX8{_mm256_max_ps(a.v, b.v)};
+}
+inline FloatX8 Abs(FloatX8 a) {
+  return FloatX8{_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)};
+}
+inline FloatX8 Round(FloatX8 a) {
+  return FloatX8{
+      _mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)};
+}
+inline FloatX8 InvOrZero(FloatX8 a) {
+  __m256 positive = _mm256_cmp_ps(a.v, _mm256_setzero_ps(), _CMP_GT_OQ);
+  return FloatX8{
+      _mm256_and_ps(positive, _mm256_div_ps(_mm256_set1_ps(1.0f), a.v))};
+}
+inline FloatX8 SelectNegative(FloatX8 x, FloatX8 a, FloatX8 b) {
+  __m256 negative = _mm256_cmp_ps(x.v, _mm256_setzero_ps(), _CMP_LT_OQ);
+  return FloatX8{_mm256_blendv_ps(b.v, a.v, negative)};
+}
+inline FloatX8 CmpGreater(FloatX8 a, FloatX8 b) {
+  return FloatX8{_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)};
+}
+inline FloatX8 CmpGreaterEqual(FloatX8 a, FloatX8 b) {
+  return FloatX8{_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)};
+}
+inline FloatX8 And(FloatX8 a, FloatX8 b) {
+  return FloatX8{_mm256_and_ps(a.v, b.v)};
+}
+inline int MoveMask(FloatX8 a) { return _mm256_movemask_ps(a.v); }
+
+typedef FloatX8 SimdFloat;
+
+#elif defined(GLKIT_SIMD_SSE2)
+
+struct FloatX4 {
+  static const int kWidth = 4;
+  __m128 v;
+
+  static FloatX4 Set1(float x) { return FloatX4{_mm_set1_ps(x)}; }
+  static FloatX4 Load(const float* p) { return FloatX4{_mm_loadu_ps(p)}; }
+  static FloatX4 Gather(const float* base, const uint32_t* index,
+                        int stride) {
+    return FloatX4{_mm_setr_ps(base[index[0]], base[index[stride]],
+                               base[index[2 * stride]],
+                               base[index[3 * stride]])};
+  }
+  void Store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline FloatX4 operator+(FloatX4 a, FloatX4 b) {
+  return FloatX4{_mm_add_ps(a.v, b.v)};
+}
+inline FloatX4 operator-(FloatX4 a, FloatX4 b) {
+  return FloatX4{_mm_sub_ps(a.v, b.v)};
+}
+inline FloatX4 operator*(FloatX4 a, FloatX4 b) {
+  return FloatX4{_mm_mul_ps(a.v, b.v)};
+}
+inline FloatX4 operator/(FloatX4 a, FloatX4 b) {
+  return FloatX4{_mm_div_ps(a.v, b.v)};
+}
+inline FloatX4 Sqrt(FloatX4 a) { return FloatX4{_mm_sqrt_ps(a.v)}; }
+inline FloatX4 Min(FloatX4 a, FloatX4 b) {
+  return FloatX4{_mm_min_ps(a.v, b.v)};
+}
+inline FloatX4 Max(FloatX4 a, FloatX4 b) {
+  return FloatX4{_mm_max_ps(a.v, b.v)};
+}
+inline FloatX4 Abs(FloatX4 a) {
+  return FloatX4{_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)};
+}
+// Through int32, so only for |a| < 2^31.
+inline FloatX4 Round(FloatX4 a) {
+  return FloatX4{_mm_cvtepi32_ps(_mm_cvtps_epi32(a.v))};
+}
+inline FloatX4 InvOrZero(FloatX4 a) {
+  __m128 positive = _mm_cmpgt_ps(a.v, _mm_setzero_ps());
+  return FloatX4{_mm_and_ps(positive, _mm_div_ps(_mm_set1_ps(1.0f), a.v))};
+}
+inline FloatX4 SelectNegative(FloatX4 x, FloatX4 a, FloatX4 b) {
+  __m128 negative = _mm_cmplt_ps(x.v, _mm_setzero_ps());
+  return FloatX4{
+      _mm_or_ps(_mm_and_ps(negative, a.v), _mm_andnot_ps(negative, b.v))};
+}
+inline FloatX4 CmpGreater(FloatX4 a, FloatX4 b) {
+  return FloatX4{_mm_cmpgt_ps(a.v, b.v)};
+}
+inline FloatX4 CmpGreaterEqual(FloatX4 a, FloatX4 b) {
+  return FloatX4{_mm_cmpge_ps(a.v, b.v)};
+}
+inline FloatX4 And(FloatX4 a, FloatX4 b) {
+  return FloatX4{_mm_and_ps(a.v, b.v)};
+}
+inline int MoveMask(FloatX4 a) { return _mm_movemask_ps(a.v); }
+
+typedef FloatX4 SimdFloat;
+
+#else
+
+typedef FloatX1 SimdFloat;
+
+#endif
+
+inline const char* SimdName() {
+#if defined(GLKIT_SIMD_AVX2)
+  return "avx2";
+#elif defined(GLKIT_SIMD_SSE2)
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_SIMD_HPP_
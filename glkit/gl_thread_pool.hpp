@@ -0,0 +1,84 @@
+#ifndef GLKIT_GL_THREAD_POOL_HPP_
+#define GLKIT_GL_THREAD_POOL_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gl_parallel.hpp"
+
+namespace glkit {
+
+// Fixed set of worker threads running posted tasks in FIFO order. Unlike
+// ParallelFor, which splits one loop and waits for it, tasks run in the
+// background and report back through state of their own.
+class ThreadPool {
+ public:
+  ThreadPool() = default;
+  ~ThreadPool() { Stop(); }
+
+  // Values of num_threads <= 0 use all hardware threads.
+  void Start(int num_threads) {
+    Stop();
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = false;
+    num_threads = ResolveThreadCount(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.emplace_back(&ThreadPool::Work, this);
+    }
+  }
+
+  // Tasks still queued are dropped; running ones are waited for.
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+      tasks_.clear();
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) thread.join();
+    threads_.clear();
+  }
+
+  void Post(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+  bool started() const { return !threads_.empty(); }
+  size_t num_threads() const { return threads_.size(); }
+
+ private:
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void Work() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+        if (stopping_) return;
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> tasks_;
+  std::vector<std::thread> threads_;
+  bool stopping_ = false;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_THREAD_POOL_HPP_
@@ -0,0 +1,522 @@
+#ifndef GLKIT_GL_TRIANGLE_BVH_HPP_
+#define GLKIT_GL_TRIANGLE_BVH_HPP_
+
+#include <float.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gl_base.hpp"
+#include "gl_bounds.hpp"
+#include "gl_geometry.hpp"
+#include "gl_parallel.hpp"
+#include "gl_simd.hpp"
+
+namespace glkit {
+
+struct TriangleHit {
+  // Index of the triangle in the indices the tree was built from, -1 for
+  // no hit.
+  int32_t triangle = -1;
+  // Ray distance, in multiples of the ray direction.
+  float t = FLT_MAX;
+  // Barycentric weights of the second and third vertex.
+  float u = 0.0f;
+  float v = 0.0f;
+
+  bool hit() const { return triangle >= 0; }
+};
+
+// Bounding volume hierarchy over the triangles of an indexed mesh for ray
+// queries. The build bins centroids for the surface area heuristic; the
+// top levels bin on all threads, then the subtrees below are built one per
+// thread and stitched into a single array of 32-byte BvhNodes. Leaf
+// triangles are stored precomputed for Moller-Trumbore as structure of
+// arrays and padded to whole SimdFloat vectors, so a leaf is tested
+// SimdFloat::kWidth triangles at a time.
+class TriangleBvh {
+ public:
+  static const int kMaxLeafSize = 8;
+
+  TriangleBvh() = default;
+
+  // Positions are read as `positions + index * stride` (stride in floats),
+  // so they may point into an interleaved vertex array.
+  int Build(const float* positions, size_t stride, const GLuint* indices,
+            size_t num_triangles, int num_threads) {
+    Clear();
+    if (num_triangles == 0) return 0;
+    if (num_triangles > static_cast<size_t>(INT32_MAX / 2)) {
+      LOG(ERROR) << "Too many triangles for the bvh: " << num_triangles;
+      return -1;
+    }
+    num_threads = ResolveThreadCount(num_threads);
+    Builder builder;
+    builder.refs.resize(num_triangles);
+    ParallelFor(num_triangles, num_threads, [&](int, size_t b, size_t e) {
+      for (size_t t = b; t < e; ++t) {
+        Aabb box;
+        for (int k = 0; k < 3; ++k) {
+          const float* p = positions + indices[t * 3 + k] * stride;
+          box.Extend(Vec3(p[0], p[1], p[2]));
+        }
+        Builder::Ref& ref = builder.refs[t];
+        ref.min = box.min;
+        ref.max = box.max;
+        ref.triangle = static_cast<uint32_t>(t);
+        ref.padding = 0;
+      }
+    });
+
+    // Ranges below this size become subtree tasks for the worker threads.
+    const size_t defer_below =
+        num_threads > 1 ? num_triangles / (num_threads * 8) + 1 : 0;
+    std::vector<Builder::Task> deferred;
+    nodes_.resize(1);
+    builder.BuildRange(
+        Builder::Task{0, 0, static_cast<int32_t>(num_triangles), 0},
+        num_threads, defer_below, &nodes_, &deferred);
+    if (!deferred.empty()) {
+      // Largest first, so the workers finish together.
+      std::sort(deferred.begin(), deferred.end(),
+                [](const Builder::Task& a, const Builder::Task& b) {
+                  return a.end - a.begin > b.end - b.begin;
+                });
+      std::vector<std::vector<BvhNode>> subtrees(deferred.size());
+      std::atomic<size_t> next(0);
+      auto worker = [&]() {
+        for (size_t i = next++; i < deferred.size(); i = next++) {
+          Builder::Task task = deferred[i];
+          task.node = 0;
+          subtrees[i].resize(1);
+          builder.BuildRange(task, 1, 0, &subtrees[i], nullptr);
+        }
+      };
+      std::vector<std::thread> threads;
+      for (int t = 1; t < num_threads; ++t) threads.emplace_back(worker);
+      worker();
+      for (auto& t : threads) t.join();
+      for (size_t i = 0; i < deferred.size(); ++i) {
+        Stitch(subtrees[i], deferred[i].node);
+      }
+    }
+    StoreTriangles(positions, stride, indices, builder.refs);
+    return 0;
+  }
+
+  void Clear() {
+    nodes_.clear();
+    v0_.assign(0, 0.0f);
+    e1_.assign(0, 0.0f);
+    e2_.assign(0, 0.0f);
+    ids_.clear();
+    num_triangles_ = 0;
+  }
+
+  // Closest hit with t in (0, max_t]. F is the lane type of the leaf tests;
+  // FloatX1 gives the scalar path.
+  template <typename F = SimdFloat>
+  bool Intersect(const Ray& ray, float max_t, TriangleHit* hit) const {
+    *hit = TriangleHit();
+    hit->t = max_t;
+    if (nodes_.empty()) return false;
+    const Vec3 inv_direction = SafeInverse(ray.direction);
+    const BvhNode& root = nodes_[0];
+    if (IntersectRayBox(ray.origin, inv_direction, max_t, root.min,
+                        root.max) == FLT_MAX) {
+      return false;
+    }
+    int32_t stack[64];
+    int top = 0;
+    int32_t index = 0;
+    for (;;) {
+      const BvhNode& node = nodes_[index];
+      if (node.count > 0) {
+        IntersectLeaf<F>(ray, node, hit);
+      } else {
+        // Visit the nearer child first; the other waits on the stack.
+        const BvhNode& a = nodes_[node.first];
+        const BvhNode& b = nodes_[node.first + 1];
+        float ta = IntersectRayBox(ray.origin, inv_direction, hit->t, a.min,
+                                   a.max);
+        float tb = IntersectRayBox(ray.origin, inv_direction, hit->t, b.min,
+                                   b.max);
+        int32_t near_index = node.first, far_index = node.first + 1;
+        if (tb < ta) {
+          std::swap(ta, tb);
+          std::swap(near_index, far_index);
+        }
+        if (ta != FLT_MAX) {
+          if (tb != FLT_MAX) stack[top++] = far_index;
+          index = near_index;
+          continue;
+        }
+      }
+      // Pop, skipping nodes beyond the closest hit found meanwhile.
+      bool found = false;
+      while (top > 0) {
+        const BvhNode& next = nodes_[stack[--top]];
+        if (IntersectRayBox(ray.origin, inv_direction, hit->t, next.min,
+                            next.max) != FLT_MAX) {
+          index = stack[top];
+          found = true;
+          break;
+        }
+      }
+      if (!found) break;
+    }
+    return hit->hit();
+  }
+
+  bool empty() const { return nodes_.empty(); }
+  size_t num_triangles() const { return num_triangles_; }
+  const std::vector<BvhNode>& nodes() const { return nodes_; }
+  size_t memory_bytes() const {
+    return nodes_.size() * sizeof(BvhNode) +
+           v0_.size() * 9 * sizeof(float) + ids_.size() * sizeof(uint32_t);
+  }
+
+ private:
+  struct Builder {
+    static const int kBins = 32;
+    // Past this depth ranges split at the centroid median, which bounds the
+    // depth of the traversal stack.
+    static const int kMaxSahDepth = 40;
+
+    struct Task {
+      int32_t node;
+      int32_t begin;
+      int32_t end;
+      int depth;
+    };
+    struct Bin {
+      Aabb box;
+      uint32_t count = 0;
+    };
+    struct Bins {
+      Bin bin[3][kBins];
+    };
+
+    // Triangle bounds, moved around by the partitions instead of an index,
+    // so the passes over a range read memory in order.
+    struct Ref {
+      Vec3 min;
+      uint32_t triangle;
+      Vec3 max;
+      uint32_t padding;
+
+      Vec3 centroid() const { return (min + max) * 0.5f; }
+    };
+
+    std::vector<Ref> refs;
+
+    static int BinIndex(float c, float origin, float scale) {
+      return std::min(kBins - 1,
+                      std::max(0, static_cast<int>((c - origin) * scale)));
+    }
+
+    // Triangle tests of a leaf: whole SimdFloat vectors.
+    static float Packets(uint32_t count) {
+      return static_cast<float>((count + SimdFloat::kWidth - 1) /
+                                SimdFloat::kWidth);
+    }
+
+    void BoundsInto(size_t begin, size_t end, Aabb* box,
+                    Aabb* centroid_box) const {
+      for (size_t i = begin; i < end; ++i) {
+        box->min = glm::min(box->min, refs[i].min);
+        box->max = glm::max(box->max, refs[i].max);
+        centroid_box->Extend(refs[i].centroid());
+      }
+    }
+
+    void RangeBounds(int32_t begin, int32_t end, int num_threads, Aabb* box,
+                     Aabb* centroid_box) const {
+      if (num_threads == 1) {
+        BoundsInto(begin, end, box, centroid_box);
+        return;
+      }
+      std::vector<Aabb> partial(num_threads * 2);
+      ParallelFor(end - begin, num_threads, [&](int t, size_t b, size_t e) {
+        BoundsInto(begin + b, begin + e, &partial[t * 2],
+                   &partial[t * 2 + 1]);
+      });
+      for (int t = 0; t < num_threads; ++t) {
+        box->Extend(partial[t * 2]);
+        centroid_box->Extend(partial[t * 2 + 1]);
+      }
+    }
+
+    void BinInto(size_t begin, size_t end, const Aabb& centroid_box,
+                 Bins* bins) const {
+      const Vec3 extent = centroid_box.size();
+      Vec3 scale;
+      for (int axis = 0; axis < 3; ++axis) {
+        scale[axis] = extent[axis] > 0.0f ? kBins / extent[axis] : 0.0f;
+      }
+      for (size_t i = begin; i < end; ++i) {
+        const Ref& ref = refs[i];
+        const Vec3 c = ref.centroid();
+        for (int axis = 0; axis < 3; ++axis) {
+          Bin& bin = bins->bin[axis][BinIndex(c[axis],
+                                              centroid_box.min[axis],
+                                              scale[axis])];
+          bin.box.min = glm::min(bin.box.min, ref.min);
+          bin.box.max = glm::max(bin.box.max, ref.max);
+          ++bin.count;
+        }
+      }
+    }
+
+    void BinRange(int32_t begin, int32_t end, int num_threads,
+                  const Aabb& centroid_box, Bins* bins) const {
+      if (num_threads == 1) {
+        BinInto(begin, end, centroid_box, bins);
+        return;
+      }
+      std::vector<Bins> partial(num_threads);
+      ParallelFor(end - begin, num_threads, [&](int t, size_t b, size_t e) {
+        BinInto(begin + b, begin + e, centroid_box, &partial[t]);
+      });
+      for (const auto& p : partial) {
+        for (int axis = 0; axis < 3; ++axis) {
+          for (int i = 0; i < kBins; ++i) {
+            bins->bin[axis][i].box.Extend(p.bin[axis][i].box);
+            bins->bin[axis][i].count += p.bin[axis][i].count;
+          }
+        }
+      }
+    }
+
+    static float HalfArea(const Aabb& box) {
+      if (box.empty()) return 0.0f;
+      const Vec3 d = box.size();
+      return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    // Partitions refs[begin, end) and returns the split point, or -1 when a
+    // leaf is cheaper. Costs count SIMD leaf tests, a node visit counting
+    // as one.
+    int32_t Split(int32_t begin, int32_t end, int depth, int num_threads,
+                  const Aabb& box, const Aabb& centroid_box) {
+      const int32_t count = end - begin;
+      if (count <= 1) return -1;
+      const Vec3 extent = centroid_box.size();
+      if (depth < kMaxSahDepth &&
+          (extent.x > 0.0f || extent.y > 0.0f || extent.z > 0.0f)) {
+        Bins bins;
+        BinRange(begin, end, num_threads, centroid_box, &bins);
+        int best_axis = -1, best_bin = 0;
+        float best_cost = FLT_MAX;
+        for (int axis = 0; axis < 3; ++axis) {
+          if (extent[axis] <= 0.0f) continue;
+          const Bin* bin = bins.bin[axis];
+          float right_cost[kBins];
+          uint32_t right_count[kBins];
+          Aabb acc;
+          uint32_t n = 0;
+          for (int i = kBins - 1; i > 0; --i) {
+            acc.Extend(bin[i].box);
+            n += bin[i].count;
+            right_cost[i] = HalfArea(acc) * Packets(n);
+            right_count[i] = n;
+          }
+          acc = Aabb();
+          n = 0;
+          for (int i = 0; i + 1 < kBins; ++i) {
+            acc.Extend(bin[i].box);
+            n += bin[i].count;
+            if (n == 0 || right_count[i + 1] == 0) continue;
+            const float cost = HalfArea(acc) * Packets(n) + right_cost[i + 1];
+            if (cost < best_cost) {
+              best_cost = cost;
+              best_axis = axis;
+              best_bin = i;
+            }
+          }
+        }
+        const float area = HalfArea(box);
+        const float split_cost =
+            area > 0.0f ? 1.0f + best_cost / area : FLT_MAX;
+        if (count <= kMaxLeafSize && split_cost >= Packets(count)) return -1;
+        if (best_axis >= 0) {
+          const float origin = centroid_box.min[best_axis];
+          const float scale = kBins / extent[best_axis];
+          Ref* mid = std::partition(
+              refs.data() + begin, refs.data() + end, [&](const Ref& ref) {
+                return BinIndex(ref.centroid()[best_axis], origin, scale) <=
+                       best_bin;
+              });
+          return static_cast<int32_t>(mid - refs.data());
+        }
+      }
+      if (count <= kMaxLeafSize) return -1;
+      int axis = 0;
+      if (extent.y > extent[axis]) axis = 1;
+      if (extent.z > extent[axis]) axis = 2;
+      const int32_t mid = begin + count / 2;
+      std::nth_element(refs.data() + begin, refs.data() + mid,
+                       refs.data() + end, [&](const Ref& a, const Ref& b) {
+                         return a.centroid()[axis] < b.centroid()[axis];
+                       });
+      return mid;
+    }
+
+    // Builds the subtree of task.begin..end with its root at
+    // (*nodes)[task.node]. With defer_below > 0, smaller ranges are handed
+    // to `deferred` instead, their node left for the caller to fill.
+    void BuildRange(const Task& root, int num_threads, size_t defer_below,
+                    std::vector<BvhNode>* nodes,
+                    std::vector<Task>* deferred) {
+      std::vector<Task> stack(1, root);
+      while (!stack.empty()) {
+        const Task task = stack.back();
+        stack.pop_back();
+        const size_t count = task.end - task.begin;
+        if (count < defer_below) {
+          deferred->push_back(task);
+          continue;
+        }
+        // Threads only pay off on large ranges.
+        const int threads = count > 65536 ? num_threads : 1;
+        Aabb box, centroid_box;
+        RangeBounds(task.begin, task.end, threads, &box, &centroid_box);
+        const int32_t mid = Split(task.begin, task.end, task.depth, threads,
+                                  box, centroid_box);
+        BvhNode& node = (*nodes)[task.node];
+        node.min = box.min;
+        node.max = box.max;
+        if (mid < 0) {
+          node.first = task.begin;
+          node.count = task.end - task.begin;
+          continue;
+        }
+        const int32_t left = static_cast<int32_t>(nodes->size());
+        node.first = left;
+        node.count = 0;
+        nodes->resize(nodes->size() + 2);
+        stack.push_back(Task{left + 1, mid, task.end, task.depth + 1});
+        stack.push_back(Task{left, task.begin, mid, task.depth + 1});
+      }
+    }
+  };
+
+  // Moves a subtree built with its root at index 0 into nodes_[root].
+  void Stitch(const std::vector<BvhNode>& subtree, int32_t root) {
+    const int32_t offset = static_cast<int32_t>(nodes_.size()) - 1;
+    for (size_t i = 0; i < subtree.size(); ++i) {
+      BvhNode node = subtree[i];
+      if (node.count == 0) node.first += offset;
+      if (i == 0) {
+        nodes_[root] = node;
+      } else {
+        nodes_.push_back(node);
+      }
+    }
+  }
+
+  // Lays the triangles out leaf by leaf, each leaf starting on a SimdFloat
+  // boundary and padded with degenerate triangles, which never hit.
+  void StoreTriangles(const float* positions, size_t stride,
+                      const GLuint* indices,
+                      const std::vector<Builder::Ref>& refs) {
+    const int32_t width = SimdFloat::kWidth;
+    size_t slots = 0;
+    for (const auto& node : nodes_) {
+      if (node.count > 0) slots += (node.count + width - 1) / width * width;
+    }
+    v0_.assign(slots, 0.0f);
+    e1_.assign(slots, 0.0f);
+    e2_.assign(slots, 0.0f);
+    ids_.assign(slots, 0);
+    num_triangles_ = refs.size();
+    int32_t slot = 0;
+    for (auto& node : nodes_) {
+      if (node.count == 0) continue;
+      for (int32_t i = 0; i < node.count; ++i) {
+        const uint32_t t = refs[node.first + i].triangle;
+        Vec3 p[3];
+        for (int k = 0; k < 3; ++k) {
+          const float* v = positions + indices[t * 3 + k] * stride;
+          p[k] = Vec3(v[0], v[1], v[2]);
+        }
+        const int32_t s = slot + i;
+        v0_.x[s] = p[0].x;
+        v0_.y[s] = p[0].y;
+        v0_.z[s] = p[0].z;
+        e1_.x[s] = p[1].x - p[0].x;
+        e1_.y[s] = p[1].y - p[0].y;
+        e1_.z[s] = p[1].z - p[0].z;
+        e2_.x[s] = p[2].x - p[0].x;
+        e2_.y[s] = p[2].y - p[0].y;
+        e2_.z[s] = p[2].z - p[0].z;
+        ids_[s] = t;
+      }
+      node.first = slot;
+      slot += (node.count + width - 1) / width * width;
+    }
+  }
+
+  template <typename F>
+  void IntersectLeaf(const Ray& ray, const BvhNode& node,
+                     TriangleHit* hit) const {
+    const F ox = F::Set1(ray.origin.x), oy = F::Set1(ray.origin.y),
+            oz = F::Set1(ray.origin.z);
+    const F dx = F::Set1(ray.direction.x), dy = F::Set1(ray.direction.y),
+            dz = F::Set1(ray.direction.z);
+    const F zero = F::Set1(0.0f), one = F::Set1(1.0f);
+    const int32_t end =
+        node.first + (node.count + F::kWidth - 1) / F::kWidth * F::kWidth;
+    for (int32_t i = node.first; i < end; i += F::kWidth) {
+      const F e1x = F::Load(&e1_.x[i]), e1y = F::Load(&e1_.y[i]),
+              e1z = F::Load(&e1_.z[i]);
+      const F e2x = F::Load(&e2_.x[i]), e2y = F::Load(&e2_.y[i]),
+              e2z = F::Load(&e2_.z[i]);
+      const F px = dy * e2z - dz * e2y, py = dz * e2x - dx * e2z,
+              pz = dx * e2y - dy * e2x;
+      const F det = e1x * px + e1y * py + e1z * pz;
+      const F inv_det = one / det;
+      const F tx = ox - F::Load(&v0_.x[i]), ty = oy - F::Load(&v0_.y[i]),
+              tz = oz - F::Load(&v0_.z[i]);
+      const F u = (tx * px + ty * py + tz * pz) * inv_det;
+      const F qx = ty * e1z - tz * e1y, qy = tz * e1x - tx * e1z,
+              qz = tx * e1y - ty * e1x;
+      const F v = (dx * qx + dy * qy + dz * qz) * inv_det;
+      const F t = (e2x * qx + e2y * qy + e2z * qz) * inv_det;
+      F mask = And(CmpGreater(Abs(det), zero), CmpGreaterEqual(u, zero));
+      mask = And(mask, CmpGreaterEqual(v, zero));
+      mask = And(mask, CmpGreaterEqual(one, u + v));
+      mask = And(mask, CmpGreater(t, zero));
+      mask = And(mask, CmpGreaterEqual(F::Set1(hit->t), t));
+      int bits = MoveMask(mask);
+      if (bits == 0) continue;
+      float ts[F::kWidth], us[F::kWidth], vs[F::kWidth];
+      t.Store(ts);
+      u.Store(us);
+      v.Store(vs);
+      for (int lane = 0; bits; ++lane, bits >>= 1) {
+        if ((bits & 1) && ts[lane] <= hit->t) {
+          hit->triangle = static_cast<int32_t>(ids_[i + lane]);
+          hit->t = ts[lane];
+          hit->u = us[lane];
+          hit->v = vs[lane];
+        }
+      }
+    }
+  }
+
+  std::vector<BvhNode> nodes_;
+  // Per triangle slot: the first vertex and the two edges from it.
+  Vec3Array v0_;
+  Vec3Array e1_;
+  Vec3Array e2_;
+  std::vector<uint32_t> ids_;
+  size_t num_triangles_ = 0;
+};
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_TRIANGLE_BVH_HPP_
@@ -0,0 +1,50 @@
+#ifndef GLKIT_GL_VERTEX_FORMAT_HPP_
+#define GLKIT_GL_VERTEX_FORMAT_HPP_
+
+#include <stdint.h>
+#include <algorithm>
+#include <glm/gtc/packing.hpp>
+
+#include "gl_base.hpp"
+
+namespace glkit {
+
+enum VertexFormat {
+  // glkit::Vertex as is: 8 floats, 32 bytes.
+  kVertexFormatFloat = 0,
+  // PackedVertex: 16 bytes.
+  kVertexFormatPacked = 1,
+};
+
+// Compact vertex layout. The position is unorm16 relative to the mesh AABB
+// and dequantized in the vertex shader with the pos_offset/pos_scale
+// uniforms; the normal is snorm10 xyz in GL_INT_2_10_10_10_REV and the
+// texcoord is half float, both decoded by the vertex fetch.
+struct PackedVertex {
+  uint16_t position[4];
+  uint32_t normal;
+  uint16_t texcoord[2];
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must be 16 bytes");
+
+inline uint16_t PackUnorm16(float v) {
+  v = std::min(std::max(v, 0.0f), 1.0f);
+  return static_cast<uint16_t>(v * 65535.0f + 0.5f);
+}
+
+// Packs a unit vector into the x/y/z fields of GL_INT_2_10_10_10_REV.
+inline uint32_t PackSnorm10x3(const Vec3& n) {
+  uint32_t packed = 0;
+  for (int i = 0; i < 3; ++i) {
+    float c = std::min(std::max(n[i], -1.0f), 1.0f);
+    int32_t q = static_cast<int32_t>(c * 511.0f + (c < 0.0f ? -0.5f : 0.5f));
+    packed |= (static_cast<uint32_t>(q) & 0x3FFu) << (10 * i);
+  }
+  return packed;
+}
+
+inline uint16_t PackHalf(float v) { return glm::packHalf1x16(v); }
+
+}  // namespace glkit
+
+#endif  // GLKIT_GL_VERTEX_FORMAT_HPP_
@@ -1,6 +1,7 @@
 #ifndef GLKIT_GL_XY_PLANE_HPP_
 #define GLKIT_GL_XY_PLANE_HPP_
 
+#include <stdint.h>
 #include <vector>
 
 #include "gl_base.hpp"
@@ -8,13 +9,25 @@
 
 namespace glkit {
 
+enum GridMode {
+  // 2 * size lines each way, a unit apart.
+  kGridModeLines = 0,
+  // One full-screen triangle; shaders/grid.fs finds the plane under every
+  // pixel, so the grid has no edge and costs the same at any size.
+  kGridModeProcedural = 1,
+};
+
+// The z = 0 plane drawn as a grid with the X and Y axes highlighted.
 class XyPlane {
  public:
   XyPlane() = default;
 
-  void Init(Shader* shader, int size = 100) {
+  // `grid_shader` enables kGridModeProcedural, the default then.
+  void Init(Shader* shader, int size = 100, Shader* grid_shader = nullptr) {
     shader_ = shader;
     size_ = size;
+    grid_shader_ = grid_shader;
+    mode_ = grid_shader ? kGridModeProcedural : kGridModeLines;
 
     std::vector<float> v;
     for (int x = -size; x < size; x++) {
@@ -39,9 +52,15 @@ class XyPlane {
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr);
     glEnableVertexAttribArray(0);
     glBindVertexArray(0);
+
+    // Core profiles draw nothing without a vertex array, even an empty one.
+    if (grid_shader_) glGenVertexArrays(1, &grid_vao_);
   }
 
+  // The procedural grid blends over what is drawn and writes no depth, so
+  // draw it after the opaque geometry.
   int Draw(const Mat4& mvp) {
+    if (mode_ == kGridModeProcedural && grid_shader_) return DrawGrid(mvp);
     int ret = 0;
     ret = shader_->Use();
     if (ret != 0) {
@@ -71,18 +90,81 @@ class XyPlane {
       glDeleteBuffers(1, &vbo_);
       vbo_ = 0;
     }
+    if (grid_vao_ != 0) {
+      glDeleteVertexArrays(1, &grid_vao_);
+      grid_vao_ = 0;
+    }
   }
 
   ~XyPlane() { Free(); }
 
+  GridMode mode() const { return mode_; }
+  void set_mode(GridMode mode) { mode_ = mode; }
+
+  // Distance from the camera at which the procedural grid has faded out;
+  // 0, the default, for where the plane meets the far plane.
+  float fade_distance() const { return fade_distance_; }
+  void set_fade_distance(float distance) { fade_distance_ = distance; }
+
  private:
   XyPlane(const XyPlane&) = delete;
   const XyPlane& operator=(const XyPlane&) = delete;
 
+  struct GridUniforms {
+    uint32_t generation = 0;
+    Uniform<Mat4> view_projection;
+    Uniform<Mat4> inv_view_projection;
+    Uniform<float> fade_distance;
+  };
+
+  // Again after the shader reloads; see Shader::Swap.
+  void ResolveGridUniforms() {
+    grid_uniforms_.generation = grid_shader_->generation();
+    grid_uniforms_.view_projection =
+        grid_shader_->GetUniform<Mat4>("view_projection");
+    grid_uniforms_.inv_view_projection =
+        grid_shader_->GetUniform<Mat4>("inv_view_projection");
+    grid_uniforms_.fade_distance =
+        grid_shader_->GetUniform<float>("fade_distance");
+  }
+
+  int DrawGrid(const Mat4& view_projection) {
+    if (grid_shader_->Use() != 0) {
+      LOG(ERROR) << "Failed to use grid shader";
+      return -1;
+    }
+    if (grid_uniforms_.generation != grid_shader_->generation()) {
+      ResolveGridUniforms();
+    }
+    grid_shader_->Set(grid_uniforms_.view_projection, view_projection);
+    grid_shader_->Set(grid_uniforms_.inv_view_projection,
+                      glm::inverse(view_projection));
+    grid_shader_->Set(grid_uniforms_.fade_distance, fade_distance_);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    // Past the far plane the grid writes depth 1, which only passes the
+    // cleared depth with LEQUAL.
+    glDepthFunc(GL_LEQUAL);
+    glBindVertexArray(grid_vao_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    RETURN_IF_GL_ERROR(-1, "Failed to draw grid");
+    return 0;
+  }
+
   int size_ = 0;
+  GridMode mode_ = kGridModeLines;
+  float fade_distance_ = 0.0f;
   Shader* shader_ = nullptr;
+  Shader* grid_shader_ = nullptr;
+  GridUniforms grid_uniforms_;
   GLuint vao_ = 0;
   GLuint vbo_ = 0;
+  GLuint grid_vao_ = 0;
 };
 
 }  // namespace glkit
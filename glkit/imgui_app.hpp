@@ -1,12 +1,15 @@
 #ifndef GLKIT_IMGUI_APP_HPP_
 #define GLKIT_IMGUI_APP_HPP_
 
+#include <stdint.h>
 #include <stdio.h>
+#include <algorithm>
 #include "imgui/backends/imgui_impl_glfw.h"
 #include "imgui/backends/imgui_impl_opengl3.h"
 #include "imgui/imgui.h"
 
 #include "gl_base.hpp"
+#include "gl_profiler.hpp"
 
 #ifndef GL_SILENCE_DEPRECATION
 #define GL_SILENCE_DEPRECATION
@@ -16,7 +19,9 @@
 #endif
 #include <GLFW/glfw3.h>  // Will drag system OpenGL headers
 
+#include <chrono>
 #include <iostream>
+#include <thread>
 
 // [Win32] Our example includes a copy of glfw3.lib pre-compiled with VS2010 to
 // maximize ease of testing and compatibility with old VS compilers. To link
@@ -33,6 +38,18 @@ struct GLFWwindow;
 
 namespace glkit {
 
+enum FrameMode {
+  // Frames are drawn at the vsync rate while anything changes and not at
+  // all otherwise; see ImGuiApp::RequestRedraw.
+  kFrameModeOnDemand = 0,
+  // Every vsync, changed or not.
+  kFrameModeVsync = 1,
+  // As fast as possible, without vsync, for benchmarking.
+  kFrameModeUncapped = 2,
+  // Paced to target_fps() without vsync.
+  kFrameModeTargetFps = 3,
+};
+
 class ImGuiApp {
  public:
   virtual int Init(int width = 1280, int height = 720,
@@ -69,6 +86,8 @@ class ImGuiApp {
     if (window_ == NULL) return -1;
     glfwMakeContextCurrent(window_);
     glfwSwapInterval(1);  // Enable vsync
+    glfwSetWindowUserPointer(window_, this);
+    InstallRedrawCallbacks();
 
 #ifdef _WIN32
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
@@ -127,9 +146,6 @@ class ImGuiApp {
   void Run() {
     // Main loop
     while (!glfwWindowShouldClose(window_)) {
-      if (glfwGetKey(window_, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window_, true);
-
       // Poll and handle events (inputs, window resize, etc.)
       // You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to
       // tell if dear imgui wants to use your inputs.
@@ -139,7 +155,28 @@ class ImGuiApp {
       // data to your main application, or clear/overwrite your copy of the
       // keyboard data. Generally you may always pass all inputs to dear imgui,
       // and hide them from your application based on those two flags.
-      glfwPollEvents();
+      // Idle, on demand frames block on events, waking up now and then so
+      // Update can look for background work that finished.
+      const bool idle =
+          frame_mode_ == kFrameModeOnDemand && redraw_frames_ == 0;
+      if (idle) {
+        glfwWaitEventsTimeout(kIdleTimeout);
+      } else {
+        glfwPollEvents();
+      }
+      if (glfwGetKey(window_, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        glfwSetWindowShouldClose(window_, true);
+
+      if (idle) {
+        Update();
+        if (redraw_frames_ == 0) continue;
+      }
+      if (redraw_frames_ > 0) --redraw_frames_;
+      profiler_.BeginFrame();
+      if (!idle) {
+        ProfileScope scope(&profiler_, "Update");
+        Update();
+      }
 
       // Start the Dear ImGui frame
       ImGui_ImplOpenGL3_NewFrame();
@@ -149,13 +186,47 @@ class ImGuiApp {
       glfwGetFramebufferSize(window_, &window_w_, &window_h_);
 
       Render();
+      // Dragging or typing into a widget needs frames with no new events.
+      if (ImGui::IsAnyItemActive()) RequestRedraw();
+
+      {
+        ProfileScope scope(&profiler_, "ImGui Render", true);
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+      }
+
+      {
+        ProfileScope scope(&profiler_, "Swap");
+        glfwSwapBuffers(window_);
+      }
+      profiler_.EndFrame();
+      ++frames_drawn_;
+      if (frame_mode_ == kFrameModeTargetFps) WaitForNextFrame();
+    }
+  }
 
-      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+  // Draws at least `frames` more frames in kFrameModeOnDemand. Input asks
+  // for kInputRedrawFrames, which lets ImGui settle hover and layout
+  // changes; anything else that changes what is on screen asks for one.
+  void RequestRedraw(int frames = 1) {
+    redraw_frames_ = std::max(redraw_frames_, frames);
+  }
 
-      glfwSwapBuffers(window_);
-    }
+  FrameMode frame_mode() const { return frame_mode_; }
+  void set_frame_mode(FrameMode mode) {
+    if (mode == frame_mode_) return;
+    frame_mode_ = mode;
+    const bool vsync = mode == kFrameModeOnDemand || mode == kFrameModeVsync;
+    glfwSwapInterval(vsync ? 1 : 0);
+    next_frame_ = std::chrono::steady_clock::now();
+    RequestRedraw(kInputRedrawFrames);
   }
 
+  int target_fps() const { return target_fps_; }
+  void set_target_fps(int fps) { target_fps_ = std::max(fps, 1); }
+
+  // Frames drawn since the start, which stops growing while idle on demand.
+  uint64_t frames_drawn() const { return frames_drawn_; }
+
   void RenderDemo() {
     // 1. Show the big demo window (Most of the sample code is in
     // ImGui::ShowDemoWindow()! You can browse its code to learn more about
@@ -206,6 +277,11 @@ class ImGuiApp {
     }
   }
 
+  // Called once per loop iteration before Render, and on the idle wake-ups
+  // of kFrameModeOnDemand where no frame may follow. Polls background work
+  // and calls RequestRedraw when that changed the scene.
+  virtual void Update() {}
+
   virtual int Render() {
     RenderDemo();
     ImGui::Render();
@@ -222,6 +298,7 @@ class ImGuiApp {
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
+    profiler_.Free();
     glfwDestroyWindow(window_);
     glfwTerminate();
     return 0;
@@ -230,14 +307,73 @@ class ImGuiApp {
   int window_w() const { return window_w_; }
   int window_h() const { return window_h_; }
 
+  // Run records every frame, with the ImGui draw and the buffer swap as
+  // sections; Render adds its own.
+  Profiler& profiler() { return profiler_; }
+
  protected:
+  static const int kInputRedrawFrames = 3;
+  // Seconds between wake-ups while idle on demand.
+  static constexpr double kIdleTimeout = 0.25;
+
   static void glfw_error_callback(int error, const char* description) {
     fprintf(stderr, "Glfw Error %d: %s\n", error, description);
   }
 
+  static void OnInput(GLFWwindow* window) {
+    auto app = static_cast<ImGuiApp*>(glfwGetWindowUserPointer(window));
+    if (app) app->RequestRedraw(kInputRedrawFrames);
+  }
+
+  // Every event that can change the frame asks for a redraw. The callbacks
+  // go in before the ImGui backend installs its own, which call them in
+  // turn.
+  void InstallRedrawCallbacks() {
+    glfwSetCursorPosCallback(
+        window_, [](GLFWwindow* w, double, double) { OnInput(w); });
+    glfwSetCursorEnterCallback(window_,
+                               [](GLFWwindow* w, int) { OnInput(w); });
+    glfwSetMouseButtonCallback(
+        window_, [](GLFWwindow* w, int, int, int) { OnInput(w); });
+    glfwSetScrollCallback(
+        window_, [](GLFWwindow* w, double, double) { OnInput(w); });
+    glfwSetKeyCallback(window_,
+                       [](GLFWwindow* w, int, int, int, int) { OnInput(w); });
+    glfwSetCharCallback(window_,
+                        [](GLFWwindow* w, unsigned int) { OnInput(w); });
+    glfwSetWindowFocusCallback(window_,
+                               [](GLFWwindow* w, int) { OnInput(w); });
+    glfwSetFramebufferSizeCallback(
+        window_, [](GLFWwindow* w, int, int) { OnInput(w); });
+    glfwSetWindowRefreshCallback(window_,
+                                 [](GLFWwindow* w) { OnInput(w); });
+  }
+
+  // Sleeps until one target_fps() period after the previous frame; a frame
+  // that ran late starts the next period right away instead of catching up.
+  void WaitForNextFrame() {
+    const auto period = std::chrono::duration_cast<
+        std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / target_fps_));
+    next_frame_ += period;
+    const auto now = std::chrono::steady_clock::now();
+    if (next_frame_ < now) {
+      next_frame_ = now;
+    } else {
+      std::this_thread::sleep_until(next_frame_);
+    }
+  }
+
   GLFWwindow* window_;
   int window_w_;
   int window_h_;
+  Profiler profiler_;
+
+  FrameMode frame_mode_ = kFrameModeOnDemand;
+  int target_fps_ = 60;
+  int redraw_frames_ = kInputRedrawFrames;
+  uint64_t frames_drawn_ = 0;
+  std::chrono::steady_clock::time_point next_frame_;
 
   bool show_demo_window_ = false;
   bool show_another_window_ = false;
@@ -1,9 +1,23 @@
+#include <math.h>
+#include <stdio.h>
 #include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
 
 #include "glkit/gl_camera.hpp"
+#include "glkit/gl_frame_uniforms.hpp"
+#include "glkit/gl_frustum.hpp"
+#include "glkit/gl_instanced_model.hpp"
 #include "glkit/gl_mesh.hpp"
 #include "glkit/gl_mesh_manager.hpp"
 #include "glkit/gl_model.hpp"
+#include "glkit/gl_picking.hpp"
+#include "glkit/gl_point_cloud.hpp"
+#include "glkit/gl_profiler.hpp"
+#include "glkit/gl_render_queue.hpp"
+#include "glkit/gl_scene_bvh.hpp"
+#include "glkit/gl_scene_graph.hpp"
 #include "glkit/gl_shader.hpp"
 #include "glkit/gl_shader_manager.hpp"
 #include "glkit/gl_square.hpp"
@@ -19,76 +33,340 @@ class GLKitApp : public ImGuiApp {
     ImGuiApp::Init(width, height, name);
     clear_color_ = ImVec4(0.23f, 0.23f, 0.23f, 1.0f);
 
-    auto cube_mesh =
-        mesh_manager_.AddMeshFromObjFile("cube", "objects/cube.obj");
-    auto sphere_mesh =
-        mesh_manager_.AddMeshFromObjFile("sphere", "objects/sphere.obj");
-    auto monkey_mesh =
-        mesh_manager_.AddMeshFromObjFile("monkey", "objects/monkey.obj");
-
+    MeshLoadOptions mesh_options;
+    mesh_options.optimize = true;
+    mesh_options.vertex_format = kVertexFormatPacked;
+    mesh_options.generate_lods = true;
+    mesh_options.build_bvh = true;
+    // The cube loads up front and stands in for the other meshes, which
+    // stream in the background while the first frames are drawn.
+    auto cube_mesh = mesh_manager_.AddMeshFromObjFile(
+        "cube", "objects/cube.obj", mesh_options);
+    auto sphere_mesh = mesh_manager_.LoadMeshAsync(
+        "sphere", "objects/sphere.obj", mesh_options);
+    auto monkey_mesh = mesh_manager_.LoadMeshAsync(
+        "monkey", "objects/monkey.obj", mesh_options);
+
+    // Saving a shader file swaps the new program in while running. Linked
+    // programs are cached, so later runs skip compiling.
+    shader_manager_.set_watch(true);
+    shader_manager_.set_program_cache_dir("shaders/.programs");
     auto xy_plane_shader = shader_manager_.AddShaderFromFile(
         "xy_plane", "shaders/xy_plane.vs", "shaders/xy_plane.fs");
+    auto grid_shader = shader_manager_.AddShaderFromFile(
+        "grid", "shaders/grid.vs", "shaders/grid.fs");
     auto light_shader = shader_manager_.AddShaderFromFile(
         "light", "shaders/light.vs", "shaders/light.fs");
     auto mesh_shader = shader_manager_.AddShaderFromFile(
-        "mesh", "shaders/mesh.vs", "shaders/mesh.fs");
-
+        "mesh", "shaders/object.vs", "shaders/object.fs");
+    auto instanced_shader = shader_manager_.AddShaderFromFile(
+        "mesh_instanced", "shaders/object_instanced.vs", "shaders/object.fs");
+    point_cloud_shader_ = shader_manager_.AddShaderFromFile(
+        "point_cloud", "shaders/point_cloud.vs", "shaders/point_cloud.fs");
+    const ProgramCache& program_cache = shader_manager_.program_cache();
+    LOG(INFO) << "Shaders built in " << shader_manager_.build_ms() << " ms, "
+              << program_cache.hits() << " of "
+              << program_cache.hits() + program_cache.misses()
+              << " programs from the binary cache"
+              << (program_cache.enabled() ? "" : " (unsupported)");
+
+    frame_uniforms_.Init();
     square_.Init();
-    xy_plane_.Init(xy_plane_shader, 100);
+    xy_plane_.Init(xy_plane_shader, 100, grid_shader);
     light_.Init(sphere_mesh, light_shader, true);
     cube_.Init(cube_mesh, mesh_shader);
     sphere_.Init(sphere_mesh, mesh_shader);
     monkey_.Init(monkey_mesh, mesh_shader);
+    light_.set_placeholder(cube_mesh);
+    sphere_.set_placeholder(cube_mesh);
+    monkey_.set_placeholder(cube_mesh);
+    instances_.Init(sphere_mesh, instanced_shader);
+    instance_mesh_ = sphere_mesh;
+    instance_placeholder_ = cube_mesh;
+    instance_shader_ = mesh_shader;
+    // The mesh models ride on a rig that the UI moves as a whole.
+    rig_node_ = scene_graph_.Create();
+    node_models_.resize(rig_node_ + 1);
+    AttachToNode(&cube_, rig_node_);
+    AttachToNode(&sphere_, rig_node_);
+    AttachToNode(&monkey_, rig_node_);
+    scene_graph_.Update();
+    AddToScene(&light_, &show_light_);
+    AddToScene(&cube_, &show_cube_);
+    AddToScene(&sphere_, &show_sphere_);
+    AddToScene(&monkey_, &show_monkey_);
 
     glEnable(GL_DEPTH_TEST);
 
     return 0;
   }
 
+  // Streams the octree point cloud in `dir`, written by
+  // glkit_point_cloud_build, centered on the origin with its lowest point
+  // on the XY plane.
+  int OpenPointCloud(const std::string& dir) {
+    if (point_cloud_.Open(dir, point_cloud_shader_) != 0) {
+      LOG(ERROR) << "Failed to open point cloud: " << dir;
+      return -1;
+    }
+    const Aabb bounds = point_cloud_.bounds();
+    const Vec3 center = bounds.center();
+    point_cloud_.set_model(glm::translate(
+        Mat4(1.0f), Vec3(-center.x, -center.y, -bounds.min.z)));
+    const Vec3 size = bounds.size();
+    camera_.set_far(std::max(camera_.far(),
+                             4.0f * std::max(std::max(size.x, size.y),
+                                             size.z)));
+    show_point_cloud_ = true;
+    RequestRedraw();
+    return 0;
+  }
+
+  // Background work that changes the picture asks for a frame; input and
+  // the UI it drives are redrawn by ImGuiApp.
+  void Update() override {
+    if (shader_manager_.Update() > 0) RequestRedraw();
+    if (UpdateMeshes() > 0) RequestRedraw();
+    // Point cloud loads only finish in the Update of a shown cloud.
+    if (shader_manager_.reloading() || mesh_manager_.loading() > 0 ||
+        scene_bvh_.rebuilding() ||
+        (show_point_cloud_ && point_cloud_.loading() > 0)) {
+      RequestRedraw();
+    }
+  }
+
   int Render() override {
-    RenderUi();
-    ImGui::Render();
-
-    glViewport(0, 0, window_w_, window_h_);
-    glClearColor(clear_color_.x, clear_color_.y, clear_color_.z,
-                 clear_color_.w);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    if (show_xy_plane_)
-      xy_plane_.Draw(camera_.projection_mat() * camera_.view_mat());
-    if (show_light_) light_.Draw(camera_.view_mat(), camera_.projection_mat());
-    if (show_square_)
+    {
+      ProfileScope scope(&profiler_, "UI");
+      RenderUi();
+      ImGui::Render();
+    }
+    {
+      ProfileScope scope(&profiler_, "Scene Graph");
+      UpdateSceneGraph();
+    }
+
+    {
+      ProfileScope scope(&profiler_, "Clear", true);
+      glViewport(0, 0, window_w_, window_h_);
+      glClearColor(clear_color_.x, clear_color_.y, clear_color_.z,
+                   clear_color_.w);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      UpdateFrameUniforms();
+    }
+    if (show_square_) {
+      ProfileScope scope(&profiler_, "Square", true);
       square_.Draw(camera_.projection_mat() * camera_.view_mat());
-    if (show_cube_) {
-      cube_.SetLight(light_.position(), light_.color());
-      cube_.Draw(camera_.view_mat(), camera_.projection_mat());
     }
-    if (show_sphere_) {
-      sphere_.SetLight(light_.position(), light_.color());
-      sphere_.Draw(camera_.view_mat(), camera_.projection_mat());
+    const Mat4& view = camera_.view_mat();
+    const Mat4& projection = camera_.projection_mat();
+    // Keeps drawing while the camera moves, e.g. with a key held down.
+    if (view != drawn_view_ || projection != drawn_projection_) {
+      drawn_view_ = view;
+      drawn_projection_ = projection;
+      RequestRedraw();
+    }
+    submit_instance_models_ = show_instances_ && !draw_instanced_;
+    {
+      ProfileScope scope(&profiler_, "Cull");
+      CullModels(projection * view);
+    }
+    {
+      ProfileScope scope(&profiler_, "Models", true);
+      for (const Model* model : visible_models_) {
+        model->Submit(&render_queue_, view, projection);
+      }
+      render_queue_.Flush();
+    }
+    if (show_instances_ && draw_instanced_) {
+      ProfileScope scope(&profiler_, "Instances", true);
+      instances_.Draw();
+    }
+    if (show_point_cloud_) {
+      ProfileScope scope(&profiler_, "Point Cloud", true);
+      point_cloud_.Update(view, projection, window_h_);
+      point_cloud_.Draw();
     }
-    if (show_monkey_) {
-      monkey_.SetLight(light_.position(), light_.color());
-      monkey_.Draw(camera_.view_mat(), camera_.projection_mat());
+    // Last, since the procedural grid blends over the scene.
+    if (show_xy_plane_) {
+      ProfileScope scope(&profiler_, "XY Plane", true);
+      xy_plane_.Draw(projection * view);
     }
 
     return 0;
   }
 
  private:
+  enum CullMode {
+    kCullModeOff = 0,
+    // SIMD sphere test of every shown model.
+    kCullModeLinear = 1,
+    // Frustum query of scene_bvh_.
+    kCullModeBvh = 2,
+  };
+
+  // Scene models are kept in scene_bvh_, which observes their transforms.
+  // `shown` is the flag that enables drawing the model.
+  void AddToScene(Model* model, const bool* shown) {
+    const uint32_t id = scene_bvh_.Insert(model);
+    if (id >= scene_entries_.size()) scene_entries_.resize(id + 1);
+    scene_entries_[id].model = model;
+    scene_entries_[id].shown = shown;
+  }
+
+  void RemoveFromScene(Model* model) {
+    scene_entries_[model->observer_id()] = SceneEntry();
+    scene_bvh_.Remove(model);
+  }
+
+  void AttachToNode(Model* model, SceneNode node) {
+    model->set_node(&scene_graph_, node);
+    node_models_[node].push_back(model);
+  }
+
+  // Recomputes the moved part of the hierarchy and tells the models on it,
+  // which updates their bounds in scene_bvh_.
+  void UpdateSceneGraph() {
+    moved_nodes_.clear();
+    scene_graph_.Update(&moved_nodes_);
+    if (moved_nodes_.empty()) return;
+    for (SceneNode node : moved_nodes_) {
+      if (node >= node_models_.size()) continue;
+      for (Model* model : node_models_[node]) model->OnParentMoved();
+    }
+    RequestRedraw();
+  }
+
+  // Streams in the meshes that load in the background. Models switch from
+  // their placeholder to the mesh once it is ready, which changes their
+  // bounds without telling scene_bvh_. Returns the meshes that finished.
+  size_t UpdateMeshes() {
+    size_t finished = 0;
+    mesh_manager_.Update(&finished);
+    if (finished == 0) return 0;
+    for (size_t id = 0; id < scene_entries_.size(); ++id) {
+      const SceneEntry& entry = scene_entries_[id];
+      if (!entry.model) continue;
+      scene_bvh_.Update(static_cast<uint32_t>(id),
+                        entry.model->GetWorldBounds());
+    }
+    return finished;
+  }
+
+  size_t NumShownModels() const {
+    size_t count = show_light_ + show_cube_ + show_sphere_ + show_monkey_;
+    if (submit_instance_models_) count += instance_models_.size();
+    return count;
+  }
+
+  // Fills visible_models_ with the shown models whose world bounds touch
+  // the view frustum.
+  void CullModels(const Mat4& view_projection) {
+    auto start = std::chrono::steady_clock::now();
+    const Frustum frustum = Frustum::FromMatrix(view_projection);
+    visible_models_.clear();
+    scene_bvh_.Refit();
+    if (cull_mode_ == kCullModeBvh) {
+      visible_ids_.clear();
+      scene_bvh_.QueryFrustum(frustum, &visible_ids_);
+      for (uint32_t id : visible_ids_) {
+        const SceneEntry& entry = scene_entries_[id];
+        if (*entry.shown) visible_models_.push_back(entry.model);
+      }
+    } else {
+      cull_models_.clear();
+      for (const auto& entry : scene_entries_) {
+        if (entry.model && *entry.shown) cull_models_.push_back(entry.model);
+      }
+      if (cull_mode_ == kCullModeLinear) {
+        cull_spheres_.clear();
+        for (const Model* model : cull_models_) {
+          cull_spheres_.push_back(model->GetWorldBoundingSphere());
+        }
+        visible_ids_.clear();
+        CullSpheres(frustum, cull_spheres_, &visible_ids_);
+        for (uint32_t i : visible_ids_) {
+          visible_models_.push_back(cull_models_[i]);
+        }
+      } else {
+        visible_models_.swap(cull_models_);
+      }
+    }
+    cull_ms_ = std::chrono::duration<float, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  }
+
+  void UpdateFrameUniforms() {
+    FrameData data = FrameData();
+    data.view = camera_.view_mat();
+    data.projection = camera_.projection_mat();
+    data.view_projection = data.projection * data.view;
+    data.camera_position = Vec4(camera_.position(), 1.0f);
+    data.near = camera_.near();
+    data.far = camera_.far();
+    data.num_lights = 1;
+    data.lights[0].position = Vec4(light_.position(), 1.0f);
+    data.lights[0].color = Vec4(light_.color(), 1.0f);
+    frame_uniforms_.Update(data);
+  }
+
   void RenderUi() {
     ImGui::Begin("GLKit");
     ImGui::Checkbox("ImGui Demo Window", &show_demo_window_);
     ImGui::Text("average %.3f ms/frame (%.1f FPS)",
                 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
     ImGui::Text("Window Size(WxH): %dx%d", window_w_, window_h_);
+    int mode = frame_mode();
+    ImGui::Combo("Frame Mode", &mode,
+                 "On Demand\0Vsync\0Uncapped\0Target FPS\0");
+    set_frame_mode(static_cast<FrameMode>(mode));
+    if (mode == kFrameModeTargetFps) {
+      int fps = target_fps();
+      ImGui::InputInt("Target FPS", &fps, 10, 30);
+      set_target_fps(fps);
+    }
+    ImGui::Text("Frames Drawn: %llu",
+                static_cast<unsigned long long>(frames_drawn()));
+    ImGui::Text("Mesh Memory: %.1f KB", mesh_manager_.gpu_bytes() / 1024.0f);
+    ImGui::Text("Meshes Loading: %zu (%.1f KB uploaded)",
+                mesh_manager_.loading(),
+                mesh_manager_.upload_bytes() / 1024.0f);
+    const RenderQueueStats& stats = render_queue_.stats();
+    ImGui::Text("Draws: %zu", stats.draws);
+    ImGui::Text("Program Binds: %zu (%zu skipped)", stats.program_binds,
+                stats.program_binds_skipped);
+    ImGui::Text("VAO Binds: %zu (%zu skipped)", stats.vao_binds,
+                stats.vao_binds_skipped);
+    ImGui::Text("Uniform Writes: %zu (%zu skipped)", stats.uniform_writes,
+                stats.uniform_writes_skipped);
+    ImGui::Combo("Culling", &cull_mode_, "Off\0Linear\0BVH\0");
+    const size_t shown = NumShownModels();
+    ImGui::Text("Visible: %zu, Culled: %zu (%.3f ms)", visible_models_.size(),
+                shown - std::min(shown, visible_models_.size()), cull_ms_);
+    ImGui::Text("BVH: %zu nodes, %zu pending, SAH %.1f (%.1f at build)",
+                scene_bvh_.nodes().size(), scene_bvh_.pending(),
+                scene_bvh_.sah_cost(), scene_bvh_.build_sah_cost());
+    ImGui::Text("BVH Rebuilds: %zu%s", scene_bvh_.rebuilds(),
+                scene_bvh_.rebuilding() ? " (running)" : "");
     ImGui::ColorEdit3("Clear Color", (float*)&clear_color_);
     ImGui::Checkbox("Show XY Plane", &show_xy_plane_);
+    int grid_mode = xy_plane_.mode();
+    ImGui::Combo("Grid", &grid_mode, "Lines\0Procedural\0");
+    xy_plane_.set_mode(static_cast<GridMode>(grid_mode));
+    float fade_distance = xy_plane_.fade_distance();
+    // 0 fades the grid out at the far plane.
+    ImGui::InputFloat("Grid Fade Distance", &fade_distance, 10.f, 100.f,
+                      "%.0f");
+    xy_plane_.set_fade_distance(std::max(fade_distance, 0.f));
     ImGui::Checkbox("Show Camera", &show_camera_);
     ImGui::Checkbox("Show Light", &show_light_);
     ImGui::Checkbox("Show Cube", &show_cube_);
     ImGui::Checkbox("Show Sphere", &show_sphere_);
     ImGui::Checkbox("Show Square", &show_square_);
     ImGui::Checkbox("Show Monkey", &show_monkey_);
+    ImGui::Checkbox("Show Instances", &show_instances_);
+    UiAddRig();
     ImGui::End();
 
     if (show_demo_window_) ImGui::ShowDemoWindow(&show_demo_window_);
@@ -98,6 +376,227 @@ class GLKitApp : public ImGuiApp {
     if (show_cube_) UiAddModel("Cube", &cube_);
     if (show_sphere_) UiAddModel("Sphere", &sphere_);
     if (show_monkey_) UiAddModel("Monkey", &monkey_);
+    if (show_instances_) UiAddInstances();
+    if (point_cloud_.opened()) UiAddPointCloud();
+    UiAddPick();
+    UiAddShaders();
+    UiAddProfiler();
+  }
+
+  // Frame times of the recorded frames and the sections of the last second;
+  // GPU times lag a few frames behind. Save Trace writes all recorded
+  // frames for chrome://tracing.
+  void UiAddProfiler() {
+    ImGui::Begin("Profiler");
+    bool enabled = profiler_.enabled();
+    ImGui::Checkbox("Enabled", &enabled);
+    profiler_.set_enabled(enabled);
+    profiler_.FrameTimes(&frame_times_);
+    float max_ms = 0.0f;
+    for (float ms : frame_times_) max_ms = std::max(max_ms, ms);
+    char overlay[32];
+    snprintf(overlay, sizeof(overlay), "max %.2f ms", max_ms);
+    ImGui::PlotLines("Frame ms", frame_times_.data(),
+                     static_cast<int>(frame_times_.size()), 0, overlay, 0.0f,
+                     max_ms, ImVec2(0.0f, 80.0f));
+    profiler_.Summarize(60, &profile_summary_);
+    if (ImGui::BeginTable("Sections", 3)) {
+      ImGui::TableSetupColumn("Section");
+      ImGui::TableSetupColumn("CPU ms");
+      ImGui::TableSetupColumn("GPU ms");
+      ImGui::TableHeadersRow();
+      for (const ProfileSummary& section : profile_summary_) {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::Text("%*s%s", 2 * section.depth, "", section.name);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", section.cpu_ms);
+        ImGui::TableNextColumn();
+        if (section.gpu_ms >= 0.0f) {
+          ImGui::Text("%.3f", section.gpu_ms);
+        } else {
+          ImGui::Text("-");
+        }
+      }
+      ImGui::EndTable();
+    }
+    ImGui::Text("Dropped GPU Queries: %zu", profiler_.dropped_queries());
+    if (ImGui::Button("Save Trace")) {
+      trace_saved_ = profiler_.ExportChromeTrace("glkit_trace.json") == 0;
+    }
+    if (trace_saved_) {
+      ImGui::SameLine();
+      ImGui::Text("glkit_trace.json");
+    }
+    ImGui::End();
+  }
+
+  // Hot reload state, with the log of every shader whose last edit did not
+  // compile; the previous program keeps drawing meanwhile.
+  void UiAddShaders() {
+    ImGui::Begin("Shaders");
+    bool watch = shader_manager_.watch();
+    ImGui::Checkbox("Reload On Save", &watch);
+    shader_manager_.set_watch(watch);
+    ImGui::Text("Reloads: %zu (last %.1f ms)", shader_manager_.reload_count(),
+                shader_manager_.reload_ms());
+    for (const auto& error : shader_manager_.errors()) {
+      ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s",
+                         error.first.c_str());
+      ImGui::TextUnformatted(error.second.c_str());
+    }
+    ImGui::End();
+  }
+
+  // A left click outside the ImGui windows picks the closest shown model
+  // under the cursor: scene_bvh_ finds the models whose bounds the ray
+  // crosses and their mesh BVHs the triangle.
+  void UiAddPick() {
+    const auto& io = ImGui::GetIO();
+    if (!io.WantCaptureMouse && ImGui::IsMouseClicked(0)) {
+      auto start = std::chrono::steady_clock::now();
+      const Ray ray =
+          ScreenRay(camera_, io.MousePos.x, io.MousePos.y,
+                    static_cast<int>(io.DisplaySize.x),
+                    static_cast<int>(io.DisplaySize.y));
+      pick_ids_.clear();
+      scene_bvh_.QueryRay(ray, camera_.far(), &pick_ids_);
+      pick_models_.clear();
+      for (uint32_t id : pick_ids_) {
+        const SceneEntry& entry = scene_entries_[id];
+        if (*entry.shown) pick_models_.push_back(entry.model);
+      }
+      PickModels(ray, pick_models_.data(), pick_models_.size(), &pick_);
+      pick_ms_ = std::chrono::duration<float, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+    }
+
+    ImGui::Begin("Pick");
+    ImGui::Text("Left click the scene to pick.");
+    if (pick_.hit()) {
+      ImGui::Text("Model: %s", ModelName(pick_.model).c_str());
+      ImGui::Text("Triangle: %d", pick_.triangle);
+      ImGui::Text("Barycentric: %.3f %.3f %.3f", pick_.barycentric.x,
+                  pick_.barycentric.y, pick_.barycentric.z);
+      ImGui::Text("Position: %.3f %.3f %.3f", pick_.position.x,
+                  pick_.position.y, pick_.position.z);
+      ImGui::Text("Distance: %.3f", pick_.distance);
+    } else {
+      ImGui::Text("Nothing picked");
+    }
+    ImGui::Text("Candidates: %zu (%.3f ms)", pick_models_.size(), pick_ms_);
+    ImGui::End();
+  }
+
+  std::string ModelName(const Model* model) const {
+    if (model == &light_) return "Light";
+    if (model == &cube_) return "Cube";
+    if (model == &sphere_) return "Sphere";
+    if (model == &monkey_) return "Monkey";
+    if (!instance_models_.empty() && model >= &instance_models_.front() &&
+        model <= &instance_models_.back()) {
+      return "Instance " + std::to_string(model - &instance_models_[0]);
+    }
+    return "Unknown";
+  }
+
+  // Transform of the rig node carrying the cube, sphere and monkey.
+  void UiAddRig() {
+    if (!ImGui::TreeNode("Rig")) return;
+    Vec3 position = scene_graph_.position(rig_node_);
+    ImGui::InputFloat("PX", &position.x, 0.1f, 1.f, "%.1f");
+    ImGui::InputFloat("PY", &position.y, 0.1f, 1.f, "%.1f");
+    ImGui::InputFloat("PZ", &position.z, 0.1f, 1.f, "%.1f");
+    if (position != scene_graph_.position(rig_node_)) {
+      scene_graph_.set_position(rig_node_, position);
+    }
+    Vec3 rotation = scene_graph_.rotation(rig_node_) / PI * 180.f;
+    ImGui::InputFloat("RX", &rotation.x, 1.f, 10.f, "%.1f");
+    ImGui::InputFloat("RY", &rotation.y, 1.f, 10.f, "%.1f");
+    ImGui::InputFloat("RZ", &rotation.z, 1.f, 10.f, "%.1f");
+    if (rotation != scene_graph_.rotation(rig_node_) / PI * 180.f) {
+      scene_graph_.set_rotation(rig_node_, rotation / 180.f * PI);
+    }
+    ImGui::Text("Scene Graph: %zu nodes, %zu updated", scene_graph_.size(),
+                scene_graph_.updated());
+    ImGui::TreePop();
+  }
+
+  // Sphere copies on a grid in the XY plane, drawn either instanced or as
+  // one Model each, to compare frame times.
+  void UiAddInstances() {
+    ImGui::Begin("Instances");
+    int count = static_cast<int>(instances_.size());
+    ImGui::InputInt("Count", &count, 1000, 10000);
+    ImGui::Checkbox("Instanced", &draw_instanced_);
+    int lod = instances_.lod();
+    ImGui::InputInt("LOD", &lod);
+    instances_.set_lod(std::max(lod, 0));
+    ImGui::Text("Uploaded: %.1f KB", instances_.uploaded_bytes() / 1024.0f);
+    ImGui::End();
+    ResizeInstances(static_cast<size_t>(std::max(count, 0)));
+  }
+
+  // Budgets and stats of the streamed point cloud.
+  void UiAddPointCloud() {
+    ImGui::Begin("Point Cloud");
+    ImGui::Checkbox("Show", &show_point_cloud_);
+    const PointCloudHeader& header = point_cloud_.header();
+    ImGui::Text("Points: %llu in %u nodes",
+                static_cast<unsigned long long>(header.num_points),
+                header.num_nodes);
+    int budget = static_cast<int>(point_cloud_.point_budget() / 1000);
+    ImGui::InputInt("Point Budget (k)", &budget, 100, 1000);
+    point_cloud_.set_point_budget(static_cast<size_t>(std::max(budget, 1)) *
+                                  1000);
+    float point_scale = point_cloud_.point_scale();
+    ImGui::SliderFloat("Point Scale", &point_scale, 0.25f, 4.0f);
+    point_cloud_.set_point_scale(point_scale);
+    float max_point_size = point_cloud_.max_point_size();
+    ImGui::SliderFloat("Max Point Size", &max_point_size, 1.0f, 64.0f);
+    point_cloud_.set_max_point_size(max_point_size);
+    ImGui::Text("Visible: %zu nodes, %zu points",
+                point_cloud_.visible_nodes(), point_cloud_.visible_points());
+    ImGui::Text("Resident: %zu nodes (%.1f MB pool)",
+                point_cloud_.resident_nodes(),
+                point_cloud_.gpu_bytes() / (1024.0f * 1024.0f));
+    ImGui::Text("Loading: %zu (%.1f KB uploaded)", point_cloud_.loading(),
+                point_cloud_.upload_bytes() / 1024.0f);
+    ImGui::End();
+  }
+
+  void ResizeInstances(size_t count) {
+    const size_t old_count = instances_.size();
+    if (count == old_count) return;
+    for (size_t i = count; i < old_count; ++i) {
+      RemoveFromScene(&instance_models_[i]);
+    }
+    instances_.Resize(count);
+    const Model* old_data = instance_models_.data();
+    instance_models_.resize(count);
+    if (instance_models_.data() != old_data) {
+      for (size_t i = 0; i < std::min(count, old_count); ++i) {
+        Model& model = instance_models_[i];
+        scene_entries_[model.observer_id()].model = &model;
+      }
+    }
+    // A fixed row length keeps existing instances in place, so growing only
+    // uploads the new ones.
+    const size_t columns = 256;
+    for (size_t i = old_count; i < count; ++i) {
+      Model& model = instance_models_[i];
+      model.Init(instance_mesh_, instance_shader_);
+      model.set_placeholder(instance_placeholder_);
+      const float x = static_cast<float>(i % columns);
+      const float y = static_cast<float>(i / columns);
+      model.set_position(Vec3(x * 2.0f, y * 2.0f, 0.5f));
+      model.set_scale(Vec3(0.5f));
+      model.set_color(Vec3(0.4f + 0.6f * x / columns,
+                           0.4f + 0.6f * fmodf(y / columns, 1.0f), 0.7f));
+      instances_.SetInstance(i, model.GetModelMatrix(), model.color());
+      AddToScene(&model, &submit_instance_models_);
+    }
   }
 
   void UiAddCamera() {
@@ -208,8 +707,6 @@ class GLKitApp : public ImGuiApp {
     int render_mode = model->render_mode();
     ImGui::InputInt("Render Mode: 0:Light 1:Depth", &render_mode);
     model->set_render_mode(static_cast<RenderMode>(render_mode));
-    model->set_near(camera_.near());
-    model->set_far(camera_.far());
     Vec3 color = model->color();
     ImGui::ColorEdit3("Color", &color.x);
     model->set_color(color);
@@ -217,21 +714,33 @@ class GLKitApp : public ImGuiApp {
     ImGui::InputFloat("PX", &position.x, 0.1f, 1.f, "%.1f");
     ImGui::InputFloat("PY", &position.y, 0.1f, 1.f, "%.1f");
     ImGui::InputFloat("PZ", &position.z, 0.1f, 1.f, "%.1f");
-    model->set_position(position);
+    // Setting an unchanged transform would still recompose the matrix and
+    // refit scene_bvh_.
+    if (position != model->position()) model->set_position(position);
     Vec3 rotation = model->rotation() / PI * 180.f;
     ImGui::InputFloat("RX", &rotation.x, 1.f, 10.f, "%.1f");
     ImGui::InputFloat("RY", &rotation.y, 1.f, 10.f, "%.1f");
     ImGui::InputFloat("RZ", &rotation.z, 1.f, 10.f, "%.1f");
-    model->set_rotation(rotation / 180.f * PI);
+    if (rotation != model->rotation() / PI * 180.f) {
+      model->set_rotation(rotation / 180.f * PI);
+    }
     Vec3 scale = model->scale();
     ImGui::InputFloat("SX", &scale.x, 0.1f, 1.f, "%.1f");
     ImGui::InputFloat("SY", &scale.y, 0.1f, 1.f, "%.1f");
     ImGui::InputFloat("SZ", &scale.z, 0.1f, 1.f, "%.1f");
-    model->set_scale(scale);
+    if (scale != model->scale()) model->set_scale(scale);
+    int forced_lod = model->forced_lod();
+    ImGui::InputInt("LOD: -1:Auto", &forced_lod);
+    model->set_forced_lod(std::max(forced_lod, -1));
+    float lod_threshold = model->lod_threshold() * 1000.f;
+    ImGui::InputFloat("LOD Error (1/1000 H)", &lod_threshold, 0.1f, 1.f,
+                      "%.2f");
+    model->set_lod_threshold(std::max(lod_threshold, 0.f) / 1000.f);
+    ImGui::Text("LOD: %d", model->lod());
 
     const Mat4& model_mat = model->GetModelMatrix();
     Mat4 view_mat = camera_.view_mat();
-    Vec4 view_pos = view_mat * Vec4(position, 1.0);
+    Vec4 view_pos = view_mat * model_mat[3];
     Mat4 mv_mat = view_mat * model_mat;
     if (ImGui::TreeNode("View Coordinate")) {
       ImGui::Text("Pos: %6.3f %6.3f %6.3f %6.3f", view_pos.x, view_pos.y,
@@ -257,7 +766,6 @@ class GLKitApp : public ImGuiApp {
     }
 
     if (ImGui::TreeNode("Model Matrix")) {
-      const Mat4& model_mat = model->GetModelMatrix();
       for (int i = 0; i < 4; i++) {
         for (int j = 0; j < 3; j++) {
           ImGui::Text("%6.3f", model_mat[j][i]);
@@ -293,6 +801,8 @@ class GLKitApp : public ImGuiApp {
   }
 
   Camera camera_;
+  FrameUniforms frame_uniforms_;
+  RenderQueue render_queue_;
   ShaderManager shader_manager_;
   MeshManager mesh_manager_;
   XyPlane xy_plane_;
@@ -301,6 +811,43 @@ class GLKitApp : public ImGuiApp {
   Model cube_;
   Model sphere_;
   Model monkey_;
+  InstancedModel instances_;
+  PointCloud point_cloud_;
+  Shader* point_cloud_shader_ = nullptr;
+  std::vector<Model> instance_models_;
+  Mesh* instance_mesh_ = nullptr;
+  Mesh* instance_placeholder_ = nullptr;
+  Shader* instance_shader_ = nullptr;
+  struct SceneEntry {
+    const Model* model = nullptr;
+    const bool* shown = nullptr;
+  };
+  // Indexed by SceneBvh id.
+  std::vector<SceneEntry> scene_entries_;
+  SceneBvh scene_bvh_;
+  SceneGraph scene_graph_;
+  SceneNode rig_node_ = kNoSceneNode;
+  // Models attached to each node, by node.
+  std::vector<std::vector<Model*>> node_models_;
+  std::vector<SceneNode> moved_nodes_;
+  bool submit_instance_models_ = false;
+  // Culling scratch: the shown models with their world bounding spheres for
+  // the linear mode, and the models that passed.
+  std::vector<const Model*> cull_models_;
+  SphereArray cull_spheres_;
+  std::vector<uint32_t> visible_ids_;
+  std::vector<const Model*> visible_models_;
+  int cull_mode_ = kCullModeBvh;
+  float cull_ms_ = 0.0f;
+  std::vector<uint32_t> pick_ids_;
+  std::vector<const Model*> pick_models_;
+  PickResult pick_;
+  float pick_ms_ = 0.0f;
+  std::vector<float> frame_times_;
+  std::vector<ProfileSummary> profile_summary_;
+  bool trace_saved_ = false;
+  Mat4 drawn_view_;
+  Mat4 drawn_projection_;
 
   bool show_xy_plane_ = true;
   bool show_camera_ = true;
@@ -309,13 +856,18 @@ class GLKitApp : public ImGuiApp {
   bool show_square_ = false;
   bool show_sphere_ = false;
   bool show_monkey_ = false;
+  bool show_instances_ = false;
+  bool draw_instanced_ = true;
+  bool show_point_cloud_ = false;
 };
 
 }  // namespace glkit
 
-int main() {
+// usage: glkit [point_cloud_dir]
+int main(int argc, char** argv) {
   glkit::GLKitApp app;
   app.Init();
+  if (argc > 1) app.OpenPointCloud(argv[1]);
   app.Run();
   app.Destory();
   return 0;
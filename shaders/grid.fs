@@ -0,0 +1,68 @@
+#version 330 core
+
+// The z = 0 plane under every pixel, with anti-aliased lines at powers of
+// ten picked for the pixel's footprint, and the axes in the colors of
+// xy_plane.fs.
+uniform mat4 view_projection;
+// Lines fade out between half this distance from the camera and it; 0 for
+// the distance to the far plane.
+uniform float fade_distance;
+in vec3 near_point;
+in vec3 far_point;
+out vec4 FragColor;
+
+// Coverage of the lines `cell` apart at p, about a pixel wide at any
+// distance. Lines less than a few pixels apart fade out before they would
+// alias into moire.
+float GridLines(vec2 p, float cell) {
+    vec2 coord = p / cell;
+    vec2 width = fwidth(coord);
+    vec2 grid = abs(fract(coord - 0.5) - 0.5) / width;
+    float line = 1.0 - min(min(grid.x, grid.y), 1.0);
+    return line * (1.0 - smoothstep(0.1, 0.3, max(width.x, width.y)));
+}
+
+// Coverage of the line where c is 0.
+float AxisLine(float c) {
+    return 1.0 - min(abs(c) / fwidth(c), 1.0);
+}
+
+// Coverage of three decades of lines, the finest 1 to 10 pixels apart at
+// p. As the footprint grows each decade takes the place of the next finer
+// one, so the grid cross-fades between scales at any height.
+float ScaledGridLines(vec2 p) {
+    vec2 footprint = fwidth(p);
+    // log10, which GLSL does not have.
+    float lod = log2(10.0 * max(max(footprint.x, footprint.y), 1e-6)) *
+                0.30103;
+    float cell = pow(10.0, floor(lod));
+    float blend = fract(lod);
+    float minor = 0.5 * (1.0 - blend) * GridLines(p, cell);
+    float middle = mix(1.0, 0.5, blend) * GridLines(p, 10.0 * cell);
+    float major = GridLines(p, 100.0 * cell);
+    return max(max(minor, middle), major);
+}
+
+void main() {
+    float t = -near_point.z / (far_point.z - near_point.z);
+    // Rays that point away from the plane or run along it.
+    if (!(t > 0.0) || isinf(t)) discard;
+    vec3 p = near_point + t * (far_point - near_point);
+
+    vec4 clip = view_projection * vec4(p, 1.0);
+    // Clamped to the far plane, so the grid reaches the horizon instead of
+    // being clipped; XyPlane draws it with GL_LEQUAL to pass there.
+    gl_FragDepth = min(0.5 * clip.z / clip.w + 0.5, 1.0);
+
+    vec4 color = vec4(0.3, 0.3, 0.3, ScaledGridLines(p.xy));
+    float x_axis = AxisLine(p.y);
+    float y_axis = AxisLine(p.x);
+    color = mix(color, vec4(0.56, 0.24, 0.28, 1.0), x_axis);
+    color = mix(color, vec4(0.3, 0.54, 0.15, 1.0), y_axis);
+    float distance = length(p - near_point);
+    float fade = fade_distance > 0.0 ? fade_distance
+                                     : length(far_point - near_point);
+    color.a *= 1.0 - smoothstep(0.5 * fade, fade, distance);
+    if (color.a < 0.01) discard;
+    FragColor = color;
+}
@@ -0,0 +1,20 @@
+#version 330 core
+
+// Full-screen triangle without vertex buffers. Every vertex carries the
+// world space points on the near and far planes behind it; both planes are
+// parallel to the screen, so the interpolated points stay on them.
+uniform mat4 inv_view_projection;
+out vec3 near_point;
+out vec3 far_point;
+
+vec3 Unproject(vec2 xy, float z) {
+    vec4 p = inv_view_projection * vec4(xy, z, 1.0);
+    return p.xyz / p.w;
+}
+
+void main() {
+    vec2 xy = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    near_point = Unproject(xy, -1.0);
+    far_point = Unproject(xy, 1.0);
+    gl_Position = vec4(xy, 0.0, 1.0);
+}
@@ -1,11 +1,29 @@
 #version 330 core
 
+struct Light {
+    vec4 position;
+    vec4 color;
+};
+
+// Per-frame data shared by all programs, see glkit/gl_frame_uniforms.hpp.
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_position;
+    float near;
+    float far;
+    int num_lights;
+    Light lights[4];
+};
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform vec3 pos_offset;
+uniform vec3 pos_scale;
 
 layout (location = 0) in vec3 pos;
 
 void main() {
-    gl_Position = projection * view * model * vec4(pos, 1.0);
+    gl_Position =
+        view_projection * model * vec4(pos_offset + pos * pos_scale, 1.0);
 }
\ No newline at end of file
@@ -1,29 +1,47 @@
 #version 330 core
 
-uniform vec3 light_pos;
-uniform vec3 light_color;
-uniform vec3 color;
+struct Light {
+    vec4 position;
+    vec4 color;
+};
+
+// Per-frame data shared by all programs, see glkit/gl_frame_uniforms.hpp.
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_position;
+    float near;
+    float far;
+    int num_lights;
+    Light lights[4];
+};
+
 uniform int render_mode;
-uniform float near;
-uniform float far;
 
 in vec3 m_pos;
 in vec3 m_normal;
+in vec3 m_color;
 in float depth_eye;
 
 out vec4 FragColor;
 
 vec4 calc_lighting() {
-    // ambient
-    vec3 ambient = light_color * color;
-
-    // diffuse
-    vec3 light_dir = normalize(light_pos - m_pos);
     vec3 norm = normalize(m_normal);
-    float diff = max(dot(light_dir, norm), 0.0f);
-    vec3 diffuse = light_color * diff * color;
+    vec3 result = vec3(0.0f);
+    for (int i = 0; i < num_lights; ++i) {
+        vec3 light_color = lights[i].color.rgb;
+
+        // ambient
+        vec3 ambient = light_color * m_color;
 
-    vec3 result = ambient * 0.2f + diffuse * 0.8f;
+        // diffuse
+        vec3 light_dir = normalize(lights[i].position.xyz - m_pos);
+        float diff = max(dot(light_dir, norm), 0.0f);
+        vec3 diffuse = light_color * diff * m_color;
+
+        result += ambient * 0.2f + diffuse * 0.8f;
+    }
     return vec4(result, 1.0f);
 }
 
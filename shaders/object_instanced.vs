@@ -0,0 +1,45 @@
+#version 330 core
+
+struct Light {
+    vec4 position;
+    vec4 color;
+};
+
+// Per-frame data shared by all programs, see glkit/gl_frame_uniforms.hpp.
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_position;
+    float near;
+    float far;
+    int num_lights;
+    Light lights[4];
+};
+
+// Dequantization of packed positions, identity for float vertices.
+uniform vec3 pos_offset;
+uniform vec3 pos_scale;
+
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 texcoord;
+// Per instance, see glkit/gl_instanced_model.hpp.
+layout (location = 3) in mat4 model;
+layout (location = 7) in vec4 color;
+
+out vec3 m_pos;
+out vec3 m_normal;
+out vec3 m_color;
+out float depth_eye;
+
+void main() {
+    vec4 m_pos4 = model * vec4(pos_offset + pos * pos_scale, 1.0);
+    vec4 v_pos4 = view * m_pos4;
+    vec4 p_pos4 = projection * v_pos4;
+    m_pos = m_pos4.xyz;
+    m_normal = vec3(model * vec4(normal, 0.0));
+    m_color = color.rgb;
+    depth_eye = -v_pos4.z;
+    gl_Position = p_pos4;
+}
\ No newline at end of file
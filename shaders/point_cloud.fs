@@ -0,0 +1,14 @@
+#version 330 core
+
+in vec3 p_color;
+
+out vec4 FragColor;
+
+void main() {
+    // Round points; gl_PointCoord spans the square the point covers.
+    vec2 d = gl_PointCoord * 2.0 - 1.0;
+    if (dot(d, d) > 1.0) {
+        discard;
+    }
+    FragColor = vec4(p_color, 1.0);
+}
@@ -0,0 +1,51 @@
+#version 330 core
+
+struct Light {
+    vec4 position;
+    vec4 color;
+};
+
+// Per-frame data shared by all programs, see glkit/gl_frame_uniforms.hpp.
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_position;
+    float near;
+    float far;
+    int num_lights;
+    Light lights[4];
+};
+
+uniform mat4 model;
+// Cube of the node being drawn, and the sample spacing of the finest level
+// drawn in each of its octants, in cloud units.
+uniform vec3 node_min;
+uniform float node_size;
+uniform vec4 octant_spacing_low;
+uniform vec4 octant_spacing_high;
+uniform float viewport_height;
+uniform float point_scale;
+uniform float max_point_size;
+
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec4 color;
+
+out vec3 p_color;
+
+void main() {
+    vec4 v_pos4 = view * model * vec4(pos, 1.0);
+    gl_Position = projection * v_pos4;
+    // Child index order: x is bit 0, y bit 1, z bit 2.
+    vec3 half_bits = step(node_min + 0.5 * node_size, pos);
+    int octant = int(dot(half_bits, vec3(1.0, 2.0, 4.0)));
+    float spacing = octant < 4 ? octant_spacing_low[octant]
+                               : octant_spacing_high[octant - 4];
+    // The spacing in pixels at this depth, so the points close up however
+    // far they are.
+    float world_spacing = spacing * length(model[0].xyz);
+    float pixels = world_spacing * projection[1][1] * 0.5 * viewport_height /
+                   max(-v_pos4.z, 1e-6);
+    gl_PointSize = clamp(point_scale * pixels, 1.0, max_point_size);
+    p_color = color.rgb;
+}
@@ -0,0 +1,396 @@
+// Renders a scene from a list of camera poses without a window and writes
+// color and depth images, for batch rendering and regression images on
+// machines without a display.
+//
+// usage: glkit_headless <scene_file> <camera_file> <output_dir>
+//                       [--width W] [--height H] [--near N] [--far F]
+//                       [--shaders DIR] [--threads N]
+//
+// The scene file has one entry per line; angles are in degrees and lines
+// starting with '#' are skipped:
+//   mesh <name> <obj_file>
+//   model <mesh_name> <px py pz> <rx ry rz> <sx sy sz> <r g b>
+//   light <px py pz> <r g b>
+//   clear <r g b>
+// The camera file has one pose per line: <px py pz> <rx ry rz> [fovy].
+//
+// Pose i is written to <output_dir> as NNNN_color.ppm, NNNN_depth.pfm with
+// the linear eye space depth and NNNN_depth.pgm with that depth mapped to
+// 16 bits, near white and far black. Images are read back while the next
+// pose renders and written on --threads worker threads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glkit/gl_camera.hpp"
+#include "glkit/gl_frame_uniforms.hpp"
+#include "glkit/gl_framebuffer.hpp"
+#include "glkit/gl_headless.hpp"
+#include "glkit/gl_image_io.hpp"
+#include "glkit/gl_mesh_manager.hpp"
+#include "glkit/gl_model.hpp"
+#include "glkit/gl_render_queue.hpp"
+#include "glkit/gl_shader_manager.hpp"
+#include "glkit/gl_thread_pool.hpp"
+
+namespace {
+
+using namespace glkit;
+
+const float kDegrees = PI / 180.0f;
+
+struct CameraPose {
+  Vec3 position;
+  // Radians.
+  Vec3 rotation;
+  float fovy = 0.0f;
+};
+
+struct Scene {
+  std::vector<std::unique_ptr<Model>> models;
+  std::vector<FrameLight> lights;
+  Vec3 clear_color = Vec3(0.23f, 0.23f, 0.23f);
+};
+
+bool ReadVec3(std::istringstream* line, Vec3* v) {
+  return static_cast<bool>(*line >> v->x >> v->y >> v->z);
+}
+
+// Queues the meshes of the scene file on the loader threads of
+// `mesh_manager` and creates the models drawing them with `shader`.
+int ReadScene(const std::string& file, MeshManager* mesh_manager,
+              Shader* shader, Scene* scene) {
+  std::ifstream in(file);
+  if (!in) {
+    LOG(ERROR) << "Failed to open scene: " << file;
+    return -1;
+  }
+  MeshLoadOptions options;
+  options.optimize = true;
+  options.vertex_format = kVertexFormatPacked;
+  options.generate_lods = true;
+  std::string text;
+  for (int line_number = 1; std::getline(in, text); ++line_number) {
+    std::istringstream line(text);
+    std::string type;
+    if (!(line >> type) || type[0] == '#') continue;
+    bool ok = false;
+    if (type == "mesh") {
+      std::string name, obj_file;
+      ok = static_cast<bool>(line >> name >> obj_file);
+      if (ok) mesh_manager->LoadMeshAsync(name, obj_file, options);
+    } else if (type == "model") {
+      std::string mesh_name;
+      Vec3 position, rotation, scale, color;
+      ok = (line >> mesh_name) && ReadVec3(&line, &position) &&
+           ReadVec3(&line, &rotation) && ReadVec3(&line, &scale) &&
+           ReadVec3(&line, &color);
+      if (ok) {
+        Mesh* mesh = mesh_manager->GetMesh(mesh_name);
+        if (!mesh) {
+          LOG(ERROR) << file << ":" << line_number << ": unknown mesh "
+                     << mesh_name << ": " << text;
+          return -1;
+        }
+        scene->models.emplace_back(new Model());
+        Model* model = scene->models.back().get();
+        model->Init(mesh, shader);
+        model->set_position(position);
+        model->set_rotation(rotation * kDegrees);
+        model->set_scale(scale);
+        model->set_color(color);
+      }
+    } else if (type == "light") {
+      Vec3 position, color;
+      ok = ReadVec3(&line, &position) && ReadVec3(&line, &color);
+      if (ok && scene->lights.size() == kMaxFrameLights) {
+        LOG(WARN) << file << ":" << line_number << ": more than "
+                  << kMaxFrameLights << " lights";
+        continue;
+      }
+      if (ok) {
+        FrameLight light;
+        light.position = Vec4(position, 1.0f);
+        light.color = Vec4(color, 1.0f);
+        scene->lights.push_back(light);
+      }
+    } else if (type == "clear") {
+      ok = ReadVec3(&line, &scene->clear_color);
+    }
+    if (!ok) {
+      LOG(ERROR) << file << ":" << line_number << ": bad line: " << text;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int ReadCameraPoses(const std::string& file, float default_fovy,
+                    std::vector<CameraPose>* poses) {
+  std::ifstream in(file);
+  if (!in) {
+    LOG(ERROR) << "Failed to open camera poses: " << file;
+    return -1;
+  }
+  std::string text;
+  for (int line_number = 1; std::getline(in, text); ++line_number) {
+    std::istringstream line(text);
+    std::string first;
+    if (!(line >> first) || first[0] == '#') continue;
+    line.seekg(0);
+    CameraPose pose;
+    if (!ReadVec3(&line, &pose.position) ||
+        !ReadVec3(&line, &pose.rotation)) {
+      LOG(ERROR) << file << ":" << line_number << ": bad pose: " << text;
+      return -1;
+    }
+    pose.rotation *= kDegrees;
+    float fovy = 0.0f;
+    pose.fovy = (line >> fovy) ? fovy * kDegrees : default_fovy;
+    poses->push_back(pose);
+  }
+  return 0;
+}
+
+// Writes read back frames on a thread pool. At most max_pending frames are
+// held in memory; Write blocks while that many wait to be written.
+class ImageWriter {
+ public:
+  ImageWriter(const std::string& dir, int width, int height, float near,
+              float far)
+      : dir_(dir), width_(width), height_(height), near_(near), far_(far) {}
+
+  void Start(int num_threads) {
+    pool_.Start(num_threads);
+    max_pending_ = 2 * pool_.num_threads();
+  }
+
+  void Write(size_t frame, std::vector<uint8_t>* color,
+             std::vector<float>* depth) {
+    std::shared_ptr<Frame> data(new Frame());
+    data->index = frame;
+    data->color.swap(*color);
+    data->depth.swap(*depth);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return pending_ < max_pending_; });
+      ++pending_;
+    }
+    pool_.Post([this, data] {
+      const bool ok = WriteFrame(data.get()) == 0;
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!ok) ++failed_;
+      --pending_;
+      cv_.notify_all();
+    });
+  }
+
+  // Waits for all frames passed to Write and returns the number that failed.
+  size_t Finish() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return pending_ == 0; });
+    return failed_;
+  }
+
+ private:
+  struct Frame {
+    size_t index = 0;
+    std::vector<uint8_t> color;
+    std::vector<float> depth;
+  };
+
+  int WriteFrame(Frame* frame) const {
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "/%04zu", frame->index);
+    const std::string path = dir_ + prefix;
+    if (WritePpm(path + "_color.ppm", width_, height_,
+                 frame->color.data()) != 0) {
+      return -1;
+    }
+    // Window space depth back to eye space distance along the view axis;
+    // cleared pixels end up at the far plane.
+    std::vector<float>& depth = frame->depth;
+    for (float& d : depth) {
+      const float ndc = 2.0f * d - 1.0f;
+      d = 2.0f * near_ * far_ / (far_ + near_ - ndc * (far_ - near_));
+    }
+    if (WritePfm(path + "_depth.pfm", width_, height_, depth.data()) != 0) {
+      return -1;
+    }
+    for (float& d : depth) d = 1.0f - (d - near_) / (far_ - near_);
+    return WritePgm16(path + "_depth.pgm", width_, height_, depth.data());
+  }
+
+  const std::string dir_;
+  const int width_;
+  const int height_;
+  const float near_;
+  const float far_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t max_pending_ = 2;
+  size_t pending_ = 0;
+  size_t failed_ = 0;
+  // Last, so its threads stop before the state they use goes away.
+  ThreadPool pool_;
+};
+
+void Render(const Scene& scene, const Camera& camera,
+            const Framebuffer& framebuffer, FrameUniforms* frame_uniforms,
+            RenderQueue* render_queue) {
+  FrameData data = FrameData();
+  data.view = camera.view_mat();
+  data.projection = camera.projection_mat();
+  data.view_projection = data.projection * data.view;
+  data.camera_position = Vec4(camera.position(), 1.0f);
+  data.near = camera.near();
+  data.far = camera.far();
+  data.num_lights = static_cast<int>(scene.lights.size());
+  std::copy(scene.lights.begin(), scene.lights.end(), data.lights);
+  frame_uniforms->Update(data);
+
+  framebuffer.Bind();
+  glClearColor(scene.clear_color.x, scene.clear_color.y, scene.clear_color.z,
+               1.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  for (const auto& model : scene.models) {
+    model->Submit(render_queue, data.view, data.projection);
+  }
+  render_queue->Flush();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string> args;
+  int width = 1280;
+  int height = 720;
+  float near = 0.1f;
+  float far = 100.0f;
+  std::string shader_dir = "shaders";
+  int num_threads = 0;
+  for (int i = 1; i < argc; ++i) {
+    const bool has_value = i + 1 < argc;
+    if (!strcmp(argv[i], "--width") && has_value) {
+      width = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--height") && has_value) {
+      height = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--near") && has_value) {
+      near = static_cast<float>(atof(argv[++i]));
+    } else if (!strcmp(argv[i], "--far") && has_value) {
+      far = static_cast<float>(atof(argv[++i]));
+    } else if (!strcmp(argv[i], "--shaders") && has_value) {
+      shader_dir = argv[++i];
+    } else if (!strcmp(argv[i], "--threads") && has_value) {
+      num_threads = atoi(argv[++i]);
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  if (args.size() != 3 || width <= 0 || height <= 0 || near <= 0.0f ||
+      far <= near) {
+    fprintf(stderr,
+            "usage: %s <scene_file> <camera_file> <output_dir> [--width W] "
+            "[--height H] [--near N] [--far F] [--shaders DIR] "
+            "[--threads N]\n",
+            argv[0]);
+    return 1;
+  }
+  const std::string& output_dir = args[2];
+
+  const auto start = std::chrono::steady_clock::now();
+  HeadlessContext context;
+  if (context.Init() != 0) return 1;
+
+  ShaderManager shader_manager;
+  shader_manager.set_program_cache_dir(shader_dir + "/.programs");
+  Shader* shader = shader_manager.AddShaderFromFile(
+      "mesh", shader_dir + "/object.vs", shader_dir + "/object.fs");
+  if (!shader) return 1;
+
+  // Meshes load on all cores, and with nothing to draw meanwhile the whole
+  // upload may go in one Update.
+  MeshManager mesh_manager;
+  mesh_manager.set_load_threads(0);
+  mesh_manager.set_upload_budget(64 << 20);
+  Scene scene;
+  if (ReadScene(args[0], &mesh_manager, shader, &scene) != 0) return 1;
+  while (mesh_manager.loading() > 0) {
+    if (mesh_manager.Update() != 0) return 1;
+    // Leaves the core to the workers between polls.
+    if (mesh_manager.loading() > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  for (const auto& model : scene.models) {
+    if (!model->mesh()->ready()) return 1;
+  }
+
+  Camera camera;
+  std::vector<CameraPose> poses;
+  if (ReadCameraPoses(args[1], camera.fovy(), &poses) != 0) return 1;
+  camera.set_aspect(static_cast<float>(width) / height);
+  camera.set_near(near);
+  camera.set_far(far);
+
+  Framebuffer framebuffer;
+  FrameUniforms frame_uniforms;
+  RenderQueue render_queue;
+  if (framebuffer.Init(width, height) != 0 || frame_uniforms.Init() != 0) {
+    return 1;
+  }
+  glEnable(GL_DEPTH_TEST);
+  mkdir(output_dir.c_str(), 0755);
+  ImageWriter writer(output_dir, width, height, near, far);
+  writer.Start(num_threads);
+  const auto render_start = std::chrono::steady_clock::now();
+  LOG(INFO) << "Scene ready in "
+            << std::chrono::duration<float, std::milli>(render_start - start)
+                   .count()
+            << " ms";
+
+  // Frame i is read back after frame i + 1 was queued, so the GPU never
+  // waits for the copy.
+  std::vector<uint8_t> color;
+  std::vector<float> depth;
+  size_t read = 0;
+  for (size_t i = 0; i < poses.size(); ++i) {
+    camera.set_position(poses[i].position);
+    camera.set_rotation(poses[i].rotation);
+    camera.set_fovy(poses[i].fovy);
+    Render(scene, camera, framebuffer, &frame_uniforms, &render_queue);
+    if (framebuffer.StartRead() != 0) return 1;
+    if (i + 1 - read < Framebuffer::kReadSlots) continue;
+    if (framebuffer.FinishRead(&color, &depth) != 0) return 1;
+    writer.Write(read++, &color, &depth);
+  }
+  while (read < poses.size()) {
+    if (framebuffer.FinishRead(&color, &depth) != 0) return 1;
+    writer.Write(read++, &color, &depth);
+  }
+  const float render_ms = std::chrono::duration<float, std::milli>(
+                              std::chrono::steady_clock::now() - render_start)
+                              .count();
+  const size_t failed = writer.Finish();
+  const float total_ms = std::chrono::duration<float, std::milli>(
+                             std::chrono::steady_clock::now() - render_start)
+                             .count();
+  printf("%zu frames of %dx%d: %.1f ms rendering (%.1f fps), %.1f ms with "
+         "writes\n",
+         poses.size(), width, height, render_ms,
+         render_ms > 0.0f ? poses.size() * 1000.0f / render_ms : 0.0f,
+         total_ms);
+  return failed == 0 ? 0 : 1;
+}
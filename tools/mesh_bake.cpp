@@ -0,0 +1,121 @@
+// Pre-bakes the binary mesh cache for every .obj file in a directory, so
+// MeshManager can map the meshes directly on the next start.
+//
+// usage: glkit_mesh_bake <obj_dir> [cache_dir] [--threads N] [--no-optimize]
+//                        [--no-lods] [--force]
+// Without cache_dir the caches are written next to the OBJ files, which is
+// where MeshManager looks by default. Optimization and LODs are part of the
+// cache key and on by default, as in the viewer; caches baked without them
+// only match loads that turn them off too.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "glkit/gl_mesh_cache.hpp"
+
+namespace {
+
+bool EndsWith(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int ListObjFiles(const std::string& dir, std::vector<std::string>* files) {
+#ifdef _WIN32
+  WIN32_FIND_DATAA entry;
+  HANDLE find = FindFirstFileA((dir + "\\*.obj").c_str(), &entry);
+  if (find == INVALID_HANDLE_VALUE) return -1;
+  do {
+    files->push_back(dir + "/" + entry.cFileName);
+  } while (FindNextFileA(find, &entry));
+  FindClose(find);
+#else
+  DIR* d = opendir(dir.c_str());
+  if (d == nullptr) return -1;
+  while (struct dirent* entry = readdir(d)) {
+    std::string name = entry->d_name;
+    if (EndsWith(name, ".obj")) files->push_back(dir + "/" + name);
+  }
+  closedir(d);
+#endif
+  std::sort(files->begin(), files->end());
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string obj_dir;
+  std::string cache_dir;
+  glkit::MeshLoadOptions options;
+  options.num_threads = 0;
+  options.optimize = true;
+  options.generate_lods = true;
+  bool force = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      options.num_threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--no-optimize") == 0) {
+      options.optimize = false;
+    } else if (strcmp(argv[i], "--no-lods") == 0) {
+      options.generate_lods = false;
+    } else if (strcmp(argv[i], "--force") == 0) {
+      force = true;
+    } else if (obj_dir.empty()) {
+      obj_dir = argv[i];
+    } else {
+      cache_dir = argv[i];
+    }
+  }
+  if (obj_dir.empty()) {
+    fprintf(stderr,
+            "usage: %s <obj_dir> [cache_dir] [--threads N] [--no-optimize] "
+            "[--no-lods] [--force]\n",
+            argv[0]);
+    return 1;
+  }
+
+  std::vector<std::string> files;
+  if (ListObjFiles(obj_dir, &files) != 0) {
+    fprintf(stderr, "Failed to list %s\n", obj_dir.c_str());
+    return 1;
+  }
+
+  int failed = 0;
+  for (const auto& file : files) {
+    const std::string cache_path = glkit::MeshCache::CachePath(file, cache_dir);
+    glkit::MeshCacheView view;
+    if (!force && glkit::MeshCache::Open(cache_path, file, options, &view) == 0) {
+      printf("%-40s up to date\n", file.c_str());
+      continue;
+    }
+    view.file.Close();
+
+    auto start = std::chrono::steady_clock::now();
+    glkit::MeshData data;
+    if (glkit::Mesh::LoadObjFile(file, options, &data) != 0 ||
+        glkit::MeshCache::Write(cache_path, file, options, data) != 0) {
+      fprintf(stderr, "%-40s FAILED\n", file.c_str());
+      ++failed;
+      continue;
+    }
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    printf("%-40s %zu vertices %zu triangles %.1f ms -> %s\n", file.c_str(),
+           data.vertices.size(), data.indices.size() / 3, ms,
+           cache_path.c_str());
+  }
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+// Converts PLY or XYZ point files into the octree directory PointCloud
+// streams from. Memory use stays bounded by --memory-points whatever the
+// input size; larger cubes are split through temporary files in out_dir.
+//
+// usage: glkit_point_cloud_build <out_dir> <input.ply|input.xyz>...
+//                                [--max-node-points N] [--memory-points N]
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "glkit/gl_point_cloud_builder.hpp"
+
+namespace {
+
+int MakeDir(const std::string& dir) {
+#ifdef _WIN32
+  const int ret = _mkdir(dir.c_str());
+#else
+  const int ret = mkdir(dir.c_str(), 0755);
+#endif
+  return ret == 0 || errno == EEXIST ? 0 : -1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string out_dir;
+  std::vector<std::string> inputs;
+  glkit::PointCloudBuildOptions options;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--max-node-points") == 0 && i + 1 < argc) {
+      options.max_node_points = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--memory-points") == 0 && i + 1 < argc) {
+      options.memory_points = strtoull(argv[++i], nullptr, 10);
+    } else if (out_dir.empty()) {
+      out_dir = argv[i];
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+  if (inputs.empty() || options.max_node_points == 0) {
+    fprintf(stderr,
+            "usage: %s <out_dir> <input.ply|input.xyz>... "
+            "[--max-node-points N] [--memory-points N]\n",
+            argv[0]);
+    return 1;
+  }
+  if (MakeDir(out_dir) != 0) {
+    fprintf(stderr, "Failed to create %s\n", out_dir.c_str());
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  glkit::PointCloudBuilder builder(options);
+  glkit::PointCloudBuildStats stats;
+  if (builder.Build(inputs, out_dir, &stats) != 0) {
+    fprintf(stderr, "Failed to build %s\n", out_dir.c_str());
+    return 1;
+  }
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           start)
+                 .count();
+  printf("%llu points -> %zu nodes, %d levels, %zu file splits, %.1f s\n",
+         static_cast<unsigned long long>(stats.points_written), stats.nodes,
+         stats.levels, stats.file_splits, s);
+  if (stats.points_dropped > 0) {
+    printf("%llu duplicate points dropped\n",
+           static_cast<unsigned long long>(stats.points_dropped));
+  }
+  return 0;
+}